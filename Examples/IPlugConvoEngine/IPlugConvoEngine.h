@@ -9,14 +9,7 @@
   #define WDL_FFT_REALSIZE 8
 #endif
 
-#include "convoengine.h"
-
-#if defined USE_WDL_RESAMPLER
-  #include "resample.h"
-#elif defined USE_R8BRAIN
-  #include "CDSPResampler.h"
-  using namespace r8b;
-#endif
+#include "AsyncConvolution.h"
 
 const int kNumPresets = 1;
 
@@ -37,29 +30,11 @@ public:
 #if IPLUG_DSP // http://bit.ly/2S64BDd
   void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override;
   void OnReset() override;
+  void OnIdle() override;
 private:
-  // Returns destination length
-  inline int ResampleLength(int srcLength, double srcRate, double destRate) const
-  {
-    return int(destRate / srcRate * (double)srcLength + 0.5);
-  }
-
-  template <class I, class O> void Resample(const I* pSrc, int srcLength, double srcRate, O* pDst, int dstLength, double dstRate);
-  
   static const float mIR[512];
 
-  WDL_ImpulseBuffer mImpulse;
-//  WDL_ConvolutionEngine_Div mEngine; // < low latency version
-  WDL_ConvolutionEngine mEngine;
-  
-  static constexpr int mBlockLength = 64;
-
-  #if defined USE_WDL_RESAMPLER
-  WDL_Resampler mResampler;
-  #elif defined USE_R8BRAIN
-  std::unique_ptr<CDSPResampler16IR> mResampler;
-  #endif
-
-  double mSampleRate = 0.0;
+  // the IR is resampled and transformed on a background thread, so neither loading it nor a sample rate change blocks OnReset()
+  AsyncConvolutionEngine<> mEngine; // < zero latency WDL_ConvolutionEngine_Div
 #endif
 };
@@ -1295,6 +1295,7 @@ void IVGroupControl::SetBoundsBasedOnGroup(const char* groupName, float padL, fl
   float halfLabelHeight = mLabelBounds.H()/2.f;
   unionRect.GetVPadded(halfLabelHeight);
   mRECT = unionRect.GetPadded(padL, padT, padR, padB);
+  GetUI()->InvalidateControlIndex();
   
   OnResize();
 }
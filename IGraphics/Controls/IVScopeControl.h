@@ -96,6 +96,155 @@ private:
   int mBufferSize = MAXBUF;
 };
 
+/** Vectorial multi-channel capable envelope oscilloscope control, to display the min/max (and optionally RMS) envelopes
+ * sent by an IEnvelopeSender. Each channel is drawn in its own lane as a filled polygon. Call IEnvelopeSender::SetNumPoints()
+ * with the width of the control in pixels, so that only the points it needs are sent. If more arrive they are combined
+ * in pairs down to a point per pixel, so long time windows are as cheap to draw as short ones.
+ * The RMS envelope is drawn with the kX1 color, the sweep position with kHL
+ * @ingroup IControls */
+template <int MAXNC = 1, int MAXPOINTS = 512>
+class IVEnvelopeScopeControl : public IControl
+                             , public IVectorBase
+{
+public:
+  using Points = IEnvelopePoints<MAXPOINTS>;
+
+  /** Constructs an IVEnvelopeScopeControl
+   * @param bounds The rectangular area that the control occupies
+   * @param label A CString to label the control
+   * @param style, /see IVStyle
+   * @param drawRMS Whether to draw the RMS envelope. It is only drawn if the sender calculates it */
+  IVEnvelopeScopeControl(const IRECT& bounds, const char* label = "", const IVStyle& style = DEFAULT_STYLE, bool drawRMS = false)
+  : IControl(bounds)
+  , IVectorBase(style)
+  , mDrawRMS(drawRMS)
+  {
+    AttachIControl(this, label);
+    mBuf.nChans = 0;
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    DrawBackground(g, mRECT);
+    DrawWidget(g);
+    DrawLabel(g);
+
+    if (mStyle.drawFrame)
+      g.DrawRect(GetColor(kFR), mWidgetBounds, &mBlend, mStyle.frameThickness);
+  }
+
+  void DrawWidget(IGraphics& g) override
+  {
+    const IRECT r = mWidgetBounds.GetPadded(-mPadding);
+    const int nChans = std::max(mBuf.nChans, 1);
+
+    for (int i = 0; i < mBuf.nChans; i++)
+    {
+      const IRECT lane = r.SubRectVertical(nChans, i);
+      const Points& p = mBuf.vals[mBuf.chanOffset + i];
+
+      g.DrawHorizontalLine(GetColor(kSH), lane, 0.5, &mBlend, mStyle.frameThickness);
+
+      if (p.nPoints <= 0)
+        continue;
+
+      // one point per pixel is enough, don't go beyond the resolution of the screen
+      const int nPixels = std::max(static_cast<int>(std::ceil(lane.W() * g.GetDrawScale() * g.GetScreenScale())), 1);
+      const float* pMax = p.max.data();
+      const float* pMin = p.min.data();
+      const float* pRMS = p.rms.data();
+      const bool drawRMS = mDrawRMS && p.hasRMS;
+      int nPoints = p.nPoints;
+
+      if (nPoints / 2 >= nPixels)
+      {
+        std::copy_n(p.max.begin(), nPoints, mMax.begin());
+        std::copy_n(p.min.begin(), nPoints, mMin.begin());
+        if (drawRMS)
+          std::copy_n(p.rms.begin(), nPoints, mRMS.begin());
+
+        for (; nPoints / 2 >= nPixels; nPoints /= 2)
+        {
+          for (int j = 0; j < nPoints / 2; j++)
+          {
+            mMax[j] = std::max(mMax[2 * j], mMax[2 * j + 1]);
+            mMin[j] = std::min(mMin[2 * j], mMin[2 * j + 1]);
+            if (drawRMS)
+              mRMS[j] = std::sqrt((mRMS[2 * j] * mRMS[2 * j] + mRMS[2 * j + 1] * mRMS[2 * j + 1]) * 0.5f);
+          }
+        }
+
+        pMax = mMax.data();
+        pMin = mMin.data();
+        pRMS = mRMS.data();
+      }
+
+      DrawEnvelope(g, lane, pMax, pMin, nPoints, GetColor(kFG), false);
+
+      if (drawRMS)
+        DrawEnvelope(g, lane, pRMS, pRMS, nPoints, GetColor(kX1), true);
+
+      const float sweepX = lane.L + lane.W() * static_cast<float>(p.sweepPos) / MAXPOINTS;
+      g.DrawVerticalLine(GetColor(kHL), sweepX, lane.T, lane.B, &mBlend);
+    }
+  }
+
+  void OnResize() override
+  {
+    SetTargetRECT(MakeRects(mRECT));
+    SetDirty(false);
+  }
+
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    if (!IsDisabled() && msgTag == ISender<>::kUpdateMessage)
+    {
+      IByteStream stream(pData, dataSize);
+
+      int pos = 0;
+      pos = stream.Get(&mBuf, pos);
+
+      SetDirty(false);
+    }
+  }
+
+private:
+  /** Fills the area between an upper and a lower curve of sample values. With symmetric, the lower curve is the negated upper one */
+  void DrawEnvelope(IGraphics& g, const IRECT& lane, const float* pUpper, const float* pLower, int nPoints, const IColor& color, bool symmetric)
+  {
+    const float halfHeight = lane.H() * 0.5f;
+    const float mid = lane.MH();
+    const float dx = lane.W() / nPoints;
+    auto y = [&](float v) { return mid - Clip(v, -1.f, 1.f) * halfHeight; };
+
+    g.PathClear();
+    g.PathMoveTo(lane.L, y(pUpper[0]));
+
+    for (int i = 0; i < nPoints; i++)
+    {
+      g.PathLineTo(lane.L + i * dx, y(pUpper[i]));
+      g.PathLineTo(lane.L + (i + 1) * dx, y(pUpper[i]));
+    }
+
+    for (int i = nPoints - 1; i >= 0; i--)
+    {
+      const float lower = symmetric ? -pLower[i] : pLower[i];
+      g.PathLineTo(lane.L + (i + 1) * dx, y(lower));
+      g.PathLineTo(lane.L + i * dx, y(lower));
+    }
+
+    g.PathClose();
+    g.PathFill(color, IFillOptions(), &mBlend);
+  }
+
+  ISenderData<MAXNC, Points> mBuf;
+  std::array<float, MAXPOINTS> mMax;
+  std::array<float, MAXPOINTS> mMin;
+  std::array<float, MAXPOINTS> mRMS;
+  float mPadding = 2.f;
+  bool mDrawRMS = false;
+};
+
 END_IGRAPHICS_NAMESPACE
 END_IPLUG_NAMESPACE
 
@@ -28,6 +28,7 @@ public:
    : IControl(bounds)
   {
     SetWantsMultiTouch(true);
+    SetWantsDirtyPolling(true);
   }
   
   void Draw(IGraphics& g) override
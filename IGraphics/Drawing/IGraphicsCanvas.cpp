@@ -268,23 +268,34 @@ void IGraphicsCanvas::SetCanvasBlendMode(val& context, const IBlend* pBlend)
   }
 }
 
-void IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const
+const IGraphicsCanvas::TextLayout& IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const
 {
-  StaticStorage<Font>::Accessor storage(sFontCache);
-  Font* pFont = storage.Find(text.mFont);
-    
-  assert(pFont && "No font found - did you forget to load it?");
-  
-  FontDescriptor descriptor = &pFont->mDescriptor;
-  val context = GetContext();
-  std::string fontString = GetFontString(descriptor->first.Get(), descriptor->second.Get(), text.mSize * pFont->mEMRatio);
+  // measureText() is a call into JavaScript, so keep the results for strings that are drawn again
+  const TextLayout* pLayout = mTextLayoutCache.Find(str, text);
   
-  context.set("font", fontString);
+  if (!pLayout)
+  {
+    Font* pFont = sFontCache.Find(text.mFont);
+    
+    assert(pFont && "No font found - did you forget to load it?");
+    
+    FontDescriptor descriptor = &pFont->mDescriptor;
+    val context = GetContext();
+    TextLayout layout;
+    layout.mFontString = GetFontString(descriptor->first.Get(), descriptor->second.Get(), text.mSize * pFont->mEMRatio);
+    
+    context.set("font", layout.mFontString);
+    
+    layout.mWidth = context.call<val>("measureText", std::string(str))["width"].as<double>();
+    layout.mAscender = pFont->mAscenderRatio * text.mSize;
+    layout.mDescender = -(1.0 - pFont->mAscenderRatio) * text.mSize;
+    pLayout = &mTextLayoutCache.Add(str, text, 1.f, 0.f, 0.f, std::move(layout));
+  }
   
-  const double textWidth = context.call<val>("measureText", std::string(str))["width"].as<double>();
+  const double textWidth = pLayout->mWidth;
   const double textHeight = text.mSize;
-  const double ascender = pFont->mAscenderRatio * textHeight;
-  const double descender = -(1.0 - pFont->mAscenderRatio) * textHeight;
+  const double ascender = pLayout->mAscender;
+  const double descender = pLayout->mDescender;
   
   switch (text.mAlign)
   {
@@ -301,6 +312,8 @@ void IGraphicsCanvas::PrepareAndMeasureText(const IText& text, const char* str,
   }
   
   r = IRECT((float) x, (float) (y - ascender), (float) (x + textWidth), (float) (y + textHeight - ascender));
+  
+  return *pLayout;
 }
 
 float IGraphicsCanvas::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
@@ -318,9 +331,10 @@ void IGraphicsCanvas::DoDrawText(const IText& text, const char* str, const IRECT
   val context = GetContext();
   double x, y;
   
-  PrepareAndMeasureText(text, str, measured, x, y);
+  const TextLayout& layout = PrepareAndMeasureText(text, str, measured, x, y);
   PathTransformSave();
   DoTextRotation(text, bounds, measured);
+  context.set("font", layout.mFontString);
   context.set("textBaseline", std::string("alphabetic"));
   SetCanvasSourcePattern(context, text.mFGColor, pBlend);
   context.call<void>("fillText", std::string(str), x, y);
@@ -510,6 +524,10 @@ bool IGraphicsCanvas::AssetsLoaded()
     }
   }
   
+  // text measured with a fallback font while the fonts were loading is measured again
+  if (!mLoadingFonts.empty())
+    mTextLayoutCache.Clear();
+  
   mLoadingFonts.clear();
     
   return true;
@@ -77,7 +77,16 @@ protected:
   void DoDrawText(const IText& text, const char* str, const IRECT& bounds, const IBlend* pBlend) override;
     
 private:
-  void PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const;
+  /** The CSS font and measurements of a string */
+  struct TextLayout
+  {
+    std::string mFontString;
+    double mWidth = 0.0;
+    double mAscender = 0.0;
+    double mDescender = 0.0;
+  };
+  
+  const TextLayout& PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y) const;
     
   val GetContext() const
   {
@@ -100,6 +109,7 @@ private:
   void SetCanvasBlendMode(val& context, const IBlend* pBlend);
     
   std::vector<val> mLoadingFonts;
+  mutable ITextLayoutCache<TextLayout> mTextLayoutCache {DEFAULT_TEXT_LAYOUT_CACHE_SIZE};
 
   static StaticStorage<Font> sFontCache;
 };
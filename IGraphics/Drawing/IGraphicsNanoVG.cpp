@@ -67,6 +67,8 @@
 #include <string>
 #include <map>
 
+#include "stb_image.h"
+
 using namespace iplug;
 using namespace igraphics;
 
@@ -144,6 +146,18 @@ static StaticStorage<IFontData> sFontCache;
 
 extern std::map<std::string, MTLTexturePtr> gTextureMap;
 
+// stb_image's load flags are globals, which decoding reads on worker threads, so they are set once, the way nvgCreateImage() would set them
+static void InitSTBImageFlags()
+{
+  static const bool sInitialized = []() {
+    stbi_set_unpremultiply_on_load(1);
+    stbi_convert_iphone_png_to_rgb(1);
+    return true;
+  }();
+  
+  (void) sInitialized;
+}
+
 // Retrieving pixels
 static void nvgReadPixels(NVGcontext* pContext, int image, int x, int y, int width, int height, void* pData)
 {
@@ -231,6 +245,7 @@ IGraphicsNanoVG::IGraphicsNanoVG(IGEditorDelegate& dlg, int w, int h, int fps, f
 : IGraphics(dlg, w, h, fps, scale)
 {
   DBGMSG("IGraphics NanoVG @ %i FPS\n", fps);
+  InitSTBImageFlags();
   StaticStorage<IFontData>::Accessor storage(sFontCache);
   storage.Retain();
 }
@@ -298,7 +313,10 @@ IBitmap IGraphicsNanoVG::LoadBitmap(const char* name, int nStates, bool framesAr
       return IBitmap(); // return invalid IBitmap
     }
 
-    pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
+    pAPIBitmap = TakePreloadedBitmap(name, targetScale);
+    
+    if (!pAPIBitmap)
+      pAPIBitmap = LoadAPIBitmap(fullPathOrResourceID.Get(), sourceScale, resourceFound, ext);
     
     storage.Add(pAPIBitmap, name, sourceScale);
 
@@ -340,9 +358,17 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* fileNameOrResID, int scale
 #endif
   if (location == EResourceLocation::kAbsolutePath)
   {
-    ActivateGLContext(); // no-op on non WIN/GL
-    idx = nvgCreateImage(mVG, fileNameOrResID, nvgImageFlags);
-    DeactivateGLContext(); // no-op on non WIN/GL
+    // Not nvgCreateImage(), which would write stb_image's flags while PreloadBitmaps() tasks may be reading them
+    int w = 0, h = 0, n = 0;
+    stbi_uc* pDecoded = stbi_load(fileNameOrResID, &w, &h, &n, 4);
+    
+    if (pDecoded)
+    {
+      ActivateGLContext(); // no-op on non WIN/GL
+      idx = nvgCreateImageRGBA(mVG, w, h, nvgImageFlags, pDecoded);
+      DeactivateGLContext(); // no-op on non WIN/GL
+      stbi_image_free(pDecoded);
+    }
   }
 
   return new Bitmap(mVG, fileNameOrResID, scale, idx, location == EResourceLocation::kPreloadedTexture);
@@ -370,6 +396,34 @@ APIBitmap* IGraphicsNanoVG::LoadAPIBitmap(const char* name, const void* pData, i
   return pBitmap;
 }
 
+static bool DecodeBitmap(const void* pData, int dataSize, RawBitmapData& pixels, int& width, int& height)
+{
+  int nComponents = 0;
+  stbi_uc* pDecoded = stbi_load_from_memory(static_cast<const stbi_uc*>(pData), dataSize, &width, &height, &nComponents, 4);
+  
+  if (!pDecoded)
+    return false;
+  
+  pixels.Resize(width * height * 4);
+  memcpy(pixels.Get(), pDecoded, pixels.GetSize());
+  stbi_image_free(pDecoded);
+  return true;
+}
+
+PreloadedBitmap::DecodeFunc IGraphicsNanoVG::GetAPIBitmapDecoder() const
+{
+  return DecodeBitmap;
+}
+
+APIBitmap* IGraphicsNanoVG::LoadAPIBitmapFromPixels(const char* name, const RawBitmapData& pixels, int width, int height, int scale)
+{
+  ActivateGLContext(); // no-op on non WIN/GL
+  const int idx = nvgCreateImageRGBA(mVG, width, height, NVG_IMAGE_PREMULTIPLIED, pixels.Get());
+  DeactivateGLContext(); // no-op on non WIN/GL
+  
+  return idx ? new Bitmap(mVG, name, scale, idx, false) : nullptr;
+}
+
 APIBitmap* IGraphicsNanoVG::CreateAPIBitmap(int width, int height, float scale, double drawScale, bool cacheable)
 {
   if (mInDraw)
@@ -463,6 +517,8 @@ void IGraphicsNanoVG::OnViewDestroyed()
 {
   // need to remove all the controls to free framebuffers, before deleting context
   RemoveAllControls();
+  ClearSVGRasterCache();
+  mTextLayoutCache.Clear();
 
   StaticStorage<APIBitmap>::Accessor storage(mBitmapCache);
   storage.Clear();
@@ -644,9 +700,21 @@ void IGraphicsNanoVG::PrepareAndMeasureText(const IText& text, const char* str,
   }
   
   nvgTextAlign(mVG, align);
+  
+  // NanoVG snaps glyphs to whole device pixels, so the bounds depend on the position and the font scale of the transform as well
+  float xform[6];
+  nvgCurrentTransform(mVG, xform);
+  const float scale = GetScreenScale() * (std::sqrt(xform[0] * xform[0] + xform[1] * xform[1]) + std::sqrt(xform[2] * xform[2] + xform[3] * xform[3])) * 0.5f;
+  
+  if (const IRECT* pCached = mTextLayoutCache.Find(str, text, scale, (float) x, (float) y))
+  {
+    r = *pCached;
+    return;
+  }
+  
   nvgTextBounds(mVG, x, y, str, NULL, fbounds);
   
-  r = IRECT(fbounds[0], fbounds[1], fbounds[2], fbounds[3]);
+  r = mTextLayoutCache.Add(str, text, scale, (float) x, (float) y, IRECT(fbounds[0], fbounds[1], fbounds[2], fbounds[3]));
 }
 
 float IGraphicsNanoVG::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
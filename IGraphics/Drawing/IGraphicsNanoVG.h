@@ -129,6 +129,9 @@ protected:
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
   APIBitmap* LoadAPIBitmap(const char* name, const void* pData, int dataSize, int scale) override;
   APIBitmap* CreateAPIBitmap(int width, int height, float scale, double drawScale, bool cacheable = false) override;
+  PreloadedBitmap::DecodeFunc GetAPIBitmapDecoder() const override;
+  APIBitmap* LoadAPIBitmapFromPixels(const char* name, const RawBitmapData& pixels, int width, int height, int scale) override;
+  APIBitmap* FindCachedBitmap(const char* name, int scale) override { return mBitmapCache.Find(name, scale); }
 
   bool LoadAPIFont(const char* fontID, const PlatformFontPtr& font) override;
 
@@ -160,6 +163,7 @@ private:
   WDL_Mutex mFBOMutex;
   std::stack<NVGframebuffer*> mFBOStack; // A stack of FBOs that requires freeing at the end of the frame
   StaticStorage<APIBitmap> mBitmapCache; //not actually static (doesn't require retaining or releasing)
+  mutable ITextLayoutCache<IRECT> mTextLayoutCache {DEFAULT_TEXT_LAYOUT_CACHE_SIZE}; // measured bounds
   NVGcontext* mVG = nullptr;
   NVGframebuffer* mMainFrameBuffer = nullptr;
   int mInitialFBO = 0;
@@ -111,6 +111,7 @@ IGraphicsSkia::Bitmap::Bitmap(sk_sp<SkImage> image, double sourceScale)
   mDrawable.mImage = image;
 #endif
 
+  mDrawable.mIsSurface = false;
   SetBitmap(&mDrawable, mDrawable.mImage->width(), mDrawable.mImage->height(), sourceScale, 1.f);
 }
 
@@ -323,6 +324,34 @@ APIBitmap* IGraphicsSkia::LoadAPIBitmap(const char* name, const void* pData, int
   return new Bitmap(pData, dataSize, scale);
 }
 
+static bool DecodeBitmap(const void* pData, int dataSize, RawBitmapData& pixels, int& width, int& height)
+{
+  sk_sp<SkImage> image = SkImage::MakeFromEncoded(SkData::MakeWithoutCopy(pData, dataSize));
+  
+  if (!image)
+    return false;
+  
+  width = image->width();
+  height = image->height();
+  pixels.Resize(width * height * 4);
+  
+  const SkImageInfo info = SkImageInfo::Make(width, height, kRGBA_8888_SkColorType, kUnpremul_SkAlphaType);
+  return image->readPixels(info, pixels.Get(), width * 4, 0, 0);
+}
+
+PreloadedBitmap::DecodeFunc IGraphicsSkia::GetAPIBitmapDecoder() const
+{
+  return DecodeBitmap;
+}
+
+APIBitmap* IGraphicsSkia::LoadAPIBitmapFromPixels(const char* name, const RawBitmapData& pixels, int width, int height, int scale)
+{
+  const SkImageInfo info = SkImageInfo::Make(width, height, kRGBA_8888_SkColorType, kPremul_SkAlphaType);
+  sk_sp<SkImage> image = SkImage::MakeRasterCopy(SkPixmap(info, pixels.Get(), width * 4));
+  
+  return image ? new Bitmap(image, scale) : nullptr;
+}
+
 void IGraphicsSkia::OnViewInitialized(void* pContext)
 {
 #if defined IGRAPHICS_GL
@@ -347,6 +376,8 @@ void IGraphicsSkia::OnViewInitialized(void* pContext)
 void IGraphicsSkia::OnViewDestroyed()
 {
   RemoveAllControls();
+  ClearSVGRasterCache();
+  mTextLayoutCache.Clear();
 
 #if defined IGRAPHICS_GL
   mSurface = nullptr;
@@ -589,30 +620,43 @@ bool IGraphicsSkia::LoadAPIFont(const char* fontID, const PlatformFontPtr& font)
   return false;
 }
 
-void IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const
+IGraphicsSkia::TextLayout& IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const
 {
-  SkFontMetrics metrics;
-  SkPaint paint;
-  //SkRect bounds;
-  
-  StaticStorage<Font>::Accessor storage(sFontCache);
-  Font* pFont = storage.Find(text.mFont);
+  // Skia measures in unscaled units, so the layout doesn't depend on the scale or the position
+  TextLayout* pLayout = mTextLayoutCache.Find(str, text);
+  const bool measure = !pLayout;
   
-  assert(pFont && "No font found - did you forget to load it?");
+  if (!pLayout)
+  {
+    Font* pFont = sFontCache.Find(text.mFont);
+    
+    assert(pFont && "No font found - did you forget to load it?");
+    
+    TextLayout layout;
+    layout.mTypeface = pFont->mTypeface;
+    layout.mSize = text.mSize * pFont->mData->GetHeightEMRatio();
+    pLayout = &mTextLayoutCache.Add(str, text, 1.f, 0.f, 0.f, std::move(layout));
+  }
 
-  font.setTypeface(pFont->mTypeface);
+  font.setTypeface(pLayout->mTypeface);
   font.setHinting(SkFontHinting::kSlight);
   font.setForceAutoHinting(false);
   font.setSubpixel(true);
-  font.setSize(text.mSize * pFont->mData->GetHeightEMRatio());
+  font.setSize(pLayout->mSize);
   
-  // Draw / measure
-  const double textWidth = font.measureText(str, strlen(str), SkTextEncoding::kUTF8, nullptr/* &bounds*/);
-  font.getMetrics(&metrics);
+  if (measure)
+  {
+    SkFontMetrics metrics;
+    pLayout->mWidth = font.measureText(str, strlen(str), SkTextEncoding::kUTF8, nullptr);
+    font.getMetrics(&metrics);
+    pLayout->mAscender = metrics.fAscent;
+    pLayout->mDescender = metrics.fDescent;
+  }
   
+  const double textWidth = pLayout->mWidth;
   const double textHeight = text.mSize;
-  const double ascender = metrics.fAscent;
-  const double descender = metrics.fDescent;
+  const double ascender = pLayout->mAscender;
+  const double descender = pLayout->mDescender;
   
   switch (text.mAlign)
   {
@@ -629,6 +673,8 @@ void IGraphicsSkia::PrepareAndMeasureText(const IText& text, const char* str, IR
   }
   
   r = IRECT((float) x, (float) y + ascender, (float) (x + textWidth), (float) (y + ascender + textHeight));
+  
+  return *pLayout;
 }
 
 float IGraphicsSkia::DoMeasureText(const IText& text, const char* str, IRECT& bounds) const
@@ -652,12 +698,18 @@ void IGraphicsSkia::DoDrawText(const IText& text, const char* str, const IRECT&
 
   double x, y;
 
-  PrepareAndMeasureText(text, str, measured, x, y, font);
+  TextLayout& layout = PrepareAndMeasureText(text, str, measured, x, y, font);
   PathTransformSave();
   DoTextRotation(text, bounds, measured);
   SkPaint paint;
   paint.setColor(SkiaColor(text.mFGColor, pBlend));
-  mCanvas->drawSimpleText(str, strlen(str), SkTextEncoding::kUTF8, x, y, font, paint);
+  
+  if (!layout.mBlob)
+    layout.mBlob = SkTextBlob::MakeFromText(str, strlen(str), font, SkTextEncoding::kUTF8);
+  
+  if (layout.mBlob)
+    mCanvas->drawTextBlob(layout.mBlob, x, y, paint);
+  
   PathTransformRestore();
 }
 
@@ -18,6 +18,7 @@
 #include "SkPath.h"
 #include "SkCanvas.h"
 #include "SkImage.h"
+#include "SkTextBlob.h"
 #include "GrDirectContext.h"
 #pragma warning( pop )
 
@@ -132,8 +133,21 @@ protected:
 
   APIBitmap* LoadAPIBitmap(const char* fileNameOrResID, int scale, EResourceLocation location, const char* ext) override;
   APIBitmap* LoadAPIBitmap(const char* name, const void* pData, int dataSize, int scale) override;
+  PreloadedBitmap::DecodeFunc GetAPIBitmapDecoder() const override;
+  APIBitmap* LoadAPIBitmapFromPixels(const char* name, const RawBitmapData& pixels, int width, int height, int scale) override;
 private:  
-  void PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const;
+  /** The font and measurements of a string, and its glyph run once it has been drawn */
+  struct TextLayout
+  {
+    sk_sp<SkTypeface> mTypeface;
+    float mSize = 0.f;
+    double mWidth = 0.0;
+    double mAscender = 0.0;
+    double mDescender = 0.0;
+    sk_sp<SkTextBlob> mBlob;
+  };
+  
+  TextLayout& PrepareAndMeasureText(const IText& text, const char* str, IRECT& r, double& x, double & y, SkFont& font) const;
 
   void PathTransformSetMatrix(const IMatrix& m) override;
   void SetClipRegion(const IRECT& r) override;
@@ -146,6 +160,7 @@ private:
   SkMatrix mMatrix;
   SkMatrix mClipMatrix;
   SkMatrix mFinalMatrix;
+  mutable ITextLayoutCache<TextLayout> mTextLayoutCache {DEFAULT_TEXT_LAYOUT_CACHE_SIZE};
 
 #if defined OS_WIN && defined IGRAPHICS_CPU
   WDL_TypedBuf<uint8_t> mSurfaceMemory;
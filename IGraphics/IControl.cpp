@@ -11,6 +11,7 @@
 #include <cmath>
 #include <cstring>
 #include "dirscan.h"
+#include "fnv64.h"
 
 #include "IControl.h"
 #include "IPlugParameter.h"
@@ -204,6 +205,9 @@ void IControl::SetDirty(bool triggerAction, int valIdx)
   
   mDirty = true;
   
+  if (mGraphics)
+    mGraphics->AddDirtyControl(this);
+  
   if (triggerAction)
   {
     auto paramUpdate = [this](int v)
@@ -236,8 +240,31 @@ bool IControl::IsDirty()
   return mDirty;
 }
 
+void IControl::SetWantsDirtyPolling(bool poll)
+{
+  mWantsDirtyPolling = poll;
+  OnAnimationSet();
+}
+
+WDL_UINT64 IControl::GetDrawStateKey() const
+{
+  WDL_UINT64 key = WDL_FNV64_IV;
+  
+  for (auto v = 0; v < NVals(); v++)
+  {
+    const double value = GetValue(v);
+    key = WDL_FNV64(key, (const unsigned char*) &value, sizeof(value));
+  }
+  
+  const bool state[2] = { mMouseIsOver, mDisabled };
+  return WDL_FNV64(key, (const unsigned char*) state, sizeof(state));
+}
+
 void IControl::Hide(bool hide)
 {
+  if (hide != mHide)
+    InvalidateControlIndex();
+
   mHide = hide;
   SetDirty(false);
 }
@@ -78,7 +78,11 @@ public:
   void operator=(const IControl&) = delete;
   
   /** Destructor. Clean up any resources that your control owns. */
-  virtual ~IControl() {}
+  virtual ~IControl()
+  {
+    if (mGraphics)
+      mGraphics->RemoveFromControlLists(this);
+  }
 
   /** Implement this method to respond to a mouse down event on this control. 
    * @param x The X coordinate of the mouse event
@@ -317,7 +321,7 @@ public:
 
   /** Set the rectangular draw area for this control, within the graphics context
    * @param bounds The control's bounds */
-  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetRECT(const IRECT& bounds) { mRECT = bounds; mMouseIsOver = false; InvalidateControlIndex(); OnResize(); }
   
   /** Get the rectangular mouse tracking target area, within the graphics context for this control
    * @return The control's target bounds within the graphics context */
@@ -325,11 +329,11 @@ public:
 
   /** Set the rectangular mouse tracking target area, within the graphics context for this control
    * @param bounds The control's new target bounds within the graphics context */
-  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; }
+  void SetTargetRECT(const IRECT& bounds) { mTargetRECT = bounds; mMouseIsOver = false; InvalidateControlIndex(); }
   
   /** Set BOTH the draw rect and the target area, within the graphics context for this control
    * @param bounds The control's new draw and target bounds within the graphics context */
-  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; OnResize(); }
+  void SetTargetAndDrawRECTs(const IRECT& bounds) { mRECT = mTargetRECT = bounds; mMouseIsOver = false; InvalidateControlIndex(); OnResize(); }
 
   /** Set the position of the control, preserving the width and height. This may need to be overriden if you maintain custom positioning data in your control
    * @param x the new x coordinate of the top left corner of the control
@@ -394,6 +398,7 @@ public:
   void SetPromptShowsParamLabel(bool enable) { mPromptShowsParamLabel = enable; }
   
   /** Hit test the control. Override this method if you want the control to be hit only if a visible part of it is hit, or whatever.
+   * N.B. IGraphics only hit tests controls whose draw or target RECT contains the point.
    * @param x The X coordinate within the control to test 
    * @param y The y coordinate within the control to test
    * @return \c Return true if the control was hit. */
@@ -411,10 +416,36 @@ public:
   /* Called at each display refresh by the IGraphics draw loop, triggers the control's AnimationFunc if it is set */
   void Animate();
 
-  /** Called at each display refresh by the IGraphics draw loop, after IControl::Animate(), to determine if the control is marked as dirty. 
+  /** Called at each display refresh by the IGraphics draw loop, after IControl::Animate(), to determine if the control is marked as dirty.
+   * N.B. This is only called for controls that have been marked dirty with SetDirty(), are animating, or want dirty polling.
+   * If you override it to report changes that don't call SetDirty(), call SetWantsDirtyPolling(true)
    * @return \c true if the control is marked dirty. */
   virtual bool IsDirty();
 
+  /** Ask to have IsDirty() and Animate() called at every display refresh, even when the control isn't dirty or animating
+   * @param poll \c true to be polled */
+  void SetWantsDirtyPolling(bool poll);
+
+  /** @return \c true if the control wants IsDirty() called at every display refresh */
+  bool GetWantsDirtyPolling() const { return mWantsDirtyPolling; }
+
+  /** Retained drawing keeps what Draw() drew in a layer, which is redrawn instead of calling Draw() when the control is redrawn
+   * because an overlapping control changed. The layer is redrawn when the control is dirty or GetDrawStateKey() changes.
+   * Use it for controls that are expensive to draw and sit under or next to controls that change often.
+   * Each layer is an offscreen bitmap (an FBO with NanoVG) of about width * height * 4 * scale^2 bytes, where scale is the screen
+   * scale times the draw scale, kept until retained drawing is turned off or the control is removed. IGraphics::SetMaxRetainedLayers()
+   * limits how many controls get one, beyond that they draw directly
+   * @param retain \c true to use retained drawing */
+  void SetRetainedDrawing(bool retain) { mRetainedDrawing = retain; if (!retain) mRetainedLayer = nullptr; }
+
+  /** @return \c true if the control uses retained drawing */
+  bool GetRetainedDrawing() const { return mRetainedDrawing; }
+
+  /** Used by retained drawing to check that the state the control draws hasn't changed without it being marked dirty.
+   * The default combines the values, the mouse over state and the disabled state. Override it if Draw() depends on other state
+   * @return A key for the state that Draw() depends on */
+  virtual WDL_UINT64 GetDrawStateKey() const;
+
   /** Disable/enable default prompt for user input
    * @param disable Set true to disable prompt */
   void DisablePrompt(bool disable) { mDisablePrompt = disable; }
@@ -458,6 +489,11 @@ public:
   {
     mDelegate = &dlg;
     mGraphics = dlg.GetUI();
+    
+    if (mGraphics && mDirty)
+      mGraphics->AddDirtyControl(this);
+    
+    OnAnimationSet();
     OnInit();
     OnResize();
     OnRescale();
@@ -494,12 +530,12 @@ public:
   
   /** Set the animation function
    * @param func A std::function conforming to IAnimationFunction */
-  void SetAnimation(IAnimationFunction func) { mAnimationFunc = func;}
+  void SetAnimation(IAnimationFunction func) { mAnimationFunc = func; OnAnimationSet(); }
   
   /** Set the animation function and starts it
    * @param func A std::function conforming to IAnimationFunction
    * @param duration Duration in milliseconds for the animation */
-  void SetAnimation(IAnimationFunction func, int duration) { mAnimationFunc = func; StartAnimation(duration); }
+  void SetAnimation(IAnimationFunction func, int duration) { mAnimationFunc = func; OnAnimationSet(); StartAnimation(duration); }
 
   /** Get the control's animation function, if it exists */
   IAnimationFunction GetAnimationFunction() { return mAnimationFunc; }
@@ -583,6 +619,18 @@ protected:
 #endif
   
 private:
+  friend class IGraphics;
+
+  /** Add the control to the graphics context's list of animating controls, if it is animating or polled */
+  void OnAnimationSet()
+  {
+    if (mGraphics && (mAnimationFunc || mWantsDirtyPolling))
+      mGraphics->AddAnimatingControl(this);
+  }
+
+  /** Tell the graphics context that the control's bounds or visibility have changed */
+  void InvalidateControlIndex() { if (mGraphics) mGraphics->InvalidateControlIndex(); }
+
   IContainerBase* mParent = nullptr;
   IGEditorDelegate* mDelegate = nullptr;
   IGraphics* mGraphics = nullptr;
@@ -594,6 +642,13 @@ private:
   std::vector<ParamTuple> mVals { {kNoParameter, 0.} };
   std::unordered_map<EGestureType, IGestureFunc> mGestureFuncs;
   EGestureType mLastGesture = EGestureType::Unknown;
+  bool mWantsDirtyPolling = false;
+  bool mInDirtyList = false; // managed by IGraphics
+  bool mInAnimatingList = false; // managed by IGraphics
+  bool mRetainedDrawing = false;
+  bool mRetainedRecord = false; // record the layer at the next draw, rather than drawing directly
+  WDL_UINT64 mRetainedKey = 0;
+  ILayerPtr mRetainedLayer;
 };
 
 #pragma mark - Base Controls
@@ -14,6 +14,15 @@
 #pragma warning(disable:4244) // float conversion
 #include "nanosvg.h"
 
+#if defined IPLUG_SIMDE
+  #if defined(__arm64__)
+    #define SIMDE_ENABLE_NATIVE_ALIASES
+    #include "simde/x86/sse2.h"
+  #else
+    #include <emmintrin.h>
+  #endif
+#endif
+
 #if defined VST3_API
 #include "pluginterfaces/base/ustring.h"
 #include "IPlugVST3.h"
@@ -75,6 +84,16 @@ IGraphics::~IGraphics()
 void IGraphics::SetScreenScale(float scale)
 {
   mScreenScale = scale;
+  
+  // LoadBitmap() won't take bitmaps that were preloaded for another scale, so don't keep their pixels
+  for (auto it = mPreloadedBitmaps.begin(); it != mPreloadedBitmaps.end();)
+  {
+    if (it->second->mTargetScale != GetRoundedScreenScale())
+      it = mPreloadedBitmaps.erase(it);
+    else
+      ++it;
+  }
+  
   int windowWidth = WindowWidth() * GetPlatformWindowScale();
   int windowHeight = WindowHeight() * GetPlatformWindowScale();
   
@@ -110,6 +129,7 @@ void IGraphics::Resize(int w, int h, float scale, bool needsPlatformResize)
 
   bool parentResized = GetDelegate()->EditorResizeFromUI(windowWidth, windowHeight, needsPlatformResize);
   PlatformResize(parentResized);
+  InvalidateControlIndex();
   ForAllControls(&IControl::OnResize);
   SetAllControlsDirty();
   DrawResize();
@@ -133,6 +153,7 @@ void IGraphics::RemoveControlWithTag(int ctrlTag)
 {
   mControls.DeletePtr(GetControlWithTag(ctrlTag), true);
   mCtrlTags.erase(ctrlTag);
+  InvalidateControlIndex();
   SetAllControlsDirty();
 }
 
@@ -161,6 +182,7 @@ void IGraphics::RemoveControls(int fromIdx)
     mControls.Delete(idx--, true);
   }
   
+  InvalidateControlIndex();
   SetAllControlsDirty();
 }
 
@@ -188,6 +210,7 @@ void IGraphics::RemoveControl(IControl* pControl)
   
   mControls.DeletePtr(pControl, true);
   
+  InvalidateControlIndex();
   SetAllControlsDirty();
 }
 
@@ -208,7 +231,11 @@ void IGraphics::RemoveAllControls()
   mBubbleControls.Empty(true);
   
   mCtrlTags.clear();
+  mDirtyControls.clear();
+  mAnimatingControls.clear();
+  mShadowMasks.clear();
   mControls.Empty(true);
+  InvalidateControlIndex();
 }
 
 void IGraphics::SetControlPosition(IControl* pControl, float x, float y)
@@ -290,6 +317,7 @@ void IGraphics::AttachBackground(const char* fileName)
   IControl* pBG = new IBitmapControl(0, 0, LoadBitmap(fileName, 1, false), kNoParameter, EBlend::Default);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  InvalidateControlIndex();
 }
 
 void IGraphics::AttachSVGBackground(const char* fileName)
@@ -297,6 +325,7 @@ void IGraphics::AttachSVGBackground(const char* fileName)
   IControl* pBG = new ISVGControl(GetBounds(), LoadSVG(fileName), true);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  InvalidateControlIndex();
 }
 
 void IGraphics::AttachPanelBackground(const IPattern& color)
@@ -304,6 +333,7 @@ void IGraphics::AttachPanelBackground(const IPattern& color)
   IControl* pBG = new IPanelControl(GetBounds(), color);
   pBG->SetDelegate(*GetDelegate());
   mControls.Insert(0, pBG);
+  InvalidateControlIndex();
 }
 
 IControl* IGraphics::AttachControl(IControl* pControl, int ctrlTag, const char* group)
@@ -320,6 +350,7 @@ IControl* IGraphics::AttachControl(IControl* pControl, int ctrlTag, const char*
   pControl->SetDelegate(*GetDelegate());
   pControl->SetGroup(group);
   mControls.Add(pControl);
+  InvalidateControlIndex();
     
   pControl->OnAttached();
   return pControl;
@@ -548,7 +579,11 @@ void IGraphics::ForStandardControlsFunc(IControlFunction func)
 void IGraphics::ForAllControlsFunc(IControlFunction func)
 {
   ForStandardControlsFunc(func);
-  
+  ForSpecialControlsFunc(func);
+}
+
+void IGraphics::ForSpecialControlsFunc(IControlFunction func)
+{
   if (mPerfDisplay)
     func(mPerfDisplay.get());
   
@@ -594,7 +629,14 @@ void IGraphics::SetAllControlsDirty()
 
 void IGraphics::SetAllControlsClean()
 {
-  ForAllControls(&IControl::SetClean);
+  // N.B. Only controls in the dirty list can be dirty
+  for (auto pControl : mDirtyControls)
+  {
+    pControl->mInDirtyList = false;
+    pControl->SetClean();
+  }
+  
+  mDirtyControls.clear();
 }
 
 void IGraphics::AssignParamNameToolTips()
@@ -830,18 +872,71 @@ void IGraphics::PathRadialLine(float cx, float cy, float angle, float rMin, floa
   PathLine(data[0][0], data[0][1], data[1][0], data[1][1]);
 }
 
+void IGraphics::AddDirtyControl(IControl* pControl)
+{
+  if (!pControl->mInDirtyList)
+  {
+    pControl->mInDirtyList = true;
+    mDirtyControls.push_back(pControl);
+  }
+}
+
+void IGraphics::AddAnimatingControl(IControl* pControl)
+{
+  if (!pControl->mInAnimatingList)
+  {
+    pControl->mInAnimatingList = true;
+    mAnimatingControls.push_back(pControl);
+  }
+}
+
+void IGraphics::RemoveFromControlLists(IControl* pControl)
+{
+  if (pControl->mInDirtyList)
+    mDirtyControls.erase(std::remove(mDirtyControls.begin(), mDirtyControls.end(), pControl), mDirtyControls.end());
+  
+  if (pControl->mInAnimatingList)
+  {
+    // Erasing during the animate pass would shift the next control into the slot that has just been animated
+    if (mInAnimatePass)
+      std::replace(mAnimatingControls.begin(), mAnimatingControls.end(), pControl, static_cast<IControl*>(nullptr));
+    else
+      mAnimatingControls.erase(std::remove(mAnimatingControls.begin(), mAnimatingControls.end(), pControl), mAnimatingControls.end());
+  }
+  
+  mShadowMasks.erase(pControl);
+}
+
 bool IGraphics::IsDirty(IRECTList& rects)
 {
+  mTaskQueue.ProcessCompletions();
+
   if (mDisplayTickFunc)
     mDisplayTickFunc();
 
-  ForAllControlsFunc([](IControl* pControl) { pControl->Animate(); } );
+  // N.B. Animation functions can start or end animations, and remove controls, so the list can grow while it is iterated.
+  // Removed controls are only cleared from it, and erased once every animation function has run
+  mInAnimatePass = true;
+  
+  for (auto i = 0; i < (int) mAnimatingControls.size(); i++)
+  {
+    if (mAnimatingControls[i])
+      mAnimatingControls[i]->Animate();
+  }
+  
+  mInAnimatePass = false;
+  mAnimatingControls.erase(std::remove(mAnimatingControls.begin(), mAnimatingControls.end(), nullptr), mAnimatingControls.end());
 
   bool dirty = false;
     
   auto func = [&dirty, &rects](IControl* pControl) {
     if (pControl->IsDirty())
     {
+      if (pControl->mRetainedLayer)
+        pControl->mRetainedLayer->Invalidate();
+      
+      pControl->mRetainedRecord = false;
+      
       // N.B padding outlines for single line outlines
       auto rectToAdd = pControl->GetRECT().GetPadded(0.75);
       
@@ -852,10 +947,38 @@ bool IGraphics::IsDirty(IRECTList& rects)
       
       rects.Add(rectToAdd);
       dirty = true;
+      return true;
     }
+    
+    return false;
   };
+  
+  // Only controls that have been set dirty, or are animating, can be dirty. Controls that no longer are leave the lists
+  for (auto i = 0; i < (int) mDirtyControls.size(); i++)
+  {
+    IControl* pControl = mDirtyControls[i];
+
+    if (!func(pControl))
+    {
+      pControl->mInDirtyList = false;
+      mDirtyControls[i--] = mDirtyControls.back();
+      mDirtyControls.pop_back();
+    }
+  }
+  
+  for (auto i = 0; i < (int) mAnimatingControls.size(); i++)
+  {
+    IControl* pControl = mAnimatingControls[i];
+
+    if (!pControl->mInDirtyList)
+      func(pControl);
     
-  ForAllControlsFunc(func);
+    if (!pControl->GetAnimationFunction() && !pControl->GetWantsDirtyPolling())
+    {
+      pControl->mInAnimatingList = false;
+      mAnimatingControls.erase(mAnimatingControls.begin() + i--);
+    }
+  }
 
 #ifdef USE_IDLE_CALLS
   if (dirty)
@@ -910,7 +1033,12 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
     }
     
     PrepareRegion(clipBounds);
-    pControl->Draw(*this);
+    
+    if (pControl->GetRetainedDrawing() && !pControl->GetAnimationFunction())
+      DrawRetainedControl(pControl);
+    else
+      pControl->Draw(*this);
+    
 #ifdef AAX_API
     pControl->DrawPTHighlight(*this);
 #endif
@@ -927,9 +1055,80 @@ void IGraphics::DrawControl(IControl* pControl, const IRECT& bounds, float scale
   }
 }
 
+void IGraphics::UpdateControlIndex()
+{
+  if (mControlIndexValid)
+    return;
+  
+  mControlIndex.Reset(GetBounds(), NControls());
+  
+  for (auto c = 0; c < NControls(); c++)
+  {
+    IControl* pControl = GetControl(c);
+    
+    // N.B. DrawControl() draws the background even when it is hidden
+    if (!pControl->IsHidden() || c == 0)
+      mControlIndex.Add(c, pControl->GetRECT().Union(pControl->GetTargetRECT()));
+  }
+  
+  mControlIndex.Build();
+  mControlIndexValid = true;
+}
+
+void IGraphics::DrawRetainedControl(IControl* pControl)
+{
+  ILayerPtr& layer = pControl->mRetainedLayer;
+  const WDL_UINT64 key = pControl->GetDrawStateKey();
+
+  if (CheckLayer(layer) && key == pControl->mRetainedKey)
+  {
+    DrawLayer(layer);
+    return;
+  }
+  
+  // N.B. A control that has just changed is likely to change again, so it is drawn directly and only recorded the next time it is drawn
+  if (!pControl->mRetainedRecord || (!layer && mNumRetainedLayers >= mMaxRetainedLayers))
+  {
+    pControl->Draw(*this);
+    pControl->mRetainedRecord = true;
+    return;
+  }
+  
+  if (!layer)
+    mNumRetainedLayers++;
+  
+  StartLayer(pControl, pControl->GetRECT().GetPadded(0.75));
+  pControl->Draw(*this);
+  layer = EndLayer();
+  pControl->mRetainedKey = key;
+  DrawLayer(layer);
+}
+
+void IGraphics::SetMaxRetainedLayers(int maxLayers)
+{
+  mMaxRetainedLayers = std::max(maxLayers, 0);
+  mNumRetainedLayers = 0;
+  
+  ForAllControlsFunc([this](IControl* pControl) {
+    if (pControl->mRetainedLayer && ++mNumRetainedLayers > mMaxRetainedLayers)
+    {
+      pControl->mRetainedLayer = nullptr;
+      mNumRetainedLayers--;
+    }
+  });
+}
+
 void IGraphics::Draw(const IRECT& bounds, float scale)
 {
-  ForAllControlsFunc([this, bounds, scale](IControl* pControl) { DrawControl(pControl, bounds, scale); });
+  UpdateControlIndex();
+  
+  // N.B. Padding covers the padding and pixel alignment in DrawControl(), which does the exact test
+  mControlIndex.GetCandidates(bounds.GetPadded(0.75f + 1.f / scale), mControlsInRegion);
+  
+  for (auto i = 0; i < mControlsInRegion.GetSize(); i++)
+    DrawControl(GetControl(mControlsInRegion.Get()[i]), bounds, scale);
+  
+  ForSpecialControlsFunc([this, bounds, scale](IControl* pControl) { DrawControl(pControl, bounds, scale); });
 
 #ifndef NDEBUG
   if (mShowAreaDrawn)
@@ -949,6 +1148,9 @@ void IGraphics::Draw(IRECTList& rects)
     return;
   
   float scale = GetBackingPixelScale();
+  
+  mNumRetainedLayers = 0;
+  ForAllControlsFunc([this](IControl* pControl) { mNumRetainedLayers += pControl->mRetainedLayer != nullptr; });
     
   BeginFrame();
     
@@ -1294,32 +1496,45 @@ int IGraphics::GetMouseControlIdx(float x, float y, bool mouseOver)
 {
   if (!mouseOver || mEnableMouseOver)
   {
+    const int minIdx = mouseOver ? 1 : 0;
+    
+#ifndef NDEBUG
+    // Live edit can select hidden controls, which are not in the index
+    if (mLiveEdit)
+    {
+      for (auto c = NControls() - 1; c >= minIdx; --c)
+      {
+        IControl* pControl = GetControl(c);
+
+        if (pControl->GetRECT().Contains(x, y) && pControl->GetParent() == nullptr)
+          return c;
+      }
+      
+      return -1;
+    }
+#endif
+    
+    UpdateControlIndex();
+    
+    int nCandidates;
+    const int* pCandidates = mControlIndex.GetCandidates(x, y, nCandidates);
+    
     // Search from front to back
-    for (auto c = NControls() - 1; c >= (mouseOver ? 1 : 0); --c)
+    for (auto i = nCandidates - 1; i >= 0 && pCandidates[i] >= minIdx; --i)
     {
+      const int c = pCandidates[i];
       IControl* pControl = GetControl(c);
 
-#ifndef NDEBUG
-      if(!mLiveEdit)
+      if (!pControl->IsHidden() && !pControl->GetIgnoreMouse())
       {
-#endif
-        if (!pControl->IsHidden() && !pControl->GetIgnoreMouse())
+        if ((!pControl->IsDisabled() || (mouseOver ? pControl->GetMouseOverWhenDisabled() : pControl->GetMouseEventsWhenDisabled())))
         {
-          if ((!pControl->IsDisabled() || (mouseOver ? pControl->GetMouseOverWhenDisabled() : pControl->GetMouseEventsWhenDisabled())))
+          if (pControl->IsHit(x, y))
           {
-            if (pControl->IsHit(x, y))
-            {
-              return c;
-            }
+            return c;
           }
         }
-#ifndef NDEBUG
       }
-      else if (pControl->GetRECT().Contains(x, y) && pControl->GetParent() == nullptr)
-      {
-        return c;
-      }
-#endif
     }
   }
   
@@ -1565,6 +1780,10 @@ void IGraphics::EnableLiveEdit(bool enable)
 #ifdef SVG_USE_SKIA
 ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
 {
+  // SVGs that are already loaded are found without locking the cache
+  if (SVGHolder* pCached = sSVGCache.Find(fileName))
+    return ISVG(pCached->mSVGDom, pCached->mID);
+
   StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
   SVGHolder* pHolder = storage.Find(fileName);
   
@@ -1581,11 +1800,14 @@ ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
     }
   }
   
-  return ISVG(pHolder->mSVGDom);
+  return ISVG(pHolder->mSVGDom, pHolder->mID);
 }
 
 ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const char* units, float dpi)
 {
+  if (SVGHolder* pCached = sSVGCache.Find(name))
+    return ISVG(pCached->mSVGDom, pCached->mID);
+
   StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
   SVGHolder* pHolder = storage.Find(name);
 
@@ -1621,12 +1843,16 @@ ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const
     storage.Add(pHolder, name);
   }
 
-  return ISVG(pHolder->mSVGDom);
+  return ISVG(pHolder->mSVGDom, pHolder->mID);
 }
 
 #else
 ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
 {
+  // SVGs that are already loaded are found without locking the cache
+  if (SVGHolder* pCached = sSVGCache.Find(fileName))
+    return ISVG(pCached->mImage, pCached->mID);
+
   StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
   SVGHolder* pHolder = storage.Find(fileName);
 
@@ -1643,11 +1869,14 @@ ISVG IGraphics::LoadSVG(const char* fileName, const char* units, float dpi)
     }
   }
 
-  return ISVG(pHolder->mImage);
+  return ISVG(pHolder->mImage, pHolder->mID);
 }
 
 ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const char* units, float dpi)
 {
+  if (SVGHolder* pCached = sSVGCache.Find(name))
+    return ISVG(pCached->mImage, pCached->mID);
+
   StaticStorage<SVGHolder>::Accessor storage(sSVGCache);
   SVGHolder* pHolder = storage.Find(name);
 
@@ -1667,7 +1896,7 @@ ISVG IGraphics::LoadSVG(const char* name, const void* pData, int dataSize, const
     storage.Add(pHolder, name);
   }
 
-  return ISVG(pHolder->mImage);
+  return ISVG(pHolder->mImage, pHolder->mID);
 }
 #endif
 
@@ -1726,11 +1955,183 @@ WDL_TypedBuf<uint8_t> IGraphics::LoadResource(const char* fileNameOrResID, const
   return result;
 }
 
+/** Premultiplies RGBA pixels by their alpha, rounding to nearest, four pixels at a time with SIMD */
+static void PremultiplyRGBA(uint8_t* pPixels, int nPixels)
+{
+  int i = 0;
+  
+#if defined IPLUG_SIMDE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+  
+  auto premultiply = [&](__m128i rgba16) {
+    const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rgba16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i product = _mm_add_epi16(_mm_mullo_epi16(rgba16, alpha), half);
+    return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8); // (x + (x >> 8)) >> 8 == x / 255, rounded
+  };
+  
+  for (; i + 4 <= nPixels; i += 4)
+  {
+    __m128i* pFour = reinterpret_cast<__m128i*>(pPixels + i * 4);
+    const __m128i src = _mm_loadu_si128(pFour);
+    const __m128i lo = premultiply(_mm_unpacklo_epi8(src, zero));
+    const __m128i hi = premultiply(_mm_unpackhi_epi8(src, zero));
+    const __m128i rgb = _mm_andnot_si128(alphaMask, _mm_packus_epi16(lo, hi));
+    _mm_storeu_si128(pFour, _mm_or_si128(rgb, _mm_and_si128(src, alphaMask)));
+  }
+#endif
+  
+  for (; i < nPixels; i++)
+  {
+    uint8_t* pPixel = pPixels + i * 4;
+    const int alpha = pPixel[3];
+    
+    for (auto c = 0; c < 3; c++)
+    {
+      const int product = pPixel[c] * alpha + 128;
+      pPixel[c] = static_cast<uint8_t>((product + (product >> 8)) >> 8);
+    }
+  }
+}
+
+bool PreloadedBitmap::Decode()
+{
+  if (mStarted.exchange(true))
+    return false;
+  
+  WDL_TypedBuf<uint8_t> fileData;
+  const void* pData = mResourceData;
+  int dataSize = mResourceSize;
+  
+  if (!pData)
+  {
+    if (FILE* fd = fopenUTF8(mPath.Get(), "rb"))
+    {
+      if (!fseek(fd, 0, SEEK_END))
+      {
+        const long size = ftell(fd);
+        
+        if (size > 0 && !fseek(fd, 0, SEEK_SET) && fileData.ResizeOK(static_cast<int>(size), false)
+            && fread(fileData.Get(), 1, size, fd) == static_cast<size_t>(size))
+        {
+          pData = fileData.Get();
+          dataSize = fileData.GetSize();
+        }
+      }
+      
+      fclose(fd);
+    }
+  }
+  
+  mValid = pData && mDecode(pData, dataSize, mPixels, mWidth, mHeight) && mWidth > 0 && mHeight > 0 && mPixels.GetSize() == mWidth * mHeight * 4;
+  
+  if (mValid)
+    PremultiplyRGBA(mPixels.Get(), mWidth * mHeight);
+  else
+    mPixels.Resize(0);
+  
+  mDone.set_value();
+  return true;
+}
+
+void IGraphics::PreloadBitmaps(const std::vector<const char*>& fileNamesOrResIDs, std::function<void()> onComplete, int targetScale)
+{
+  struct Batch
+  {
+    int mRemaining = 0;
+    std::chrono::high_resolution_clock::time_point mStart = std::chrono::high_resolution_clock::now();
+    std::function<void()> mOnComplete;
+  };
+  
+  if (targetScale == 0)
+    targetScale = GetRoundedScreenScale();
+  
+  PreloadedBitmap::DecodeFunc decode = GetAPIBitmapDecoder();
+  auto pBatch = std::make_shared<Batch>();
+  pBatch->mOnComplete = std::move(onComplete);
+  
+  for (auto i = 0; decode && i < (int) fileNamesOrResIDs.size(); i++)
+  {
+    const char* name = fileNamesOrResIDs[i];
+    std::string key = std::string(name) + "@" + std::to_string(targetScale);
+    
+    if (mPreloadedBitmaps.count(key) || FindCachedBitmap(name, targetScale))
+      continue;
+    
+    const char* ext = name + strlen(name) - 1;
+    while (ext >= name && *ext != '.') --ext;
+    ++ext;
+    
+    if (!BitmapExtSupported(ext))
+      continue;
+    
+    auto pPreloaded = std::make_shared<PreloadedBitmap>(decode);
+    pPreloaded->mTargetScale = targetScale;
+    const EResourceLocation location = SearchImageResource(name, ext, pPreloaded->mPath, targetScale, pPreloaded->mSourceScale);
+
+#ifdef OS_WIN
+    if (location == EResourceLocation::kWinBinary)
+      pPreloaded->mResourceData = LoadWinResource(pPreloaded->mPath.Get(), ext, pPreloaded->mResourceSize, GetWinModuleHandle());
+    
+    if (location == EResourceLocation::kWinBinary && !pPreloaded->mResourceData)
+      continue;
+#endif
+    if (location != EResourceLocation::kAbsolutePath && location != EResourceLocation::kWinBinary)
+      continue;
+    
+    mPreloadedBitmaps[key] = pPreloaded;
+    pBatch->mRemaining++;
+    
+    mTaskQueue.Add([pPreloaded](IPlugTask&) { pPreloaded->Decode(); },
+                   [pBatch](bool) {
+                     if (--pBatch->mRemaining > 0)
+                       return;
+                     
+                     DBGMSG("Preloaded bitmaps in %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pBatch->mStart).count());
+                     
+                     if (pBatch->mOnComplete)
+                       pBatch->mOnComplete();
+                   });
+  }
+  
+  if (!pBatch->mRemaining && pBatch->mOnComplete)
+    pBatch->mOnComplete();
+}
+
+APIBitmap* IGraphics::TakePreloadedBitmap(const char* name, int targetScale)
+{
+  auto it = mPreloadedBitmaps.find(std::string(name) + "@" + std::to_string(targetScale));
+  
+  if (it == mPreloadedBitmaps.end())
+    return nullptr;
+  
+  std::shared_ptr<PreloadedBitmap> pPreloaded = std::move(it->second);
+  mPreloadedBitmaps.erase(it);
+  pPreloaded->Wait();
+  
+  if (!pPreloaded->mValid)
+    return nullptr;
+  
+  APIBitmap* pAPIBitmap = LoadAPIBitmapFromPixels(name, pPreloaded->mPixels, pPreloaded->mWidth, pPreloaded->mHeight, pPreloaded->mSourceScale);
+  pPreloaded->mPixels.Resize(0); // the pixels of the task's copy aren't needed any more
+  return pAPIBitmap;
+}
+
+APIBitmap* IGraphics::FindCachedBitmap(const char* name, int scale)
+{
+  return sBitmapCache.Find(name, scale);
+}
+
 IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHorizontal, int targetScale)
 {
   if (targetScale == 0)
     targetScale = GetRoundedScreenScale();
 
+  // Bitmaps that are already loaded are found without locking the cache
+  if (APIBitmap* pCached = sBitmapCache.Find(name, targetScale))
+    return IBitmap(pCached, nStates, framesAreHorizontal, name);
+
   StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
   APIBitmap* pAPIBitmap = storage.Find(name, targetScale);
 
@@ -1763,10 +2164,14 @@ IBitmap IGraphics::LoadBitmap(const char* name, int nStates, bool framesAreHoriz
       if (sourceScale != targetScale)
         pAPIBitmap = storage.Find(name, sourceScale);
 
-      // Load the resource if no match found
+      // Load the resource if no match found, unless PreloadBitmaps() has decoded it
       if (!pAPIBitmap)
       {
-        loadedBitmap = std::unique_ptr<APIBitmap>(LoadAPIBitmap(fullPath.Get(), sourceScale, resourceLocation, ext));
+        loadedBitmap = std::unique_ptr<APIBitmap>(TakePreloadedBitmap(name, targetScale));
+        
+        if (!loadedBitmap)
+          loadedBitmap = std::unique_ptr<APIBitmap>(LoadAPIBitmap(fullPath.Get(), sourceScale, resourceLocation, ext));
+        
         pAPIBitmap= loadedBitmap.get();
       }
     }
@@ -1793,6 +2198,9 @@ IBitmap IGraphics::LoadBitmap(const char *name, const void *pData, int dataSize,
   if (targetScale == 0)
     targetScale = GetRoundedScreenScale();
 
+  if (APIBitmap* pCached = sBitmapCache.Find(name, targetScale))
+    return IBitmap(pCached, nStates, framesAreHorizontal, name);
+
   StaticStorage<APIBitmap>::Accessor storage(sBitmapCache);
   APIBitmap* pAPIBitmap = storage.Find(name, targetScale);
 
@@ -2080,105 +2488,296 @@ void IGraphics::DrawRotatedLayer(const ILayerPtr& layer, double angle)
   PathTransformRestore();
 }
 
-void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
+/** Adds one row to and subtracts one row from the running sums of a box blur, and writes the averages. Either row may be nullptr, as may the output */
+static void BoxBlurRow(int32_t* pSums, const uint8_t* pAdd, const uint8_t* pSub, uint8_t* pOut, int width, float scale)
 {
-  auto GaussianBlurSwap = [](uint8_t* out, uint8_t* in, uint8_t* kernel, int width, int height,
-                             int outStride, int inStride, int kernelSize, uint32_t norm)
+  int x = 0;
+  
+#if defined IPLUG_SIMDE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale4 = _mm_set1_ps(scale);
+  
+  auto load4 = [&](const uint8_t* p) {
+    int32_t v;
+    memcpy(&v, p, 4);
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+  };
+  
+  for (; x + 4 <= width; x += 4)
   {
-    int repeats = 0;
-    int fullKernelSize = kernelSize * 2 + 1;
-    uint32_t last = 0;
-
-    auto RepeatCheck = [&](int idx)
+    __m128i sums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSums + x));
+    
+    if (pAdd)
+      sums = _mm_add_epi32(sums, load4(pAdd + x));
+    if (pSub)
+      sums = _mm_sub_epi32(sums, load4(pSub + x));
+    
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pSums + x), sums);
+    
+    if (pOut)
     {
-      repeats = last == in[idx * 4] ? std::min(repeats + 1, fullKernelSize) : 1;
-      last = in[idx * 4];
-        
-      return repeats == fullKernelSize;
-    };
-      
-    for (int i = 0; i < height; i++, in += inStride)
+      const __m128i averages = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sums), scale4));
+      const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(averages, averages), zero);
+      const int32_t v = _mm_cvtsi128_si32(packed);
+      memcpy(pOut + x, &v, 4);
+    }
+  }
+#endif
+  
+  for (; x < width; x++)
+  {
+    pSums[x] += (pAdd ? pAdd[x] : 0) - (pSub ? pSub[x] : 0);
+    
+    if (pOut)
+      pOut[x] = static_cast<uint8_t>(pSums[x] * scale + 0.5f);
+  }
+}
+
+/** Blurs the columns of a single channel image with a box of 2 * radius + 1 rows, treating pixels outside the image as zero.
+ * Every column keeps a running sum and the columns are processed side by side, so the cost doesn't depend on the radius */
+static void BoxBlurColumns(uint8_t* pOut, const uint8_t* pIn, int width, int height, int radius, int32_t* pSums)
+{
+  const float scale = 1.f / static_cast<float>(2 * radius + 1);
+  
+  memset(pSums, 0, width * sizeof(int32_t));
+  
+  for (auto y = 0; y < std::min(radius, height); y++)
+    BoxBlurRow(pSums, pIn + y * width, nullptr, nullptr, width, scale);
+  
+  for (auto y = 0; y < height; y++)
+  {
+    const uint8_t* pAdd = y + radius < height ? pIn + (y + radius) * width : nullptr;
+    const uint8_t* pSub = y - radius - 1 >= 0 ? pIn + (y - radius - 1) * width : nullptr;
+    BoxBlurRow(pSums, pAdd, pSub, pOut + y * width, width, scale);
+  }
+}
+
+/** Transposes a single channel image of height rows of width pixels, in tiles to stay within the cache */
+static void TransposePlane(uint8_t* pOut, const uint8_t* pIn, int width, int height)
+{
+  constexpr int kTile = 32;
+  
+  for (auto y0 = 0; y0 < height; y0 += kTile)
+  {
+    for (auto x0 = 0; x0 < width; x0 += kTile)
     {
-      for (int j = 0; j < kernelSize - 1; j++)
+      for (auto y = y0; y < std::min(y0 + kTile, height); y++)
       {
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < j + 1; k++)
-          accum += kernel[k] * in[(j - k) * 4];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * in[(j + k) * 4];
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        for (auto x = x0; x < std::min(x0 + kTile, width); x++)
+          pOut[x * height + y] = pIn[y * width + x];
       }
-      for (int j = 0; j < kernelSize * 2 - 2; j++)
-        RepeatCheck(j);
-      for (int j = kernelSize - 1; j < (width - kernelSize) + 1; j++)
+    }
+  }
+}
+
+/** Convolves the columns of a single channel image with a symmetric kernel, treating pixels outside the image as zero.
+ * Used for blurs too small for box blurs to approximate well, where the kernel is short */
+static void KernelBlurColumns(uint8_t* pOut, const uint8_t* pIn, int width, int height, const float* pKernel, int radius)
+{
+  for (auto y = 0; y < height; y++)
+  {
+    const int kStart = std::max(-radius, -y);
+    const int kEnd = std::min(radius, height - 1 - y);
+    uint8_t* pOutRow = pOut + y * width;
+    int x = 0;
+    
+#if defined IPLUG_SIMDE
+    const __m128i zero = _mm_setzero_si128();
+    
+    for (; x + 4 <= width; x += 4)
+    {
+      __m128 accum = _mm_set1_ps(0.5f);
+      
+      for (auto k = kStart; k <= kEnd; k++)
       {
-        if (RepeatCheck(j + kernelSize - 1))
-        {
-            out[j * outStride + (i * 4)] = static_cast<uint8_t>(last);
-            continue;
-        }
-          
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * (in[(j - k) * 4] + in[(j + k) * 4]);
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        int32_t v;
+        memcpy(&v, pIn + (y + k) * width + x, 4);
+        const __m128i pixels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+        accum = _mm_add_ps(accum, _mm_mul_ps(_mm_cvtepi32_ps(pixels), _mm_set1_ps(pKernel[std::abs(k)])));
       }
-      for (int j = (width - kernelSize) + 1; j < width; j++)
+      
+      const __m128i values = _mm_cvttps_epi32(accum);
+      const int32_t v = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(values, values), zero));
+      memcpy(pOutRow + x, &v, 4);
+    }
+#endif
+    
+    for (; x < width; x++)
+    {
+      float accum = 0.5f;
+      
+      for (auto k = kStart; k <= kEnd; k++)
+        accum += pKernel[std::abs(k)] * pIn[(y + k) * width + x];
+      
+      pOutRow[x] = static_cast<uint8_t>(std::min(accum, 255.f));
+    }
+  }
+}
+
+/** Gaussian blurs a single channel image, treating pixels outside it as zero. Larger blurs are approximated with three box blurs in each direction
+ * (see "Fast Almost-Gaussian Filtering", Kovesi 2010), so their cost doesn't depend on the size of the blur
+ * @param plane The image, height rows of width pixels, which is blurred in place
+ * @param sigma The standard deviation of the gaussian in pixels */
+static void GaussianBlurPlane(RawBitmapData& plane, int width, int height, float sigma)
+{
+  constexpr int kPasses = 3;
+  constexpr int kMaxKernelRadius = 6;
+  
+  const int kernelRadius = static_cast<int>(std::ceil(3.f * sigma));
+  const bool useKernel = kernelRadius <= kMaxKernelRadius;
+  float kernel[kMaxKernelRadius + 1] = {};
+  int radii[kPasses] = {};
+  int border = 0;
+  
+  if (useKernel)
+  {
+    float sum = 0.f;
+    
+    for (auto i = 0; i <= kernelRadius; i++)
+    {
+      kernel[i] = std::exp(-(i * i) / (2.f * sigma * sigma));
+      sum += i ? 2.f * kernel[i] : kernel[i];
+    }
+    
+    for (auto i = 0; i <= kernelRadius; i++)
+      kernel[i] /= sum;
+  }
+  else
+  {
+    // The widths of the boxes are the odd numbers either side of the ideal width, with as many of each as gives the right variance
+    const float variance = sigma * sigma;
+    int lower = static_cast<int>(std::floor(std::sqrt(12.f * variance / kPasses + 1.f)));
+    if (lower % 2 == 0)
+      lower--;
+    const int nLower = static_cast<int>(std::round((12.f * variance - kPasses * lower * lower - 4 * kPasses * lower - 3 * kPasses) / (-4.f * lower - 4.f)));
+    
+    for (auto i = 0; i < kPasses; i++)
+      radii[i] = ((i < nLower ? lower : lower + 2) - 1) / 2;
+    
+    // Later passes spread what earlier passes moved beyond the edges back in, so blur a plane with a border that the blur can't cross
+    border = radii[0] + radii[1] + radii[2];
+  }
+  
+  if (!kernelRadius)
+    return;
+  
+  const int paddedWidth = width + 2 * border;
+  const int paddedHeight = height + 2 * border;
+  
+  RawBitmapData padded;
+  RawBitmapData temp;
+  WDL_TypedBuf<int32_t> sums;
+  padded.Resize(paddedWidth * paddedHeight);
+  temp.Resize(paddedWidth * paddedHeight);
+  sums.Resize(std::max(paddedWidth, paddedHeight));
+  memset(padded.Get(), 0, padded.GetSize());
+  
+  for (auto y = 0; y < height; y++)
+    memcpy(padded.Get() + (y + border) * paddedWidth + border, plane.Get() + y * width, width);
+  
+  uint8_t* pA = padded.Get();
+  uint8_t* pB = temp.Get();
+  
+  // Blur the columns, transpose so that the rows can be blurred as columns, then transpose back
+  for (auto dir = 0; dir < 2; dir++)
+  {
+    const int w = dir ? paddedHeight : paddedWidth;
+    const int h = dir ? paddedWidth : paddedHeight;
+    
+    if (useKernel)
+    {
+      KernelBlurColumns(pB, pA, w, h, kernel, kernelRadius);
+      std::swap(pA, pB);
+    }
+    
+    for (auto i = 0; i < kPasses; i++)
+    {
+      if (radii[i])
       {
-        uint32_t accum = in[j * 4] * kernel[0];
-        for (int k = 1; k < kernelSize; k++)
-          accum += kernel[k] * in[(j - k) * 4];
-        for (int k = 1; k < width - j; k++)
-          accum += kernel[k] * in[(j + k) * 4];
-        out[j * outStride + (i * 4)] = static_cast<uint8_t>(std::min(static_cast<uint32_t>(255), accum / norm));
+        BoxBlurColumns(pB, pA, w, h, radii[i], sums.Get());
+        std::swap(pA, pB);
       }
     }
-  };
+    
+    TransposePlane(pB, pA, w, h);
+    std::swap(pA, pB);
+  }
+  
+  for (auto y = 0; y < height; y++)
+    memcpy(plane.Get() + y * width, pA + (y + border) * paddedWidth + border, width);
+}
+
+/** Hashes a plane of bytes eight at a time, which is several times quicker than a byte-wise FNV hash of a whole layer */
+static WDL_UINT64 HashPlane(const uint8_t* pData, int size)
+{
+  WDL_UINT64 hash = WDL_FNV64_IV ^ static_cast<WDL_UINT64>(size);
+  WDL_UINT64 word;
+  int i = 0;
   
-  RawBitmapData temp1;
-  RawBitmapData temp2;
-  RawBitmapData kernel;
+  for (; i + 8 <= size; i += 8)
+  {
+    memcpy(&word, pData + i, 8);
+    hash = (hash ^ word) * WDL_UINT64_CONST(0x9E3779B97F4A7C15);
+    hash ^= hash >> 32;
+  }
+  
+  word = 0;
+  memcpy(&word, pData + i, size - i);
+  hash = (hash ^ word) * WDL_UINT64_CONST(0x9E3779B97F4A7C15);
+  return hash ^ (hash >> 32);
+}
+
+void IGraphics::ApplyLayerDropShadow(ILayerPtr& layer, const IShadow& shadow)
+{
+  RawBitmapData temp;
     
   // Get bitmap in 32-bit form
-  GetLayerBitmapData(layer, temp1);
+  GetLayerBitmapData(layer, temp);
     
-  if (!temp1.GetSize())
+  if (!temp.GetSize())
       return;
-  temp2.Resize(temp1.GetSize());
-    
-  // Form kernel (reference blurSize from zero (which will be no blur))
-  bool flipped = FlippedBitmap();
-  float scale = layer->GetAPIBitmap()->GetScale() * layer->GetAPIBitmap()->GetDrawScale();
-  float blurSize = std::max(1.f, (shadow.mBlurSize * scale) + 1.f);
-  float blurConst = 4.5f / (blurSize * blurSize);
-  int iSize = static_cast<int>(ceil(blurSize));
-  int width = layer->GetAPIBitmap()->GetWidth();
-  int height = layer->GetAPIBitmap()->GetHeight();
-  int stride1 = temp1.GetSize() / width;
-  int stride2 = flipped ? -temp1.GetSize() / height : temp1.GetSize() / height;
-  int stride3 = flipped ? -stride2 : stride2;
-
-  kernel.Resize(iSize);
-        
-  for (int i = 0; i < iSize; i++)
-    kernel.Get()[i] = static_cast<uint8_t>(std::round(255.f * std::expf(-(i * i) * blurConst)));
   
-  // Kernel normalisation
-  int normFactor = kernel.Get()[0];
-    
-  for (int i = 1; i < iSize; i++)
-    normFactor += kernel.Get()[i] + kernel.Get()[i];
+  // Reference blurSize from zero (which will be no blur). It spans three deviations of the gaussian
+  const float scale = layer->GetAPIBitmap()->GetScale() * layer->GetAPIBitmap()->GetDrawScale();
+  const float blurSize = std::max(1.f, (shadow.mBlurSize * scale) + 1.f);
+  const int width = layer->GetAPIBitmap()->GetWidth();
+  const int height = layer->GetAPIBitmap()->GetHeight();
+  const int rowBytes = temp.GetSize() / height;
+  uint8_t* pAlpha = temp.Get() + AlphaChannel();
+  
+  // A control's layer is often redrawn with the same shape, so its last mask is kept, keyed on the alpha plane that the mask depends on
+  ShadowMask localMask;
+  ShadowMask& mask = layer->mControl ? mShadowMasks[layer->mControl] : localMask;
   
-  // Do blur
-  uint8_t* asRows = temp1.Get() + AlphaChannel();
-  uint8_t* inRows = flipped ? asRows + stride3 * (height - 1) : asRows;
-  uint8_t* asCols = temp2.Get() + AlphaChannel();
+  mShadowAlpha.Resize(width * height, false);
   
-  GaussianBlurSwap(asCols, inRows, kernel.Get(), width, height, stride1, stride2, iSize, normFactor);
-  GaussianBlurSwap(asRows, asCols, kernel.Get(), height, width, stride3, stride1, iSize, normFactor);
+  for (auto y = 0; y < height; y++)
+  {
+    for (auto x = 0; x < width; x++)
+      mShadowAlpha.Get()[y * width + x] = pAlpha[y * rowBytes + x * 4];
+  }
+  
+  const WDL_UINT64 hash = HashPlane(mShadowAlpha.Get(), width * height);
+  
+  if (mask.mHash != hash || mask.mWidth != width || mask.mHeight != height || mask.mBlurSize != blurSize || mask.mAlpha.GetSize() != width * height)
+  {
+    mask.mHash = hash;
+    mask.mWidth = width;
+    mask.mHeight = height;
+    mask.mBlurSize = blurSize;
+    mask.mAlpha.Resize(width * height);
+    memcpy(mask.mAlpha.Get(), mShadowAlpha.Get(), width * height);
+    GaussianBlurPlane(mask.mAlpha, width, height, blurSize / 3.f);
+  }
+  
+  for (auto y = 0; y < height; y++)
+  {
+    for (auto x = 0; x < width; x++)
+      pAlpha[y * rowBytes + x * 4] = mask.mAlpha.Get()[y * width + x];
+  }
   
   // Apply alphas to the pattern and recombine/replace the image
-  ApplyShadowMask(layer, temp1, shadow);
+  ApplyShadowMask(layer, temp, shadow);
 }
 
 bool IGraphics::LoadFont(const char* fontID, const char* fileNameOrResID)
@@ -2795,6 +3394,9 @@ void IGraphics::DrawSVG(const ISVG& svg, const IRECT& dest, const IBlend* pBlend
   float yScale = dest.H() / svg.H();
   float scale = xScale < yScale ? xScale : yScale;
   
+  if (DrawCachedSVG(svg, dest.L, dest.T, scale, pBlend, pStrokeColor, pFillColor))
+    return;
+  
   PathTransformSave();
   PathTransformTranslate(dest.L, dest.T);
   PathTransformScale(scale);
@@ -2802,6 +3404,53 @@ void IGraphics::DrawSVG(const ISVG& svg, const IRECT& dest, const IBlend* pBlend
   PathTransformRestore();
 }
 
+bool IGraphics::DrawCachedSVG(const ISVG& svg, float x, float y, float scale, const IBlend* pBlend, const IColor* pStrokeColor, const IColor* pFillColor)
+{
+  // Rasterize at the scale of the current transform, so that scaled and rotated draws stay sharp
+  const float transformScale = std::max(std::sqrt(mTransform.mXX * mTransform.mXX + mTransform.mYX * mTransform.mYX),
+                                        std::sqrt(mTransform.mXY * mTransform.mXY + mTransform.mYY * mTransform.mYY));
+  const float rasterScale = scale * transformScale;
+  const float backingScale = GetBackingPixelScale();
+  const float w = svg.W() * rasterScale;
+  const float h = svg.H() * rasterScale;
+  
+  ISVGRasterCache::Key key;
+  key.svgID = svg.mID;
+  key.w = static_cast<int>(std::ceil(w * backingScale));
+  key.h = static_cast<int>(std::ceil(h * backingScale));
+  key.screenScale = GetScreenScale();
+  key.drawScale = GetDrawScale();
+  key.hasStroke = pStrokeColor != nullptr;
+  key.hasFill = pFillColor != nullptr;
+  key.stroke = pStrokeColor ? *pStrokeColor : IColor();
+  key.fill = pFillColor ? *pFillColor : IColor();
+  
+  if (!key.svgID || transformScale <= 0.f || key.w <= 0 || key.h <= 0 || !mSVGRasterCache.Fits(key.w, key.h))
+    return false;
+  
+  const ILayerPtr* pLayer = mSVGRasterCache.Find(key);
+  
+  if (!pLayer)
+  {
+    // Every size of a drag resize would allocate a new layer, so draw as paths until it ends
+    if (GetResizingInProcess())
+      return false;
+    
+    // N.B. layers reset the transform
+    PathTransformSave();
+    StartLayer(nullptr, IRECT(0.f, 0.f, w, h));
+    PathTransformScale(rasterScale);
+    DoDrawSVG(svg, nullptr, pStrokeColor, pFillColor);
+    ILayerPtr layer = EndLayer();
+    PathTransformRestore();
+    pLayer = &mSVGRasterCache.Add(key, std::move(layer));
+  }
+  
+  const IRECT& layerBounds = (*pLayer)->Bounds();
+  DrawFittedLayer(*pLayer, IRECT(x, y, x + layerBounds.W() / transformScale, y + layerBounds.H() / transformScale), pBlend);
+  return true;
+}
+
 void IGraphics::DrawRotatedSVG(const ISVG& svg, float destCtrX, float destCtrY, float width, float height, double angle, const IBlend* pBlend)
 {
   PathTransformSave();
@@ -43,6 +43,7 @@
 #include "IPlugConstants.h"
 #include "IPlugLogger.h"
 #include "IPlugPaths.h"
+#include "IPlugTaskQueue.h"
 
 #include "IGraphicsConstants.h"
 #include "IGraphicsStructs.h"
@@ -51,6 +52,7 @@
 
 #include "nanosvg.h"
 
+#include <functional>
 #include <stack>
 #include <memory>
 #include <vector>
@@ -117,6 +119,12 @@ public:
    * @param pBlend Optional blend method */
   virtual void DrawRotatedSVG(const ISVG& svg, float destCentreX, float destCentreY, float width, float height, double angle, const IBlend* pBlend = 0);
 
+  /** Enables a cache that keeps the SVGs DrawSVG() draws rasterized at the size they are drawn, so that drawing them again is a bitmap draw.
+   * Rasters are kept for each size, scale and color override, and the least recently used ones are released when the cache is full.
+   * The cache is off by default, since each raster is a layer in GPU memory of width * height * 4 bytes. Sizes seen during a drag resize aren't cached
+   * @param maxBytes The maximum size of the rasters in bytes, e.g. 32 * 1024 * 1024, or 0 to draw SVGs as paths every time */
+  void SetSVGRasterCacheSize(size_t maxBytes) { mSVGRasterCache.SetMaxBytes(maxBytes); }
+
   /** Draw a bitmap (raster) image to the graphics context
    * @param bitmap The bitmap image to draw to the graphics context
    * @param bounds The rectangular region to draw the image in
@@ -769,9 +777,16 @@ public:
     PathTransformRotate(text.mAngle);
   }
   
+  /** Release the rasterized SVGs, called by drawing classes before their context is destroyed */
+  void ClearSVGRasterCache() { mSVGRasterCache.Clear(); }
+
 private:
   IPattern GetSVGPattern(const NSVGpaint& paint, float opacity);
 
+  /** Draw an SVG from the raster cache, rasterizing it if needed
+   * @return \c false if the SVG can't be cached at this size and must be drawn as paths */
+  bool DrawCachedSVG(const ISVG& svg, float x, float y, float scale, const IBlend* pBlend, const IColor* pStrokeColor, const IColor* pFillColor);
+
   void DoDrawSVG(const ISVG& svg, const IBlend* pBlend = nullptr, const IColor* pStrokeColor = nullptr, const IColor* pFillColor = nullptr);
   
   /** Prepare a particular area of the display for drawing, normally resulting in clipping of the region.
@@ -1242,6 +1257,18 @@ private:
    * @param bounds \todo
    * @param scale \todo */
   void DrawControl(IControl* pControl, const IRECT& bounds, float scale);
+
+  /** Draw a control that uses retained drawing, from its layer if that is up to date. See IControl::SetRetainedDrawing()
+   * @param pControl The control */
+  void DrawRetainedControl(IControl* pControl);
+
+  /** Limit the number of controls that keep a layer for retained drawing. Once the limit is reached, retained controls that don't have
+   * a layer yet draw directly. Lowering the limit releases the layers beyond it. See IControl::SetRetainedDrawing()
+   * @param maxLayers The maximum number of layers, 0 to draw all controls directly */
+  void SetMaxRetainedLayers(int maxLayers);
+
+  /** @return The maximum number of controls that keep a layer for retained drawing */
+  int GetMaxRetainedLayers() const { return mMaxRetainedLayers; }
   
   /** Shows a pop up/contextual menu in relation to a rectangular region of the graphics context
    * @param control A reference to the IControl creating this pop-up menu. If it exists IControl::OnPopupMenuSelection() will be called on successful selection
@@ -1488,8 +1515,32 @@ public:
    * @param idx The index of the control
    * @param r The new bounds for the control's target and draw rect */
   void SetControlBounds(IControl* pControl, const IRECT& r);
+
+  /** Mark the index used to find the controls under the mouse and in a dirty region as out of date, so that it is rebuilt when next used.
+   * IControl calls this when its bounds change or it is shown or hidden, you only need to call it if you assign a control's
+   * mRECT or mTargetRECT directly */
+  void InvalidateControlIndex() { mControlIndexValid = false; }
+
+  /** Used internally by IControl::SetDirty() to add a control to the controls that are checked at the next display refresh
+   * @param pControl The control */
+  void AddDirtyControl(IControl* pControl);
+
+  /** Used internally by IControl to add a control to the controls that are animated and checked at every display refresh, until it stops animating
+   * @param pControl The control */
+  void AddAnimatingControl(IControl* pControl);
+
+  /** Used internally when a control is destroyed
+   * @param pControl The control */
+  void RemoveFromControlLists(IControl* pControl);
   
 private:
+  /** Rebuild the control index if it is out of date */
+  void UpdateControlIndex();
+
+  /** For all the "special controls", front-most last, perform a function
+   * @param func A std::function to perform on each control */
+  void ForSpecialControlsFunc(IControlFunction func);
+
   /** Get the index of the control at x and y coordinates on mouse event
    * @param x The X coordinate to test
    * @param y The Y coordinate to test
@@ -1661,6 +1712,16 @@ public:
    * @return An IBitmap representing the image */
   virtual IBitmap LoadBitmap(const char *name, const void* pData, int dataSize, int nStates = 1, bool framesAreHorizontal = false, int targetScale = 0);
 
+  /** Start reading and decoding bitmaps on worker threads. Call it at the start of a layout function with the bitmaps that the layout loads,
+   * so that each LoadBitmap() that follows only waits for its own bitmap, and bitmaps are decoded side by side rather than one after another.
+   * The time saved scales with the free cores of the task pool; on a single core the decodes take as long as loading serially.
+   * Bitmaps that are already loaded, and drawing backends that can't decode off the main thread, are skipped.
+   * Bitmaps that haven't been loaded when the screen scale changes are dropped, unless they were preloaded for the new scale
+   * @param fileNamesOrResIDs The file names or resource IDs, as they will be passed to LoadBitmap()
+   * @param onComplete Called on the main thread once all the bitmaps are decoded, after which LoadBitmap() doesn't wait. May be nullptr
+   * @param targetScale The targetScale that LoadBitmap() will be called with */
+  void PreloadBitmaps(const std::vector<const char*>& fileNamesOrResIDs, std::function<void()> onComplete = nullptr, int targetScale = 0);
+
   /** Load an SVG from disk or from windows resource
    * @param fileNameOrResID A CString absolute path or resource ID
    * @return An ISVG representing the image */
@@ -1720,6 +1781,25 @@ protected:
    * @return APIBitmap* The new API Bitmap */
   virtual APIBitmap* CreateAPIBitmap(int width, int height, float scale, double drawScale, bool cacheable = false) = 0;
 
+  /** @return A function that decodes bitmap data on any thread, for PreloadBitmaps(), or nullptr if the drawing backend doesn't have one */
+  virtual PreloadedBitmap::DecodeFunc GetAPIBitmapDecoder() const { return nullptr; }
+
+  /** Drawing API method to create a bitmap from the pixels that GetAPIBitmapDecoder() decoded, called internally
+   * @param name CString for the name of the resource
+   * @param pixels Premultiplied RGBA pixels
+   * @param width The width in pixels
+   * @param height The height in pixels
+   * @param scale Integer to identify the scale of the resource, for multi-scale bitmaps
+   * @return APIBitmap* Drawing API bitmap abstraction */
+  virtual APIBitmap* LoadAPIBitmapFromPixels(const char* name, const RawBitmapData& pixels, int width, int height, int scale) { return nullptr; }
+
+  /** @return A bitmap that LoadBitmap() finds in the cache, or nullptr */
+  virtual APIBitmap* FindCachedBitmap(const char* name, int scale);
+
+  /** Creates the drawing API bitmap for a bitmap that PreloadBitmaps() decoded, waiting for the decode if it hasn't finished
+   * @return The bitmap, which the caller owns, or nullptr if it wasn't preloaded */
+  APIBitmap* TakePreloadedBitmap(const char* name, int targetScale);
+
   /** Drawing API method to load a font from a PlatformFontPtr, called internally
    * @param fontID A CString that will be used to reference the font
    * @param font Valid PlatformFontPtr, loaded via LoadPlatformFont
@@ -1794,6 +1874,12 @@ private:
   
   WDL_PtrList<IControl> mControls;
   std::unordered_map<int, IControl*> mCtrlTags;
+  IRECTGrid mControlIndex; // the visible standard controls, by bounds
+  WDL_TypedBuf<int> mControlsInRegion;
+  bool mControlIndexValid = false;
+  std::vector<IControl*> mDirtyControls; // controls that have been set dirty since they were last cleaned
+  std::vector<IControl*> mAnimatingControls; // controls that are animating, or want IsDirty() polled
+  bool mInAnimatePass = false; // while the animation functions run, removed controls leave a nullptr in mAnimatingControls
 
   // Order (front-to-back) ToolTip / PopUp / TextEntry / LiveEdit / Corner / PerfDisplay
   std::unique_ptr<ICornerResizerControl> mCornerResizer;
@@ -1866,6 +1952,24 @@ protected:
   IRECT mClipRECT;
   IMatrix mTransform;
   std::stack<IMatrix> mTransformStates;
+  ISVGRasterCache mSVGRasterCache {DEFAULT_SVG_RASTER_CACHE_SIZE};
+  int mMaxRetainedLayers = DEFAULT_MAX_RETAINED_LAYERS;
+  int mNumRetainedLayers = 0; // counted at the start of each frame, since controls release their layers without telling IGraphics
+  
+  /** The blurred alpha of a control's last drop shadow, reused while its layer's alpha and the blur size are the same */
+  struct ShadowMask
+  {
+    WDL_UINT64 mHash = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+    float mBlurSize = 0.f;
+    RawBitmapData mAlpha;
+  };
+  
+  std::unordered_map<const IControl*, ShadowMask> mShadowMasks;
+  RawBitmapData mShadowAlpha; // the unblurred alpha of the layer being shadowed
+  std::unordered_map<std::string, std::shared_ptr<PreloadedBitmap>> mPreloadedBitmaps; // by name and target scale
+  IPlugTaskQueue mTaskQueue; // declared last, so that running tasks finish before anything else is destroyed
 };
 
 END_IGRAPHICS_NAMESPACE
@@ -40,6 +40,10 @@ static constexpr double DEFAULT_GEARING = 4.0;
 static constexpr double DEFAULT_MIN_DRAW_SCALE = 0.5;
 static constexpr double DEFAULT_MAX_DRAW_SCALE = 4.0;
 
+static constexpr size_t DEFAULT_SVG_RASTER_CACHE_SIZE = 0; // bytes per IGraphics instance, opt in with IGraphics::SetSVGRasterCacheSize()
+static constexpr int DEFAULT_TEXT_LAYOUT_CACHE_SIZE = 1024; // layouts per IGraphics instance
+static constexpr int DEFAULT_MAX_RETAINED_LAYERS = 64; // layers per IGraphics instance for controls that use retained drawing
+
 //what is this stuff
 #define TOOLWIN_BORDER_W 6
 #define TOOLWIN_BORDER_H 23
@@ -15,15 +15,19 @@
  * @{
  */
 
+#include <atomic>
 #include <codecvt>
+#include <future>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "mutex.h"
 #include "wdlstring.h"
 #include "wdlendian.h"
 #include "ptrlist.h"
 #include "heapbuf.h"
+#include "fnv64.h"
 
 #if defined IGRAPHICS_SKIA && !defined IGRAPHICS_NO_SKIA_SVG
 #define SVG_USE_SKIA
@@ -446,6 +450,13 @@ protected:
 
 using PlatformFontPtr = std::unique_ptr<PlatformFont>;
 
+/** @return A new ID for an SVGHolder, which is never 0 and isn't reused after the holder is freed */
+static inline int NextSVGHolderID()
+{
+  static std::atomic<int> sNextID {1};
+  return sNextID++;
+}
+
 #ifdef SVG_USE_SKIA
 struct SVGHolder
 {
@@ -463,6 +474,7 @@ struct SVGHolder
   SVGHolder& operator=(const SVGHolder&) = delete;
   
   sk_sp<SkSVGDOM> mSVGDom;
+  const int mID = NextSVGHolderID();
 };
 #else
 /** Used internally to manage SVG data*/
@@ -485,10 +497,56 @@ struct SVGHolder
   SVGHolder& operator=(const SVGHolder&) = delete;
   
   NSVGimage* mImage = nullptr;
+  const int mID = NextSVGHolderID();
 };
 #endif
 
-/** Used internally to store data statically, making sure memory is not wasted when there are multiple plug-in instances loaded */
+/** Used internally by IGraphics::PreloadBitmaps() to hold a bitmap that is read and decoded on a worker thread,
+ * until IGraphics::LoadBitmap() creates the drawing API bitmap from it on the main thread */
+struct PreloadedBitmap
+{
+  /** Decodes PNG or JPEG data into unpremultiplied RGBA pixels, on any thread */
+  using DecodeFunc = bool (*)(const void* pData, int dataSize, RawBitmapData& pixels, int& width, int& height);
+
+  PreloadedBitmap(DecodeFunc decode)
+  : mDecode(decode)
+  , mDoneFuture(mDone.get_future().share())
+  {
+  }
+
+  PreloadedBitmap(const PreloadedBitmap&) = delete;
+  PreloadedBitmap& operator=(const PreloadedBitmap&) = delete;
+
+  /** Reads, decodes and premultiplies the bitmap, unless another thread has started to
+   * @return \c true if this call did the work */
+  bool Decode();
+
+  /** Decodes the bitmap on the calling thread if no worker has started it, otherwise waits for the worker */
+  void Wait()
+  {
+    if (!Decode())
+      mDoneFuture.wait();
+  }
+
+  DecodeFunc mDecode;
+  WDL_String mPath; // an absolute path, if the data isn't in memory
+  const void* mResourceData = nullptr; // a Windows resource
+  int mResourceSize = 0;
+  int mSourceScale = 0;
+  int mTargetScale = 0; // the screen scale it was preloaded for
+  RawBitmapData mPixels; // premultiplied RGBA
+  int mWidth = 0;
+  int mHeight = 0;
+  bool mValid = false;
+  std::atomic<bool> mStarted {false};
+  std::promise<void> mDone;
+  std::shared_future<void> mDoneFuture;
+};
+
+/** Used internally to store data statically, making sure memory is not wasted when there are multiple plug-in instances loaded.
+ * Find() doesn't lock, so drawing threads of different instances don't wait for each other. It searches an immutable hash table,
+ * which Add(), Remove() and Clear() replace under the mutex. A replaced table, and the keys it refers to, is deleted once no
+ * Find() is in progress. Use an Accessor for changes and for a Find() that must not race with an Add() */
 template <class T>
 class StaticStorage
 {
@@ -518,99 +576,166 @@ public:
   ~StaticStorage()
   {
     Clear();
+    delete mTable.load();
+    FreeRetired();
   }
 
   StaticStorage(const StaticStorage&) = delete;
   StaticStorage& operator=(const StaticStorage&) = delete;
+  
+  /** Find cached data without locking. Any thread
+   * @param str The name the data was added with
+   * @param scale The scale the data was added with
+   * @return The data, or nullptr if it isn't stored */
+  T* Find(const char* str, double scale = 1.) const
+  {
+    const WDL_UINT64 hashID = Hash(str, scale);
+    T* pData = nullptr;
+    
+    mReaders++; // keeps the table and its keys from being deleted
+    
+    if (const Table* pTable = mTable.load())
+    {
+      const int mask = static_cast<int>(pTable->mSlots.size()) - 1;
+      
+      for (int i = static_cast<int>(hashID) & mask; pTable->mSlots[i]; i = (i + 1) & mask)
+      {
+        const DataKey* pKey = pTable->mSlots[i];
+        
+        // Use the hash id for a quick search and then confirm with the scale and identifier to ensure uniqueness
+        if (pKey->hashID == hashID && scale == pKey->scale && !strcmp(str, pKey->name.Get()))
+        {
+          pData = pKey->data.load();
+          break;
+        }
+      }
+    }
+    
+    mReaders--;
+    return pData;
+  }
     
 private:
-  /** \todo */
   struct DataKey
   {
     // N.B. - hashID is not guaranteed to be unique
-    size_t hashID;
+    WDL_UINT64 hashID;
     WDL_String name;
     double scale;
-    std::unique_ptr<T> data;
+    std::atomic<T*> data; // owned by the storage, nullptr once removed
   };
   
-  /** \todo 
-   * @param str \todo
-   * @return size_t \todo */
-  size_t Hash(const char* str)
+  /** An open addressed hash table of the keys, which is never changed once it is published */
+  struct Table
   {
-    std::string string(str);
-    return std::hash<std::string>()(string);
+    std::vector<const DataKey*> mSlots; // a power of two in size, and never full
+  };
+  
+  static WDL_UINT64 Hash(const char* str, double scale)
+  {
+    const WDL_UINT64 hash = WDL_FNV64(WDL_FNV64_IV, reinterpret_cast<const unsigned char*>(str), static_cast<int>(strlen(str)));
+    return WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(&scale), sizeof(scale));
   }
 
-  /** \todo 
-   * @param str \todo
-   * @param scale \todo
-   * @return T* \todo */
-  T* Find(const char* str, double scale = 1.)
+  /** Replaces the table with one of the current keys. Called with the mutex locked */
+  void Publish()
   {
-    WDL_String cacheName(str);
-    cacheName.AppendFormatted((int) strlen(str) + 6, "-%.1fx", scale);
-    
-    size_t hashID = Hash(cacheName.Get());
+    Table* pTable = nullptr;
+    const int n = mDatas.GetSize();
     
-    int i, n = mDatas.GetSize();
-    for (i = 0; i < n; ++i)
+    if (n)
     {
-      DataKey* pKey = mDatas.Get(i);
-
-      // Use the hash id for a quick search and then confirm with the scale and identifier to ensure uniqueness
-      if (pKey->hashID == hashID && scale == pKey->scale && !strcmp(str, pKey->name.Get()))
-        return pKey->data.get();
+      int size = 16;
+      while (size < n * 2)
+        size *= 2;
+      
+      pTable = new Table;
+      pTable->mSlots.resize(size, nullptr);
+      
+      for (int k = 0; k < n; ++k)
+      {
+        const DataKey* pKey = mDatas.Get(k);
+        int i = static_cast<int>(pKey->hashID) & (size - 1);
+        while (pTable->mSlots[i])
+          i = (i + 1) & (size - 1);
+        pTable->mSlots[i] = pKey;
+      }
     }
-    return nullptr;
+    
+    mRetiredTables.push_back(std::unique_ptr<Table>(mTable.exchange(pTable)));
+    
+    // A Find() that starts after the exchange sees the new table, so if none is running now the old ones can go
+    if (mReaders.load() == 0)
+      FreeRetired();
+  }
+  
+  void FreeRetired()
+  {
+    mRetiredTables.clear();
+    mRetiredKeys.Empty(true);
   }
 
-  /** \todo 
-   * @param pData \todo
-   * @param str \todo
-   * @param scale \todo scale where 2x = retina, omit if not needed */
+  /** Takes ownership of data
+   * @param pData The data to store
+   * @param str The name to find the data with
+   * @param scale scale where 2x = retina, omit if not needed */
   void Add(T* pData, const char* str, double scale = 1.)
   {
     DataKey* pKey = mDatas.Add(new DataKey);
 
-    WDL_String cacheName(str);
-    cacheName.AppendFormatted((int) strlen(str) + 6, "-%.1fx", scale);
-    
-    pKey->hashID = Hash(cacheName.Get());
-    pKey->data = std::unique_ptr<T>(pData);
+    pKey->hashID = Hash(str, scale);
+    pKey->data = pData;
     pKey->scale = scale;
     pKey->name.Set(str);
 
     //DBGMSG("adding %s to the static storage at %.1fx the original scale\n", str, scale);
+    
+    Publish();
   }
 
-  /** \todo @param pData \todo */
+  /** Deletes data. Its key is deleted once no Find() can be using it
+   * @param pData The data to delete */
   void Remove(T* pData)
   {
     for (int i = 0; i < mDatas.GetSize(); ++i)
     {
-      if (mDatas.Get(i)->data.get() == pData)
+      DataKey* pKey = mDatas.Get(i);
+      
+      if (pKey->data.load() == pData)
       {
-        mDatas.Delete(i, true);
+        delete pKey->data.exchange(nullptr);
+        mDatas.Delete(i, false);
+        mRetiredKeys.Add(pKey);
+        Publish();
         break;
       }
     }
   }
 
-  /** \todo  */
+  /** Deletes all the data */
   void Clear()
   {
-    mDatas.Empty(true);
-  };
+    if (!mDatas.GetSize())
+      return;
+    
+    for (int i = 0; i < mDatas.GetSize(); ++i)
+    {
+      DataKey* pKey = mDatas.Get(i);
+      delete pKey->data.exchange(nullptr);
+      mRetiredKeys.Add(pKey);
+    }
+    
+    mDatas.Empty(false);
+    Publish();
+  }
 
-  /** \todo  */
+  /** Counts a user of the storage, e.g. an IGraphics instance */
   void Retain()
   {
     mCount++;
   }
   
-  /** \todo  */
+  /** Clears the storage when its last user releases it */
   void Release()
   {
     if (--mCount == 0)
@@ -620,6 +745,10 @@ private:
   int mCount = 0;
   WDL_Mutex mMutex;
   WDL_PtrList<DataKey> mDatas;
+  std::atomic<Table*> mTable {nullptr};
+  mutable std::atomic<int> mReaders {0};
+  std::vector<std::unique_ptr<Table>> mRetiredTables;
+  WDL_PtrList<DataKey> mRetiredKeys;
 };
 
 /** Encapsulate an xy point in one struct */
@@ -18,12 +18,17 @@
 
 #include <functional>
 #include <chrono>
+#include <list>
 #include <numeric>
+#include <string>
+#include <unordered_map>
 
 #include "IPlugUtilities.h"
 #include "IPlugLogger.h"
 #include "IPlugStructs.h"
 
+#include "fnv64.h"
+
 #include "IGraphicsPrivate.h"
 #include "IGraphicsUtilities.h"
 #include "IGraphicsConstants.h"
@@ -165,8 +170,9 @@ private:
 #ifdef SVG_USE_SKIA
 struct ISVG
 {
-  ISVG(sk_sp<SkSVGDOM> svgDom)
+  ISVG(sk_sp<SkSVGDOM> svgDom, int id = 0)
   : mSVGDom(svgDom)
+  , mID(id)
   {
   }
   
@@ -188,13 +194,15 @@ struct ISVG
   inline bool IsValid() const { return mSVGDom != nullptr; }
   
   sk_sp<SkSVGDOM> mSVGDom;
+  int mID = 0; // the ID of the SVGHolder that owns the data, or 0
 };
 #else
 struct ISVG
 {  
-  ISVG(NSVGimage* pImage)
+  ISVG(NSVGimage* pImage, int id = 0)
   {
     mImage = pImage;
+    mID = id;
   }
   
   /** @return The width of the SVG */
@@ -215,6 +223,7 @@ struct ISVG
   inline bool IsValid() const { return mImage != nullptr; }
   
   NSVGimage* mImage = nullptr;
+  int mID = 0; // the ID of the SVGHolder that owns the data, or 0
 };
 #endif
 
@@ -1983,6 +1992,183 @@ private:
   WDL_TypedBuf<IRECT> mRects;
 };
 
+/** A uniform grid over a set of rectangles, each identified by an integer index, e.g. the controls in IGraphics.
+ * Used to find the rectangles at a point or in a region without visiting all of them.
+ * Add() the rectangles in ascending index order then call Build(). Each cell lists its indices in ascending order.
+ * Rectangles outside the grid's bounds are clamped to the edge cells, so lookups are still correct, just slower */
+class IRECTGrid
+{
+public:
+  IRECTGrid()
+  {}
+
+  IRECTGrid(const IRECTGrid&) = delete;
+  IRECTGrid& operator=(const IRECTGrid&) = delete;
+
+  /** Remove all rectangles and set the area that the grid covers
+   * @param bounds The area to divide into cells
+   * @param expectedSize The number of rectangles that will be added, used to choose the number of cells */
+  void Reset(const IRECT& bounds, int expectedSize)
+  {
+    mBounds = bounds;
+    const float w = std::max(bounds.W(), 1.f);
+    const float h = std::max(bounds.H(), 1.f);
+    const float cellSize = std::sqrt(w * h / std::max(expectedSize, 1));
+    mNCols = Clip(static_cast<int>(std::ceil(w / cellSize)), 1, kMaxCellsPerSide);
+    mNRows = Clip(static_cast<int>(std::ceil(h / cellSize)), 1, kMaxCellsPerSide);
+    mCellW = w / mNCols;
+    mCellH = h / mNRows;
+    mItems.Resize(0);
+    mCellStarts.Resize(0);
+    mCellItems.Resize(0);
+    mMaxIdx = -1;
+  }
+
+  /** Add a rectangle. Indices must be added in ascending order
+   * @param idx The index that identifies the rectangle
+   * @param r The rectangle */
+  void Add(int idx, const IRECT& r)
+  {
+    assert(idx > mMaxIdx && "IRECTGrid indices must be added in ascending order");
+    Item item;
+    item.idx = idx;
+    GetCellRange(r, item.col0, item.row0, item.col1, item.row1);
+    mItems.Add(item);
+    mMaxIdx = idx;
+  }
+
+  /** Sort the rectangles added since Reset() into the cells */
+  void Build()
+  {
+    const int nCells = mNCols * mNRows;
+    int* pStarts = mCellStarts.ResizeOK(nCells + 1, false);
+    memset(pStarts, 0, (nCells + 1) * sizeof(int));
+
+    for (auto i = 0; i < mItems.GetSize(); i++)
+      ForCellsOfItem(mItems.Get()[i], [pStarts](int cell) { pStarts[cell + 1]++; });
+
+    for (auto c = 0; c < nCells; c++)
+      pStarts[c + 1] += pStarts[c];
+
+    // each cell is filled in item order, so cells stay sorted by index
+    int* pCellItems = mCellItems.ResizeOK(pStarts[nCells], false);
+    WDL_TypedBuf<int> fill;
+    int* pFill = fill.ResizeOK(nCells, false);
+    memcpy(pFill, pStarts, nCells * sizeof(int));
+
+    for (auto i = 0; i < mItems.GetSize(); i++)
+    {
+      const int idx = mItems.Get()[i].idx;
+      ForCellsOfItem(mItems.Get()[i], [pCellItems, pFill, idx](int cell) { pCellItems[pFill[cell]++] = idx; });
+    }
+
+    mStamps.Resize(mMaxIdx + 1, false);
+    memset(mStamps.Get(), 0, mStamps.GetSize() * sizeof(int));
+    mQueryStamp = 0;
+  }
+
+  /** Get the indices of the rectangles that might contain a point
+   * @param x Horizontal position
+   * @param y Vertical position
+   * @param size Set to the number of indices
+   * @return The indices, in ascending order */
+  const int* GetCandidates(float x, float y, int& size) const
+  {
+    if (!mCellStarts.GetSize())
+    {
+      size = 0;
+      return nullptr;
+    }
+
+    const int cell = GetRow(y) * mNCols + GetCol(x);
+    const int* pStarts = mCellStarts.Get();
+    size = pStarts[cell + 1] - pStarts[cell];
+    return mCellItems.Get() + pStarts[cell];
+  }
+
+  /** Get the indices of the rectangles that might intersect a region
+   * @param r The region
+   * @param result Filled with the indices, each once, in ascending order */
+  void GetCandidates(const IRECT& r, WDL_TypedBuf<int>& result)
+  {
+    result.Resize(0, false);
+
+    if (!mCellStarts.GetSize())
+      return;
+
+    if (++mQueryStamp == 0)
+    {
+      memset(mStamps.Get(), 0, mStamps.GetSize() * sizeof(int));
+      mQueryStamp = 1;
+    }
+
+    int col0, row0, col1, row1;
+    GetCellRange(r, col0, row0, col1, row1);
+    const int* pStarts = mCellStarts.Get();
+    const int* pCellItems = mCellItems.Get();
+    int* pStamps = mStamps.Get();
+
+    for (auto row = row0; row <= row1; row++)
+    {
+      for (auto col = col0; col <= col1; col++)
+      {
+        const int cell = row * mNCols + col;
+        for (auto i = pStarts[cell]; i < pStarts[cell + 1]; i++)
+        {
+          const int idx = pCellItems[i];
+          if (pStamps[idx] != mQueryStamp)
+          {
+            pStamps[idx] = mQueryStamp;
+            result.Add(idx);
+          }
+        }
+      }
+    }
+
+    std::sort(result.Get(), result.Get() + result.GetSize());
+  }
+
+private:
+  struct Item
+  {
+    int idx;
+    int col0, row0, col1, row1;
+  };
+
+  static constexpr int kMaxCellsPerSide = 128;
+
+  int GetCol(float x) const { return Clip(static_cast<int>(std::floor((x - mBounds.L) / mCellW)), 0, mNCols - 1); }
+  int GetRow(float y) const { return Clip(static_cast<int>(std::floor((y - mBounds.T) / mCellH)), 0, mNRows - 1); }
+
+  void GetCellRange(const IRECT& r, int& col0, int& row0, int& col1, int& row1) const
+  {
+    col0 = GetCol(std::min(r.L, r.R));
+    col1 = GetCol(std::max(r.L, r.R));
+    row0 = GetRow(std::min(r.T, r.B));
+    row1 = GetRow(std::max(r.T, r.B));
+  }
+
+  template <typename F>
+  void ForCellsOfItem(const Item& item, F func) const
+  {
+    for (auto row = item.row0; row <= item.row1; row++)
+      for (auto col = item.col0; col <= item.col1; col++)
+        func(row * mNCols + col);
+  }
+
+  IRECT mBounds;
+  int mNCols = 1;
+  int mNRows = 1;
+  float mCellW = 1.f;
+  float mCellH = 1.f;
+  int mMaxIdx = -1;
+  int mQueryStamp = 0;
+  WDL_TypedBuf<Item> mItems;
+  WDL_TypedBuf<int> mCellStarts; // prefix sums of the cell sizes, nCells + 1 entries
+  WDL_TypedBuf<int> mCellItems; // the indices in each cell, cell after cell
+  WDL_TypedBuf<int> mStamps; // per index, the last query that returned it
+};
+
 /** Used to store transformation matrices */
 struct IMatrix
 {
@@ -2358,6 +2544,224 @@ private:
 /** ILayerPtr is a managed pointer for transferring the ownership of layers */
 using ILayerPtr = std::unique_ptr<ILayer>;
 
+/** Used internally to keep rasterized SVGs as layers, so that drawing an SVG at a size it has already been drawn at is a bitmap draw.
+ * The least recently used rasters are released when the total size of their bitmaps exceeds a limit */
+class ISVGRasterCache
+{
+public:
+  /** Identifies a raster of an SVG */
+  struct Key
+  {
+    int svgID = 0; // the SVGHolder, whose ID isn't reused after it is freed, unlike the address of its data
+    int w = 0; // size in pixels
+    int h = 0;
+    float screenScale = 1.f;
+    float drawScale = 1.f;
+    bool hasStroke = false;
+    bool hasFill = false;
+    IColor stroke;
+    IColor fill;
+
+    bool operator==(const Key& rhs) const
+    {
+      auto sameColor = [](const IColor& a, const IColor& b) { return a.A == b.A && a.R == b.R && a.G == b.G && a.B == b.B; };
+
+      return svgID == rhs.svgID && w == rhs.w && h == rhs.h && screenScale == rhs.screenScale && drawScale == rhs.drawScale
+          && hasStroke == rhs.hasStroke && hasFill == rhs.hasFill && (!hasStroke || sameColor(stroke, rhs.stroke)) && (!hasFill || sameColor(fill, rhs.fill));
+    }
+  };
+
+  ISVGRasterCache(size_t maxBytes)
+  : mMaxBytes(maxBytes)
+  {}
+
+  ISVGRasterCache(const ISVGRasterCache&) = delete;
+  ISVGRasterCache& operator=(const ISVGRasterCache&) = delete;
+
+  /** @return The raster for a key, or nullptr if it isn't cached */
+  const ILayerPtr* Find(const Key& key)
+  {
+    auto it = mIndex.find(Hash(key));
+
+    if (it == mIndex.end() || !(it->second->key == key))
+      return nullptr;
+
+    mEntries.splice(mEntries.end(), mEntries, it->second); // most recently used last
+    return &it->second->layer;
+  }
+
+  /** Takes ownership of a raster, releasing the least recently used ones to stay within the limit
+   * @return The raster */
+  const ILayerPtr& Add(const Key& key, ILayerPtr layer)
+  {
+    const WDL_UINT64 hash = Hash(key);
+    const size_t bytes = static_cast<size_t>(key.w) * key.h * 4;
+    auto it = mIndex.find(hash);
+
+    if (it != mIndex.end()) // a hash collision, the newer raster replaces the older
+      Erase(it->second);
+
+    while (!mEntries.empty() && mBytes + bytes > mMaxBytes)
+      Erase(mEntries.begin());
+
+    mEntries.push_back(Entry {hash, key, std::move(layer), bytes});
+    mIndex[hash] = std::prev(mEntries.end());
+    mBytes += bytes;
+    return mEntries.back().layer;
+  }
+
+  /** @return \c true if a raster of this size would fit in the cache */
+  bool Fits(int w, int h) const { return static_cast<size_t>(w) * h * 4 <= mMaxBytes; }
+
+  /** Set the maximum total size of the bitmaps, 0 disables the cache
+   * @param maxBytes The limit in bytes */
+  void SetMaxBytes(size_t maxBytes)
+  {
+    mMaxBytes = maxBytes;
+
+    while (!mEntries.empty() && mBytes > mMaxBytes)
+      Erase(mEntries.begin());
+  }
+
+  /** @return The maximum total size of the bitmaps */
+  size_t GetMaxBytes() const { return mMaxBytes; }
+
+  /** Release all the rasters, which must happen while the drawing context exists */
+  void Clear()
+  {
+    mIndex.clear();
+    mEntries.clear();
+    mBytes = 0;
+  }
+
+private:
+  struct Entry
+  {
+    WDL_UINT64 hash;
+    Key key;
+    ILayerPtr layer;
+    size_t bytes;
+  };
+
+  void Erase(std::list<Entry>::iterator it)
+  {
+    mBytes -= it->bytes;
+    mIndex.erase(it->hash);
+    mEntries.erase(it);
+  }
+
+  static WDL_UINT64 Hash(const Key& key)
+  {
+    const IColor stroke = key.hasStroke ? key.stroke : IColor(-1, 0, 0, 0); // colors that aren't used don't affect ==
+    const IColor fill = key.hasFill ? key.fill : IColor(-1, 0, 0, 0);
+    const int values[] = { key.svgID, key.w, key.h, stroke.A, stroke.R, stroke.G, stroke.B, fill.A, fill.R, fill.G, fill.B };
+    const float scales[] = { key.screenScale, key.drawScale };
+
+    const WDL_UINT64 hash = WDL_FNV64(WDL_FNV64_IV, reinterpret_cast<const unsigned char*>(values), sizeof(values));
+    return WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(scales), sizeof(scales));
+  }
+
+  std::list<Entry> mEntries;
+  std::unordered_map<WDL_UINT64, std::list<Entry>::iterator> mIndex;
+  size_t mBytes = 0;
+  size_t mMaxBytes;
+};
+
+/** An LRU cache of text layouts, used by the drawing backends so that labels whose string and font don't change aren't measured
+ * (or shaped) again every time they are drawn. Entries are keyed by the string, the font, size and alignment of the IText, the scale
+ * and, for backends whose measurement depends on it, the position of the text
+ * @tparam T The data a backend keeps for a layout */
+template <class T>
+class ITextLayoutCache
+{
+public:
+  ITextLayoutCache(int maxEntries)
+  : mMaxEntries(std::max(1, maxEntries))
+  {}
+
+  ITextLayoutCache(const ITextLayoutCache&) = delete;
+  ITextLayoutCache& operator=(const ITextLayoutCache&) = delete;
+
+  /** @return The layout for a key, or nullptr if it isn't cached */
+  T* Find(const char* str, const IText& text, float scale = 1.f, float x = 0.f, float y = 0.f)
+  {
+    auto it = mIndex.find(Hash(str, text, scale, x, y));
+    
+    if (it == mIndex.end() || !it->second->Matches(str, text, scale, x, y))
+      return nullptr;
+
+    mEntries.splice(mEntries.end(), mEntries, it->second); // most recently used last
+    return &it->second->layout;
+  }
+
+  /** Stores a layout, releasing the least recently used one if the cache is full
+   * @return The stored layout */
+  T& Add(const char* str, const IText& text, float scale, float x, float y, T&& layout)
+  {
+    const WDL_UINT64 hash = Hash(str, text, scale, x, y);
+    auto it = mIndex.find(hash);
+
+    if (it != mIndex.end()) // a hash collision, the newer layout replaces the older
+    {
+      mEntries.erase(it->second);
+      mIndex.erase(it);
+    }
+
+    while (static_cast<int>(mEntries.size()) >= mMaxEntries)
+    {
+      mIndex.erase(mEntries.front().hash);
+      mEntries.pop_front();
+    }
+
+    mEntries.push_back(Entry {hash, str, text.mFont, text.mSize, text.mAlign, text.mVAlign, scale, x, y, std::move(layout)});
+    mIndex[hash] = std::prev(mEntries.end());
+    return mEntries.back().layout;
+  }
+
+  /** @return The number of cached layouts */
+  int GetSize() const { return static_cast<int>(mEntries.size()); }
+
+  void Clear()
+  {
+    mIndex.clear();
+    mEntries.clear();
+  }
+
+private:
+  struct Entry
+  {
+    WDL_UINT64 hash;
+    std::string str;
+    std::string font;
+    float size;
+    EAlign align;
+    EVAlign valign;
+    float scale, x, y;
+    T layout;
+
+    bool Matches(const char* otherStr, const IText& text, float otherScale, float otherX, float otherY) const
+    {
+      return size == text.mSize && align == text.mAlign && valign == text.mVAlign && scale == otherScale && x == otherX && y == otherY
+          && font == text.mFont && str == otherStr;
+    }
+  };
+
+  static WDL_UINT64 Hash(const char* str, const IText& text, float scale, float x, float y)
+  {
+    const float values[] = { text.mSize, scale, x, y };
+    const int aligns[] = { static_cast<int>(text.mAlign), static_cast<int>(text.mVAlign) };
+
+    WDL_UINT64 hash = WDL_FNV64(WDL_FNV64_IV, reinterpret_cast<const unsigned char*>(str), static_cast<int>(strlen(str)) + 1);
+    hash = WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(text.mFont), static_cast<int>(strlen(text.mFont)));
+    hash = WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(values), sizeof(values));
+    return WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(aligns), sizeof(aligns));
+  }
+
+  std::list<Entry> mEntries;
+  std::unordered_map<WDL_UINT64, typename std::list<Entry>::iterator> mIndex;
+  int mMaxEntries;
+};
+
 /** Used to specify properties of a drop-shadow to a layer. Use with IGraphics::ApplyLayerDropShadow() */
 struct IShadow
 {
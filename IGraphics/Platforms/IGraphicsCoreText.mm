@@ -130,9 +130,7 @@ void CoreTextHelpers::CachePlatformFont(const char* fontID, const PlatformFontPt
 
 CoreTextFontDescriptor* CoreTextHelpers::GetCTFontDescriptor(const IText& text, StaticStorage<CoreTextFontDescriptor>& cache)
 {
-  StaticStorage<CoreTextFontDescriptor>::Accessor storage(cache);
-  
-  CoreTextFontDescriptor* cachedFont = storage.Find(text.mFont);
+  CoreTextFontDescriptor* cachedFont = cache.Find(text.mFont);
   
   assert(cachedFont && "font not found - did you forget to load it?");
   
@@ -0,0 +1,213 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A process-wide cache of immutable assets, such as decoded samples, wavetables and impulse responses, shared by all plug-in instances
+ */
+
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "fnv64.h"
+#include "fileread.h"
+#include "heapbuf.h"
+
+#include "IPlugPlatform.h"
+#include "IPlugUtilities.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Shares immutable assets of type T between all the plug-in instances in a process, so that a session with many instances
+ * holds one copy of each and only the first instance pays for loading it. Assets are looked up by a 64 bit key, usually a hash
+ * of the content they are made from (see KeyForData()) combined with the parameters used to make them (see CombineKey()).
+ * The cache only holds weak references, an asset is freed when the last instance using it releases its std::shared_ptr.
+ * If several threads request the same missing asset, one of them creates it while the others wait for the result.
+ *
+ *     auto pIR = AssetCache<WDL_ImpulseBuffer>::Get().FindOrCreate(AssetCache<>::CombineKey(fileKey, sampleRate), [&]() {
+ *       auto pNew = std::make_shared<WDL_ImpulseBuffer>();
+ *       ... load and resample ...
+ *       return pNew;
+ *     });
+ *
+ * The cache is shared by the instances of one plug-in binary. Don't modify an asset after it has been returned by the creator
+ * @tparam T The asset type. Each type has its own cache */
+template<class T = void>
+class AssetCache
+{
+public:
+  using Key = WDL_UINT64;
+  using Creator = std::function<std::shared_ptr<T>()>;
+
+  /** @return The cache for this asset type */
+  static AssetCache& Get()
+  {
+    static AssetCache sCache;
+    return sCache;
+  }
+
+  AssetCache(const AssetCache&) = delete;
+  AssetCache& operator=(const AssetCache&) = delete;
+
+  /** Looks up an asset, creating it if no instance currently holds it. Thread safe
+   * @param key The asset's key
+   * @param create Called without the cache lock held to make the asset if it isn't cached. May return nullptr on failure, in which case nothing is cached
+   * @return The asset, or nullptr if it had to be created and that failed */
+  std::shared_ptr<const T> FindOrCreate(Key key, const Creator& create)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+      auto it = mEntries.find(key);
+      if (it == mEntries.end())
+        break;
+
+      if (auto pAsset = it->second.mAsset.lock())
+      {
+        mHits++;
+        return pAsset;
+      }
+
+      if (!it->second.mLoading)
+        break; // expired
+
+      // another thread is creating it
+      mLoaded.wait(lock);
+    }
+
+    RemoveExpired();
+    mEntries[key] = Entry {std::weak_ptr<const T>(), true};
+    lock.unlock();
+
+    std::shared_ptr<const T> pAsset = create();
+
+    lock.lock();
+    if (pAsset)
+      mEntries[key] = Entry {pAsset, false};
+    else
+      mEntries.erase(key);
+    mMisses++;
+    lock.unlock();
+
+    mLoaded.notify_all();
+    return pAsset;
+  }
+
+  /** Looks up an asset without creating it
+   * @return The asset, or nullptr if no instance currently holds it */
+  std::shared_ptr<const T> Find(Key key)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mEntries.find(key);
+    return it != mEntries.end() ? it->second.mAsset.lock() : nullptr;
+  }
+
+  /** @return The number of assets currently alive */
+  int GetNumAssets()
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int n = 0;
+    for (const auto& entry : mEntries)
+      n += !entry.second.mAsset.expired();
+    return n;
+  }
+
+  /** @return The number of requests that were served from the cache */
+  int GetHits() { std::lock_guard<std::mutex> lock(mMutex); return mHits; }
+
+  /** @return The number of requests that called the creator */
+  int GetMisses() { std::lock_guard<std::mutex> lock(mMutex); return mMisses; }
+
+  /** @return A key for a block of data, e.g. an impulse response or sample file as read from disk */
+  static Key KeyForData(const void* pData, int size, Key seed = WDL_FNV64_IV)
+  {
+    return WDL_FNV64(seed, (const unsigned char*) pData, size);
+  }
+
+  /** Hashes the content of a file, reading it in blocks
+   * @return A key for the file content, or 0 if it could not be read */
+  static Key KeyForFileContent(const char* path)
+  {
+    WDL_FileRead file(path, 0, 65536);
+    if (!file.IsOpen())
+      return 0;
+
+    WDL_HeapBuf buf;
+    unsigned char* pBuf = (unsigned char*) buf.Resize(65536, false);
+    Key key = WDL_FNV64_IV;
+    int n;
+    while ((n = file.Read(pBuf, 65536)) > 0)
+      key = KeyForData(pBuf, n, key);
+    return key;
+  }
+
+  /** A key from a file's path, size and modification time, without reading it. Use this for files that are too large to hash,
+   * such as streamed samples. Unlike a content key, it doesn't match copies of the same file at different paths
+   * @return A key for the file, or 0 if it doesn't exist */
+  static Key KeyForFileIdentity(const char* path)
+  {
+#ifdef OS_WIN
+    struct _stat64 st;
+    if (_wstat64(UTF8AsUTF16(path).Get(), &st))
+      return 0;
+#else
+    struct stat st;
+    if (stat(path, &st))
+      return 0;
+#endif
+    const WDL_INT64 identity[2] = { (WDL_INT64) st.st_size, (WDL_INT64) st.st_mtime };
+    return KeyForData(identity, sizeof(identity), KeyForData(path, (int) strlen(path)));
+  }
+
+  /** Combines a key with a parameter that changes the asset made from the same data, e.g. the sample rate that an IR is resampled to */
+  template<typename P>
+  static Key CombineKey(Key key, const P& param)
+  {
+    static_assert(std::is_trivially_copyable<P>::value, "CombineKey() hashes the bytes of the parameter");
+    return KeyForData(&param, sizeof(P), key);
+  }
+
+private:
+  struct Entry
+  {
+    std::weak_ptr<const T> mAsset;
+    bool mLoading;
+  };
+
+  AssetCache() = default;
+
+  void RemoveExpired()
+  {
+    for (auto it = mEntries.begin(); it != mEntries.end();)
+    {
+      if (!it->second.mLoading && it->second.mAsset.expired())
+        it = mEntries.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mLoaded;
+  std::unordered_map<Key, Entry> mEntries;
+  int mHits = 0;
+  int mMisses = 0;
+};
+
+END_IPLUG_NAMESPACE
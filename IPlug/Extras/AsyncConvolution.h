@@ -0,0 +1,421 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A convolution engine that prepares new impulse responses on a background thread and swaps them in without blocking
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "convoengine.h"
+
+#if defined USE_WDL_RESAMPLER
+  #include "resample.h"
+#elif defined USE_R8BRAIN
+  #include "CDSPResampler.h"
+#endif
+
+#include "IPlugPlatform.h"
+#include "IPlugQueue.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Convolves audio with an impulse response that can be replaced, or re-prepared for a new sample rate, without doing
+ * any of the work on the calling thread. A worker thread resamples the IR to the session sample rate (using WDL_Resampler
+ * if USE_WDL_RESAMPLER is defined, r8brain if USE_R8BRAIN is defined, linear interpolation otherwise), creates a new
+ * engine, which transforms the impulse partitions in SetImpulse(), and runs a few silent blocks through it so the audio
+ * thread doesn't have to grow its buffers. The audio thread takes the new engine with an atomic exchange and crossfades
+ * from the one it replaces, or switches straight to it if their latencies differ. Engines are only ever created and
+ * destroyed on the worker thread.
+ * WDL_FFT_REALSIZE must match the sample type passed to ProcessBlock(), see the IPlugConvoEngine example
+ * @tparam EngineType WDL_ConvolutionEngine_Div (zero latency) or WDL_ConvolutionEngine (latency depends on the IR) */
+template<class EngineType = WDL_ConvolutionEngine_Div>
+class AsyncConvolutionEngine
+{
+public:
+  AsyncConvolutionEngine()
+  : mRetired(kMaxRetired)
+  {
+    mThread = std::thread([this]() { Run(); });
+  }
+
+  ~AsyncConvolutionEngine()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+    mCond.notify_one();
+    mThread.join();
+
+    EngineType* pEngine;
+    while (mRetired.Pop(pEngine))
+      delete pEngine;
+
+    delete mPending.exchange(nullptr);
+    delete mCurrent;
+    delete mNext;
+  }
+
+  AsyncConvolutionEngine(const AsyncConvolutionEngine&) = delete;
+  AsyncConvolutionEngine& operator=(const AsyncConvolutionEngine&) = delete;
+
+  /** Set a new impulse response. The data is copied, preparation happens on the worker thread.
+   * Call from the main/UI thread or a file loading thread, not the audio thread
+   * @param channels Non-interleaved IR channels. If there are fewer IR channels than audio channels, they wrap around
+   * @param nChans Number of IR channels
+   * @param length Length of the IR in samples
+   * @param irSampleRate The sample rate the IR was recorded at */
+  template<typename T>
+  void LoadImpulse(const T* const* channels, int nChans, int length, double irSampleRate)
+  {
+    auto pSource = std::make_shared<WDL_ImpulseBuffer>();
+    pSource->samplerate = irSampleRate;
+    pSource->SetNumChannels(nChans, false);
+    length = pSource->SetLength(length);
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      WDL_FFT_REAL* pDest = pSource->impulses[c].Get();
+      for (auto i = 0; i < length; i++)
+        pDest[i] = static_cast<WDL_FFT_REAL>(channels[c][i]);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mSource.swap(pSource);
+      mJobPending = true;
+    }
+    mCond.notify_one();
+  }
+
+  /** Set the processing configuration. Call from OnReset(). If anything changed and an IR has been loaded, a new engine
+   * is prepared in the background, the current one keeps running (at the old rate) until it is ready
+   * @param sampleRate The session sample rate
+   * @param maxBlockSize The maximum number of frames passed to ProcessBlock()
+   * @param nChans The number of channels passed to ProcessBlock() */
+  void Prepare(double sampleRate, int maxBlockSize, int nChans)
+  {
+    mFadeLength = static_cast<int>(mCrossfadeTimeMs * 0.001 * sampleRate);
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (sampleRate == mSampleRate && maxBlockSize == mBlockSize && nChans == mNumChans)
+        return;
+
+      mSampleRate = sampleRate;
+      mBlockSize = maxBlockSize;
+      mNumChans = nChans;
+      mJobPending = mSource != nullptr;
+    }
+    mCond.notify_one();
+  }
+
+  /** @param timeMs Length of the crossfade when a new engine is swapped in. Takes effect on the next Prepare() */
+  void SetCrossfadeTime(double timeMs) { mCrossfadeTimeMs = timeMs; }
+
+  /** Clears latent samples and tails, e.g. when the transport starts. Call from the audio thread */
+  void Reset()
+  {
+    if (mCurrent) mCurrent->Reset();
+    if (mNext) mNext->Reset();
+  }
+
+  /** The latency changes when the audio thread takes an engine with a different latency, so poll this from the main thread,
+   * e.g. in OnIdle(), and report changes with SetLatency(). Any thread
+   * @return The latency of the engine in use. Always 0 with WDL_ConvolutionEngine_Div */
+  int GetLatency() const { return mLatency.load(std::memory_order_relaxed); }
+
+  /** @return \c true if an IR is loaded and running. Any thread */
+  bool IsActive() const { return mActive.load(std::memory_order_relaxed); }
+
+  /** Convolve a block. Call from the audio thread. Outputs silence (or only dry signal) until the first engine is ready
+   * @param inputs Non-interleaved input buffers
+   * @param outputs Non-interleaved output buffers, may be the same as inputs
+   * @param nChans Number of channels, should match the value passed to Prepare()
+   * @param nFrames Number of sample frames, <= the maxBlockSize passed to Prepare()
+   * @param wetGain Gain applied to the convolved signal
+   * @param dryGain Gain applied to the input signal, mixed into the output */
+  void ProcessBlock(WDL_FFT_REAL** inputs, WDL_FFT_REAL** outputs, int nChans, int nFrames, WDL_FFT_REAL wetGain = 1, WDL_FFT_REAL dryGain = 0)
+  {
+    // only take a new engine once the previous crossfade is done, the worker replaces it if another arrives meanwhile
+    if (!mNext)
+    {
+      mNext = mPending.exchange(nullptr, std::memory_order_acquire);
+      mFadePos = 0;
+
+      if (mNext)
+      {
+        mLatency.store(mNext->GetLatency(), std::memory_order_relaxed);
+        mActive.store(true, std::memory_order_relaxed);
+
+        // the outputs of engines with different latencies would be misaligned during a crossfade
+        if (mCurrent && mCurrent->GetLatency() != mNext->GetLatency())
+          SwapEngines();
+      }
+    }
+
+    if (mCurrent) mCurrent->Add(inputs, nFrames, nChans);
+    if (mNext) mNext->Add(inputs, nFrames, nChans);
+
+    // engines have taken the input, so outputs may now overwrite it
+    for (auto c = 0; c < nChans; c++)
+    {
+      for (auto i = 0; i < nFrames; i++)
+        outputs[c][i] = inputs[c][i] * dryGain;
+    }
+
+    if (mCurrent) Accumulate(*mCurrent, outputs, nChans, nFrames, wetGain, false);
+
+    if (mNext)
+    {
+      Accumulate(*mNext, outputs, nChans, nFrames, wetGain, true);
+
+      mFadePos += nFrames;
+      if (mFadePos >= mFadeLength)
+        SwapEngines();
+    }
+  }
+
+private:
+  /** Replaces the current engine with the next one, the old one is deleted on the worker thread */
+  void SwapEngines()
+  {
+    if (mCurrent)
+      mRetired.Push(mCurrent); // can't fail, there are never more than kMaxRetired engines in existence
+
+    mCurrent = mNext;
+    mNext = nullptr;
+  }
+
+  /** Mixes the engine's output into outputs. The output of an engine with latency starts late in the first blocks */
+  void Accumulate(EngineType& engine, WDL_FFT_REAL** outputs, int nChans, int nFrames, WDL_FFT_REAL wetGain, bool fadeIn)
+  {
+    const int avail = std::min(engine.Avail(nFrames), nFrames);
+    if (avail <= 0)
+      return;
+
+    const int offset = nFrames - avail;
+    WDL_FFT_REAL** wet = engine.Get();
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      WDL_FFT_REAL* pOut = outputs[c] + offset;
+
+      for (auto i = 0; i < avail; i++)
+      {
+        WDL_FFT_REAL gain = wetGain;
+
+        if (mNext)
+        {
+          const int pos = mFadePos + offset + i;
+          const WDL_FFT_REAL fade = pos < mFadeLength ? static_cast<WDL_FFT_REAL>(pos) / mFadeLength : WDL_FFT_REAL(1);
+          gain *= fadeIn ? fade : WDL_FFT_REAL(1) - fade;
+        }
+
+        pOut[i] += wet[c][i] * gain;
+      }
+    }
+
+    engine.Advance(avail);
+  }
+
+  void Run()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mQuit)
+    {
+      // wake up periodically to delete engines the audio thread has finished with
+      mCond.wait_for(lock, std::chrono::milliseconds(100), [this]() { return mQuit || mJobPending; });
+
+      EngineType* pEngine;
+      while (mRetired.Pop(pEngine))
+        delete pEngine;
+
+      if (mQuit || !mJobPending || mSampleRate <= 0.)
+        continue;
+
+      mJobPending = false;
+      std::shared_ptr<WDL_ImpulseBuffer> pSource = mSource;
+      const double sampleRate = mSampleRate;
+      const int blockSize = mBlockSize;
+      const int nChans = mNumChans;
+
+      lock.unlock();
+      pEngine = CreateEngine(*pSource, sampleRate, blockSize, nChans);
+      lock.lock();
+
+      // if a newer request came in meanwhile, don't bother swapping this one in
+      if (mJobPending)
+        delete pEngine;
+      else
+        delete mPending.exchange(pEngine, std::memory_order_acq_rel); // replaces any engine the audio thread hasn't taken yet
+    }
+  }
+
+  static EngineType* CreateEngine(WDL_ImpulseBuffer& source, double sampleRate, int blockSize, int nChans)
+  {
+    WDL_ImpulseBuffer impulse;
+    const int srcLength = source.GetLength();
+    const int nIRChans = source.GetNumChannels();
+
+    impulse.samplerate = sampleRate;
+    impulse.SetNumChannels(nIRChans, false);
+    const int length = impulse.SetLength(ResampleLength(srcLength, source.samplerate, sampleRate));
+
+    if (length)
+    {
+      for (auto c = 0; c < nIRChans; c++)
+        Resample(source.impulses[c].Get(), srcLength, source.samplerate, impulse.impulses[c].Get(), length, sampleRate);
+    }
+
+    EngineType* pEngine = new EngineType;
+    pEngine->SetImpulse(&impulse);
+
+    // run some silence through so the queues and channel states are allocated here, rather than on the audio thread
+    blockSize = std::max(blockSize, 1);
+    nChans = std::max(nChans, 1);
+    WDL_TypedBuf<WDL_FFT_REAL> silence;
+    WDL_TypedBuf<WDL_FFT_REAL*> ptrs;
+    memset(silence.Resize(blockSize), 0, blockSize * sizeof(WDL_FFT_REAL));
+    ptrs.Resize(nChans);
+    for (auto c = 0; c < nChans; c++)
+      ptrs.Get()[c] = silence.Get();
+
+    for (auto i = 0; i < 4; i++)
+    {
+      pEngine->Add(ptrs.Get(), blockSize, nChans);
+      pEngine->Avail(blockSize);
+      pEngine->Get();
+      pEngine->Advance(std::min(pEngine->Avail(blockSize), blockSize));
+    }
+    pEngine->Reset();
+
+    return pEngine;
+  }
+
+  static int ResampleLength(int srcLength, double srcRate, double destRate)
+  {
+    return int(destRate / srcRate * (double) srcLength + 0.5);
+  }
+
+  static void Resample(const WDL_FFT_REAL* pSrc, int srcLength, double srcRate, WDL_FFT_REAL* pDest, int destLength, double destRate)
+  {
+    if (destLength == srcLength)
+    {
+      memcpy(pDest, pSrc, destLength * sizeof(WDL_FFT_REAL));
+      return;
+    }
+
+    // scale so the IR keeps its gain at the new rate
+    const double scale = srcRate / destRate;
+
+#if defined USE_WDL_RESAMPLER
+    WDL_Resampler resampler;
+    resampler.SetMode(false, 0, true); // Sinc, default size
+    resampler.SetFeedMode(true); // Input driven
+    resampler.SetRates(srcRate, destRate);
+
+    while (destLength > 0)
+    {
+      WDL_ResampleSample* p;
+      int n = resampler.ResamplePrepare(kBlockLength, 1, &p), m = n;
+      if (n > srcLength) n = srcLength;
+      for (int i = 0; i < n; ++i) *p++ = (WDL_ResampleSample) *pSrc++;
+      if (n < m) memset(p, 0, (m - n) * sizeof(WDL_ResampleSample));
+      srcLength -= n;
+
+      WDL_ResampleSample buf[kBlockLength];
+      n = resampler.ResampleOut(buf, m, m, 1);
+      if (n > destLength) n = destLength;
+      p = buf;
+      for (int i = 0; i < n; ++i) *pDest++ = (WDL_FFT_REAL) (scale * *p++);
+      destLength -= n;
+    }
+#elif defined USE_R8BRAIN
+    r8b::CDSPResampler16IR resampler(srcRate, destRate, kBlockLength);
+
+    while (destLength > 0)
+    {
+      double buf[kBlockLength], *p = buf;
+      int n = kBlockLength;
+      if (n > srcLength) n = srcLength;
+      for (int i = 0; i < n; ++i) *p++ = (double) *pSrc++;
+      if (n < kBlockLength) memset(p, 0, (kBlockLength - n) * sizeof(double));
+      srcLength -= n;
+
+      n = resampler.process(buf, kBlockLength, p);
+      if (n > destLength) n = destLength;
+      for (int i = 0; i < n; ++i) *pDest++ = (WDL_FFT_REAL) (scale * *p++);
+      destLength -= n;
+    }
+#else
+    double pos = 0.;
+    for (int i = 0; i < destLength; ++i)
+    {
+      int idx = int(pos);
+      if (idx < srcLength)
+      {
+        const double frac = pos - idx;
+        double interp = (1. - frac) * pSrc[idx];
+        if (++idx < srcLength) interp += frac * pSrc[idx];
+        *pDest++ = (WDL_FFT_REAL) (scale * interp);
+      }
+      else
+      {
+        *pDest++ = 0;
+      }
+      pos += scale;
+    }
+#endif
+  }
+
+  static constexpr int kBlockLength = 256;
+  static constexpr int kMaxRetired = 8;
+
+  // audio thread
+  EngineType* mCurrent = nullptr;
+  EngineType* mNext = nullptr;
+  int mFadePos = 0;
+  int mFadeLength = 0;
+  double mCrossfadeTimeMs = 20.;
+
+  // written by the audio thread, read by any thread
+  std::atomic<int> mLatency {0};
+  std::atomic<bool> mActive {false};
+
+  // audio thread <-> worker
+  std::atomic<EngineType*> mPending {nullptr};
+  IPlugQueue<EngineType*> mRetired;
+
+  // guarded by mMutex
+  std::shared_ptr<WDL_ImpulseBuffer> mSource;
+  double mSampleRate = 0.;
+  int mBlockSize = 0;
+  int mNumChans = 0;
+  bool mJobPending = false;
+  bool mQuit = false;
+
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  std::thread mThread;
+};
+
+END_IPLUG_NAMESPACE
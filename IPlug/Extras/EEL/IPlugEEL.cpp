@@ -0,0 +1,652 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+/**
+ * @file
+ * @copydoc IPlugEEL
+ */
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "IPlugEEL.h"
+#include "IPlugLogger.h"
+
+#include "fileread.h"
+
+using namespace iplug;
+
+#ifndef EEL_NO_HOSTSTUBS
+// EEL2 calls these around access to shared state. Every program has its own gmem, so they are only hit when compiling and freeing, never while the audio thread runs a program
+static WDL_Mutex sEELMutex;
+
+void NSEEL_HOSTSTUB_EnterMutex() { sEELMutex.Enter(); }
+void NSEEL_HOSTSTUB_LeaveMutex() { sEELMutex.Leave(); }
+#endif
+
+IPlugEEL::Slider::Slider(const Slider& other)
+: mVarName(other.mVarName)
+, mLabel(other.mLabel)
+, mDefault(other.mDefault)
+, mMin(other.mMin)
+, mMax(other.mMax)
+, mStep(other.mStep)
+, mHidden(other.mHidden)
+{
+  for (auto i = 0; i < other.mEnumNames.GetSize(); i++)
+  {
+    mEnumNames.Add(strdup(other.mEnumNames.Get(i)));
+  }
+}
+
+IPlugEEL::Program::Program()
+{
+  mVM = NSEEL_VM_alloc();
+
+  if (mVM)
+    NSEEL_VM_SetGRAM(mVM, &mGRAM);
+}
+
+IPlugEEL::Program::~Program()
+{
+  for (auto pCode : {mInit, mSlider, mBlock, mSample})
+  {
+    if (pCode)
+      NSEEL_code_free(pCode);
+  }
+
+  if (mVM)
+    NSEEL_VM_free(mVM);
+
+  NSEEL_VM_FreeGRAM(&mGRAM);
+}
+
+IPlugEEL::IPlugEEL(const char* name)
+{
+  static bool sInitialized = false;
+
+  if (!sInitialized)
+  {
+    NSEEL_init();
+    sInitialized = true;
+  }
+
+  mName.Set(name);
+
+  for (auto& value : mSliderValues)
+  {
+    value = 0.;
+  }
+}
+
+IPlugEEL::~IPlugEEL()
+{
+  WaitForCompile();
+
+  delete mProgram;
+  delete mPendingProgram.exchange(nullptr);
+  delete mRetiredProgram.exchange(nullptr);
+
+  mSliders.Empty(true);
+  mCompiledSliders.Empty(true);
+}
+
+bool IPlugEEL::CompileAsync(const char* script)
+{
+  if (mCompiling)
+    return false;
+
+  WaitForCompile();
+  TakeCompiledSliders(); // the compile thread compares the new sliders with mSliders, so they must be up to date
+
+  mScript.Set(script);
+  mCompiling = true;
+  mCompileThread = std::thread(&IPlugEEL::CompileThreadProc, this);
+  return true;
+}
+
+bool IPlugEEL::LoadFile(const char* path)
+{
+  WDL_FileRead file(path);
+
+  if (!file.IsOpen())
+  {
+    DBGMSG("IPlugEEL-%s: Could not open %s\n", mName.Get(), path);
+    return false;
+  }
+
+  std::vector<char> buffer(static_cast<size_t>(file.GetSize()) + 1);
+  file.Read(buffer.data(), static_cast<int>(file.GetSize()));
+  buffer.back() = '\0';
+
+  return CompileAsync(buffer.data());
+}
+
+void IPlugEEL::GetError(WDL_String& str)
+{
+  WDL_MutexLock lock(&mResultMutex);
+  str.Set(mError.Get());
+}
+
+void IPlugEEL::CompileThreadProc()
+{
+  WDL_PtrList<Slider> sliders;
+  WDL_String error;
+  Program* pProgram = Compile(mScript.Get(), sliders, error);
+
+  bool layoutChanged = false;
+
+  if (pProgram)
+  {
+    layoutChanged = !pProgram->mKeepSliderValues;
+
+    // a program that was never picked up is replaced, the audio thread only ever takes it with exchange()
+    delete mPendingProgram.exchange(pProgram);
+  }
+  else
+  {
+    DBGMSG("IPlugEEL-%s: %s\n", mName.Get(), error.Get());
+  }
+
+  {
+    WDL_MutexLock lock(&mResultMutex);
+    mError.Set(error.Get());
+
+    if (pProgram)
+    {
+      mCompiledSliders.Empty(true);
+
+      for (auto i = 0; i < sliders.GetSize(); i++)
+      {
+        mCompiledSliders.Add(sliders.Get(i));
+      }
+
+      sliders.Empty(false);
+      mSlidersCompiled = true;
+      mSlidersChangedLayout = layoutChanged;
+    }
+  }
+
+  sliders.Empty(true);
+  mCompiling = false;
+}
+
+int IPlugEEL::ParseSliderLine(const char* line, Slider& slider)
+{
+  if (strncmp(line, "slider", 6) != 0)
+    return -1;
+
+  char* pEnd = nullptr;
+  const long idx = strtol(line + 6, &pEnd, 10);
+
+  if (pEnd == line + 6 || *pEnd != ':' || idx < 1 || idx > EEL_MAX_SLIDERS)
+    return -1;
+
+  const char* p = pEnd + 1;
+
+  if (*p == '/')
+    return -1; // file sliders are not supported
+
+  // optional variable name
+  const char* pEquals = strchr(p, '=');
+  const char* pLess = strchr(p, '<');
+
+  if (pEquals && (!pLess || pEquals < pLess))
+  {
+    WDL_String name;
+    name.Set(p, static_cast<int>(pEquals - p));
+
+    while (name.GetLength() && isspace(static_cast<unsigned char>(name.Get()[name.GetLength() - 1])))
+      name.SetLen(name.GetLength() - 1);
+
+    slider.mVarName.Set(name.Get());
+    p = pEquals + 1;
+  }
+  else
+  {
+    slider.mVarName.SetFormatted(16, "slider%ld", idx);
+  }
+
+  slider.mDefault = strtod(p, nullptr);
+
+  if (!pLess)
+    return -1;
+
+  p = pLess + 1;
+
+  // <min,max,step{enum,names}>, each field optional
+  slider.mMin = strtod(p, &pEnd);
+  p = pEnd;
+
+  if (*p == ',')
+  {
+    slider.mMax = strtod(p + 1, &pEnd);
+    p = pEnd;
+  }
+
+  if (*p == ',')
+  {
+    slider.mStep = strtod(p + 1, &pEnd);
+    p = pEnd;
+  }
+
+  const char* pClose = strchr(p, '>');
+
+  if (!pClose)
+    return -1;
+
+  const char* pBrace = strchr(p, '{');
+
+  if (pBrace && pBrace < pClose)
+  {
+    const char* pName = pBrace + 1;
+
+    while (pName < pClose)
+    {
+      const char* pNext = pName;
+
+      while (pNext < pClose && *pNext != ',' && *pNext != '}')
+        pNext++;
+
+      WDL_String name;
+      name.Set(pName, static_cast<int>(pNext - pName));
+      slider.mEnumNames.Add(strdup(name.Get()));
+
+      if (*pNext != ',')
+        break;
+
+      pName = pNext + 1;
+    }
+  }
+
+  p = pClose + 1;
+
+  if (*p == '-')
+  {
+    slider.mHidden = true;
+    p++;
+  }
+
+  slider.mLabel.Set(p);
+
+  while (slider.mLabel.GetLength() && isspace(static_cast<unsigned char>(slider.mLabel.Get()[slider.mLabel.GetLength() - 1])))
+    slider.mLabel.SetLen(slider.mLabel.GetLength() - 1);
+
+  return static_cast<int>(idx - 1);
+}
+
+IPlugEEL::Program* IPlugEEL::Compile(const char* script, WDL_PtrList<Slider>& sliders, WDL_String& error)
+{
+  enum ESection { kHeader = -1, kInit = 0, kSlider, kBlock, kSample, kIgnored, kNumSections = kIgnored };
+
+  WDL_FastString code[kNumSections];
+  int firstLine[kNumSections] = {};
+  int section = kHeader;
+  int lineNumber = 0;
+
+  const char* pLine = script;
+
+  while (*pLine)
+  {
+    const char* pEOL = pLine;
+
+    while (*pEOL && *pEOL != '\n')
+      pEOL++;
+
+    WDL_String line;
+    line.Set(pLine, static_cast<int>(pEOL - pLine));
+
+    if (line.GetLength() && line.Get()[line.GetLength() - 1] == '\r')
+      line.SetLen(line.GetLength() - 1);
+
+    if (line.Get()[0] == '@')
+    {
+      const char* pName = line.Get() + 1;
+      auto isSection = [pName](const char* name) {
+        const size_t len = strlen(name);
+        return strncmp(pName, name, len) == 0 && (pName[len] == '\0' || isspace(static_cast<unsigned char>(pName[len])));
+      };
+
+      if (isSection("init")) section = kInit;
+      else if (isSection("slider")) section = kSlider;
+      else if (isSection("block")) section = kBlock;
+      else if (isSection("sample")) section = kSample;
+      else section = kIgnored; // @gfx, @serialize...
+
+      if (section < kNumSections)
+        firstLine[section] = lineNumber + 1;
+    }
+    else if (section == kHeader)
+    {
+      Slider* pSlider = new Slider;
+      const int idx = ParseSliderLine(line.Get(), *pSlider);
+
+      if (idx >= 0)
+      {
+        while (sliders.GetSize() <= idx)
+          sliders.Add(nullptr);
+
+        delete sliders.Get(idx);
+        sliders.Set(idx, pSlider);
+      }
+      else
+      {
+        delete pSlider;
+      }
+    }
+    else if (section < kNumSections)
+    {
+      code[section].Append(line.Get());
+      code[section].Append("\n");
+    }
+
+    lineNumber++;
+    pLine = *pEOL ? pEOL + 1 : pEOL;
+  }
+
+  Program* pProgram = new Program;
+
+  if (!pProgram->mVM)
+  {
+    error.Set("Could not allocate the EEL2 VM");
+    delete pProgram;
+    return nullptr;
+  }
+
+  pProgram->mSRate = NSEEL_VM_regvar(pProgram->mVM, "srate");
+  pProgram->mNumCh = NSEEL_VM_regvar(pProgram->mVM, "num_ch");
+  pProgram->mSamplesBlock = NSEEL_VM_regvar(pProgram->mVM, "samplesblock");
+
+  char name[32];
+
+  for (auto c = 0; c < EEL_MAX_CHANNELS; c++)
+  {
+    snprintf(name, sizeof(name), "spl%d", c);
+    pProgram->mSpl[c] = NSEEL_VM_regvar(pProgram->mVM, name);
+  }
+
+  for (auto s = 0; s < EEL_MAX_SLIDERS; s++)
+  {
+    snprintf(name, sizeof(name), "slider%d", s + 1);
+    pProgram->mSliderVars[s] = NSEEL_VM_regvar(pProgram->mVM, name);
+  }
+
+  pProgram->mNSliders = sliders.GetSize();
+
+  for (auto s = 0; s < sliders.GetSize(); s++)
+  {
+    const Slider* pSlider = sliders.Get(s);
+
+    if (!pSlider)
+      continue;
+
+    pProgram->mDefaults[s] = pSlider->mDefault;
+    snprintf(name, sizeof(name), "slider%d", s + 1);
+
+    if (strcmp(pSlider->mVarName.Get(), name) != 0)
+      pProgram->mNamedSliderVars[s] = NSEEL_VM_regvar(pProgram->mVM, pSlider->mVarName.Get());
+  }
+
+  NSEEL_CODEHANDLE* handles[kNumSections] = {&pProgram->mInit, &pProgram->mSlider, &pProgram->mBlock, &pProgram->mSample};
+  const char* sectionNames[kNumSections] = {"@init", "@slider", "@block", "@sample"};
+
+  for (auto s = 0; s < kNumSections; s++)
+  {
+    if (!code[s].GetLength())
+      continue;
+
+    // @init declares the functions the other sections use
+    const int flags = s == kInit ? NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS | NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS_RESET : NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS;
+    *handles[s] = NSEEL_code_compile_ex(pProgram->mVM, code[s].Get(), firstLine[s], flags);
+
+    if (!*handles[s])
+    {
+      const char* pError = NSEEL_code_getcodeerror(pProgram->mVM);
+      error.SetFormatted(1024, "%s: %s", sectionNames[s], pError ? pError : "compile error");
+      delete pProgram;
+      return nullptr;
+    }
+  }
+
+  // same sliders with the same ranges as the running script, so the user's settings survive an edit of the code
+  bool sameSliders = sliders.GetSize() == mSliders.GetSize();
+
+  for (auto s = 0; sameSliders && s < sliders.GetSize(); s++)
+  {
+    const Slider* pNew = sliders.Get(s);
+    const Slider* pOld = mSliders.Get(s);
+
+    if (!pNew || !pOld)
+      sameSliders = pNew == pOld;
+    else
+      sameSliders = strcmp(pNew->mVarName.Get(), pOld->mVarName.Get()) == 0 && pNew->mMin == pOld->mMin && pNew->mMax == pOld->mMax
+                    && pNew->mEnumNames.GetSize() == pOld->mEnumNames.GetSize();
+  }
+
+  pProgram->mKeepSliderValues = sameSliders && mSliders.GetSize() > 0;
+
+  error.Set("");
+  return pProgram;
+}
+
+void IPlugEEL::OnIdle()
+{
+  delete mRetiredProgram.exchange(nullptr);
+
+  if (!mCompiling)
+    TakeCompiledSliders();
+}
+
+void IPlugEEL::TakeCompiledSliders()
+{
+  bool layoutChanged = false;
+
+  {
+    WDL_MutexLock lock(&mResultMutex);
+
+    if (!mSlidersCompiled)
+      return;
+
+    mSliders.Empty(true);
+
+    for (auto i = 0; i < mCompiledSliders.GetSize(); i++)
+    {
+      mSliders.Add(mCompiledSliders.Get(i));
+    }
+
+    mCompiledSliders.Empty(false);
+    mSlidersCompiled = false;
+    layoutChanged = mSlidersChangedLayout;
+  }
+
+  if (layoutChanged)
+    UpdateIPlugParameters();
+}
+
+void IPlugEEL::SetSampleRate(double sampleRate)
+{
+  mSampleRate = sampleRate;
+  mResetRequested = true;
+}
+
+void IPlugEEL::SetSliderValue(int sliderIdx, double value)
+{
+  if (sliderIdx < 0 || sliderIdx >= EEL_MAX_SLIDERS)
+    return;
+
+  mSliderValues[sliderIdx].store(value, std::memory_order_relaxed);
+  mSlidersChanged = true;
+}
+
+void IPlugEEL::CreateIPlugParameters(IPlugAPIBase* pPlug, int startIdx, int nParams)
+{
+  assert(pPlug != nullptr);
+  assert(startIdx + nParams <= pPlug->NParams()); // plugin needs to have enough params!
+
+  mPlug = pPlug;
+  mParamStartIdx = startIdx;
+  mNParams = nParams;
+
+  UpdateIPlugParameters();
+}
+
+void IPlugEEL::UpdateIPlugParameters()
+{
+  if (!mPlug)
+    return;
+
+  for (auto p = 0; p < mNParams; p++)
+  {
+    const Slider* pSlider = p < mSliders.GetSize() ? mSliders.Get(p) : nullptr;
+    IParam param;
+
+    if (!pSlider)
+    {
+      param.InitDouble("Unused", 0., 0., 1., 0.01, "", IParam::kFlagCannotAutomate);
+    }
+    else if (pSlider->mEnumNames.GetSize() && pSlider->mMin == 0.)
+    {
+      param.InitEnum(pSlider->mLabel.Get(), static_cast<int>(pSlider->mDefault), pSlider->mEnumNames.GetSize());
+
+      for (auto e = 0; e < pSlider->mEnumNames.GetSize(); e++)
+      {
+        param.SetDisplayText(e, pSlider->mEnumNames.Get(e));
+      }
+    }
+    else
+    {
+      const int flags = pSlider->mStep > 0. ? IParam::kFlagStepped : 0;
+      param.InitDouble(pSlider->mLabel.Get(), pSlider->mDefault, pSlider->mMin, pSlider->mMax, pSlider->mStep > 0. ? pSlider->mStep : 0.001, "", flags);
+    }
+
+    IParam* pPlugParam = mPlug->GetParam(mParamStartIdx + p);
+    pPlugParam->Init(param);
+    pPlugParam->SetToDefault();
+  }
+
+  mPlug->InformHostOfParameterDetailsChange();
+  mPlug->OnParamReset(EParamSource::kRecompile);
+}
+
+void IPlugEEL::InitProgram(Program* pProgram)
+{
+  *pProgram->mSRate = mSampleRate.load();
+
+  if (pProgram->mInit)
+    NSEEL_code_execute(pProgram->mInit);
+}
+
+void IPlugEEL::UpdateSliders(Program* pProgram)
+{
+  for (auto s = 0; s < pProgram->mNSliders; s++)
+  {
+    const double value = mSliderValues[s].load(std::memory_order_relaxed);
+    *pProgram->mSliderVars[s] = value;
+
+    if (pProgram->mNamedSliderVars[s])
+      *pProgram->mNamedSliderVars[s] = value;
+  }
+
+  if (pProgram->mSlider)
+    NSEEL_code_execute(pProgram->mSlider);
+}
+
+void IPlugEEL::PassThrough(sample** inputs, sample** outputs, int nFrames, int nInChans, int nOutChans)
+{
+  for (auto c = 0; c < nOutChans; c++)
+  {
+    if (c < nInChans)
+    {
+      if (outputs[c] != inputs[c])
+        memcpy(outputs[c], inputs[c], nFrames * sizeof(sample));
+    }
+    else
+      memset(outputs[c], 0, nFrames * sizeof(sample));
+  }
+}
+
+void IPlugEEL::ProcessBlock(sample** inputs, sample** outputs, int nFrames, int nInChans, int nOutChans)
+{
+  // the previous swap must have been cleaned up by OnIdle(), which is the only place programs are freed
+  if (!mRetiredProgram.load())
+  {
+    Program* pNew = mPendingProgram.exchange(nullptr);
+
+    if (pNew)
+    {
+      if (!pNew->mKeepSliderValues)
+      {
+        for (auto s = 0; s < pNew->mNSliders; s++)
+        {
+          mSliderValues[s].store(pNew->mDefaults[s], std::memory_order_relaxed);
+        }
+      }
+
+      mRetiredProgram = mProgram;
+      mProgram = pNew;
+      mResetRequested = false;
+      InitProgram(mProgram);
+      mSlidersChanged = false;
+      UpdateSliders(mProgram);
+    }
+  }
+
+  Program* pProgram = mProgram;
+
+  if (!pProgram)
+  {
+    PassThrough(inputs, outputs, nFrames, nInChans, nOutChans);
+    return;
+  }
+
+  if (mResetRequested.exchange(false))
+  {
+    InitProgram(pProgram);
+    mSlidersChanged = false;
+    UpdateSliders(pProgram);
+  }
+  else if (mSlidersChanged.exchange(false))
+  {
+    UpdateSliders(pProgram);
+  }
+
+  nInChans = std::min(nInChans, EEL_MAX_CHANNELS);
+  nOutChans = std::min(nOutChans, EEL_MAX_CHANNELS);
+  const int nChans = std::max(nInChans, nOutChans);
+
+  *pProgram->mNumCh = nChans;
+  *pProgram->mSamplesBlock = nFrames;
+
+  if (pProgram->mBlock)
+    NSEEL_code_execute(pProgram->mBlock);
+
+  if (!pProgram->mSample)
+  {
+    PassThrough(inputs, outputs, nFrames, nInChans, nOutChans);
+    return;
+  }
+
+  EEL_F** spl = pProgram->mSpl;
+
+  for (auto s = 0; s < nFrames; s++)
+  {
+    for (auto c = 0; c < nInChans; c++)
+      *spl[c] = inputs[c][s];
+
+    for (auto c = nInChans; c < nChans; c++)
+      *spl[c] = 0.;
+
+    NSEEL_code_execute(pProgram->mSample);
+
+    for (auto c = 0; c < nOutChans; c++)
+      outputs[c][s] = static_cast<sample>(*spl[c]);
+  }
+}
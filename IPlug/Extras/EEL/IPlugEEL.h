@@ -0,0 +1,201 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief An EEL2 scripted DSP node, which runs JSFX-style scripts JIT compiled by WDL's EEL2 compiler
+ * Add IPlugEEL.cpp to your project along with the EEL2 sources in WDL/eel2: nseel-caltab.c, nseel-compiler.c, nseel-eval.c,
+ * nseel-lextab.c, nseel-ram.c, nseel-yylex.c and nseel-cfunc.c, plus asm-nseel-x64-sse.asm (assembled with nasm) or
+ * asm-nseel-x64-macho.o / asm-nseel-multi-macho.o on x86-64. Define EEL_TARGET_PORTABLE to use the (slower) portable interpreter instead.
+ * IPlugEEL.cpp implements the NSEEL_HOSTSTUB_ mutex functions that EEL2 requires, define EEL_NO_HOSTSTUBS if your project already does
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "IPlugPlatform.h"
+#include "IPlugConstants.h"
+#include "IPlugAPIBase.h"
+
+#include "eel2/ns-eel.h"
+#include "mutex.h"
+#include "wdlstring.h"
+#include "ptrlist.h"
+
+#define EEL_MAX_SLIDERS 64
+#define EEL_MAX_CHANNELS 64
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Compiles and runs JSFX-style EEL2 scripts, so that DSP can be prototyped at JIT speed without rebuilding the plug-in.
+ * A script has a header of slider definitions followed by @init, @slider, @block and @sample sections, e.g.
+ *
+ *     slider1:gain_db=0<-60,12,0.1>Gain (dB)
+ *     slider2:0<0,2,1{Off,Soft,Hard}>Clip
+ *     @slider
+ *     gain = 10^(gain_db/20);
+ *     @sample
+ *     spl0 *= gain;
+ *     spl1 *= gain;
+ *
+ * Scripts are compiled on a background thread and swapped in at the start of the next block, so the audio never stops.
+ * The variables srate, num_ch, samplesblock, spl0-spl63 and slider1-slider64 are available as in JSFX.
+ * Sliders can be mapped to a range of the plug-in's IParams with CreateIPlugParameters(). */
+class IPlugEEL
+{
+public:
+  /** A slider declared in the script header */
+  struct Slider
+  {
+    WDL_String mVarName; // variable the slider writes to, sliderN unless it is named in the header
+    WDL_String mLabel;
+    double mDefault = 0.;
+    double mMin = 0.;
+    double mMax = 1.;
+    double mStep = 0.;
+    bool mHidden = false; // label starts with '-'
+    WDL_PtrList<char> mEnumNames; // for sliders declared with {a,b,c}
+
+    Slider() = default;
+    Slider(const Slider& other);
+    Slider& operator=(const Slider& other) = delete;
+    ~Slider() { mEnumNames.Empty(true, free); }
+  };
+
+  IPlugEEL(const char* name);
+  ~IPlugEEL();
+
+  IPlugEEL(const IPlugEEL&) = delete;
+  IPlugEEL& operator=(const IPlugEEL&) = delete;
+
+  /** Starts compiling a script on a background thread. When it is done, the new script replaces the running one at the start of the next ProcessBlock()
+   * Call on the main thread
+   * @param script The script text, which is copied
+   * @return \c false if a previous compile is still running */
+  bool CompileAsync(const char* script);
+
+  /** Reads a script file and starts compiling it, see CompileAsync()
+   * @return \c false if the file could not be read or a previous compile is still running */
+  bool LoadFile(const char* path);
+
+  /** @return \c true while a background compile is running */
+  bool IsCompiling() const { return mCompiling; }
+
+  /** Blocks until the background compile, if any, has finished */
+  void WaitForCompile() { if (mCompileThread.joinable()) mCompileThread.join(); }
+
+  /** @param str Set to the error of the last compile, empty if it succeeded */
+  void GetError(WDL_String& str);
+
+  /** Call on the main thread regularly, e.g. from IPlugAPIBase::OnIdle(). Frees scripts that have been replaced and, if a new script declares different sliders, updates the linked IParams */
+  void OnIdle();
+
+  /** Call when the sample rate changes, e.g. from OnReset(). The running script's @init is executed again at the start of the next block */
+  void SetSampleRate(double sampleRate);
+
+  /** Realtime safe. The value is picked up by the script's @slider section at the start of the next block
+   * @param sliderIdx Zero based, slider1 is index 0
+   * @param value The non-normalized slider value */
+  void SetSliderValue(int sliderIdx, double value);
+
+  /** Links script sliders to a range of the plug-in's parameters, which the plug-in must have created beforehand. Parameters without a slider are labelled as unused.
+   * Whenever a new script is installed the parameters are reinitialised from its sliders, and the host is informed.
+   * Forward the parameter changes in OnParamChange() with SetSliderValue(paramIdx - startIdx, GetParam(paramIdx)->Value())
+   * @param pPlug The plug-in
+   * @param startIdx The first parameter index to use
+   * @param nParams The number of parameters reserved for sliders */
+  void CreateIPlugParameters(IPlugAPIBase* pPlug, int startIdx, int nParams);
+
+  /** @return The number of sliders the current script declares, main thread only */
+  int NSliders() const { return mSliders.GetSize(); }
+
+  /** @return A slider declared by the current script, or nullptr if the script skips its number. Main thread only */
+  const Slider* GetSlider(int sliderIdx) const { return mSliders.Get(sliderIdx); }
+
+  /** Runs the script's @block section and then its @sample section for every frame. Without a script, the inputs are copied to the outputs
+   * @param nInChans The number of valid input channels, which are loaded to spl0... before each sample
+   * @param nOutChans The number of output channels, which are read from spl0... after each sample. May be more or less than nInChans */
+  void ProcessBlock(sample** inputs, sample** outputs, int nFrames, int nInChans, int nOutChans);
+
+private:
+  /** A compiled script with its VM. Created on the compile thread, run on the audio thread and freed on the main thread */
+  struct Program
+  {
+    Program();
+    ~Program();
+
+    NSEEL_VMCTX mVM = nullptr;
+    void* mGRAM = nullptr; // gmem[], private to the program so that the VM never shares state with other threads
+    NSEEL_CODEHANDLE mInit = nullptr;
+    NSEEL_CODEHANDLE mSlider = nullptr;
+    NSEEL_CODEHANDLE mBlock = nullptr;
+    NSEEL_CODEHANDLE mSample = nullptr;
+    EEL_F* mSRate = nullptr;
+    EEL_F* mNumCh = nullptr;
+    EEL_F* mSamplesBlock = nullptr;
+    EEL_F* mSpl[EEL_MAX_CHANNELS] = {};
+    EEL_F* mSliderVars[EEL_MAX_SLIDERS] = {}; // sliderN
+    EEL_F* mNamedSliderVars[EEL_MAX_SLIDERS] = {}; // variables named in the header, null if not named
+    double mDefaults[EEL_MAX_SLIDERS] = {};
+    int mNSliders = 0;
+    bool mKeepSliderValues = false; // the sliders are the same as the previous script's, so their current values carry over
+  };
+
+  void CompileThreadProc();
+
+  /** Parses the slider definitions and sections of a script, and compiles them into a new program
+   * @return The program, or nullptr on failure, in which case error is set */
+  Program* Compile(const char* script, WDL_PtrList<Slider>& sliders, WDL_String& error);
+
+  /** Parses a line such as "slider1:name=0<0,1,0.1{a,b}>Label"
+   * @return The zero based slider index, or -1 if the line is not a slider definition */
+  static int ParseSliderLine(const char* line, Slider& slider);
+
+  /** Called on the audio thread */
+  void UpdateSliders(Program* pProgram);
+  void InitProgram(Program* pProgram);
+  static void PassThrough(sample** inputs, sample** outputs, int nFrames, int nInChans, int nOutChans);
+
+  /** Called on the main thread */
+  void TakeCompiledSliders();
+  void UpdateIPlugParameters();
+
+private:
+  WDL_String mName;
+  WDL_FastString mScript; // main thread, handed to the compile thread
+  std::thread mCompileThread;
+  std::atomic<bool> mCompiling {false};
+
+  WDL_Mutex mResultMutex; // protects mError and mCompiledSliders, written by the compile thread
+  WDL_String mError;
+  WDL_PtrList<Slider> mCompiledSliders;
+  bool mSlidersCompiled = false; // mCompiledSliders holds the sliders of a new script
+  bool mSlidersChangedLayout = false; // and they differ from mSliders
+
+  WDL_PtrList<Slider> mSliders; // main thread, sliders of the newest successfully compiled script
+
+  Program* mProgram = nullptr; // audio thread only
+  std::atomic<Program*> mPendingProgram {nullptr}; // compile thread -> audio thread
+  std::atomic<Program*> mRetiredProgram {nullptr}; // audio thread -> main thread
+
+  std::atomic<double> mSampleRate {DEFAULT_SAMPLE_RATE};
+  std::atomic<bool> mResetRequested {false};
+  std::atomic<double> mSliderValues[EEL_MAX_SLIDERS];
+  std::atomic<bool> mSlidersChanged {false};
+
+  IPlugAPIBase* mPlug = nullptr;
+  int mParamStartIdx = -1;
+  int mNParams = 0;
+};
+
+END_IPLUG_NAMESPACE
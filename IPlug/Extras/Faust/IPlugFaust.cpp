@@ -23,12 +23,9 @@ using namespace iplug;
 
 IPlugFaust::IPlugFaust(const char* name, int nVoices, int rate)
 : mNVoices(nVoices)
+, mOverSamplingRate(rate)
 {
-  if (rate > 1)
-  {
-    mOverSampler = std::make_unique<OverSampler<sample>>(OverSampler<sample>::RateToFactor(rate), true, 2 /* TODO: flexible channel count */);
-  }
-
+  // the oversampler is created once the channel count is known, see CreateOverSampler()
   mName.Set(name);
 
   if (sUITimer == nullptr)
@@ -44,8 +41,8 @@ void IPlugFaust::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
     assert(mDSP->getSampleRate() != 0); // did you forget to call SetSampleRate?
 
     if (mOverSampler)
-      mOverSampler->ProcessBlock(inputs, outputs, nFrames, 2, 2 /* TODO: flexible channel count */,
-        [&](sample** inputs, sample** outputs, int nFrames) //TODO:: badness capture = allocated
+      mOverSampler->ProcessBlock(inputs, outputs, nFrames, mDSP->getNumInputs(), mDSP->getNumOutputs(),
+        [this](sample** inputs, sample** outputs, int nFrames) // passed as a template argument, no std::function and no allocation
         {
           mDSP->compute(nFrames, inputs, outputs);
         });
@@ -55,6 +52,18 @@ void IPlugFaust::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
   //    else silence?
 }
 
+void IPlugFaust::CreateOverSampler()
+{
+  if (mOverSamplingRate <= 1 && !mOverSampler)
+    return;
+
+  const int nInputs = std::max({mMaxNInputs, mDSP ? mDSP->getNumInputs() : 0, 1});
+  const int nOutputs = std::max({mMaxNOutputs, mDSP ? mDSP->getNumOutputs() : 0, 1});
+
+  if (!mOverSampler || mOverSampler->NInChannels() < nInputs || mOverSampler->NOutChannels() < nOutputs)
+    mOverSampler = std::make_unique<OverSampler<sample>>(OverSampler<sample>::RateToFactor(mOverSamplingRate), true, nInputs, nOutputs);
+}
+
 void IPlugFaust::SetParameterValueNormalised(int paramIdx, double normalizedValue)
 {
   if (paramIdx > kNoParameter && paramIdx >= NParams())
@@ -65,8 +74,8 @@ void IPlugFaust::SetParameterValueNormalised(int paramIdx, double normalizedValu
   {
     mParams.Get(paramIdx)->SetNormalized(normalizedValue);
 
-    if (mZones.GetSize() == NParams())
-      *(mZones.Get(paramIdx)) = mParams.Get(paramIdx)->Value();
+    if ((int) mZones.size() == NParams())
+      *(mZones[paramIdx]) = mParams.Get(paramIdx)->Value();
     else
       DBGMSG("IPlugFaust-%s:: Missing zone for parameter %s\n", mName.Get(), mParams.Get(paramIdx)->GetName());
   }
@@ -80,8 +89,8 @@ void IPlugFaust::SetParameterValue(int paramIdx, double nonNormalizedValue)
 
     mParams.Get(paramIdx)->Set(nonNormalizedValue);
 
-    if (mZones.GetSize() == NParams())
-      *(mZones.Get(paramIdx)) = nonNormalizedValue;
+    if ((int) mZones.size() == NParams())
+      *(mZones[paramIdx]) = nonNormalizedValue;
     else
       DBGMSG("IPlugFaust-%s:: Missing zone for parameter %s\n", mName.Get(), mParams.Get(paramIdx)->GetName());
   }
@@ -164,14 +173,15 @@ void IPlugFaust::AddOrUpdateParam(IParam::EParamType type, const char* label, FA
   if (idx == -1)
     mParams.Add(pParam);
 
-  mZones.Add(zone);
+  if (mAddZones)
+    mZones.push_back(zone);
 }
 
 void IPlugFaust::BuildParameterMap()
 {
   for (auto p = 0; p < NParams(); p++)
   {
-    mMap.Insert(mParams.Get(p)->GetName(), mZones.Get(p)); // insert will overwrite keys with the same name
+    mMap.Insert(mParams.Get(p)->GetName(), p < (int) mZones.size() ? mZones[p] : nullptr); // insert will overwrite keys with the same name
   }
 
   if (mIPlugParamStartIdx > -1 && mPlug != nullptr) // if we've already linked parameters
@@ -200,8 +210,11 @@ int IPlugFaust::FindExistingParameterWithName(const char* name) // TODO: this ne
 
 void IPlugFaust::SyncFaustParams()
 {
+  if ((int) mZones.size() != NParams())
+    return;
+
   for (auto p = 0; p < NParams(); p++)
   {
-    *mZones.Get(p) = mParams.Get(p)->Value();
+    *mZones[p] = mParams.Get(p)->Value();
   }
 }
@@ -16,6 +16,9 @@
  */
 
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #define FAUSTCLASS_POLY mydsp_poly
 
@@ -60,8 +63,10 @@ public:
     
   virtual void Init() = 0;
 
-  // NO-OP in the base class
-  virtual void SetMaxChannelCount(int maxNInputs, int maxNOutputs) {}
+  /** Call this method after constructing the class to inform IPlugFaust what the maximum I/O count is. This sizes the oversampler, so that it can process any DSP that fits
+   * @param maxNInputs Specify a number here to tell IPlugFaust the maximum number of inputs the hosting code can accommodate
+   * @param maxNOutputs Specify a number here to tell IPlugFaust the maximum number of outputs the hosting code can accommodate */
+  virtual void SetMaxChannelCount(int maxNInputs, int maxNOutputs) { mMaxNInputs = maxNInputs; mMaxNOutputs = maxNOutputs; }
   
   /** In FaustGen this is implemented, so that the SVG files generated by a specific instance can be located. The path to the SVG file for process.svg will be returned.
    * There is a NO-OP implementation here so that when not using the JIT compiler, the same class can be used interchangeably
@@ -83,22 +88,32 @@ public:
     mMidiHandler = nullptr;
   }
   
+  /** Not realtime safe, call SetSampleRate() afterwards to initialize the DSP at the new rate
+   * @param rate The oversampling rate, 1, 2, 4, 8 or 16 */
   void SetOverSamplingRate(int rate)
   {
+    mOverSamplingRate = rate;
+
     if(mOverSampler)
       mOverSampler->SetOverSampling(OverSampler<sample>::RateToFactor(rate));
+    else
+      CreateOverSampler();
   }
 
   // Unique methods
   void SetSampleRate(double sampleRate)
   {
     int multiplier = 1;
+
+    CreateOverSampler();
     
     if(mOverSampler)
       multiplier = mOverSampler->GetRate();
     
+    mSampleRate = ((int) sampleRate) * multiplier;
+
     if (mDSP) {
-      mDSP->init(((int) sampleRate) * multiplier);
+      mDSP->init(mSampleRate);
       SyncFaustParams();
     }
   }
@@ -174,6 +189,9 @@ protected:
   
   void BuildParameterMap();
 
+  /** Creates the oversampler if oversampling is enabled and it doesn't exist yet, or if the DSP has more channels than it was created for. Not realtime safe */
+  void CreateOverSampler();
+
   int FindExistingParameterWithName(const char* name);
     
   void OnUITimer(Timer& timer)
@@ -182,13 +200,18 @@ protected:
   }
   
   std::unique_ptr<OverSampler<sample>> mOverSampler;
+  int mOverSamplingRate = 1;
+  int mMaxNInputs = -1;
+  int mMaxNOutputs = -1;
   WDL_String mName;
   int mNVoices;
   std::unique_ptr<::dsp> mDSP;
   MidiHandlerPtr mMidiHandler;
   std::unique_ptr<MidiUI> mMidiUI;
   WDL_PtrList<IParam> mParams;
-  WDL_PtrList<FAUSTFLOAT> mZones;
+  std::vector<FAUSTFLOAT*> mZones; // a vector rather than a WDL_PtrList, so that FaustGen can swap it for a new DSP's zones without allocating
+  bool mAddZones = true; // AddOrUpdateParam() collects the zones, unless they were installed together with their DSP
+  std::atomic<int> mSampleRate {0}; // the rate the DSP runs at, including oversampling, once SetSampleRate() has been called
   static Timer* sUITimer;
   WDL_StringKeyedArray<FAUSTFLOAT*> mMap; // map is used for setting FAUST parameters by name, also used to reconnect existing parameters
   int mIPlugParamStartIdx = -1; // if this is negative, it means there is no linking
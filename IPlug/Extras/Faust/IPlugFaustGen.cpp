@@ -17,13 +17,23 @@
 #define LLVM_DSP
 
 #include "fileread.h"
+#include "filewrite.h"
+#include "dirscan.h"
+#include "fnv64.h"
+
+#ifndef OS_WIN
+#include <unistd.h>
+#endif
 
 using namespace iplug;
 
 int FaustGen::sFaustGenCounter = 0;
+int FaustGen::sTimerTicks = 0;
 int FaustGen::Factory::sFactoryCounter = 0;
 bool FaustGen::sAutoRecompile = false;
 std::map<std::string, FaustGen::Factory *> FaustGen::Factory::sFactoryMap;
+WDL_String FaustGen::Factory::sCachePath;
+bool FaustGen::Factory::sCacheEnabled = true;
 Timer* FaustGen::sTimer = nullptr;
 
 FaustGen::Factory::Factory(const char* name, const char* libraryPath, const char* drawPath, const char* inputDSP)
@@ -48,6 +58,8 @@ FaustGen::Factory::~Factory()
 
 void FaustGen::Factory::FreeDSPFactory()
 {
+  CancelCompile();
+
   WDL_MutexLock lock(&mDSPMutex);
 
   for (auto inst : mInstances)
@@ -60,6 +72,13 @@ void FaustGen::Factory::FreeDSPFactory()
     deleteDSPFactory(mLLVMFactory); // this is commented in faustgen~
     mLLVMFactory = nullptr;
   }
+
+  for (auto pFactory : mRetiredFactories)
+  {
+    deleteDSPFactory(pFactory);
+  }
+
+  mRetiredFactories.clear();
 }
 
 llvm_dsp_factory* FaustGen::Factory::CreateFactoryFromBitCode()
@@ -108,44 +127,270 @@ llvm_dsp_factory *FaustGen::Factory::CreateFactoryFromSourceCode()
 
   argv[N] = 0; // NULL terminated argv
 
-  llvm_dsp_factory* pFactory = createDSPFactoryFromString(name.Get(), mSourceCodeStr.Get(), N, argv, GetLLVMArchStr(), error, mOptimizationLevel);
+  WDL_String cacheKey;
+  llvm_dsp_factory* pFactory = nullptr;
+
+  if (sCacheEnabled)
+  {
+    GetCacheKey(cacheKey, N, argv);
+    pFactory = CreateFactoryFromCache(cacheKey.Get());
+  }
+
+  if (!pFactory)
+  {
+    pFactory = createDSPFactoryFromString(name.Get(), mSourceCodeStr.Get(), N, argv, GetLLVMArchStr(), error, mOptimizationLevel);
+
+    if(error.length())
+      DBGMSG("%s\n", error.c_str());
 
-  if(error.length())
-    DBGMSG("%s\n", error.c_str());
+    if (pFactory && sCacheEnabled)
+      WriteToCache(pFactory, cacheKey.Get());
+  }
   
-  assert(pFactory != nullptr);
+  // this can run on the compile thread, so the instances are told about errors when the result is installed
+  if (!pFactory)
+    DBGMSG("FaustGen-%s: Invalid Faust code or compile options : %s\n", mName.Get(), error.c_str());
 
-  if (pFactory)
+  return pFactory;
+}
+
+void FaustGen::Factory::GetCacheFolder(WDL_String& path)
+{
+  path.Set(sCachePath.Get());
+
+  if (!path.GetLength())
   {
-    // Update all instances
-    for (auto inst : mInstances)
+    AppSupportPath(path);
+    path.Append(WDL_DIRCHAR_STR "FaustGen");
+    MakeDir(path.Get());
+    path.Append(WDL_DIRCHAR_STR "cache");
+  }
+
+  MakeDir(path.Get());
+}
+
+void FaustGen::Factory::GetCacheFile(WDL_String& path, const char* key)
+{
+  GetCacheFolder(path);
+  path.AppendFormatted(MAX_WIN32_PATH_LEN, WDL_DIRCHAR_STR "%s" FAUST_CACHE_FILE_EXT, key);
+}
+
+static constexpr int kHashChars = 16; // a 64-bit FNV hash in hex
+
+static void HashToString(WDL_UINT64 hash, WDL_String& str)
+{
+  str.SetFormatted(kHashChars + 1, "%016llx", (unsigned long long) hash);
+}
+
+static bool HashFile(const char* path, WDL_String& str)
+{
+  WDL_FileRead infile(path);
+
+  if (!infile.IsOpen())
+    return false;
+
+  WDL_UINT64 hash = WDL_FNV64_IV;
+  unsigned char buf[8192];
+  int bytesRead;
+
+  while ((bytesRead = infile.Read(buf, sizeof(buf))) > 0)
+    hash = WDL_FNV64(hash, buf, bytesRead);
+
+  HashToString(hash, str);
+  return true;
+}
+
+void FaustGen::Factory::GetCacheKey(WDL_String& key, int argc, const char* argv[])
+{
+  WDL_UINT64 hash = WDL_FNV64_IV;
+
+  auto add = [&hash](const char* str) {
+    hash = WDL_FNV64(hash, reinterpret_cast<const unsigned char*>(str), (int) strlen(str) + 1); // include the terminator, so that the fields are delimited
+  };
+
+  const std::string machineTarget = getDSPMachineTarget();
+  WDL_String optimizationLevel;
+  optimizationLevel.SetFormatted(16, "%d", mOptimizationLevel);
+
+  add(FAUSTGEN_VERSION);
+  add(getCLibFaustVersion());
+  add(GetLLVMArchStr().c_str());
+  add(machineTarget.c_str());
+  add(optimizationLevel.Get());
+
+  for (auto i = 0; i < argc; i++)
+    add(argv[i]);
+
+  add(mSourceCodeStr.Get());
+
+  HashToString(hash, key);
+}
+
+llvm_dsp_factory* FaustGen::Factory::CreateFactoryFromCache(const char* key)
+{
+  WDL_String path;
+  GetCacheFile(path, key);
+
+  std::vector<char> buffer;
+  int size = 0;
+
+  {
+    WDL_FileRead infile(path.Get());
+
+    if (!infile.IsOpen())
+      return nullptr;
+
+    buffer.resize(static_cast<size_t>(infile.GetSize()) + 1);
+    size = infile.Read(buffer.data(), static_cast<int>(infile.GetSize()));
+    buffer[size] = '\0';
+  }
+
+  // header lines, then the machine code
+  WDL_String header;
+  header.SetFormatted(256, "FAUSTGEN-CACHE %s\nkey %s\n", FAUSTGEN_VERSION, key);
+
+  const char* pos = buffer.data();
+  const char* end = buffer.data() + size;
+  bool valid = strncmp(pos, header.Get(), header.GetLength()) == 0;
+
+  if (valid)
+    pos += header.GetLength();
+
+  while (valid && strncmp(pos, "lib ", 4) == 0)
+  {
+    // lib <hash> <path>
+    const char* pHash = pos + 4;
+    const char* pPath = pHash + kHashChars + 1;
+    const char* pEOL = static_cast<const char*>(memchr(pos, '\n', end - pos));
+
+    if (!pEOL || pPath >= pEOL)
     {
-      inst->SetErrored(false);
+      valid = false;
+      break;
     }
-    
-    return pFactory;
+
+    WDL_String libPath(pPath, (int) (pEOL - pPath));
+    WDL_String libHash;
+    valid = HashFile(libPath.Get(), libHash) && strncmp(libHash.Get(), pHash, kHashChars) == 0;
+
+    if (!valid)
+      DBGMSG("FaustGen-%s: Cached factory is out of date, %s has changed\n", mName.Get(), libPath.Get());
+
+    pos = pEOL + 1;
+  }
+
+  int codeSize = 0;
+  valid = valid && sscanf(pos, "code %d\n", &codeSize) == 1;
+
+  if (valid)
+  {
+    pos = static_cast<const char*>(memchr(pos, '\n', end - pos)) + 1;
+    valid = (end - pos) == codeSize;
+  }
+
+  llvm_dsp_factory* pFactory = nullptr;
+
+  if (valid)
+  {
+    std::string error;
+    pFactory = readDSPFactoryFromMachine(std::string(pos, codeSize), GetLLVMArchStr(), error);
+
+    if (error.length())
+      DBGMSG("%s\n", error.c_str());
+  }
+
+  if (pFactory)
+  {
+    DBGMSG("FaustGen-%s: Loaded compiled factory from cache %s\n", mName.Get(), path.Get());
+    Touch(path.Get()); // for least recently used eviction
   }
   else
+    remove(path.Get());
+
+  return pFactory;
+}
+
+void FaustGen::Factory::WriteToCache(llvm_dsp_factory* pFactory, const char* key)
+{
+  WDL_String contents;
+  contents.SetFormatted(256, "FAUSTGEN-CACHE %s\nkey %s\n", FAUSTGEN_VERSION, key);
+
+  // the key doesn't cover imported libraries, they are only known after compiling. Store their hashes to validate the entry
+  for (auto& lib : getDSPFactoryLibraryList(pFactory))
   {
-    // Update all instances
-    for (auto inst : mInstances)
+    WDL_String libHash;
+
+    if (!HashFile(lib.c_str(), libHash))
+      return; // can't validate, don't cache
+
+    contents.AppendFormatted(MAX_WIN32_PATH_LEN + 64, "lib %s %s\n", libHash.Get(), lib.c_str());
+  }
+
+  const std::string code = writeDSPFactoryToMachine(pFactory, GetLLVMArchStr());
+  contents.AppendFormatted(32, "code %d\n", (int) code.size());
+
+  WDL_String path, tmpPath;
+  GetCacheFile(path, key);
+#ifdef OS_WIN
+  const int processID = (int) GetCurrentProcessId();
+#else
+  const int processID = (int) getpid();
+#endif
+  // unique to this factory in this process, as other hosts or a plug-in scanner can write the same entry at the same time
+  tmpPath.SetFormatted(MAX_WIN32_PATH_LEN, "%s.%d.%d.tmp", path.Get(), processID, mInstanceIdx);
+
+  {
+    WDL_FileWrite outfile(tmpPath.Get(), 0);
+
+    if (!outfile.IsOpen())
+      return;
+
+    outfile.Write(contents.Get(), contents.GetLength());
+    outfile.Write(code.data(), (int) code.size());
+  }
+
+  // write then rename, so that other processes never see a partial entry
+  remove(path.Get());
+  rename(tmpPath.Get(), path.Get());
+
+  // evict the least recently used entries
+  WDL_String folder;
+  GetCacheFolder(folder);
+  std::vector<std::pair<StatTime, std::string>> entries;
+  WDL_DirScan dir;
+
+  if (!dir.First(folder.Get()))
+  {
+    do
     {
-      inst->SetErrored(true);
-    }
+      const char* fn = dir.GetCurrentFN();
+      const size_t len = strlen(fn);
+      const size_t extLen = strlen(FAUST_CACHE_FILE_EXT);
+
+      if (len > extLen && !strcmp(fn + len - extLen, FAUST_CACHE_FILE_EXT))
+      {
+        WDL_String entryPath;
+        dir.GetCurrentFullFN(&entryPath);
+        StatType buf;
+
+        if (GetStat(entryPath.Get(), &buf) == 0)
+          entries.push_back({GetModifiedTime(buf), entryPath.Get()});
+      }
+    } while (!dir.Next());
+  }
 
-    //WHAT IS THIS?
-//    if (mInstances.begin() != mInstances.end())
-//    {
-//      (*mInstances.begin())->hilight_error(error);
-//    }
-    DBGMSG("FaustGen-%s: Invalid Faust code or compile options : %s\n", mName.Get(), error.c_str());
-    return 0;
+  if (entries.size() > FAUST_CACHE_MAX_ENTRIES)
+  {
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return Earlier(a.first, b.first); });
+
+    for (size_t i = 0; i < entries.size() - FAUST_CACHE_MAX_ENTRIES; i++)
+      remove(entries[i].second.c_str());
   }
 }
 
-::dsp *FaustGen::Factory::CreateDSPInstance(const MidiHandlerPtr& handler, int nVoices)
+::dsp *FaustGen::Factory::CreateDSPInstance(const MidiHandlerPtr& handler, int nVoices, llvm_dsp_factory* pFactory)
 {
-  ::dsp* pMonoDSP = mLLVMFactory->createDSPInstance();
+  ::dsp* pMonoDSP = (pFactory ? pFactory : mLLVMFactory)->createDSPInstance();
 
   // Polyphony handling
   bool midiSync = false;
@@ -263,7 +508,7 @@ void FaustGen::Factory::SetDefaultCompileOptions()
     AddCompileOption("-double");
 
   // All library paths
-  for (auto i = 0; i< mLibraryPaths.size(); i++)
+  for (size_t i = 0; i < mLibraryPaths.size(); i++)
   {
     AddCompileOption("-I", mLibraryPaths[i].c_str());
   }
@@ -276,16 +521,19 @@ void FaustGen::Factory::SetDefaultCompileOptions()
   }
 
   // All options set in the 'compileoptions' message
-  for (auto c : mOptions)
+  mOptimizationLevel = LLVM_OPTIMIZATION;
+
+  for (size_t i = 0; i < mOptions.size(); i++)
   {
     // '-opt v' : parsed for LLVM optimization level
-    if (c == "-opt")
+    if (mOptions[i] == "-opt")
     {
-      mOptimizationLevel = atoi(c.c_str());
+      if (++i < mOptions.size())
+        mOptimizationLevel = atoi(mOptions[i].c_str());
     }
     else
     {
-      AddCompileOption(c.c_str());
+      AddCompileOption(mOptions[i].c_str());
     }
   }
 
@@ -313,18 +561,26 @@ void FaustGen::Factory::UpdateSourceCode(const char* str)
     //      inst->hilight_off();
     //    }
 
-    // Delete the existing Faust module
-    FreeDSPFactory();
+    // a compile of the previous code is out of date, and reads the source code
+    CancelCompile();
 
     mSourceCodeStr.Set(str);
 
     // Free the memory allocated for fBitCode
     mBitCodeStr.Set("");
 
-    // Update all instances
-    for (auto inst : mInstances)
+    if (mLLVMFactory)
     {
-      inst->Init();
+      // the running DSP carries on until the timer installs the result
+      CompileAsync();
+    }
+    else
+    {
+      // Update all instances
+      for (auto inst : mInstances)
+      {
+        inst->Init();
+      }
     }
   }
   else
@@ -335,6 +591,7 @@ void FaustGen::Factory::UpdateSourceCode(const char* str)
 
 void FaustGen::Factory::RemoveInstance(FaustGen* pDSP)
 {
+  WaitForCompile(); // the compile thread uses this factory, which is deleted with the last instance
   mInstances.erase(pDSP);
 
   // Last instance : remove factory from global table and commit suicide...
@@ -347,8 +604,32 @@ void FaustGen::Factory::RemoveInstance(FaustGen* pDSP)
 
 bool FaustGen::Factory::LoadFile(const char* file)
 {
-  // Delete the existing Faust module
-  //FreeDSPFactory();
+  CancelCompile(); // the compile thread reads the source code
+
+  if (ReadFile(file))
+  {
+    if (mLLVMFactory)
+    {
+      // the running DSP carries on until the timer installs the result
+      CompileAsync();
+    }
+    else
+    {
+      // Update all instances
+      for (auto inst : mInstances)
+      {
+        inst->Init();
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+bool FaustGen::Factory::ReadFile(const char* file)
+{
   WDL_String fileStr(file);
 
   mBitCodeStr.Set("");
@@ -373,12 +654,6 @@ bool FaustGen::Factory::LoadFile(const char* file)
     
     mInputDSPFile.Set(file);
     
-    // Update all instances
-    for (auto inst : mInstances)
-    {
-      inst->Init();
-    }
-    
     return true;
   }
   
@@ -393,39 +668,314 @@ bool FaustGen::Factory::WriteToFile(const char* file)
 }
 
 void FaustGen::Factory::SetCompileOptions(std::initializer_list<const char*> options)
+{
+  SetCompileOptions(std::vector<std::string>(options.begin(), options.end()));
+}
+
+void FaustGen::Factory::SetCompileOptions(const std::vector<std::string>& options)
 {
   DBGMSG("FaustGen-%s: Compiler options modified for FaustGen\n", mName.Get());
 
   if (options.size() == 0)
-    DBGMSG("FaustGen-%s: No argument entered, no additional compilation option will be used", mName.Get());
+    DBGMSG("FaustGen-%s: No argument entered, no additional compilation option will be used\n", mName.Get());
 
-  //TODO
-//  mOptions = options;
-//
-//  /*
-//  if (optimize) {
-//
-//    DBGMSG("FaustGen-%s: Start looking for optimal compilation options...\n");
-//
-//  #ifdef OS_MAC
-//    double best;
-//    dsp_optimizer optimizer(string(mSourceCodeStr.Get()), (*mLibraryPaths.begin()).c_str(), getTarget(), sys_getblksize());
-//    mOptions = optimizer.findOptimizedParameters(best);
-//  #endif
-//
-//    DBGMSG("FaustGen-%s: Optimal compilation options found\n");
-//  }
-//  */
-//
-//  // Delete the existing Faust module
-//  FreeDSPFactory();
-//  mBitCodeStr.Set("");
-//
-//  // Update all instances
-//  for (auto i : fInstances) {
-//    i->UpdateSourceCode();
-//  }
+  if (options == mOptions)
+    return;
+
+  CancelCompile(); // a compile with the previous options is out of date, and reads the options
+
+  mOptions = options;
+
+  if (!mLLVMFactory)
+    return; // the options are picked up by the first compile
+
+  mBitCodeStr.Set("");
+
+  // the running DSP carries on until the timer installs the result, it can't be freed while the audio thread uses it
+  CompileAsync();
+}
+
+double FaustGen::Factory::Benchmark(llvm_dsp_factory* pFactory, int blockSize)
+{
+  std::unique_ptr<::dsp> pDSP(pFactory->createDSPInstance());
+
+  if (!pDSP)
+    return -1.;
+
+  pDSP->init(DEFAULT_SAMPLE_RATE);
+
+  const int nInputs = pDSP->getNumInputs();
+  const int nOutputs = pDSP->getNumOutputs();
+
+  std::vector<FAUSTFLOAT> buffer((nInputs + nOutputs) * blockSize);
+  std::vector<FAUSTFLOAT*> inputs(nInputs + 1);
+  std::vector<FAUSTFLOAT*> outputs(nOutputs + 1);
+
+  for (auto c = 0; c < nInputs; c++)
+    inputs[c] = buffer.data() + (c * blockSize);
+
+  for (auto c = 0; c < nOutputs; c++)
+    outputs[c] = buffer.data() + ((nInputs + c) * blockSize);
+
+  // quiet noise, so that effects have something to work on without going denormal or clipping
+  unsigned int seed = 1;
+
+  for (auto i = 0; i < nInputs * blockSize; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    buffer[i] = (FAUSTFLOAT) (((double) (seed >> 8) / (double) (1 << 24)) - 0.5) * (FAUSTFLOAT) 0.1;
+  }
+
+  pDSP->compute(blockSize, inputs.data(), outputs.data()); // warm up
+
+  double best = -1.;
+
+  for (auto run = 0; run < FAUST_BENCHMARK_RUNS; run++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+
+    for (auto block = 0; block < FAUST_BENCHMARK_BLOCKS; block++)
+    {
+      pDSP->compute(blockSize, inputs.data(), outputs.data());
+    }
+
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (best < 0. || time < best)
+      best = time;
+  }
+
+  return best;
+}
+
+void FaustGen::Factory::OptimizeCompileOptions(int blockSize)
+{
+  // scalar code first, so that it wins ties
+  static const std::vector<std::vector<std::string>> candidates = {
+    {},
+    {"-vec", "-vs", "16"},
+    {"-vec", "-vs", "32"},
+    {"-vec", "-vs", "64"},
+    {"-vec", "-vs", "128"},
+    {"-vec", "-vs", "32", "-dfs"},
+    {"-vec", "-vs", "64", "-dfs"},
+    {"-vec", "-lv", "1", "-vs", "32"},
+    {"-vec", "-lv", "1", "-vs", "64"},
+  };
+
+  if (!mSourceCodeStr.GetLength())
+    return;
+
+  WaitForCompile(); // the compile thread uses mOptions and mCompileOptions
+
+  DBGMSG("FaustGen-%s: Start looking for optimal compilation options...\n", mName.Get());
+
+  // options that don't affect vectorization, such as -opt, are kept
+  std::vector<std::string> baseOptions;
+
+  for (size_t i = 0; i < mOptions.size(); i++)
+  {
+    const std::string& option = mOptions[i];
+
+    if (option == "-vec" || option == "-dfs" || option == "-scal")
+      continue;
+
+    if (option == "-vs" || option == "-lv" || option == "-fun")
+    {
+      i++; // skip the value too
+      continue;
+    }
+
+    baseOptions.push_back(option);
+  }
+
+  const std::vector<std::string> previousOptions = mOptions;
+  const std::vector<std::string>* pBest = nullptr;
+  double bestTime = 0.;
+
+  WDL_String name;
+  name.SetFormatted(64, "FaustGen-%d-benchmark", mInstanceIdx);
+
+  for (auto& candidate : candidates)
+  {
+    mOptions = baseOptions;
+    mOptions.insert(mOptions.end(), candidate.begin(), candidate.end());
+    SetDefaultCompileOptions();
+
+    const char* argv[64];
+    const int N = (int) mCompileOptions.size();
+
+    assert(N < 64);
+
+    for (auto i = 0; i < N; i++)
+    {
+      argv[i] = mCompileOptions[i].c_str();
+    }
+
+    argv[N] = 0; // NULL terminated argv
+
+    // straight to the compiler, the benchmark builds shouldn't end up in the cache
+    std::string error;
+    llvm_dsp_factory* pFactory = createDSPFactoryFromString(name.Get(), mSourceCodeStr.Get(), N, argv, GetLLVMArchStr(), error, mOptimizationLevel);
 
+    if (!pFactory)
+    {
+      DBGMSG("FaustGen-%s: Benchmark compile failed : %s\n", mName.Get(), error.c_str());
+      continue;
+    }
+
+    const double time = Benchmark(pFactory, blockSize);
+    deleteDSPFactory(pFactory);
+
+    DBGMSG("FaustGen-%s: %i blocks of %i samples in %f ms with options:", mName.Get(), FAUST_BENCHMARK_BLOCKS, blockSize, time * 1000.);
+
+    for (auto& option : candidate)
+      DBGMSG(" %s", option.c_str());
+
+    DBGMSG("\n");
+
+    if (time >= 0. && (!pBest || time < bestTime))
+    {
+      pBest = &candidate;
+      bestTime = time;
+    }
+  }
+
+  mOptions = previousOptions;
+
+  if (pBest)
+  {
+    std::vector<std::string> bestOptions = baseOptions;
+    bestOptions.insert(bestOptions.end(), pBest->begin(), pBest->end());
+
+    DBGMSG("FaustGen-%s: Optimal compilation options found\n", mName.Get());
+    SetCompileOptions(bestOptions);
+  }
+}
+
+bool FaustGen::Factory::CompileAsync()
+{
+  if (IsCompiling())
+    return false;
+
+  FaustGen::StartTimer(); // installs the result
+  mCompileThread = std::thread(&Factory::CompileThreadProc, this);
+  return true;
+}
+
+void FaustGen::Factory::CompileThreadProc()
+{
+  // only the factory is created here, the instances belong to the main thread
+  mCompiledFactory = CreateFactoryFromSourceCode();
+  mCompileDone = true;
+}
+
+bool FaustGen::Factory::IsBusy() const
+{
+  if (IsCompiling() || !mRetiredFactories.empty())
+    return true;
+
+  for (auto inst : mInstances)
+  {
+    if (inst->mSwapping)
+      return true;
+  }
+
+  return false;
+}
+
+void FaustGen::Factory::CancelCompile()
+{
+  WaitForCompile();
+
+  if (mCompileDone)
+  {
+    if (mCompiledFactory)
+    {
+      deleteDSPFactory(mCompiledFactory);
+      mCompiledFactory = nullptr;
+    }
+
+    mCompileDone = false;
+  }
+}
+
+void FaustGen::Factory::InstallCompiledDSP()
+{
+  bool swapping = false;
+
+  for (auto inst : mInstances)
+  {
+    swapping = inst->CollectRetiredDSP() || swapping;
+  }
+
+  if (swapping)
+    return;
+
+  for (auto pFactory : mRetiredFactories)
+  {
+    deleteDSPFactory(pFactory);
+  }
+
+  mRetiredFactories.clear();
+
+  if (!mCompileDone)
+    return;
+
+  WaitForCompile();
+  mCompileDone = false;
+
+  if (!mCompiledFactory)
+  {
+    // the previous DSP keeps running, only instances that have nothing to run are muted
+    DBGMSG("FaustGen-%s: The recompile failed, keeping the previous DSP\n", mName.Get());
+
+    for (auto inst : mInstances)
+    {
+      if (!inst->mDSP)
+        inst->SetErrored(true);
+    }
+
+    return;
+  }
+
+  // all instances swap to the new factory or none do, so that the previous factory can be deleted
+  bool prepared = true;
+
+  for (auto inst : mInstances)
+  {
+    prepared = prepared && inst->PrepareDSP(mCompiledFactory);
+  }
+
+  if (!prepared)
+  {
+    DBGMSG("FaustGen-%s: The recompiled DSP doesn't fit the channel count, keeping the previous DSP\n", mName.Get());
+
+    for (auto inst : mInstances)
+    {
+      inst->mPreparedDSP = nullptr;
+    }
+
+    deleteDSPFactory(mCompiledFactory);
+    mCompiledFactory = nullptr;
+    return;
+  }
+
+  {
+    WDL_MutexLock lock(&mDSPMutex);
+
+    if (mLLVMFactory)
+      mRetiredFactories.push_back(mLLVMFactory);
+
+    mLLVMFactory = mCompiledFactory;
+    mCompiledFactory = nullptr;
+  }
+
+  for (auto inst : mInstances)
+  {
+    inst->SetErrored(false);
+    inst->PublishDSP();
+  }
 }
 
 #pragma mark -
@@ -462,15 +1012,33 @@ FaustGen::~FaustGen()
     SetAutoRecompile(false);
   }
 
+  if(mFactory)
+    mFactory->WaitForCompile();
+
   FreeDSP();
 
   if(mFactory)
     mFactory->RemoveInstance(this);
 }
 
+void FaustGen::SetMaxChannelCount(int maxNInputs, int maxNOutputs)
+{
+  IPlugFaust::SetMaxChannelCount(maxNInputs, maxNOutputs);
+
+  mFadeBuffer.Resize(maxNOutputs * FAUST_SWAP_FADE_BLOCK);
+  mFadeInputs.resize(maxNInputs);
+  mFadeOutputs.resize(maxNOutputs);
+  mFadeOldOutputs.resize(maxNOutputs);
+
+  for (auto c = 0; c < maxNOutputs; c++)
+  {
+    mFadeOldOutputs[c] = mFadeBuffer.Get() + (c * FAUST_SWAP_FADE_BLOCK);
+  }
+}
+
 void FaustGen::Init()
 {
-  mZones.Empty(); // remove existing pointers to zones
+  mZones.clear(); // remove existing pointers to zones
     
   mMidiHandler = std::make_unique<iplug2_midi_handler>();
   mMidiUI = std::make_unique<MidiUI>(mMidiHandler.get());
@@ -501,6 +1069,192 @@ void FaustGen::Init()
     mMidiHandler->startMidi();
 }
 
+void FaustGen::FreeDSP()
+{
+  mPreparedDSP = nullptr;
+  mFadingDSP = nullptr;
+  delete mPendingDSP.exchange(nullptr);
+  delete mRetiredDSP.exchange(nullptr);
+  mSwapping = false;
+
+  if (mMidiHandler)
+    IPlugFaust::FreeDSP();
+}
+
+bool FaustGen::PrepareDSP(llvm_dsp_factory* pFactory)
+{
+  auto pSlot = std::make_unique<DSPSlot>();
+  pSlot->mMidiHandler = std::make_unique<iplug2_midi_handler>();
+  pSlot->mDSP = std::unique_ptr<::dsp>(mFactory->CreateDSPInstance(pSlot->mMidiHandler, 0, pFactory));
+
+  if ((pSlot->mDSP->getNumInputs() > mMaxNInputs) || (pSlot->mDSP->getNumOutputs() > mMaxNOutputs))
+    return false;
+
+  const int sampleRate = mSampleRate;
+  pSlot->mDSP->init(sampleRate ? sampleRate : DEFAULT_SAMPLE_RATE);
+
+  // init() resets the zones to their defaults, so copy the parameter values after it
+  ZoneCollector zones;
+  pSlot->mDSP->buildUserInterface(&zones);
+  pSlot->mParamsChanged = zones.count != NParams();
+
+  for (auto p = 0; p < NParams() && !pSlot->mParamsChanged; p++)
+  {
+    IParam* pParam = mParams.Get(p);
+    FAUSTFLOAT* zone = zones.items.Get(pParam->GetName(), nullptr);
+
+    if (zone)
+    {
+      *zone = pParam->Value();
+      pSlot->mZones.push_back(zone);
+    }
+    else
+      pSlot->mParamsChanged = true;
+  }
+
+  // the parameters are rebuilt once the DSP is installed, and take their zones in declaration order
+  if (pSlot->mParamsChanged)
+    pSlot->mZones = std::move(zones.ordered);
+
+  mPreparedDSP = std::move(pSlot);
+  return true;
+}
+
+void FaustGen::PublishDSP()
+{
+  if (!mPreparedDSP)
+    return;
+
+  // MidiUI registers itself with the global GUI list, so it is only created for a DSP that is published
+  DSPSlot* pSlot = mPreparedDSP.release();
+  pSlot->mMidiUI = std::make_unique<MidiUI>(pSlot->mMidiHandler.get());
+  pSlot->mDSP->buildUserInterface(pSlot->mMidiUI.get());
+  pSlot->mMidiHandler->startMidi();
+
+  mSwapping = true;
+  mPendingDSP.store(pSlot);
+}
+
+bool FaustGen::CollectRetiredDSP()
+{
+  std::unique_ptr<DSPSlot> pRetired(mRetiredDSP.exchange(nullptr));
+
+  if (!pRetired)
+    return mSwapping;
+
+  // the audio thread has installed the new zones with the DSP, and swaps no other DSP until this one is collected, so they can be read here.
+  // The map still points into the old DSP, so update it before that is deleted
+  if (pRetired->mParamsChanged)
+    RebuildParameters();
+  else
+  {
+    for (auto p = 0; p < NParams(); p++)
+    {
+      mMap.Insert(mParams.Get(p)->GetName(), mZones[p]);
+    }
+  }
+
+  if (pRetired->mMidiHandler)
+    pRetired->mMidiHandler->stopMidi();
+
+  pRetired = nullptr;
+  mSwapping = false;
+
+  DBGMSG("FaustGen-%s: Recompiled DSP installed\n", mName.Get());
+
+  if(mPlug)
+    mPlug->OnParamReset(EParamSource::kRecompile);
+
+  if(mOnCompileFunc)
+    mOnCompileFunc();
+
+  return false;
+}
+
+void FaustGen::RebuildParameters()
+{
+  mAddZones = false;
+  mDSP->buildUserInterface(this);
+  mAddZones = true;
+  BuildParameterMap();
+}
+
+void FaustGen::SwapDSP(DSPSlot* pSlot)
+{
+  // OnReset() may have changed the rate since the DSP was prepared on the main thread
+  const int sampleRate = mSampleRate;
+
+  if (sampleRate && pSlot->mDSP->getSampleRate() != sampleRate)
+    pSlot->mDSP->init(sampleRate);
+
+  std::swap(mDSP, pSlot->mDSP);
+  std::swap(mMidiHandler, pSlot->mMidiHandler);
+  std::swap(mMidiUI, pSlot->mMidiUI);
+  mZones.swap(pSlot->mZones);
+
+  // picks up parameter changes since the DSP was prepared, and the values that init() reset
+  if (!pSlot->mParamsChanged)
+    SyncFaustParams();
+
+  // pSlot now holds the previous DSP. The crossfade needs both DSPs at the same rate, so it is skipped when oversampling
+  if (pSlot->mDSP && !mOverSampler)
+  {
+    mFadeLength = std::max(static_cast<int>(mDSP->getSampleRate() * FAUST_SWAP_FADE_TIME / 1000), 1);
+    mFadePos = 0;
+    mFadingDSP.reset(pSlot);
+  }
+  else
+    mRetiredDSP.store(pSlot);
+}
+
+void FaustGen::ProcessCrossfade(sample** inputs, sample** outputs, int nFrames)
+{
+  ::dsp* pOldDSP = mFadingDSP->mDSP.get();
+  const int nNewOutputs = mDSP->getNumOutputs();
+  const int nOldOutputs = pOldDSP->getNumOutputs();
+  const int nOutputs = std::max(nNewOutputs, nOldOutputs);
+
+  for (auto pos = 0; pos < nFrames; pos += FAUST_SWAP_FADE_BLOCK)
+  {
+    const int n = std::min(nFrames - pos, FAUST_SWAP_FADE_BLOCK);
+
+    for (auto c = 0; c < mMaxNInputs; c++)
+      mFadeInputs[c] = inputs[c] + pos;
+
+    for (auto c = 0; c < mMaxNOutputs; c++)
+      mFadeOutputs[c] = outputs[c] + pos;
+
+    if (mFadePos >= mFadeLength)
+    {
+      mDSP->compute(nFrames - pos, mFadeInputs.data(), mFadeOutputs.data());
+      break;
+    }
+
+    // the outgoing DSP runs first, in case the new one processes in place
+    pOldDSP->compute(n, mFadeInputs.data(), mFadeOldOutputs.data());
+    mDSP->compute(n, mFadeInputs.data(), mFadeOutputs.data());
+
+    for (auto c = 0; c < nOutputs; c++)
+    {
+      sample* pOut = mFadeOutputs[c];
+      const sample* pOld = mFadeOldOutputs[c];
+
+      for (auto s = 0; s < n; s++)
+      {
+        const sample gain = std::min(static_cast<sample>(mFadePos + s) / mFadeLength, static_cast<sample>(1.));
+        const sample newValue = c < nNewOutputs ? pOut[s] : 0.;
+        const sample oldValue = c < nOldOutputs ? pOld[s] : 0.;
+        pOut[s] = oldValue + (gain * (newValue - oldValue));
+      }
+    }
+
+    mFadePos += n;
+  }
+
+  if (mFadePos >= mFadeLength)
+    mRetiredDSP.store(mFadingDSP.release());
+}
+
 void FaustGen::GetDrawPath(WDL_String& path)
 {
   assert(!CStringHasContents(mFactory->mDrawPath.Get()));
@@ -579,13 +1333,27 @@ bool FaustGen::CompileCPP()
 //  return true;
 //}
 
+//static
 void FaustGen::OnTimer(Timer& timer)
 {
   WDL_String* pInputFile;
   bool recompile = false;
+  bool busy = false;
+
+  // the timer runs at the install interval, file changes are checked less often, and only with auto recompile
+  const bool checkFiles = sAutoRecompile && (++sTimerTicks * FAUST_INSTALL_INTERVAL) >= FAUST_RECOMPILE_INTERVAL;
+
+  if (checkFiles)
+    sTimerTicks = 0;
 
   for (auto f : Factory::sFactoryMap)
   {
+    f.second->InstallCompiledDSP();
+    busy = busy || f.second->IsBusy();
+
+    if (!checkFiles || f.second->IsCompiling())
+      continue;
+
     pInputFile = &f.second->mInputDSPFile;
     StatType buf;
     GetStat(pInputFile->Get(), &buf);
@@ -594,13 +1362,16 @@ void FaustGen::OnTimer(Timer& timer)
 
     if(!Equal(newTime, oldTime))
     {
-      WDL_MutexLock lock(&mMutex);
-
-      recompile = true;
-      f.second->FreeDSPFactory();
-      DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", mName.Get());
-      DBGMSG("FaustGen-%s: JIT compiling %s\n", mName.Get(), pInputFile->Get());
-      f.second->LoadFile(pInputFile->Get());
+      // the running DSP carries on while the new one is compiled on a background thread and then crossfaded in
+      DBGMSG("FaustGen-%s: File change detected ----------------------------------\n", f.second->GetName());
+      DBGMSG("FaustGen-%s: JIT compiling %s\n", f.second->GetName(), pInputFile->Get());
+
+      if (f.second->ReadFile(pInputFile->Get()))
+      {
+        f.second->CompileAsync();
+        recompile = true;
+        busy = true;
+      }
     }
       
     f.second->mPreviousTime = newTime;
@@ -609,7 +1380,7 @@ void FaustGen::OnTimer(Timer& timer)
   if(recompile)
   {
     // TODO: should check for successfull JIT
-    DBGMSG("FaustGen-%s: Statically compiling all FAUST blocks\n", mName.Get());
+    DBGMSG("FaustGen: Statically compiling all FAUST blocks\n");
     CompileCPP();
     //WDL_String objFile;
     //objFile.Set(pInputFile);
@@ -623,33 +1394,69 @@ void FaustGen::OnTimer(Timer& timer)
 //
 //    CompileObjectFile(objFile.Get());
   }
+
+  // without auto recompile the timer only runs until the compiles it installs are finished
+  if (!sAutoRecompile && !busy)
+    StopTimer();
+}
+
+//static
+void FaustGen::StartTimer()
+{
+  if(sTimer == nullptr)
+    sTimer = Timer::Create(&FaustGen::OnTimer, FAUST_INSTALL_INTERVAL);
+}
+
+//static
+void FaustGen::StopTimer()
+{
+  if(sTimer != nullptr)
+  {
+    sTimer->Stop();
+    sTimer = nullptr;
+  }
 }
 
 //static
 void FaustGen::SetAutoRecompile(bool enable)
 {
+  sAutoRecompile = enable;
+
   if(enable)
   {
-    if(sTimer == nullptr)
-      sTimer = Timer::Create(std::bind(&FaustGen::OnTimer, this, std::placeholders::_1), FAUST_RECOMPILE_INTERVAL);
+    StartTimer();
   }
   else
   {
-    if(sTimer != nullptr)
+    bool busy = false;
+
+    for (auto f : Factory::sFactoryMap)
     {
-      sTimer->Stop();
-      sTimer = nullptr;
+      busy = busy || f.second->IsBusy();
     }
+
+    // otherwise the timer stops itself once the compiles are installed
+    if (!busy)
+      StopTimer();
   }
-  
-  sAutoRecompile = enable;
 }
 
 void FaustGen::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-  WDL_MutexLock lock(&mMutex);
+  // pick up a recompiled DSP, once the main thread has freed the one replaced by the previous swap
+  if (!mFadingDSP && !mRetiredDSP.load())
+  {
+    if (DSPSlot* pSlot = mPendingDSP.exchange(nullptr))
+      SwapDSP(pSlot);
+  }
+
   if(!mErrored)
-    IPlugFaust::ProcessBlock(inputs, outputs, nFrames);
+  {
+    if (mFadingDSP)
+      ProcessCrossfade(inputs, outputs, nFrames);
+    else
+      IPlugFaust::ProcessBlock(inputs, outputs, nFrames);
+  }
   else
     memset(outputs[0], 0, nFrames * mMaxNOutputs * sizeof(sample));
 }
@@ -21,17 +21,26 @@ using FaustGen = iplug::IPlugFaust; // not used, except for CompileCPP();
 
 #ifndef FAUST_COMPILED
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <set>
 #include <vector>
 #include <map>
+#include <thread>
+#include <chrono>
 
 #include "IPlugPlatform.h"
 #include "IPlugConstants.h"
 #include "IPlugPaths.h"
 
 #include <sys/stat.h>
+#if defined OS_MAC || defined OS_LINUX
+#include <utime.h>
+#else
+#include <direct.h>
+#include <sys/utime.h>
+#endif
 
 #if defined OS_MAC || defined OS_LINUX
 typedef struct stat StatType;
@@ -40,6 +49,9 @@ typedef timespec StatTime;
 static inline int GetStat(const char* path, StatType* pStatbuf) { return stat(path, pStatbuf); }
 static inline StatTime GetModifiedTime(StatType &s) { return s.st_mtimespec; }
 static inline bool Equal(StatTime a, StatTime b) { return (a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec); }
+static inline bool Earlier(StatTime a, StatTime b) { return (a.tv_sec < b.tv_sec) || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec); }
+static inline int MakeDir(const char* path) { return mkdir(path, 0755); }
+static inline void Touch(const char* path) { utime(path, nullptr); }
 static inline StatTime TimeZero()
 {
   StatTime ts;
@@ -59,6 +71,19 @@ static inline int GetStat(const char* path, StatType* pStatbuf)
 }
 static inline StatTime GetModifiedTime(StatType &s) { return s.st_mtime; }
 static inline bool Equal(StatTime a, StatTime b) { return a == b; }
+static inline bool Earlier(StatTime a, StatTime b) { return a < b; }
+static inline int MakeDir(const char* path)
+{
+  wchar_t utf16str[MAX_PATH];
+  iplug::UTF8ToUTF16(utf16str, path, MAX_PATH);
+  return _wmkdir(utf16str);
+}
+static inline void Touch(const char* path)
+{
+  wchar_t utf16str[MAX_PATH];
+  iplug::UTF8ToUTF16(utf16str, path, MAX_PATH);
+  _wutime(utf16str, nullptr);
+}
 static inline StatTime TimeZero() { return (StatTime) 0; }
 #endif
 
@@ -82,6 +107,13 @@ static inline StatTime TimeZero() { return (StatTime) 0; }
 
 #define FAUST_CLASS_PREFIX "F"
 #define FAUST_RECOMPILE_INTERVAL 5000 //ms
+#define FAUST_INSTALL_INTERVAL 100 //ms, how often the timer checks for finished background compiles
+#define FAUST_SWAP_FADE_TIME 20 //ms, crossfade when a recompiled DSP replaces the running one
+#define FAUST_SWAP_FADE_BLOCK 64 //samples
+#define FAUST_CACHE_MAX_ENTRIES 128 // compiled factories kept in the on-disk cache, least recently used are evicted
+#define FAUST_CACHE_FILE_EXT ".fgcache"
+#define FAUST_BENCHMARK_BLOCKS 256 // blocks computed per timing run when benchmarking compile options
+#define FAUST_BENCHMARK_RUNS 5 // the fastest run is taken
 
 #ifndef FAUST_EXE
   #if defined OS_MAC || defined OS_LINUX
@@ -138,6 +170,23 @@ class FaustGen : public IPlugFaust
       
     llvm_dsp_factory* CreateFactoryFromBitCode();
     llvm_dsp_factory* CreateFactoryFromSourceCode();
+
+    /** Loads a factory from the on-disk cache. The entry is only used if the libraries it was compiled with are unchanged, otherwise it is deleted
+     * @param key The cache key, see GetCacheKey()
+     * @return The factory, or nullptr if there is no valid entry */
+    llvm_dsp_factory* CreateFactoryFromCache(const char* key);
+
+    /** Writes the machine code of a factory to the on-disk cache, along with hashes of the libraries that it imports, and evicts the least recently used entries */
+    void WriteToCache(llvm_dsp_factory* pFactory, const char* key);
+
+    /** The cache key is a hash of everything that the compiled code depends on, except for the imported libraries, which are validated when loading
+     * @param key The hash as a hex string
+     * @param argc The number of compile options
+     * @param argv The compile options */
+    void GetCacheKey(WDL_String& key, int argc, const char* argv[]);
+
+    static void GetCacheFolder(WDL_String& path);
+    static void GetCacheFile(WDL_String& path, const char* key);
     
     /** If DSP already exists will return it, otherwise create it
      * @return pointer to the DSP instance */
@@ -153,15 +202,56 @@ class FaustGen : public IPlugFaust
 
     void UpdateSourceCode(const char* str);
 
-    ::dsp* CreateDSPInstance(const MidiHandlerPtr& handler, int nVoices = 0);
+    /** @param pFactory The factory to create the instance from, defaults to the current one */
+    ::dsp* CreateDSPInstance(const MidiHandlerPtr& handler, int nVoices = 0, llvm_dsp_factory* pFactory = nullptr);
     void AddInstance(FaustGen* pDSP) { mInstances.insert(pDSP); }
     void RemoveInstance(FaustGen* pDSP);
 
     bool LoadFile(const char* file);
+    /** Reads the source code from a file without compiling it */
+    bool ReadFile(const char* file);
     bool WriteToFile(const char* file);
+
+    /** Sets additional compile options, e.g. {"-vec", "-vs", "64"}, or {"-opt", "3"} for the LLVM optimization level.
+     * If the DSP has already been compiled, it is recompiled with the new options in the background, and the running DSP
+     * carries on until the result is installed. Call on the main thread
+     * @param options The options, as they would be given to the faust command line compiler */
     void SetCompileOptions(std::initializer_list<const char*> options);
+    void SetCompileOptions(const std::vector<std::string>& options);
+
+    /** Compiles the DSP with a number of vectorization options (-vec, -vs, -lv, -dfs), times each one and keeps the fastest via SetCompileOptions().
+     * This blocks for as long as the compiles take, so call it on the main thread, e.g. during development or from a menu item, not at every launch
+     * @param blockSize The block size to benchmark at, ideally the one the host uses */
+    void OptimizeCompileOptions(int blockSize);
+
+    /** Starts compiling the current source code on a background thread. Call on the main thread.
+     * The timer prepares a new DSP for every instance from the result and hands them over in InstallCompiledDSP()
+     * @return \c false if a previous compile has not been installed yet */
+    bool CompileAsync();
+
+    /** @return \c true if a background compile is running or its result has not been installed yet */
+    bool IsCompiling() const { return mCompileThread.joinable() || mCompileDone; }
+
+    /** @return \c true if a compile or a DSP swap hasn't finished, so the timer is still needed */
+    bool IsBusy() const;
+
+    /** Blocks until the background compile, if any, has finished. Its result is kept and installed as usual */
+    void WaitForCompile() { if (mCompileThread.joinable()) mCompileThread.join(); }
+
+    /** Waits for the background compile, if any, and discards its result */
+    void CancelCompile();
+
+    /** Call on the main thread, regularly. Cleans up after finished DSP swaps and, once all instances are idle,
+     * prepares DSPs from a finished background compile and publishes them to the audio thread.
+     * If the compile failed, the previous DSPs keep running */
+    void InstallCompiledDSP();
 
   private:
+    void CompileThreadProc();
+
+    /** Creates a DSP from the factory and times its compute() on noise
+     * @return The fastest time taken for FAUST_BENCHMARK_BLOCKS blocks, in seconds, or a negative value on failure */
+    static double Benchmark(llvm_dsp_factory* pFactory, int blockSize);
     void AddLibraryPath(const char* libraryPath);
     void AddCompileOption(const char* key, const char* value = "");
   private:
@@ -192,6 +282,10 @@ class FaustGen : public IPlugFaust
     std::set<FaustGen*> mInstances;
 
     llvm_dsp_factory* mLLVMFactory = nullptr;
+    llvm_dsp_factory* mCompiledFactory = nullptr; // result of the background compile, not yet installed
+    std::vector<llvm_dsp_factory*> mRetiredFactories; // replaced factories, deleted once no instance runs their DSPs
+    std::thread mCompileThread;
+    std::atomic<bool> mCompileDone {false};
     WDL_FastString mSourceCodeStr;
     WDL_FastString mBitCodeStr;
     WDL_String mDrawPath;
@@ -206,6 +300,8 @@ class FaustGen : public IPlugFaust
     int mOptimizationLevel = LLVM_OPTIMIZATION;
     static int sFactoryCounter;
     static std::map<std::string, Factory*> sFactoryMap;
+    static WDL_String sCachePath;
+    static bool sCacheEnabled;
     WDL_String mInputDSPFile;
     StatTime mPreviousTime;
   };
@@ -222,12 +318,13 @@ public:
   /** Call this method after constructing the class to inform FaustGen what the maximum I/O count is
    * @param maxNInputs Specify a number here to tell FaustGen the maximum number of inputs the hosting code can accommodate
    * @param maxNOutputs Specify a number here to tell FaustGen the maximum number of outputs the hosting code can accommodate */
-  void SetMaxChannelCount(int maxNInputs, int maxNOutputs) override { mMaxNInputs = maxNInputs; mMaxNOutputs = maxNOutputs; }
+  void SetMaxChannelCount(int maxNInputs, int maxNOutputs) override;
   
   /** Call this method after constructing the class to JIT compile */
   void Init() override;
 
-  void LoadFile(const char* path) { mFactory->FreeDSPFactory(); mFactory->LoadFile(path); }
+  /** Loads new source code. If a DSP is running it is recompiled in the background and swapped in, see Factory::LoadFile() */
+  void LoadFile(const char* path) { mFactory->LoadFile(path); }
   
   /** This method allows SVG files generated by a specific instance of FaustGen can be located. The path to the SVG file for process.svg will be returned, if drawPath has been specified in the constructor.
    * This method will trigger an assertion if drawPath has not been specified
@@ -241,26 +338,114 @@ public:
   //bool CompileObjectFile(const char* fileName);
 
   void SetAutoRecompile(bool enable);
+
+  /** Compiled factories are cached on disk, so that unchanged DSP doesn't need to be compiled again on the next launch. Call before constructing any FaustGen
+   * @param enable Set \c false to always compile from source */
+  static void SetCacheEnabled(bool enable) { Factory::sCacheEnabled = enable; }
+
+  /** Call before constructing any FaustGen
+   * @param path The folder for the compiled factory cache, by default FaustGen/cache in the user's application support folder */
+  static void SetCachePath(const char* path) { Factory::sCachePath.Set(path); }
   
+  /** @see Factory::SetCompileOptions() */
+  void SetCompileOptions(std::initializer_list<const char*> options) { mFactory->SetCompileOptions(options); }
+
+  /** @see Factory::OptimizeCompileOptions() */
+  void OptimizeCompileOptions(int blockSize = DEFAULT_BLOCK_SIZE) { mFactory->OptimizeCompileOptions(blockSize); }
+
   void SetCompileFunc(std::function<void()> func) { mOnCompileFunc = func; }
   
-  void OnTimer(Timer& timer);
+  /** Installs finished background compiles and, with auto recompile, checks the DSP files for changes */
+  static void OnTimer(Timer& timer);
   
   void ProcessBlock(sample** inputs, sample** outputs, int nFrames) override;
   
   void SetErrored(bool errored) { mErrored = errored; }
-  
+
+  /** Frees the DSP, including any DSP that is being swapped in or out */
+  void FreeDSP();
+
+private:
+  /** A DSP instance together with the objects that are tied to it, so that it can be handed between threads and swapped as one */
+  struct DSPSlot
+  {
+    std::unique_ptr<::dsp> mDSP;
+    MidiHandlerPtr mMidiHandler;
+    std::unique_ptr<MidiUI> mMidiUI;
+    std::vector<FAUSTFLOAT*> mZones; // zones of mDSP, in the order of the existing parameters, or in declaration order if they changed. Swapped with the instance's zones
+    bool mParamsChanged = false; // mDSP does not have the same parameters as the DSP it replaces
+  };
+
+  /** Collects the parameter zones of a DSP by label */
+  struct ZoneCollector : public UI
+  {
+    void openTabBox(const char* label) override {}
+    void openHorizontalBox(const char* label) override {}
+    void openVerticalBox(const char* label) override {}
+    void closeBox() override {}
+    void addButton(const char* label, FAUSTFLOAT* zone) override { Add(label, zone); }
+    void addCheckButton(const char* label, FAUSTFLOAT* zone) override { Add(label, zone); }
+    void addVerticalSlider(const char* label, FAUSTFLOAT* zone, FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step) override { Add(label, zone); }
+    void addHorizontalSlider(const char* label, FAUSTFLOAT* zone, FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step) override { Add(label, zone); }
+    void addNumEntry(const char* label, FAUSTFLOAT* zone, FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step) override { Add(label, zone); }
+    void addHorizontalBargraph(const char* label, FAUSTFLOAT* zone, FAUSTFLOAT min, FAUSTFLOAT max) override {}
+    void addVerticalBargraph(const char* label, FAUSTFLOAT* zone, FAUSTFLOAT min, FAUSTFLOAT max) override {}
+    void addSoundfile(const char* label, const char* filename, Soundfile** sf_zone) override {}
+
+    void Add(const char* label, FAUSTFLOAT* zone)
+    {
+      items.Insert(label, zone);
+      ordered.push_back(zone);
+      count++;
+    }
+
+    WDL_StringKeyedArray<FAUSTFLOAT*> items;
+    std::vector<FAUSTFLOAT*> ordered; // in declaration order, as IPlugFaust would add them
+    int count = 0;
+  };
+
+  /** Called on the main thread when a background compile has finished. Creates a DSP from the new factory, initializes it at the current sample rate and copies the current parameter values to it
+   * @return \c false if the DSP doesn't fit the channel count of this instance */
+  bool PrepareDSP(llvm_dsp_factory* pFactory);
+
+  /** Called on the main thread, finishes the prepared DSP and hands it to the audio thread */
+  void PublishDSP();
+
+  /** Called on the main thread, frees the DSP that the audio thread has swapped out and updates the parameters
+   * @return \c true if a swap is still in progress */
+  bool CollectRetiredDSP();
+
+  /** Called on the main thread when the new DSP has different parameters. The zones were installed with the DSP, so only the parameters are rebuilt */
+  void RebuildParameters();
+
+  /** Starts the timer that installs background compiles, if it isn't running */
+  static void StartTimer();
+  static void StopTimer();
+
+  /** Called on the audio thread, installs the DSP and its zones together. If the sample rate changed since the DSP was prepared, it is initialized again */
+  void SwapDSP(DSPSlot* pSlot);
+  void ProcessCrossfade(sample** inputs, sample** outputs, int nFrames);
+
 private:
   Factory* mFactory = nullptr;
   static Timer* sTimer;
   static int sFaustGenCounter;
   static bool sAutoRecompile;
-  int mMaxNInputs = -1;
-  int mMaxNOutputs = -1;
-  bool mErrored = false;
+  std::atomic<bool> mErrored {false};
   std::function<void()> mOnCompileFunc = nullptr;
-  
-  WDL_Mutex mMutex;
+
+  static int sTimerTicks;
+  std::unique_ptr<DSPSlot> mPreparedDSP; // main thread, between preparing and publishing a recompiled DSP
+  std::atomic<DSPSlot*> mPendingDSP {nullptr}; // main thread -> audio thread
+  std::atomic<DSPSlot*> mRetiredDSP {nullptr}; // audio thread -> main thread
+  std::unique_ptr<DSPSlot> mFadingDSP; // audio thread only, the DSP that is being faded out
+  bool mSwapping = false; // main thread only, a DSP has been published and the one it replaces not yet freed
+  int mFadeLength = 0;
+  int mFadePos = 0;
+  WDL_TypedBuf<sample> mFadeBuffer;
+  std::vector<sample*> mFadeInputs;
+  std::vector<sample*> mFadeOutputs;
+  std::vector<sample*> mFadeOldOutputs;
 };
 
 END_IPLUG_NAMESPACE
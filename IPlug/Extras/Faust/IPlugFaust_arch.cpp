@@ -18,7 +18,7 @@ public:
               const char* outputCPPFile = 0,
               const char* drawPath = 0,
               const char* libraryPath = FAUST_SHARE_PATH)
-  : IPlugFaust(name, nVoices)
+  : IPlugFaust(name, nVoices, rate)
   {
   }
 
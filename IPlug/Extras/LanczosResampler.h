@@ -116,43 +116,10 @@ public:
   , mPhaseOutIncr(mInputSampleRate / mOutputSamplerate)
   {
     ClearBuffer();
-    
-    auto kernel = [](double x) {
-      if (std::fabs(x) < 1e-7)
-        return T(1.0);
-      
-      const auto pi = iplug::PI;
-      return T(A * std::sin(pi * x) * std::sin(pi * x / A) / (pi * pi * x * x));
-    };
-    
-    if (!sTablesInitialized)
-    {
-      for (auto t=0; t<kTablePoints+1; ++t)
-      {
-        const double x0 = kDeltaX * t;
-        
-        for (auto i=0; i<kFilterWidth; ++i)
-        {
-          const double x = x0 + i - A;
-          sTable[t][i] = kernel(x);
-        }
-      }
-      
-      for (auto t=0; t<kTablePoints; ++t)
-      {
-        for (auto i=0; i<kFilterWidth; ++i)
-        {
-          sDeltaTable[t][i] = sTable[t + 1][i] - sTable[t][i];
-        }
-      }
-      
-      for (auto i=0; i<kFilterWidth; ++i)
-      {
-        // Wrap at the end - delta is the same
-        sDeltaTable[kTablePoints][i] = sDeltaTable[0][i];
-      }
-      sTablesInitialized = true;
-    }
+
+    // the tables are shared by all instances, a function-local static makes their initialization thread safe
+    static const bool sTablesInitialized = InitTables();
+    (void) sTablesInitialized;
   }
   
   inline size_t GetNumSamplesRequiredFor(size_t nOutputSamples) const
@@ -201,6 +168,14 @@ public:
     mPhaseOut = 0;
   }
 
+  /** Sets the read position of the next output sample, so that a resampler can start part way through a signal, e.g. when it is processed in chunks
+   * @param inputOffset The position in input samples, relative to the next sample to be pushed */
+  void SetPhase(double inputOffset)
+  {
+    mPhaseIn = 0.0;
+    mPhaseOut = inputOffset;
+  }
+
   void Reset()
   {
     ClearBuffer();
@@ -212,6 +187,43 @@ public:
   }
   
 private:
+  static bool InitTables()
+  {
+    auto kernel = [](double x) {
+      if (std::fabs(x) < 1e-7)
+        return T(1.0);
+      
+      const auto pi = iplug::PI;
+      return T(A * std::sin(pi * x) * std::sin(pi * x / A) / (pi * pi * x * x));
+    };
+    
+    for (auto t=0; t<kTablePoints+1; ++t)
+    {
+      const double x0 = kDeltaX * t;
+      
+      for (auto i=0; i<kFilterWidth; ++i)
+      {
+        const double x = x0 + i - A;
+        sTable[t][i] = kernel(x);
+      }
+    }
+    
+    for (auto t=0; t<kTablePoints; ++t)
+    {
+      for (auto i=0; i<kFilterWidth; ++i)
+      {
+        sDeltaTable[t][i] = sTable[t + 1][i] - sTable[t][i];
+      }
+    }
+    
+    for (auto i=0; i<kFilterWidth; ++i)
+    {
+      // Wrap at the end - delta is the same
+      sDeltaTable[kTablePoints][i] = sDeltaTable[0][i];
+    }
+    return true;
+  }
+
 #ifdef IPLUG_SIMDE
   inline void ReadSamples(double xBack, T** outputs, int s, int nChans) const
   {
@@ -315,7 +327,6 @@ private:
   
   static T sTable alignas(16)[kTablePoints + 1][kFilterWidth];
   static T sDeltaTable alignas(16)[kTablePoints + 1][kFilterWidth];
-  static bool sTablesInitialized;
   
   T mInputBuffer[NCHANS][kBufferSize * 2];
   int mWritePos = 0;
@@ -333,8 +344,5 @@ T LanczosResampler<T, NCHANS, A>::sTable alignas(16) [LanczosResampler<T, NCHANS
 template<typename T, int NCHANS, size_t A>
 T LanczosResampler<T, NCHANS, A>::sDeltaTable alignas(16) [LanczosResampler<T, NCHANS, A>::kTablePoints + 1][LanczosResampler::kFilterWidth];
 
-template<typename T, int NCHANS, size_t A>
-bool LanczosResampler<T, NCHANS, A>::sTablesInitialized{false};
-
 } // namespace iplug
 
@@ -0,0 +1,640 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Multichannel lookahead compressor/limiter with O(1) sliding-window peak detection
+ */
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "IPlugUtilities.h"
+#include "Oversampler.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Running maximum over the last N values, using a monotonic deque stored in a ring buffer.
+ * Each value is pushed and popped at most once, so the cost per sample is amortised O(1) regardless of window length */
+template<typename T>
+class SlidingWindowMax
+{
+public:
+  SlidingWindowMax(int windowSize = 1)
+  {
+    SetMaxWindowSize(windowSize);
+    SetWindowSize(windowSize);
+  }
+
+  /** Allocates for windows up to maxWindowSize and resets. Don't call this on the audio thread */
+  void SetMaxWindowSize(int maxWindowSize)
+  {
+    // the deque can hold one expired entry before it is popped
+    mCapacity = std::max(maxWindowSize, 1) + 1;
+    mValues.Resize(mCapacity);
+    mIndices.Resize(mCapacity);
+    mScratchValues.Resize(mCapacity);
+    mScratchIndices.Resize(mCapacity);
+    mWindowSize = std::min(mWindowSize, mCapacity - 1);
+    Reset();
+  }
+
+  /** Changes the window without losing the values already seen. This only allocates if the window is larger than the maximum */
+  void SetWindowSize(int windowSize)
+  {
+    windowSize = std::max(windowSize, 1);
+
+    if (windowSize >= mCapacity)
+      SetMaxWindowSize(windowSize);
+
+    mWindowSize = windowSize;
+  }
+
+  /** Copies the state of another instance with the same maximum window size */
+  void CopyFrom(const SlidingWindowMax& other)
+  {
+    assert(other.mCapacity == mCapacity);
+    memcpy(mValues.Get(), other.mValues.Get(), mCapacity * sizeof(T));
+    memcpy(mIndices.Get(), other.mIndices.Get(), mCapacity * sizeof(uint32_t));
+    mWindowSize = other.mWindowSize;
+    mFront = other.mFront;
+    mCount = other.mCount;
+    mTime = other.mTime;
+  }
+
+  /** Combines the values seen by another instance that has processed the same number of values, so that from now on
+   * the maximum covers both */
+  void MergeFrom(const SlidingWindowMax& other)
+  {
+    if (other.mTime != mTime || other.mCapacity != mCapacity)
+      return;
+
+    T* scratchValues = mScratchValues.Get();
+    uint32_t* scratchIndices = mScratchIndices.Get();
+    const int nOwn = mCount;
+
+    for (auto i = 0; i < nOwn; i++)
+    {
+      scratchValues[i] = mValues.Get()[Wrap(mFront + i)];
+      scratchIndices[i] = mIndices.Get()[Wrap(mFront + i)];
+    }
+
+    mFront = 0;
+    mCount = 0;
+
+    // both deques are in time order, so push their entries oldest first
+    for (auto i = 0, j = 0; i < nOwn || j < other.mCount;)
+    {
+      const int otherIdx = other.Wrap(other.mFront + j);
+
+      if (j == other.mCount || (i < nOwn && (int32_t) (scratchIndices[i] - other.mIndices.Get()[otherIdx]) <= 0))
+      {
+        Push(scratchValues[i], scratchIndices[i]);
+        i++;
+      }
+      else
+      {
+        Push(other.mValues.Get()[otherIdx], other.mIndices.Get()[otherIdx]);
+        j++;
+      }
+    }
+  }
+
+  void Reset()
+  {
+    mFront = 0;
+    mCount = 0;
+    mTime = 0;
+  }
+
+  inline T Process(T x)
+  {
+    Push(x, mTime);
+
+    // drop the oldest entries once they leave the window, which can be more than one after the window shrinks
+    // (unsigned arithmetic handles wrap-around)
+    while ((uint32_t) (mTime - mIndices.Get()[mFront]) >= (uint32_t) mWindowSize)
+    {
+      mFront = Wrap(mFront + 1);
+      mCount--;
+    }
+
+    mTime++;
+
+    return mValues.Get()[mFront];
+  }
+
+  int GetWindowSize() const { return mWindowSize; }
+
+private:
+  inline int Wrap(int idx) const { return idx >= mCapacity ? idx - mCapacity : idx; }
+  inline int Back() const { return Wrap(mFront + mCount - 1); }
+
+  inline void Push(T x, uint32_t time)
+  {
+    T* values = mValues.Get();
+    uint32_t* indices = mIndices.Get();
+
+    // drop entries that can never be the maximum again
+    while (mCount > 0 && values[Back()] <= x)
+      mCount--;
+
+    if (mCount > 0 && indices[Back()] == time)
+      return;
+
+    const int back = Wrap(mFront + mCount);
+    values[back] = x;
+    indices[back] = time;
+    mCount++;
+  }
+
+  WDL_TypedBuf<T> mValues;
+  WDL_TypedBuf<uint32_t> mIndices;
+  WDL_TypedBuf<T> mScratchValues;
+  WDL_TypedBuf<uint32_t> mScratchIndices;
+  int mWindowSize = 1;
+  int mCapacity = 0;
+  int mFront = 0;
+  int mCount = 0;
+  uint32_t mTime = 0;
+};
+
+/** A feed-forward lookahead compressor. The input is delayed by the lookahead time, while the
+ * detector sees the undelayed signal. Peaks are held for the lookahead window with a SlidingWindowMax, and the gain
+ * is smoothed with a moving average whose length is the attack time, so gain reduction is fully applied by the time
+ * a peak reaches the output. Channels can be linked (one gain for all channels) or processed independently.
+ * Optionally the detector can run on an oversampled copy of the input to catch inter-sample (true) peaks.
+ * Buffers are allocated for a maximum lookahead time (see SetMaxLookaheadTime()), so the times can be automated without
+ * allocating or clearing any state.
+ * @tparam T sample type
+ * @tparam NC maximum number of channels */
+template<typename T, int NC = 2>
+class LookaheadCompressor
+{
+public:
+  LookaheadCompressor()
+  : mTruePeakOverSampler(kNone, true, NC, NC)
+  {
+    mTruePeakFunc = [this](T** inputs, T**, int nFrames) {
+      const int stride = mTruePeakOverSampler.GetRate() * mBlockSize;
+
+      for (auto c = 0; c < mTruePeakNChans; c++)
+      {
+        T* dst = mTruePeakBuf.Get() + (c * stride) + (mTruePeakChunk * nFrames);
+        for (auto s = 0; s < nFrames; s++)
+          dst[s] = std::abs(inputs[c][s]);
+      }
+
+      mTruePeakChunk++;
+    };
+
+    Allocate();
+  }
+
+  LookaheadCompressor(const LookaheadCompressor&) = delete;
+  LookaheadCompressor& operator=(const LookaheadCompressor&) = delete;
+
+  /** Call from OnReset(). Allocates all buffers, nothing is allocated in ProcessBlock()
+   * @param sampleRate The sample rate
+   * @param blockSize The maximum block size that will be passed to ProcessBlock() */
+  void Reset(double sampleRate, int blockSize = DEFAULT_BLOCK_SIZE)
+  {
+    mSampleRate = sampleRate;
+    mBlockSize = blockSize;
+    mTruePeakOverSampler.Reset(blockSize);
+    mTruePeakBuf.Resize(blockSize * mTruePeakOverSampler.GetRate() * NC);
+    mLevelBuf.Resize(blockSize * NC);
+    Allocate();
+  }
+
+  void SetThreshold(double thresholdDB) { mThresholdDB = thresholdDB; }
+
+  /** @param ratio Compression ratio, e.g. 4 for 4:1. Values <= 1 disable compression, use a very large value (or LookaheadLimiter) for limiting */
+  void SetRatio(double ratio) { mSlope = ratio > 1. ? (1. / ratio) - 1. : 0.; }
+
+  void SetKnee(double kneeDB) { mKneeDB = std::max(kneeDB, 0.); }
+
+  void SetMakeupGain(double gainDB) { mMakeup = DBToAmp(gainDB); }
+
+  /** Allocates the buffers for lookahead times up to maxLookaheadTime, and clears them if they grow.
+   * Call it from OnReset() or the UI thread, not ProcessBlock()
+   * @param maxLookaheadTime The longest lookahead time in seconds that SetLookaheadTime() will be given */
+  void SetMaxLookaheadTime(double maxLookaheadTime)
+  {
+    mMaxLookaheadTime = std::max(maxLookaheadTime, 0.);
+
+    if (ToSamples(std::max(mMaxLookaheadTime, mLookaheadTime)) > mCapacity)
+      Allocate();
+  }
+
+  /** Changing the lookahead changes latency. Up to the maximum lookahead time this doesn't allocate and keeps the
+   * audio in the delay line, beyond it the buffers grow and are cleared, so that must not happen on the audio thread.
+   * A longer lookahead replays audio whose peaks the detector has already released, so it can briefly overshoot
+   * @param lookaheadTime Lookahead time in seconds */
+  void SetLookaheadTime(double lookaheadTime)
+  {
+    mLookaheadTime = std::max(lookaheadTime, 0.);
+
+    if (ToSamples(mLookaheadTime) > mCapacity)
+      Allocate();
+    else
+      UpdateTimes();
+  }
+
+  /** @param attackTime Attack time in seconds. Limited to the lookahead time */
+  void SetAttackTime(double attackTime)
+  {
+    mAttackTime = std::max(attackTime, 0.);
+    UpdateTimes();
+  }
+
+  /** @param releaseTime Release time in seconds */
+  void SetReleaseTime(double releaseTime)
+  {
+    mReleaseTime = std::max(releaseTime, 0.);
+    mReleaseCoeff = mReleaseTime > 0. ? std::exp(-1.0 / (mReleaseTime * mSampleRate)) : 0.;
+  }
+
+  /** Switches the detector without clearing the delay line. The new detectors start from the gain reduction of the old
+   * ones, so peaks that are already in the delay line are still caught
+   * @param linked If true all channels share the gain from the loudest channel, otherwise each channel has its own detector */
+  void SetLinked(bool linked)
+  {
+    if (linked == mLinked)
+      return;
+
+    mLinked = linked;
+
+    if (linked)
+    {
+      for (auto c = 1; c < mNChans; c++)
+        mChains[0].MergeFrom(mChains[c]);
+    }
+    else
+    {
+      for (auto c = 1; c < NC; c++)
+        mChains[c].CopyFrom(mChains[0]);
+    }
+  }
+
+  /** Enable true-peak detection by running the detector on an oversampled copy of the input.
+   * This reallocates buffers, so call it from OnReset() or the UI thread, not ProcessBlock()
+   * @param factor The oversampling factor, kNone for sample-peak detection */
+  void SetTruePeakOverSampling(EFactor factor)
+  {
+    if (OverSampler<T>::RateToFactor(mTruePeakOverSampler.GetRate()) != factor)
+    {
+      mTruePeakOverSampler.SetOverSampling(factor);
+      Reset(mSampleRate, mBlockSize);
+    }
+  }
+
+  /** @return The latency introduced by the lookahead in samples. Report this to the host with SetLatency() */
+  int GetLatency() const { return mLookaheadSamples; }
+
+  /** @return The current gain reduction in dB (<= 0) for a channel, useful for metering */
+  double GetGainReductionDB(int chan = 0) const
+  {
+    return AmpToDB(std::max(mChains[mLinked ? 0 : chan].mLastGain, 1e-10));
+  }
+
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames)
+  {
+    assert(nChans <= NC);
+    assert(nFrames <= mBlockSize);
+
+    const int nChains = mLinked ? 1 : nChans;
+    mNChans = nChans;
+
+    ComputeLevels(inputs, nChans, nFrames);
+
+    // outputs = lookahead-delayed inputs, gain is then applied in-place
+    for (auto c = 0; c < nChans; c++)
+    {
+      T* delay = mDelayBuf.Get() + (c * mCapacity);
+      int writePos = mDelayPos;
+      int readPos = writePos - mLookaheadSamples;
+      if (readPos < 0)
+        readPos += mCapacity;
+
+      for (auto s = 0; s < nFrames; s++)
+      {
+        const T input = inputs[c][s];
+        outputs[c][s] = delay[readPos];
+        delay[writePos] = input;
+
+        if (++writePos == mCapacity)
+          writePos = 0;
+        if (++readPos == mCapacity)
+          readPos = 0;
+      }
+    }
+
+    mDelayPos = (mDelayPos + nFrames) % mCapacity;
+
+    for (auto i = 0; i < nChains; i++)
+    {
+      GainChain& chain = mChains[i];
+      const T* levels = mLevelBuf.Get() + (i * mBlockSize);
+
+      for (auto s = 0; s < nFrames; s++)
+      {
+        const double gain = chain.Process(ComputeGain(levels[s]), mReleaseCoeff) * mMakeup;
+
+        if (mLinked)
+        {
+          for (auto c = 0; c < nChans; c++)
+            outputs[c][s] *= (T) gain;
+        }
+        else
+          outputs[i][s] *= (T) gain;
+      }
+    }
+  }
+
+private:
+  /** Per-detector state: peak hold over the lookahead window, instant attack/one-pole release, then a moving average over the attack window */
+  struct GainChain
+  {
+    SlidingWindowMax<double> mHold; // holds the maximum *reduction*, stored as negative gain
+    WDL_TypedBuf<double> mAvgBuf; // the envelope history for the longest average, so that its length can change
+    double mAvgSum = 0.;
+    int mAvgLen = 1;
+    int mAvgPos = 0;
+    double mEnvelope = 1.;
+    double mLastGain = 1.;
+    int mSamplesSinceResum = 0;
+
+    /** Allocates for windows up to maxLen samples and resets */
+    void Allocate(int maxLen)
+    {
+      mHold.SetMaxWindowSize(maxLen + 1);
+      mAvgBuf.Resize(std::max(maxLen, 1));
+      mAvgLen = std::min(mAvgLen, mAvgBuf.GetSize());
+      Reset();
+    }
+
+    /** Changes the window lengths without allocating or losing the history */
+    void SetLengths(int holdLen, int avgLen)
+    {
+      mHold.SetWindowSize(holdLen);
+      avgLen = Clip(avgLen, 1, mAvgBuf.GetSize());
+
+      if (avgLen != mAvgLen)
+      {
+        mAvgLen = avgLen;
+        Resum();
+      }
+    }
+
+    void Reset()
+    {
+      mHold.Reset();
+      std::fill(mAvgBuf.Get(), mAvgBuf.Get() + mAvgBuf.GetSize(), 1.);
+      mAvgSum = mAvgLen;
+      mAvgPos = 0;
+      mEnvelope = 1.;
+      mLastGain = 1.;
+      mSamplesSinceResum = 0;
+    }
+
+    void CopyFrom(const GainChain& other)
+    {
+      mHold.CopyFrom(other.mHold);
+      memcpy(mAvgBuf.Get(), other.mAvgBuf.Get(), mAvgBuf.GetSize() * sizeof(double));
+      mAvgSum = other.mAvgSum;
+      mAvgLen = other.mAvgLen;
+      mAvgPos = other.mAvgPos;
+      mEnvelope = other.mEnvelope;
+      mLastGain = other.mLastGain;
+      mSamplesSinceResum = other.mSamplesSinceResum;
+    }
+
+    /** Takes the larger gain reduction of this chain and another at every stage, so the result catches the peaks of both */
+    void MergeFrom(const GainChain& other)
+    {
+      mHold.MergeFrom(other.mHold);
+
+      double* buf = mAvgBuf.Get();
+      const double* otherBuf = other.mAvgBuf.Get();
+      const int offset = other.mAvgPos - mAvgPos;
+      const int size = mAvgBuf.GetSize();
+
+      for (auto i = 0; i < size; i++)
+        buf[i] = std::min(buf[i], otherBuf[(i + offset + size) % size]);
+
+      mEnvelope = std::min(mEnvelope, other.mEnvelope);
+      mLastGain = std::min(mLastGain, other.mLastGain);
+      Resum();
+    }
+
+    void Resum()
+    {
+      const double* buf = mAvgBuf.Get();
+      const int size = mAvgBuf.GetSize();
+      mAvgSum = 0.;
+
+      for (auto i = 1; i <= mAvgLen; i++)
+        mAvgSum += buf[(mAvgPos - i + size) % size];
+
+      mSamplesSinceResum = 0;
+    }
+
+    inline double Process(double targetGain, double releaseCoeff)
+    {
+      const double held = -mHold.Process(-targetGain);
+
+      if (held < mEnvelope)
+        mEnvelope = held;
+      else
+        mEnvelope = held + releaseCoeff * (mEnvelope - held);
+
+      double* buf = mAvgBuf.Get();
+      const int size = mAvgBuf.GetSize();
+      int oldest = mAvgPos - mAvgLen;
+      if (oldest < 0)
+        oldest += size;
+
+      mAvgSum += mEnvelope - buf[oldest];
+      buf[mAvgPos] = mEnvelope;
+      if (++mAvgPos == size)
+        mAvgPos = 0;
+
+      // re-sum periodically so floating point error in the running sum can't accumulate
+      if (++mSamplesSinceResum >= 65536)
+        Resum();
+
+      mLastGain = mAvgSum / mAvgLen;
+      return mLastGain;
+    }
+  };
+
+  int ToSamples(double time) const { return std::max(1, (int) std::round(time * mSampleRate)); }
+
+  /** Allocates all the buffers for the maximum lookahead time and clears them */
+  void Allocate()
+  {
+    mCapacity = ToSamples(std::max(mMaxLookaheadTime, mLookaheadTime));
+    mDelayBuf.Resize(mCapacity * NC);
+    memset(mDelayBuf.Get(), 0, mCapacity * NC * sizeof(T));
+    mDelayPos = 0;
+
+    for (auto c = 0; c < NC; c++)
+      mChains[c].Allocate(mCapacity);
+
+    SetReleaseTime(mReleaseTime);
+    UpdateTimes();
+  }
+
+  /** Applies the lookahead and attack times to the delay line and detectors, without allocating */
+  void UpdateTimes()
+  {
+    mLookaheadSamples = std::min(ToSamples(mLookaheadTime), mCapacity);
+    const int attackSamples = Clip((int) std::round(mAttackTime * mSampleRate), 1, mLookaheadSamples);
+
+    for (auto c = 0; c < NC; c++)
+      mChains[c].SetLengths(mLookaheadSamples + 1, attackSamples);
+  }
+
+  /** Fills mLevelBuf with the absolute detector level for each chain */
+  void ComputeLevels(T** inputs, int nChans, int nFrames)
+  {
+    const int rate = mTruePeakOverSampler.GetRate();
+    T* levels = mLevelBuf.Get();
+
+    if (rate > 1)
+    {
+      mTruePeakNChans = nChans;
+      mTruePeakChunk = 0;
+      // no output channels, so the oversampler only runs the upsampling stages
+      mTruePeakOverSampler.ProcessBlock(inputs, inputs, nFrames, nChans, 0, mTruePeakFunc);
+
+      // the upsampled stream is split into rate chunks of nFrames, so sample s covers [s * rate, s * rate + rate)
+      const int stride = rate * mBlockSize;
+
+      for (auto s = 0; s < nFrames; s++)
+      {
+        T linkedPeak = 0;
+
+        for (auto c = 0; c < nChans; c++)
+        {
+          const T* upPeaks = mTruePeakBuf.Get() + (c * stride) + (s * rate);
+          // the IIR upsampler doesn't pass the original samples through unchanged, so include the sample peak too
+          T peak = std::abs(inputs[c][s]);
+          for (auto r = 0; r < rate; r++)
+            peak = std::max(peak, upPeaks[r]);
+
+          if (mLinked)
+            linkedPeak = std::max(linkedPeak, peak);
+          else
+            levels[(c * mBlockSize) + s] = peak;
+        }
+
+        if (mLinked)
+          levels[s] = linkedPeak;
+      }
+    }
+    else if (mLinked)
+    {
+      for (auto s = 0; s < nFrames; s++)
+      {
+        T peak = 0;
+        for (auto c = 0; c < nChans; c++)
+          peak = std::max(peak, (T) std::abs(inputs[c][s]));
+        levels[s] = peak;
+      }
+    }
+    else
+    {
+      for (auto c = 0; c < nChans; c++)
+      {
+        T* dst = levels + (c * mBlockSize);
+        for (auto s = 0; s < nFrames; s++)
+          dst[s] = std::abs(inputs[c][s]);
+      }
+    }
+  }
+
+  /** Static gain curve with a quadratic soft knee
+   * @return linear gain for a given absolute level */
+  inline double ComputeGain(double level) const
+  {
+    if (mSlope == 0. || level <= 1e-10)
+      return 1.;
+
+    const double over = AmpToDB(level) - mThresholdDB;
+    double reductionDB;
+
+    if (2. * over < -mKneeDB)
+      return 1.;
+    else if (mKneeDB > 0. && 2. * std::abs(over) <= mKneeDB)
+    {
+      const double x = over + mKneeDB * 0.5;
+      reductionDB = mSlope * x * x / (2. * mKneeDB);
+    }
+    else
+      reductionDB = mSlope * over;
+
+    return DBToAmp(reductionDB);
+  }
+
+protected:
+  double mSlope = (1. / 4.) - 1.;
+
+private:
+  WDL_TypedBuf<T> mDelayBuf;
+  OverSampler<T> mTruePeakOverSampler;
+  typename OverSampler<T>::BlockProcessFunc mTruePeakFunc;
+  WDL_TypedBuf<T> mTruePeakBuf;
+  WDL_TypedBuf<T> mLevelBuf;
+  GainChain mChains[NC];
+  int mTruePeakChunk = 0;
+  int mTruePeakNChans = 0;
+
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  int mBlockSize = DEFAULT_BLOCK_SIZE;
+  double mThresholdDB = -12.;
+  double mKneeDB = 0.;
+  double mMakeup = 1.;
+  double mLookaheadTime = 0.005;
+  double mMaxLookaheadTime = 0.;
+  double mAttackTime = 0.005;
+  double mReleaseTime = 0.1;
+  double mReleaseCoeff = 0.;
+  int mLookaheadSamples = 1;
+  int mCapacity = 1;
+  int mDelayPos = 0;
+  int mNChans = NC;
+  bool mLinked = true;
+};
+
+/** A brickwall lookahead limiter: a LookaheadCompressor with an infinite ratio and no knee.
+ * With the attack equal to the lookahead, the output never exceeds the ceiling (at the detector's resolution) */
+template<typename T, int NC = 2>
+class LookaheadLimiter : public LookaheadCompressor<T, NC>
+{
+public:
+  LookaheadLimiter()
+  {
+    this->mSlope = -1.;
+    this->SetThreshold(-0.3);
+  }
+
+  void SetCeiling(double ceilingDB) { this->SetThreshold(ceilingDB); }
+
+private:
+  using LookaheadCompressor<T, NC>::SetRatio;
+  using LookaheadCompressor<T, NC>::SetKnee;
+};
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,317 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A multichannel, multi-tap delay line with modulated fractional delay times
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+#if defined IPLUG_SIMDE
+  #if defined(__arm64__)
+    #define SIMDE_ENABLE_NATIVE_ALIASES
+    #include "simde/x86/sse2.h"
+  #else
+    #include <emmintrin.h>
+  #endif
+#endif
+
+#include "heapbuf.h"
+#include "IPlugConstants.h"
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+enum class EDelayInterpolation
+{
+  kLinear = 0,
+  kLagrange, // 3rd order, 4 points
+  kAllpass   // 1st order Thiran, stateful - best for constant or slowly modulated delays inside feedback loops
+};
+
+/** Interpolates four taps at once. Each tap reads the points at delays i-1, i, i+1 and i+2 from a mirrored buffer,
+ * where idx[k] is the buffer index of the sample at delay i for tap k and frac[k] is the fractional part of its delay */
+template<typename T>
+struct DelayTapKernel
+{
+  static inline void Process(const T* buf, const int* idx, const T* frac, EDelayInterpolation mode, T* state, T* out)
+  {
+    for (auto k = 0; k < 4; k++)
+    {
+      const T* p = buf + idx[k];
+      const T f = frac[k];
+
+      switch (mode)
+      {
+        case EDelayInterpolation::kLinear:
+          out[k] = p[0] + f * (p[-1] - p[0]);
+          break;
+        case EDelayInterpolation::kLagrange:
+        {
+          const T fm1 = f - T(1), fm2 = f - T(2), fp1 = f + T(1);
+          out[k] = (-f * fm1 * fm2 / T(6)) * p[1]
+                 + (fp1 * fm1 * fm2 / T(2)) * p[0]
+                 + (-fp1 * f * fm2 / T(2)) * p[-1]
+                 + (fp1 * f * fm1 / T(6)) * p[-2];
+          break;
+        }
+        case EDelayInterpolation::kAllpass:
+        {
+          const T a = (T(1) - f) / (T(1) + f);
+          out[k] = state[k] = a * p[0] + p[-1] - a * state[k];
+          break;
+        }
+      }
+    }
+  }
+};
+
+#ifdef IPLUG_SIMDE
+template<>
+struct DelayTapKernel<float>
+{
+  static inline void Process(const float* buf, const int* idx, const float* frac, EDelayInterpolation mode, float* state, float* out)
+  {
+    // each load picks up [x(i+2), x(i+1), x(i), x(i-1)] for one tap, transposing gives one vector per point across taps
+    __m128 xp2 = _mm_loadu_ps(buf + idx[0] - 2);
+    __m128 xp1 = _mm_loadu_ps(buf + idx[1] - 2);
+    __m128 x0 = _mm_loadu_ps(buf + idx[2] - 2);
+    __m128 xm1 = _mm_loadu_ps(buf + idx[3] - 2);
+    _MM_TRANSPOSE4_PS(xp2, xp1, x0, xm1);
+
+    const __m128 f = _mm_loadu_ps(frac);
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 y;
+
+    switch (mode)
+    {
+      case EDelayInterpolation::kLinear:
+        y = _mm_add_ps(x0, _mm_mul_ps(f, _mm_sub_ps(xp1, x0)));
+        break;
+      case EDelayInterpolation::kLagrange:
+      {
+        const __m128 fm1 = _mm_sub_ps(f, one);
+        const __m128 fm2 = _mm_sub_ps(f, _mm_set1_ps(2.f));
+        const __m128 fp1 = _mm_add_ps(f, one);
+        const __m128 sixth = _mm_set1_ps(1.f / 6.f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 ffm1 = _mm_mul_ps(f, fm1);
+        const __m128 fp1fm2 = _mm_mul_ps(fp1, fm2);
+        const __m128 h0 = _mm_mul_ps(_mm_mul_ps(ffm1, fm2), _mm_set1_ps(-1.f / 6.f));
+        const __m128 h1 = _mm_mul_ps(_mm_mul_ps(fp1fm2, fm1), half);
+        const __m128 h2 = _mm_mul_ps(_mm_mul_ps(fp1fm2, f), _mm_set1_ps(-0.5f));
+        const __m128 h3 = _mm_mul_ps(_mm_mul_ps(ffm1, fp1), sixth);
+        y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h0, xm1), _mm_mul_ps(h1, x0)),
+                       _mm_add_ps(_mm_mul_ps(h2, xp1), _mm_mul_ps(h3, xp2)));
+        break;
+      }
+      case EDelayInterpolation::kAllpass:
+      default:
+      {
+        const __m128 a = _mm_div_ps(_mm_sub_ps(one, f), _mm_add_ps(one, f));
+        const __m128 s = _mm_loadu_ps(state);
+        y = _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(x0, s)), xp1);
+        _mm_storeu_ps(state, y);
+        break;
+      }
+    }
+
+    _mm_storeu_ps(out, y);
+  }
+};
+#endif
+
+/** A multichannel delay line with NTAPS read taps, each with a smoothed base delay, an optional per-sample modulation
+ * signal and an output gain. Delay times are fractional and in samples. Taps are interpolated in groups of four,
+ * using SSE when IPLUG_SIMDE is defined (float only), so chorus/flanger/diffusion structures don't pay per-tap scalar
+ * interpolation costs. Define IPLUG_SIMDE at project level to enable SIMD, see LanczosResampler.h
+ * @tparam T sample type
+ * @tparam NC maximum number of channels
+ * @tparam NTAPS number of taps */
+template<typename T = double, int NC = 2, int NTAPS = 4>
+class ModulatedDelayLine
+{
+#ifdef IPLUG_SIMDE
+  static_assert(std::is_same<T, float>::value, "ModulatedDelayLine requires T to be float when using SIMD instructions");
+#endif
+
+  static constexpr int kNumGroups = (NTAPS + 3) / 4;
+  static constexpr int kNumLanes = kNumGroups * 4;
+
+public:
+  ModulatedDelayLine(EDelayInterpolation mode = EDelayInterpolation::kLagrange)
+  : mMode(mode)
+  {
+    for (auto t = 0; t < kNumLanes; t++)
+    {
+      mTapTarget[t] = mTapDelay[t] = T(1);
+      mTapGain[t] = t < NTAPS ? T(1) / NTAPS : T(0);
+    }
+
+    SetSmoothTime(20.);
+    SetMaxDelayTime(4096);
+  }
+
+  /** Allocates the buffer. Call from OnReset(), not from the audio thread
+   * @param maxDelaySamples The longest delay (including modulation) any tap will need */
+  void SetMaxDelayTime(int maxDelaySamples)
+  {
+    mMaxDelay = std::max(maxDelaySamples, 2);
+    int size = 1;
+    while (size < mMaxDelay + 4)
+      size <<= 1;
+    mSize = size;
+    mMask = size - 1;
+    // mirrored buffer: every sample is written twice so reads never have to wrap
+    // the padding covers the 4-point load of an allpass tap at delay 0 on the last channel
+    mBuffer.Resize(NC * mSize * 2 + 4);
+    mWritePos = 0;
+    ClearBuffer();
+  }
+
+  void ClearBuffer()
+  {
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(T));
+    memset(mAllpassState, 0, sizeof(mAllpassState));
+  }
+
+  void SetInterpolation(EDelayInterpolation mode)
+  {
+    mMode = mode;
+    memset(mAllpassState, 0, sizeof(mAllpassState));
+  }
+
+  /** @param timeMs Time constant for tap delay changes made with SetTapDelay()
+   * @param sampleRate The sample rate */
+  void SetSmoothTime(double timeMs, double sampleRate = DEFAULT_SAMPLE_RATE)
+  {
+    mSmoothCoeff = T(1. - std::exp(-1. / (timeMs * 0.001 * sampleRate)));
+  }
+
+  /** @param tap Tap index
+   * @param delaySamples Base delay in samples. The tap glides to the new value over the smoothing time */
+  void SetTapDelay(int tap, double delaySamples)
+  {
+    assert(tap < NTAPS);
+    mTapTarget[tap] = T(Clamp(delaySamples));
+  }
+
+  /** Set a tap delay immediately, without smoothing. Use on init or after ClearBuffer() */
+  void SetTapDelayImmediate(int tap, double delaySamples)
+  {
+    assert(tap < NTAPS);
+    mTapTarget[tap] = mTapDelay[tap] = T(Clamp(delaySamples));
+  }
+
+  void SetTapGain(int tap, double gain)
+  {
+    assert(tap < NTAPS);
+    mTapGain[tap] = T(gain);
+  }
+
+  /** Delay the input and sum the weighted taps into the output
+   * @param inputs Non-interleaved input buffers
+   * @param outputs Non-interleaved output buffers, may be the same as inputs
+   * @param nChans Number of channels to process, must be <= NC
+   * @param nFrames Number of sample frames
+   * @param tapModulation Optional per-tap modulation in samples, [NTAPS][nFrames], added to each tap's base delay and shared by all channels
+   * @param tapOutputs Optional per-channel, per-tap outputs, [nChans * NTAPS][nFrames], e.g. for feeding a diffusion network. Taps are not weighted by their gain */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames, T** tapModulation = nullptr, T** tapOutputs = nullptr)
+  {
+    assert(nChans <= NC);
+
+    alignas(16) int idx[kNumLanes];
+    alignas(16) T frac[kNumLanes];
+    alignas(16) T taps[kNumLanes];
+    const T maxDelay = T(mMaxDelay);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      // read positions are identical for every channel, so compute them once per frame
+      for (auto t = 0; t < kNumLanes; t++)
+      {
+        mTapDelay[t] += (mTapTarget[t] - mTapDelay[t]) * mSmoothCoeff;
+
+        T delay = mTapDelay[t];
+        if (tapModulation && t < NTAPS)
+          delay = std::min(std::max(delay + tapModulation[t][s], T(1)), maxDelay);
+
+        int i = static_cast<int>(delay);
+        T f = delay - T(i);
+
+        // keep the allpass coefficient away from the pole at -1 by using a fractional part in [0.5, 1.5)
+        if (mMode == EDelayInterpolation::kAllpass && f < T(0.5))
+        {
+          i--;
+          f += T(1);
+        }
+
+        idx[t] = mSize + mWritePos - i;
+        frac[t] = f;
+      }
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        T* buf = mBuffer.Get() + (c * mSize * 2);
+        const T input = inputs[c][s];
+        buf[mWritePos] = input;
+        buf[mWritePos + mSize] = input;
+
+        T sum = T(0);
+
+        for (auto g = 0; g < kNumGroups; g++)
+        {
+          const int lane = g * 4;
+          DelayTapKernel<T>::Process(buf, idx + lane, frac + lane, mMode, mAllpassState[c] + lane, taps + lane);
+
+          for (auto k = 0; k < 4; k++)
+            sum += taps[lane + k] * mTapGain[lane + k];
+        }
+
+        if (tapOutputs)
+        {
+          for (auto t = 0; t < NTAPS; t++)
+            tapOutputs[(c * NTAPS) + t][s] = taps[t];
+        }
+
+        outputs[c][s] = sum;
+      }
+
+      mWritePos = (mWritePos + 1) & mMask;
+    }
+  }
+
+private:
+  /** Delays are limited to [1, max] so the 4-point kernels always read written samples within the mirrored buffer */
+  double Clamp(double delaySamples) const
+  {
+    return std::min(std::max(delaySamples, 1.), (double) mMaxDelay);
+  }
+
+  WDL_TypedBuf<T> mBuffer;
+  int mSize = 0;
+  int mMask = 0;
+  int mWritePos = 0;
+  int mMaxDelay = 0;
+  EDelayInterpolation mMode;
+  T mSmoothCoeff = T(1);
+  alignas(16) T mTapDelay[kNumLanes];
+  alignas(16) T mTapTarget[kNumLanes];
+  alignas(16) T mTapGain[kNumLanes];
+  alignas(16) T mAllpassState[NC][kNumLanes];
+} WDL_FIXALIGN;
+
+END_IPLUG_NAMESPACE
@@ -0,0 +1,390 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Converts whole multichannel buffers, such as impulse responses and samples being loaded, to another sample rate on several threads
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "resample.h"
+#include "heapbuf.h"
+
+#include "IPlugPlatform.h"
+#include "LanczosResampler.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Resamples complete buffers by splitting the output into chunks that are converted in parallel, by a pool of worker threads
+ * and the calling thread. Each chunk's resampler starts a little earlier in the input, so that its filter history is primed
+ * when the chunk begins, and its start phase is computed from the chunk's absolute output position rather than accumulated,
+ * so the chunks join seamlessly and the result matches a single resampler run over the whole buffer.
+ * With integer sample rates, chunks start on output frames that fall exactly on an input sample, which keeps WDL_Resampler
+ * on its exact filter phases when it can use them (e.g. for 48k -> 96k), the result is then identical to a single pass.
+ * Process() blocks until the conversion is complete, so call it from a loading thread rather than the audio or UI thread
+ * @tparam T The sample type of the buffers
+ * @tparam A The filter size of the Lanczos mode, see LanczosResampler */
+template<typename T = double, size_t A = 12>
+class OfflineResampler
+{
+public:
+  enum class ESRCMode
+  {
+    kSinc = 0, // WDL_Resampler in sinc mode
+    kLanczos,  // LanczosResampler, float precision with IPLUG_SIMDE
+    kNumModes
+  };
+
+  /** Constructor
+   * @param mode The resampling algorithm
+   * @param nThreads The total number of threads working on a conversion, including the calling thread. 0 to use one per core
+   * @param sincSize The filter length of the sinc mode, see WDL_Resampler::SetMode()
+   * @param chunkSize The approximate number of output frames converted in one go by each thread */
+  OfflineResampler(ESRCMode mode = ESRCMode::kSinc, int nThreads = 0, int sincSize = 64, int chunkSize = 32768)
+  : mMode(mode)
+  , mSincSize(std::max(sincSize, 4))
+  , mChunkSize(std::max(chunkSize, 1024))
+  {
+    if (nThreads <= 0)
+      nThreads = std::max((int) std::thread::hardware_concurrency(), 1);
+
+    for (auto i = 1; i < nThreads; i++)
+      mThreads.emplace_back([this]() { WorkerThread(); });
+  }
+
+  ~OfflineResampler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+    mWorkCond.notify_all();
+
+    for (auto& thread : mThreads)
+      thread.join();
+  }
+
+  OfflineResampler(const OfflineResampler&) = delete;
+  OfflineResampler& operator=(const OfflineResampler&) = delete;
+
+  /** @return The number of output frames that Process() writes for a given input length */
+  static int GetOutputLength(int nFrames, double srcRate, double destRate)
+  {
+    return int(destRate / srcRate * (double) nFrames + 0.5);
+  }
+
+  /** @return The number of threads that share a conversion, including the calling thread */
+  int GetNumThreads() const { return (int) mThreads.size() + 1; }
+
+  /** Resamples non-interleaved buffers. Blocks until all channels are converted, calls from several threads are serialized
+   * @param inputs The input channels, nFrames long
+   * @param outputs The output channels, GetOutputLength(nFrames, srcRate, destRate) long
+   * @param nChans The number of channels
+   * @param nFrames The length of the input
+   * @param srcRate The sample rate of the input
+   * @param destRate The sample rate to convert to
+   * @return The number of frames written to each output channel */
+  int Process(const T* const* inputs, T** outputs, int nChans, int nFrames, double srcRate, double destRate)
+  {
+    const int outLength = GetOutputLength(nFrames, srcRate, destRate);
+
+    if (nChans < 1 || outLength < 1 || srcRate <= 0. || destRate <= 0.)
+      return 0;
+
+    if (srcRate == destRate)
+    {
+      for (auto c = 0; c < nChans; c++)
+        std::copy(inputs[c], inputs[c] + nFrames, outputs[c]);
+      return nFrames;
+    }
+
+    std::lock_guard<std::mutex> processLock(mProcessMutex);
+
+    Conversion conv;
+    conv.inputs = inputs;
+    conv.outputs = outputs;
+    conv.nChans = nChans;
+    conv.nFrames = nFrames;
+    conv.srcRate = srcRate;
+    conv.destRate = destRate;
+    conv.outLength = outLength;
+    // the Lanczos resampler steps through the input with a float ratio
+    conv.ratio = mMode == ESRCMode::kLanczos ? (double) (float(srcRate) / float(destRate)) : srcRate / destRate;
+
+    // with integer rates every period output frames lie exactly on an input sample, start chunks there if that is often enough
+    int period = 0;
+    if (mMode == ESRCMode::kSinc && srcRate == std::floor(srcRate) && destRate == std::floor(destRate) && destRate < 2147483647.)
+    {
+      const int64_t divisor = GCD((int64_t) srcRate, (int64_t) destRate);
+      if ((int64_t) destRate / divisor <= mChunkSize / 4)
+      {
+        period = int((int64_t) destRate / divisor);
+        conv.periodIn = (int64_t) srcRate / divisor;
+      }
+    }
+
+    const double filterHalfWidth = mMode == ESRCMode::kLanczos ? double(A + 1) : double(mSincSize / 2 + 1);
+    conv.preroll = (int) std::ceil((filterHalfWidth + 2.) / conv.ratio);
+    conv.chunkSize = mChunkSize;
+    if (period)
+    {
+      conv.period = period;
+      conv.preroll = (conv.preroll + period - 1) / period * period;
+      conv.chunkSize = mChunkSize / period * period;
+    }
+
+    const int nChunks = (outLength + conv.chunkSize - 1) / conv.chunkSize;
+
+    // WDL_Resampler converts interleaved frames, LanczosResampler is given one channel at a time
+    if (mMode == ESRCMode::kSinc)
+      RunJobs(nChunks, [&](int job) { ProcessChunkSinc(conv, job); });
+    else
+      RunJobs(nChunks * nChans, [&](int job) { ProcessChunkLanczos(conv, job / nChans, job % nChans); });
+
+    return outLength;
+  }
+
+private:
+#ifdef IPLUG_SIMDE
+  using LanczosSample = float;
+#else
+  using LanczosSample = T;
+#endif
+  using LanczosType = LanczosResampler<LanczosSample, 1, A>;
+
+  struct Conversion
+  {
+    const T* const* inputs;
+    T** outputs;
+    int nChans;
+    int nFrames;
+    double srcRate;
+    double destRate;
+    double ratio; // input frames per output frame
+    int outLength;
+    int chunkSize; // output frames
+    int preroll = 0; // output frames computed and discarded before a chunk starts
+    int period = 0; // output frames between exact input positions, 0 if not used
+    int64_t periodIn = 0; // input frames per period
+  };
+
+  static constexpr int kBlockSize = 1024;
+
+  static int64_t GCD(int64_t a, int64_t b)
+  {
+    while (b)
+    {
+      const int64_t t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  /** Calculates where the resampler for a chunk starts
+   * @param startPos Set to the output frame at which the resampler starts, including the preroll
+   * @param inputPos Set to the input frame that is pushed first
+   * @param fracPos Set to the position of the first output frame, relative to inputPos */
+  static void GetChunkStart(const Conversion& conv, int chunkIdx, int& startPos, int64_t& inputPos, double& fracPos)
+  {
+    const int chunkStart = chunkIdx * conv.chunkSize;
+    startPos = std::max(chunkStart - conv.preroll, 0);
+
+    if (conv.period)
+    {
+      inputPos = (int64_t) (startPos / conv.period) * conv.periodIn;
+      fracPos = 0.;
+    }
+    else
+    {
+      const double pos = (double) startPos * conv.ratio;
+      inputPos = (int64_t) std::floor(pos);
+      fracPos = pos - (double) inputPos;
+    }
+  }
+
+  template<typename SampleType>
+  static SampleType GetInput(const Conversion& conv, int chan, int64_t pos)
+  {
+    return pos < conv.nFrames ? (SampleType) conv.inputs[chan][pos] : SampleType(0);
+  }
+
+  void ProcessChunkSinc(const Conversion& conv, int chunkIdx)
+  {
+    int startPos;
+    int64_t inputPos;
+    double fracPos;
+    GetChunkStart(conv, chunkIdx, startPos, inputPos, fracPos);
+
+    const int nChans = conv.nChans;
+    const int chunkStart = chunkIdx * conv.chunkSize;
+    const int chunkEnd = std::min(chunkStart + conv.chunkSize, conv.outLength);
+
+    WDL_Resampler resampler;
+    resampler.SetMode(false, 0, true, mSincSize);
+    resampler.SetRates(conv.srcRate, conv.destRate);
+    resampler.Reset(fracPos);
+
+    WDL_TypedBuf<WDL_ResampleSample> buf;
+    WDL_ResampleSample* pOut = buf.Resize(kBlockSize * nChans, false);
+    int outPos = startPos;
+
+    while (outPos < chunkEnd)
+    {
+      const int want = std::min(kBlockSize, chunkEnd - outPos);
+      WDL_ResampleSample* pIn;
+      const int nIn = resampler.ResamplePrepare(want, nChans, &pIn);
+
+      // past the end of the input the resampler is fed silence, so that it is flushed exactly like a single pass would be
+      for (auto i = 0; i < nIn; i++)
+        for (auto c = 0; c < nChans; c++)
+          *pIn++ = GetInput<WDL_ResampleSample>(conv, c, inputPos + i);
+      inputPos += nIn;
+
+      const int nOut = std::min(resampler.ResampleOut(pOut, nIn, want, nChans), chunkEnd - outPos);
+
+      for (auto i = std::max(chunkStart - outPos, 0); i < nOut; i++)
+        for (auto c = 0; c < nChans; c++)
+          conv.outputs[c][outPos + i] = (T) pOut[i * nChans + c];
+      outPos += nOut;
+
+      if (WDL_NOT_NORMALLY(!nOut && !nIn))
+        break;
+    }
+  }
+
+  void ProcessChunkLanczos(const Conversion& conv, int chunkIdx, int chan)
+  {
+    int startPos;
+    int64_t inputPos;
+    double fracPos;
+    GetChunkStart(conv, chunkIdx, startPos, inputPos, fracPos);
+
+    const int chunkStart = chunkIdx * conv.chunkSize;
+    const int chunkEnd = std::min(chunkStart + conv.chunkSize, conv.outLength);
+
+    std::unique_ptr<LanczosType> pResampler(new LanczosType((float) conv.srcRate, (float) conv.destRate));
+    pResampler->SetPhase(fracPos);
+
+    LanczosSample inBuf[kBlockSize];
+    LanczosSample outBuf[kBlockSize * 2];
+    LanczosSample* pIn = inBuf;
+    LanczosSample* pOut = outBuf;
+    int outPos = startPos;
+
+    while (outPos < chunkEnd)
+    {
+      for (auto i = 0; i < kBlockSize; i++)
+        inBuf[i] = GetInput<LanczosSample>(conv, chan, inputPos + i);
+      inputPos += kBlockSize;
+      pResampler->PushBlock(&pIn, kBlockSize, 1);
+
+      size_t nOut;
+      while (outPos < chunkEnd && (nOut = pResampler->PopBlock(&pOut, std::min(kBlockSize * 2, chunkEnd - outPos), 1)) > 0)
+      {
+        for (auto i = std::max(chunkStart - outPos, 0); i < (int) nOut; i++)
+          conv.outputs[chan][outPos + i] = (T) outBuf[i];
+        outPos += (int) nOut;
+      }
+    }
+  }
+
+  /** Runs jobs 0 to nJobs - 1 on the worker threads and the calling thread, returns when all of them have finished */
+  void RunJobs(int nJobs, std::function<void(int)> func)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    // a worker that woke up late for the previous conversion may still be looking for jobs
+    mDoneCond.wait(lock, [this]() { return mActiveWorkers == 0; });
+
+    mJobFunc = std::move(func);
+    mNumJobs = nJobs;
+    mJobsRemaining = nJobs;
+    mNextJob = 0;
+    mGeneration++;
+    lock.unlock();
+    mWorkCond.notify_all();
+
+    DoJobs();
+
+    lock.lock();
+    mDoneCond.wait(lock, [this]() { return mJobsRemaining == 0 && mActiveWorkers == 0; });
+    mJobFunc = nullptr;
+  }
+
+  void DoJobs()
+  {
+    int job;
+    while ((job = mNextJob.fetch_add(1)) < mNumJobs)
+    {
+      mJobFunc(job);
+
+      if (mJobsRemaining.fetch_sub(1) == 1)
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDoneCond.notify_all();
+      }
+    }
+  }
+
+  void WorkerThread()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    uint64_t generation = mGeneration;
+
+    while (true)
+    {
+      mWorkCond.wait(lock, [&]() { return mQuit || mGeneration != generation; });
+
+      if (mQuit)
+        return;
+
+      generation = mGeneration;
+      mActiveWorkers++;
+      lock.unlock();
+      DoJobs();
+      lock.lock();
+      mActiveWorkers--;
+      mDoneCond.notify_all();
+    }
+  }
+
+  const ESRCMode mMode;
+  const int mSincSize;
+  const int mChunkSize;
+
+  std::mutex mProcessMutex; // one conversion at a time
+
+  std::vector<std::thread> mThreads;
+  std::mutex mMutex;
+  std::condition_variable mWorkCond;
+  std::condition_variable mDoneCond;
+  bool mQuit = false;
+  uint64_t mGeneration = 0;
+  int mActiveWorkers = 0;
+
+  std::function<void(int)> mJobFunc;
+  std::atomic<int> mNextJob {0};
+  std::atomic<int> mNumJobs {0};
+  std::atomic<int> mJobsRemaining {0};
+};
+
+END_IPLUG_NAMESPACE
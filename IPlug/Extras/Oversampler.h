@@ -12,6 +12,7 @@
 
 #define OVERSAMPLING_FACTORS_VA_LIST "None", "2x", "4x", "8x", "16x"
 
+#include <algorithm>
 #include <functional>
 #include <cmath>
 
@@ -68,6 +69,7 @@ public:
       
       // ptr location doesn't matter at this stage
       mNextInputPtrs.Add(mUp2x.Get());
+      mChunkInputPtrs.Add(mUp2x.Get());
     }
     
     for (auto c = 0; c < mNOutChannels; c++)
@@ -84,6 +86,7 @@ public:
       
       // ptr location doesn't matter at this stage
       mNextOutputPtrs.Add(mDown2x.Get());
+      mChunkOutputPtrs.Add(mDown2x.Get());
     }
         
     SetOverSampling(factor);
@@ -118,17 +121,20 @@ public:
       blockSize = 1;
     }
     
-    numBufSamples *= mNInChannels;
+    mBlockSize = blockSize;
+
+    const int numUpBufSamples = numBufSamples * mNInChannels;
+    const int numDownBufSamples = numBufSamples * mNOutChannels;
     
-    mUp2x.Resize(2 * numBufSamples);
-    mUp4x.Resize(4 * numBufSamples);
-    mUp8x.Resize(8 * numBufSamples);
-    mUp16x.Resize(16 * numBufSamples);
+    mUp2x.Resize(2 * numUpBufSamples);
+    mUp4x.Resize(4 * numUpBufSamples);
+    mUp8x.Resize(8 * numUpBufSamples);
+    mUp16x.Resize(16 * numUpBufSamples);
     
-    mDown2x.Resize(2 * numBufSamples);
-    mDown4x.Resize(4 * numBufSamples);
-    mDown8x.Resize(8 * numBufSamples);
-    mDown16x.Resize(16 * numBufSamples);
+    mDown2x.Resize(2 * numDownBufSamples);
+    mDown4x.Resize(4 * numDownBufSamples);
+    mDown8x.Resize(8 * numDownBufSamples);
+    mDown16x.Resize(16 * numDownBufSamples);
     
     mUp16BufferPtrs.Empty();
     mUp8BufferPtrs.Empty();
@@ -173,12 +179,49 @@ public:
    * @param nFrames The block size for this block: number of samples per channel.
    * @param nInChans The number of input channels to process. Must be less or equal to the number of channels passed to the constructor
    * @param nOutChans The number of output channels to process. Must be less or equal to the number of channels passed to the constructor
-   * @param func The function that processes the audio sample at the higher sampling rate. NOTE: std::function can call malloc if you pass in captures */
-  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nInChans, int nOutChans, BlockProcessFunc func)
+   * @param func The function that processes the audio sample at the higher sampling rate, with the signature void(T** inputs, T** outputs, int nFrames).
+   * Any callable works. Passing a lambda directly, rather than wrapping it in a BlockProcessFunc, avoids std::function, which can allocate when the lambda has captures.
+   * Blocks longer than the block size passed to Reset() are processed in chunks of that size */
+  template <typename FUNC>
+  void ProcessBlock(T** inputs, T** outputs, int nFrames, int nInChans, int nOutChans, FUNC&& func)
   {
     assert(nInChans <= mNInChannels);
     assert(nOutChans <= mNOutChannels);
-    
+
+    if (mRate == 1)
+    {
+      func(inputs, outputs, nFrames);
+      return;
+    }
+
+    if (nFrames <= mBlockSize)
+    {
+      ProcessChunk(inputs, outputs, nFrames, nInChans, nOutChans, func);
+      return;
+    }
+
+    for (auto pos = 0; pos < nFrames; pos += mBlockSize)
+    {
+      for (auto c = 0; c < nInChans; c++)
+        mChunkInputPtrs.Set(c, inputs[c] + pos);
+
+      for (auto c = 0; c < nOutChans; c++)
+        mChunkOutputPtrs.Set(c, outputs[c] + pos);
+
+      ProcessChunk(mChunkInputPtrs.GetList(), mChunkOutputPtrs.GetList(), std::min(nFrames - pos, mBlockSize), nInChans, nOutChans, func);
+    }
+  }
+
+  /** @return The number of input channels passed to the constructor */
+  int NInChannels() const { return mNInChannels; }
+
+  /** @return The number of output channels passed to the constructor */
+  int NOutChannels() const { return mNOutChannels; }
+
+private:
+  template <typename FUNC>
+  void ProcessChunk(T** inputs, T** outputs, int nFrames, int nInChans, int nOutChans, FUNC& func)
+  {
     if (mRate != mPrevRate)
     {
       switch (mRate) {
@@ -220,16 +263,14 @@ public:
       }
     }
     
-    if (mRate == 1) {
-      func(inputs, outputs, nFrames);
-    } else {
-      for (auto i = 0; i < mRate; i++) {
-        for (auto c = 0; c < nInChans; c++) {
-          mNextInputPtrs.Set(c, mInPtrLoopSrc->Get(c) + (i * nFrames));
-          mNextOutputPtrs.Set(c, mOutPtrLoopSrc->Get(c) + (i * nFrames));
-        }
-        func(mNextInputPtrs.GetList(), mNextOutputPtrs.GetList(), nFrames);
+    for (auto i = 0; i < mRate; i++) {
+      for (auto c = 0; c < nInChans; c++) {
+        mNextInputPtrs.Set(c, mInPtrLoopSrc->Get(c) + (i * nFrames));
       }
+      for (auto c = 0; c < nOutChans; c++) {
+        mNextOutputPtrs.Set(c, mOutPtrLoopSrc->Get(c) + (i * nFrames));
+      }
+      func(mNextInputPtrs.GetList(), mNextOutputPtrs.GetList(), nFrames);
     }
     
     for (auto c = 0; c < nOutChans; c++) {
@@ -248,6 +289,7 @@ public:
     }
   }
   
+public:
   /** Over sample an input sample with a per-sample function (up-sample input -> process with function -> down-sample)
    * @param input The audio sample to input
    * @param std::function<double(double)> The function that processes the audio sample at the higher sampling rate. NOTE: std::function can call malloc if you pass in captures
@@ -439,6 +481,7 @@ private:
   bool mBlockProcessing; // false
   int mNInChannels; // 1
   int mNOutChannels;
+  int mBlockSize = DEFAULT_BLOCK_SIZE;
   
   // the actual data
   WDL_TypedBuf<T> mUp16x;
@@ -465,6 +508,10 @@ private:
   WDL_PtrList<T> mNextInputPtrs;
   WDL_PtrList<T> mNextOutputPtrs;
 
+  //Ptrs into the caller's buffers, when a block is longer than mBlockSize
+  WDL_PtrList<T> mChunkInputPtrs;
+  WDL_PtrList<T> mChunkOutputPtrs;
+
   //Ptrs to the buffer data ptrs, changed depending on rate (block processing only)
   WDL_PtrList<T>* mInPtrLoopSrc = nullptr;
   WDL_PtrList<T>* mOutPtrLoopSrc = nullptr;
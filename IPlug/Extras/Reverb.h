@@ -0,0 +1,469 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief A multichannel Freeverb style reverb, based on WDL_ReverbEngine (WDL/verbengine.h), with the comb bank processed in SIMD lanes
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+#if defined IPLUG_SIMDE
+  #if defined(__arm64__)
+    #define SIMDE_ENABLE_NATIVE_ALIASES
+    #include "simde/x86/sse2.h"
+  #else
+    #include <emmintrin.h>
+  #endif
+#endif
+
+#include "heapbuf.h"
+#include "verbengine.h"
+#include "IPlugConstants.h"
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** Runs the lowpass-feedback comb filters of one channel over a chunk, with NGROUPS groups of four combs side by side in lanes.
+ * io holds the delayed output of each comb on entry, one row of stride samples per comb, and the values to write back to its delay line on exit.
+ * The filter states stay in registers for the whole chunk and the combs are independent, so their feedback chains overlap */
+template<typename T, int NGROUPS>
+struct ReverbCombKernel
+{
+  static inline void Process(T* io, int stride, T* filterStore, const T* input, const T* damp, const T* feedback, T* output, int nFrames)
+  {
+    constexpr int kNumLanes = NGROUPS * 4;
+    // a constant offset keeps the recirculating filter states out of the denormal range, without a branch per lane
+    constexpr T antiDenormal = T(1e-20);
+
+    T fs[kNumLanes];
+
+    for (auto k = 0; k < kNumLanes; k++)
+      fs[k] = filterStore[k];
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      const T d = damp[s];
+      const T oneMinusD = T(1) - d;
+      const T fb = feedback[s];
+      const T x = input[s];
+      T sum[4] = {};
+
+      for (auto k = 0; k < kNumLanes; k++)
+      {
+        T& sample = io[(k * stride) + s];
+        const T y = sample;
+        fs[k] = (y * oneMinusD) + (fs[k] * d) + antiDenormal;
+        sample = x + (fs[k] * fb);
+        sum[k & 3] += y;
+      }
+
+      output[s] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+
+    for (auto k = 0; k < kNumLanes; k++)
+      filterStore[k] = fs[k];
+  }
+};
+
+#ifdef IPLUG_SIMDE
+template<int NGROUPS>
+struct ReverbCombKernel<float, NGROUPS>
+{
+  static inline __m128 Tick(__m128 y, __m128& fs, __m128 x, __m128 oneMinusD, __m128 d, __m128 fb)
+  {
+    fs = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, oneMinusD), _mm_mul_ps(fs, d)), _mm_set1_ps(1e-20f));
+    return _mm_add_ps(x, _mm_mul_ps(fs, fb));
+  }
+
+  static inline void Process(float* io, int stride, float* filterStore, const float* input, const float* damp, const float* feedback, float* output, int nFrames)
+  {
+    __m128 fs[NGROUPS];
+
+    for (auto g = 0; g < NGROUPS; g++)
+      fs[g] = _mm_load_ps(filterStore + (g * 4));
+
+    int s = 0;
+
+    // four frames at a time: a 4x4 transpose turns four comb rows into four frames of four combs
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      __m128 d[4], oneMinusD[4], fb[4], x[4];
+
+      for (auto j = 0; j < 4; j++)
+      {
+        d[j] = _mm_set1_ps(damp[s + j]);
+        oneMinusD[j] = _mm_set1_ps(1.f - damp[s + j]);
+        fb[j] = _mm_set1_ps(feedback[s + j]);
+        x[j] = _mm_set1_ps(input[s + j]);
+      }
+
+      __m128 sum[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+
+      for (auto g = 0; g < NGROUPS; g++)
+      {
+        float* pRow = io + (g * 4 * stride) + s;
+        __m128 y0 = _mm_loadu_ps(pRow);
+        __m128 y1 = _mm_loadu_ps(pRow + stride);
+        __m128 y2 = _mm_loadu_ps(pRow + (2 * stride));
+        __m128 y3 = _mm_loadu_ps(pRow + (3 * stride));
+        _MM_TRANSPOSE4_PS(y0, y1, y2, y3);
+
+        sum[0] = _mm_add_ps(sum[0], y0);
+        sum[1] = _mm_add_ps(sum[1], y1);
+        sum[2] = _mm_add_ps(sum[2], y2);
+        sum[3] = _mm_add_ps(sum[3], y3);
+
+        __m128 w0 = Tick(y0, fs[g], x[0], oneMinusD[0], d[0], fb[0]);
+        __m128 w1 = Tick(y1, fs[g], x[1], oneMinusD[1], d[1], fb[1]);
+        __m128 w2 = Tick(y2, fs[g], x[2], oneMinusD[2], d[2], fb[2]);
+        __m128 w3 = Tick(y3, fs[g], x[3], oneMinusD[3], d[3], fb[3]);
+        _MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+
+        _mm_storeu_ps(pRow, w0);
+        _mm_storeu_ps(pRow + stride, w1);
+        _mm_storeu_ps(pRow + (2 * stride), w2);
+        _mm_storeu_ps(pRow + (3 * stride), w3);
+      }
+
+      // transposing the four sums gives the per-lane totals of each frame in one vector
+      _MM_TRANSPOSE4_PS(sum[0], sum[1], sum[2], sum[3]);
+      _mm_storeu_ps(output + s, _mm_add_ps(_mm_add_ps(sum[0], sum[1]), _mm_add_ps(sum[2], sum[3])));
+    }
+
+    for (; s < nFrames; s++)
+    {
+      const __m128 d = _mm_set1_ps(damp[s]);
+      const __m128 oneMinusD = _mm_set1_ps(1.f - damp[s]);
+      const __m128 fb = _mm_set1_ps(feedback[s]);
+      const __m128 x = _mm_set1_ps(input[s]);
+      __m128 sum = _mm_setzero_ps();
+
+      for (auto g = 0; g < NGROUPS; g++)
+      {
+        float* pRow = io + (g * 4 * stride) + s;
+        const __m128 y = _mm_setr_ps(pRow[0], pRow[stride], pRow[2 * stride], pRow[3 * stride]);
+        alignas(16) float w[4];
+        _mm_store_ps(w, Tick(y, fs[g], x, oneMinusD, d, fb));
+        pRow[0] = w[0];
+        pRow[stride] = w[1];
+        pRow[2 * stride] = w[2];
+        pRow[3 * stride] = w[3];
+        sum = _mm_add_ps(sum, y);
+      }
+
+      alignas(16) float partial[4];
+      _mm_store_ps(partial, sum);
+      output[s] = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+    }
+
+    for (auto g = 0; g < NGROUPS; g++)
+      _mm_store_ps(filterStore + (g * 4), fs[g]);
+  }
+};
+#endif
+
+/** A Freeverb style reverb for any number of channels, with the same tunings and sound as WDL_ReverbEngine, which is stereo and double only.
+ * Each channel has its own comb bank and allpass chain, detuned by the stereo spread, and the width control blends each channel with the mean of the others.
+ * The combs of a channel run side by side in lanes, using SSE when IPLUG_SIMDE is defined (float only, see ModulatedDelay.h).
+ * Audio is processed in chunks no longer than the shortest delay line, so every comb's and allpass's delayed samples for a chunk are already in its delay line and are
+ * read and written back contiguously, rather than one sample at a time per filter.
+ * Room size, dampening, width and the dry/wet mix are smoothed per sample.
+ * @tparam T sample type
+ * @tparam NC maximum number of channels */
+template<typename T = double, int NC = 2>
+class Reverb
+{
+#ifdef IPLUG_SIMDE
+  static_assert(std::is_same<T, float>::value, "Reverb requires T to be float when using SIMD instructions");
+#endif
+
+  static constexpr int kNumCombs = sizeof(wdl_verb__combtunings) / sizeof(wdl_verb__combtunings[0]);
+  static constexpr int kNumAllpasses = sizeof(wdl_verb__allpasstunings) / sizeof(wdl_verb__allpasstunings[0]);
+  static constexpr int kNumGroups = (kNumCombs + 3) / 4;
+  static constexpr int kNumLanes = kNumGroups * 4;
+  static constexpr int kMaxChunk = 128;
+  static constexpr double kOutputGain = 0.015;
+
+  struct DelayLine
+  {
+    T* mBuffer = nullptr;
+    int mLength = 1;
+    int mPos = 0;
+  };
+
+public:
+  Reverb(double sampleRate = DEFAULT_SAMPLE_RATE)
+  {
+    SetRoomSize(0.5);
+    SetDampening(0.5);
+    SetWidth(1.);
+    SetMix(0., 1.);
+    SetSmoothTime(20.);
+    SetSampleRate(sampleRate);
+    SnapParameters();
+  }
+
+  /** Allocates and clears the delay lines. Call from OnReset(), not from the audio thread */
+  void SetSampleRate(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    const double scale = sampleRate / 44100.;
+
+    auto length = [scale](int tuning) { return std::max(static_cast<int>(tuning * scale), 1); };
+
+    int total = 0;
+
+    for (auto c = 0; c < NC; c++)
+    {
+      for (auto k = 0; k < kNumCombs; k++)
+        total += length(wdl_verb__combtunings[k] + (c * wdl_verb__stereospread));
+
+      for (auto k = 0; k < kNumAllpasses; k++)
+        total += length(wdl_verb__allpasstunings[k] + (c * wdl_verb__stereospread));
+    }
+
+    mBuffer.Resize(total);
+    T* pBuffer = mBuffer.Get();
+    mChunkSize = kMaxChunk;
+
+    for (auto c = 0; c < NC; c++)
+    {
+      for (auto k = 0; k < kNumCombs; k++)
+      {
+        DelayLine& line = mCombs[c][k];
+        line.mLength = length(wdl_verb__combtunings[k] + (c * wdl_verb__stereospread));
+        line.mBuffer = pBuffer;
+        pBuffer += line.mLength;
+        mChunkSize = std::min(mChunkSize, line.mLength);
+      }
+
+      for (auto k = 0; k < kNumAllpasses; k++)
+      {
+        DelayLine& line = mAllpasses[c][k];
+        line.mLength = length(wdl_verb__allpasstunings[k] + (c * wdl_verb__stereospread));
+        line.mBuffer = pBuffer;
+        pBuffer += line.mLength;
+        mChunkSize = std::min(mChunkSize, line.mLength);
+      }
+    }
+
+    SetSmoothTime(mSmoothTimeMs);
+    Clear();
+  }
+
+  /** Silences the tail */
+  void Clear()
+  {
+    memset(mBuffer.Get(), 0, mBuffer.GetSize() * sizeof(T));
+    memset(mFilterStore, 0, sizeof(mFilterStore));
+
+    for (auto c = 0; c < NC; c++)
+    {
+      for (auto k = 0; k < kNumCombs; k++)
+        mCombs[c][k].mPos = 0;
+
+      for (auto k = 0; k < kNumAllpasses; k++)
+        mAllpasses[c][k].mPos = 0;
+    }
+  }
+
+  /** @param timeMs Time constant for parameter changes */
+  void SetSmoothTime(double timeMs)
+  {
+    mSmoothTimeMs = timeMs;
+    mSmoothCoeff = timeMs > 0. ? T(1. - std::exp(-1. / (timeMs * 0.001 * mSampleRate))) : T(1);
+  }
+
+  /** @param size Comb feedback, 0.3 to 0.99 or so */
+  void SetRoomSize(double size) { mTarget[kRoomSize] = T(size); }
+
+  /** @param damp High frequency damping of the tail, 0 to 1 */
+  void SetDampening(double damp) { mTarget[kDamp] = T(damp * 0.4); }
+
+  /** @param width -1 to 1. At 0 every channel carries the same mix, at 1 the channels are as decorrelated as possible and negative values swap them */
+  void SetWidth(double width)
+  {
+    width = std::min(std::max(width, -1.), 1.) * 0.5;
+    mTarget[kWidth] = T(width >= 0. ? width + 0.5 : width - 0.5);
+  }
+
+  /** @param dry Gain of the input
+   * @param wet Gain of the reverb */
+  void SetMix(double dry, double wet)
+  {
+    mTarget[kDry] = T(dry);
+    mTarget[kWet] = T(wet);
+  }
+
+  /** Jumps to the target values of the parameters, e.g. when the plug-in is reset */
+  void SnapParameters()
+  {
+    for (auto p = 0; p < kNumParams; p++)
+      mCurrent[p] = mTarget[p];
+  }
+
+  /** @param inputs Non-interleaved input buffers
+   * @param outputs Non-interleaved output buffers, may be the same as inputs
+   * @param nChans Number of channels to process, must be <= NC
+   * @param nFrames Number of sample frames */
+  void ProcessBlock(T** inputs, T** outputs, int nChans, int nFrames)
+  {
+    assert(nChans <= NC);
+
+    for (auto start = 0; start < nFrames; start += mChunkSize)
+    {
+      const int n = std::min(mChunkSize, nFrames - start);
+
+      SmoothParameters(n);
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        ProcessCombs(c, inputs[c] + start, mWet[c], n);
+        ProcessAllpasses(c, mWet[c], n);
+      }
+
+      Mix(inputs, outputs, nChans, start, n);
+    }
+  }
+
+private:
+  enum EParams { kRoomSize = 0, kDamp, kWidth, kDry, kWet, kNumParams };
+
+  void SmoothParameters(int nFrames)
+  {
+    for (auto s = 0; s < nFrames; s++)
+    {
+      for (auto p = 0; p < kNumParams; p++)
+      {
+        mCurrent[p] += (mTarget[p] - mCurrent[p]) * mSmoothCoeff;
+        mSmoothed[p][s] = mCurrent[p];
+      }
+    }
+  }
+
+  void ProcessCombs(int chan, const T* input, T* output, int nFrames)
+  {
+    DelayLine* combs = mCombs[chan];
+
+    // copy the delayed samples of every comb for the chunk, which are all in its delay line because the chunk is no longer than the comb
+    for (auto k = 0; k < kNumCombs; k++)
+    {
+      const DelayLine& line = combs[k];
+      const int firstPart = std::min(nFrames, line.mLength - line.mPos);
+      memcpy(mCombIO[k], line.mBuffer + line.mPos, firstPart * sizeof(T));
+      memcpy(mCombIO[k] + firstPart, line.mBuffer, (nFrames - firstPart) * sizeof(T));
+    }
+
+    for (auto k = kNumCombs; k < kNumLanes; k++)
+      memset(mCombIO[k], 0, nFrames * sizeof(T));
+
+    ReverbCombKernel<T, kNumGroups>::Process(mCombIO[0], kMaxChunk, mFilterStore[chan], input, mSmoothed[kDamp], mSmoothed[kRoomSize], output, nFrames);
+
+    // and write the new comb inputs back
+    for (auto k = 0; k < kNumCombs; k++)
+    {
+      DelayLine& line = combs[k];
+      const int firstPart = std::min(nFrames, line.mLength - line.mPos);
+      memcpy(line.mBuffer + line.mPos, mCombIO[k], firstPart * sizeof(T));
+      memcpy(line.mBuffer, mCombIO[k] + firstPart, (nFrames - firstPart) * sizeof(T));
+
+      line.mPos += nFrames;
+
+      if (line.mPos >= line.mLength)
+        line.mPos -= line.mLength;
+    }
+  }
+
+  void ProcessAllpasses(int chan, T* buffer, int nFrames)
+  {
+    // the chunk is no longer than any allpass, so a whole chunk reads samples written before it, and each stage is two branchless loops
+    auto process = [](T* pDelay, T* pBuffer, int n) {
+      constexpr T antiDenormal = T(1e-20);
+
+      for (auto s = 0; s < n; s++)
+      {
+        const T input = pBuffer[s];
+        const T bufOut = pDelay[s];
+        pDelay[s] = input + (bufOut * T(0.5)) + antiDenormal;
+        pBuffer[s] = bufOut - input;
+      }
+    };
+
+    for (auto k = 0; k < kNumAllpasses; k++)
+    {
+      DelayLine& line = mAllpasses[chan][k];
+      const int firstPart = std::min(nFrames, line.mLength - line.mPos);
+      process(line.mBuffer + line.mPos, buffer, firstPart);
+      process(line.mBuffer, buffer + firstPart, nFrames - firstPart);
+
+      line.mPos += nFrames;
+
+      if (line.mPos >= line.mLength)
+        line.mPos -= line.mLength;
+    }
+  }
+
+  void Mix(T** inputs, T** outputs, int nChans, int start, int nFrames)
+  {
+    const T* width = mSmoothed[kWidth];
+    const T* dry = mSmoothed[kDry];
+    const T* wet = mSmoothed[kWet];
+    const T othersScale = nChans > 1 ? T(1) / T(nChans - 1) : T(0);
+
+    for (auto s = 0; s < nFrames; s++)
+    {
+      T total = T(0);
+
+      for (auto c = 0; c < nChans; c++)
+        total += mWet[c][s];
+
+      // like WDL_ReverbEngine, a negative width swaps the weights of a channel and the others. A mono channel has no others, so width is ignored
+      T ownGain = T(kOutputGain);
+      T othersGain = T(0);
+
+      if (nChans > 1)
+      {
+        const T m = std::abs(width[s]);
+        ownGain = T(kOutputGain) * (width[s] < T(0) ? T(1) - m : m);
+        othersGain = T(kOutputGain) * (width[s] < T(0) ? m : T(1) - m) * othersScale;
+      }
+
+      for (auto c = 0; c < nChans; c++)
+      {
+        const T own = mWet[c][s];
+        const T others = total - own;
+        outputs[c][start + s] = (dry[s] * inputs[c][start + s]) + (wet[s] * ((own * ownGain) + (others * othersGain)));
+      }
+    }
+  }
+
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  double mSmoothTimeMs = 20.;
+  T mSmoothCoeff = T(1);
+  int mChunkSize = kMaxChunk;
+  T mTarget[kNumParams] = {};
+  T mCurrent[kNumParams] = {};
+  T mSmoothed[kNumParams][kMaxChunk];
+
+  WDL_TypedBuf<T> mBuffer;
+  DelayLine mCombs[NC][kNumCombs];
+  DelayLine mAllpasses[NC][kNumAllpasses];
+  alignas(16) T mFilterStore[NC][kNumLanes];
+  alignas(16) T mCombIO[kNumLanes][kMaxChunk]; // one row per comb lane
+  T mWet[NC][kMaxChunk];
+} WDL_FIXALIGN;
+
+END_IPLUG_NAMESPACE
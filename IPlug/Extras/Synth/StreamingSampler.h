@@ -0,0 +1,668 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+/**
+ * @file
+ * @brief A sampler voice that streams samples from disk, so that large multisampled instruments need little resident memory
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "fileread.h"
+#include "heapbuf.h"
+#include "mutex.h"
+#include "pcmfmtcvt.h"
+#include "ptrlist.h"
+
+#include "IPlugConstants.h"
+#include "SynthVoice.h"
+#include "ADSREnvelope.h"
+#include "AssetCache.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** A WAV file (16, 24 or 32 bit integer or 32 bit float PCM, up to 2GB) that is played from disk. The file is memory mapped and only its
+ * first frames, the attack, are converted and kept in memory. The rest is read through the mapping by a SampleStreamer when a voice plays it,
+ * so the pages are faulted in on the streaming thread rather than the audio thread. Load on a loading thread, before any voice can play it */
+class StreamingSample
+{
+public:
+  static constexpr int kDefaultPreloadFrames = 16384;
+
+  StreamingSample() = default;
+  StreamingSample(const StreamingSample&) = delete;
+  StreamingSample& operator=(const StreamingSample&) = delete;
+
+  /** Opens a WAV file and preloads its attack
+   * @param path The file path, UTF-8
+   * @param preloadFrames The number of frames to keep in memory. This must cover the time the streaming thread needs to start reading
+   * @return \c false if the file could not be opened or its format is not supported */
+  bool Load(const char* path, int preloadFrames = kDefaultPreloadFrames)
+  {
+    mFile.reset();
+    mData = nullptr;
+    mLength = 0;
+
+    // no async reads, and map files of any size below 2GB rather than buffering them
+    std::unique_ptr<WDL_FileRead> pFile(new WDL_FileRead(path, 0, 8192, 4, 0, 0x7fffffff));
+    if (!pFile->IsOpen())
+      return false;
+
+    const WDL_FILEREAD_POSTYPE size = pFile->GetSize();
+    if (size < 12 || size >= 0x7fffffff)
+      return false;
+
+    int len = (int) size;
+    const unsigned char* pFileData = (const unsigned char*) pFile->GetMappedView(0, &len);
+    if (!pFileData || len < 12 || memcmp(pFileData, "RIFF", 4) || memcmp(pFileData + 8, "WAVE", 4))
+      return false;
+
+    int format = 0, dataOffset = 0, dataBytes = 0;
+    for (int pos = 12; pos + 8 <= len;)
+    {
+      const unsigned char* pChunk = pFileData + pos;
+      const int body = pos + 8;
+      uint32_t chunkSize = ReadLE(pChunk + 4, 4);
+
+      // a chunk that runs past the end of the file is truncated, which is how some recorders leave the data chunk, and is the last one read
+      if (chunkSize > (uint32_t) (len - body))
+        chunkSize = (uint32_t) (len - body);
+
+      if (!memcmp(pChunk, "fmt ", 4) && chunkSize >= 16)
+      {
+        format = (int) ReadLE(pChunk + 8, 2);
+        mNChans = (int) ReadLE(pChunk + 10, 2);
+        mSampleRate = (double) ReadLE(pChunk + 12, 4);
+        mBitsPerSample = (int) ReadLE(pChunk + 22, 2);
+        if (format == 0xFFFE && chunkSize >= 26) // WAVE_FORMAT_EXTENSIBLE, the format is at the start of the subformat GUID
+          format = (int) ReadLE(pChunk + 32, 2);
+      }
+      else if (!memcmp(pChunk, "data", 4))
+      {
+        dataOffset = body;
+        dataBytes = (int) chunkSize;
+      }
+
+      const int64_t next = (int64_t) body + chunkSize + (chunkSize & 1);
+      if (next <= pos)
+        break;
+
+      pos = (int) std::min<int64_t>(next, len);
+    }
+
+    const bool isPCM = format == 1 && (mBitsPerSample == 16 || mBitsPerSample == 24 || mBitsPerSample == 32);
+    mIsFloat = format == 3 && mBitsPerSample == 32;
+    if (!(isPCM || mIsFloat) || mNChans < 1 || mSampleRate <= 0. || !dataOffset)
+      return false;
+
+    mFile = std::move(pFile);
+    mData = pFileData + dataOffset;
+    mLength = dataBytes / (mNChans * mBitsPerSample / 8);
+
+    mPreloadLength = std::min(std::max(preloadFrames, 0), mLength);
+    Read(0, mPreloadLength, mPreload.ResizeOK(mPreloadLength * mNChans, false), mNChans);
+
+    return true;
+  }
+
+  /** @return \c true if a file is loaded */
+  bool IsLoaded() const { return mData != nullptr; }
+
+  /** @return The length in frames */
+  int GetLength() const { return mLength; }
+
+  int GetNumChans() const { return mNChans; }
+
+  double GetSampleRate() const { return mSampleRate; }
+
+  /** @return The number of frames held in memory */
+  int GetPreloadLength() const { return mPreloadLength; }
+
+  /** @return The interleaved preloaded frames */
+  const float* GetPreload() const { return mPreload.Get(); }
+
+  /** @return The memory used by the preloaded frames, in bytes */
+  int GetPreloadBytes() const { return mPreload.GetSize() * (int) sizeof(float); }
+
+  /** Converts frames from the file, which can fault in pages of the mapping, so don't call this on the audio thread
+   * @param startFrame The first frame to read
+   * @param nFrames The number of frames, which must not exceed the length
+   * @param pDest Interleaved output, with destChans channels per frame
+   * @param destChans If the file has fewer channels, the remaining ones are left as they are. If it has more, they are ignored */
+  void Read(int startFrame, int nFrames, float* pDest, int destChans) const
+  {
+    const int bytesPerSample = mBitsPerSample / 8;
+    const unsigned char* pSrc = mData + (size_t) startFrame * mNChans * bytesPerSample;
+    const int nChans = std::min(mNChans, destChans);
+
+    for (auto c = 0; c < nChans; c++)
+    {
+      if (mIsFloat)
+      {
+        for (auto i = 0; i < nFrames; i++)
+          memcpy(pDest + i * destChans + c, pSrc + (i * mNChans + c) * 4, 4);
+      }
+      else
+      {
+        pcmToDoubles((void*) (pSrc + c * bytesPerSample), nFrames, mBitsPerSample, mNChans, pDest + c, destChans);
+      }
+    }
+  }
+
+private:
+  static uint32_t ReadLE(const unsigned char* p, int nBytes)
+  {
+    uint32_t v = 0;
+    for (auto i = nBytes - 1; i >= 0; i--)
+      v = (v << 8) | p[i];
+    return v;
+  }
+
+  std::unique_ptr<WDL_FileRead> mFile;
+  const unsigned char* mData = nullptr; // the data chunk in the mapped file
+  bool mIsFloat = false;
+  int mBitsPerSample = 0;
+  int mNChans = 0;
+  int mLength = 0;
+  double mSampleRate = 0.;
+  int mPreloadLength = 0;
+  WDL_TypedBuf<float> mPreload;
+};
+
+/** A lock-free ring buffer through which a SampleStreamer delivers the frames of a sample after its preloaded attack to one voice.
+ * The voice (the audio thread) requests a sample, and reads and acknowledges frames, the streaming thread fills the ring.
+ * Each request has a generation, which tags everything either side publishes, so that data belonging to a sample the voice has
+ * since replaced is never read */
+class SampleStream
+{
+public:
+  static constexpr int kRingFrames = 16384; // must be a power of two
+
+  SampleStream(int maxChans)
+  : mMaxChans(maxChans)
+  {
+    memset(mRing.Resize(kRingFrames * mMaxChans, false), 0, kRingFrames * mMaxChans * sizeof(float));
+  }
+
+  SampleStream(const SampleStream&) = delete;
+  SampleStream& operator=(const SampleStream&) = delete;
+
+  int GetMaxChans() const { return mMaxChans; }
+
+  /** Audio thread. Starts streaming a sample from a given frame, replacing the previous request
+   * @param pSample The sample, or nullptr to stop streaming */
+  void Start(const StreamingSample* pSample, int startFrame)
+  {
+    if (!++mGeneration) // 0 means a request is being written
+      ++mGeneration;
+
+    mReadPos = 0;
+    mReadState.store(Pack(mGeneration, 0), std::memory_order_release);
+    mRequest.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    mRequestSample.store(pSample, std::memory_order_relaxed);
+    mRequestStart.store(startFrame, std::memory_order_relaxed);
+    mRequest.store(mGeneration, std::memory_order_release);
+  }
+
+  void Stop() { Start(nullptr, 0); }
+
+  /** Audio thread. Call once per block before reading frames
+   * @return The number of frames that can be read */
+  int GetAvailable()
+  {
+    const uint64_t state = mWriteState.load(std::memory_order_acquire);
+    return GetGeneration(state) == mGeneration ? (int) (GetCount(state) - mReadPos) : 0;
+  }
+
+  /** Audio thread. Reads the next frame, only call this if GetAvailable() said there is one
+   * @return The frame, with GetMaxChans() samples */
+  const float* ReadFrame()
+  {
+    return mRing.Get() + ((mReadPos++) & (kRingFrames - 1)) * mMaxChans;
+  }
+
+  /** Audio thread. Frees the frames that have been read for the streaming thread, call once per block after reading */
+  void Acknowledge()
+  {
+    mReadState.store(Pack(mGeneration, mReadPos), std::memory_order_release);
+  }
+
+  /** Audio thread. Records the start of a dropout */
+  void AddUnderrun() { mUnderruns.fetch_add(1, std::memory_order_relaxed); }
+
+  /** Audio thread. Records frames that were output as silence because the stream was dry */
+  void AddUnderrunFrames(int nFrames) { mUnderrunFrames.fetch_add(nFrames, std::memory_order_relaxed); }
+
+  /** @return The number of times the stream ran dry, any thread */
+  int GetUnderruns() const { return mUnderruns.load(std::memory_order_relaxed); }
+
+  /** @return The number of frames for which the stream was dry, any thread */
+  int64_t GetUnderrunFrames() const { return mUnderrunFrames.load(std::memory_order_relaxed); }
+
+private:
+  friend class SampleStreamer;
+
+  static uint64_t Pack(uint32_t generation, uint32_t count) { return ((uint64_t) generation << 32) | count; }
+  static uint32_t GetGeneration(uint64_t state) { return (uint32_t) (state >> 32); }
+  static uint32_t GetCount(uint64_t state) { return (uint32_t) state; }
+
+  /** Streaming thread. Tops up the ring with at most maxFrames frames
+   * @return The number of frames written */
+  int Fill(int maxFrames)
+  {
+    const uint32_t generation = mRequest.load(std::memory_order_acquire);
+    if (!generation)
+      return 0;
+
+    if (generation != mFillGeneration)
+    {
+      const StreamingSample* pSample = mRequestSample.load(std::memory_order_relaxed);
+      const int startFrame = mRequestStart.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      // the request changed while it was being read, pick it up on the next pass
+      if (mRequest.load(std::memory_order_relaxed) != generation)
+        return 0;
+
+      mFillGeneration = generation;
+      mFillSample = pSample;
+      mFillPos = pSample ? std::min(std::max(startFrame, 0), pSample->GetLength()) : 0;
+      mFillCount = 0;
+    }
+
+    if (!mFillSample)
+      return 0;
+
+    const uint64_t readState = mReadState.load(std::memory_order_acquire);
+    if (GetGeneration(readState) != generation)
+      return 0;
+
+    const int space = kRingFrames - (int) (mFillCount - GetCount(readState));
+    const int nFrames = std::min({space, maxFrames, mFillSample->GetLength() - mFillPos});
+    if (nFrames <= 0)
+      return 0;
+
+    // the file can have fewer channels than the ring, and it is read in up to two parts either side of the wrap point
+    const int writeIdx = (int) (mFillCount & (kRingFrames - 1));
+    const int nFirst = std::min(nFrames, kRingFrames - writeIdx);
+    mFillSample->Read(mFillPos, nFirst, mRing.Get() + writeIdx * mMaxChans, mMaxChans);
+    if (nFrames > nFirst)
+      mFillSample->Read(mFillPos + nFirst, nFrames - nFirst, mRing.Get(), mMaxChans);
+
+    mFillPos += nFrames;
+    mFillCount += nFrames;
+    mWriteState.store(Pack(generation, mFillCount), std::memory_order_release);
+    return nFrames;
+  }
+
+  const int mMaxChans;
+  WDL_TypedBuf<float> mRing;
+
+  // audio thread -> streaming thread
+  std::atomic<uint32_t> mRequest {0};
+  std::atomic<const StreamingSample*> mRequestSample {nullptr};
+  std::atomic<int> mRequestStart {0};
+  std::atomic<uint64_t> mReadState {0}; // generation and frames read
+
+  // streaming thread -> audio thread
+  std::atomic<uint64_t> mWriteState {0}; // generation and frames written
+
+  // audio thread
+  uint32_t mGeneration = 0;
+  uint32_t mReadPos = 0;
+
+  // streaming thread
+  uint32_t mFillGeneration = 0;
+  const StreamingSample* mFillSample = nullptr;
+  int mFillPos = 0;
+  uint32_t mFillCount = 0;
+
+  std::atomic<int> mUnderruns {0};
+  std::atomic<int64_t> mUnderrunFrames {0};
+};
+
+/** Owns the SampleStreams of a group of voices and the thread that fills them. Streams are filled a bit at a time in turn,
+ * and the thread sleeps for a millisecond whenever all of them are full or idle */
+class SampleStreamer
+{
+public:
+  static constexpr int kReadFrames = 4096; // the most frames read for one stream before moving on to the next
+
+  SampleStreamer()
+  {
+    mThread = std::thread([this]() { Run(); });
+  }
+
+  ~SampleStreamer()
+  {
+    mQuit = true;
+    mThread.join();
+    mStreams.Empty(true);
+  }
+
+  SampleStreamer(const SampleStreamer&) = delete;
+  SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+  /** Creates a stream for a voice, call on the main thread when creating voices. The stream lives as long as the streamer
+   * @param maxChans The number of channels the ring buffer holds, samples with more channels are played with only the first maxChans */
+  SampleStream* AddStream(int maxChans = 2)
+  {
+    WDL_MutexLock lock(&mMutex);
+    return mStreams.Add(new SampleStream(std::max(maxChans, 1)));
+  }
+
+  /** @return The number of dropouts of all streams, e.g. for a diagnostic display */
+  int GetUnderruns() const
+  {
+    WDL_MutexLock lock(&mMutex);
+    int total = 0;
+    for (auto i = 0; i < mStreams.GetSize(); i++)
+      total += mStreams.Get(i)->GetUnderruns();
+    return total;
+  }
+
+private:
+  void Run()
+  {
+    while (!mQuit)
+    {
+      int nFrames = 0;
+      {
+        WDL_MutexLock lock(&mMutex);
+        for (auto i = 0; i < mStreams.GetSize(); i++)
+          nFrames += mStreams.Get(i)->Fill(kReadFrames);
+      }
+
+      if (!nFrames)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  mutable WDL_Mutex mMutex; // protects mStreams
+  WDL_PtrList<SampleStream> mStreams;
+  std::thread mThread;
+  std::atomic<bool> mQuit {false};
+};
+
+/** A set of StreamingSamples mapped to key and velocity ranges. Load it completely before the voices that use it start playing.
+ * Samples are shared through the AssetCache, so instances of a plug-in that load the same files map and preload them once */
+class StreamingSampleMap
+{
+public:
+  struct Zone
+  {
+    const StreamingSample* mSample;
+    int mRootKey;
+    int mLowKey;
+    int mHighKey;
+    int mLowVelocity;
+    int mHighVelocity;
+  };
+
+  StreamingSampleMap() = default;
+  StreamingSampleMap(const StreamingSampleMap&) = delete;
+  StreamingSampleMap& operator=(const StreamingSampleMap&) = delete;
+
+  /** Loads a sample and maps it to a range of keys and velocities
+   * @param path The WAV file
+   * @param rootKey The MIDI note at which the sample plays at its original pitch
+   * @param preloadFrames See StreamingSample::Load()
+   * @return \c false if the file could not be loaded */
+  bool AddZone(const char* path, int rootKey, int lowKey, int highKey, int lowVelocity = 0, int highVelocity = 127, int preloadFrames = StreamingSample::kDefaultPreloadFrames)
+  {
+    using Cache = AssetCache<StreamingSample>;
+
+    // sample files are too large to hash, so they are identified by path, size and modification time
+    const Cache::Key fileKey = Cache::KeyForFileIdentity(path);
+    if (!fileKey)
+      return false;
+
+    std::shared_ptr<const StreamingSample> pSample = Cache::Get().FindOrCreate(Cache::CombineKey(fileKey, preloadFrames), [&]() {
+      std::shared_ptr<StreamingSample> pNew(new StreamingSample);
+      return pNew->Load(path, preloadFrames) ? pNew : nullptr;
+    });
+
+    if (!pSample)
+      return false;
+
+    mZones.push_back({pSample.get(), rootKey, lowKey, highKey, lowVelocity, highVelocity});
+    mSamples.push_back(std::move(pSample));
+    return true;
+  }
+
+  /** @return The first zone containing the key and velocity, or nullptr */
+  const Zone* FindZone(int key, int velocity) const
+  {
+    for (const auto& zone : mZones)
+    {
+      if (key >= zone.mLowKey && key <= zone.mHighKey && velocity >= zone.mLowVelocity && velocity <= zone.mHighVelocity)
+        return &zone;
+    }
+    return nullptr;
+  }
+
+  /** @return The memory used by all the preloaded attacks, in bytes, including those shared with other instances */
+  int64_t GetPreloadBytes() const
+  {
+    int64_t total = 0;
+    for (const auto& pSample : mSamples)
+      total += pSample->GetPreloadBytes();
+    return total;
+  }
+
+private:
+  std::vector<Zone> mZones;
+  std::vector<std::shared_ptr<const StreamingSample>> mSamples;
+};
+
+/** A SynthVoice that plays the zone of a StreamingSampleMap matching its key and velocity, with linear interpolation for
+ * transposition. The attack is played from memory while the voice's SampleStream catches up. If the stream still runs dry,
+ * the voice outputs silence and resumes where it stopped when data arrives, and the dropout is counted */
+class StreamingSamplerVoice : public SynthVoice
+{
+public:
+  /** @param streamer The streamer that fills this voice's stream, which must outlive the voice
+   * @param sampleMap The samples, which must outlive the voice
+   * @param maxChans The maximum number of sample channels played */
+  StreamingSamplerVoice(SampleStreamer& streamer, const StreamingSampleMap& sampleMap, int maxChans = 2)
+  : mStream(streamer.AddStream(std::min(maxChans, kMaxChans)))
+  , mSampleMap(sampleMap)
+  , mEnv("sampler", [&]() { StartZone(); })
+  {
+    mEnv.SetStageTime(ADSREnvelope<sample>::kAttack, 1.);
+    mEnv.SetStageTime(ADSREnvelope<sample>::kRelease, 200.);
+  }
+
+  bool GetBusy() const override
+  {
+    return mEnv.GetBusy() && (mZone != nullptr || mPendingZone != nullptr);
+  }
+
+  void Trigger(double level, bool isRetrigger) override
+  {
+    mPendingZone = mSampleMap.FindZone(mKey, (int) std::round(level * 127.));
+
+    if (isRetrigger)
+    {
+      mEnv.Retrigger(level); // the new zone starts once the previous sound has faded, see StartZone()
+    }
+    else
+    {
+      StartZone();
+      mEnv.Start(level);
+    }
+  }
+
+  void Release() override
+  {
+    mEnv.Release();
+  }
+
+  void ProcessSamplesAccumulating(sample**, sample** outputs, int, int nOutputs, int startIdx, int nFrames) override
+  {
+    if (!mZone && !mPendingZone)
+      return;
+
+    const double pitchRatio = std::pow(2., mInputs[kVoiceControlPitch].endValue + mInputs[kVoiceControlPitchBend].endValue);
+    int underrunFrames = 0;
+    mAvailable = mStream->GetAvailable();
+
+    for (auto s = startIdx; s < startIdx + nFrames; s++)
+    {
+      const sample env = mEnv.Process(1.) * mGain; // a retriggered voice starts its new zone in here, see StartZone()
+
+      if (!mZone)
+      {
+        if (mPendingZone)
+          continue; // the previous sample ended during the retrigger fade
+
+        break;
+      }
+
+      if (!Advance())
+      {
+        if (mZone)
+        {
+          if (!mInUnderrun)
+            mStream->AddUnderrun();
+          mInUnderrun = true;
+          underrunFrames++;
+        }
+        continue;
+      }
+
+      mInUnderrun = false;
+
+      const int nChans = std::min(mStream->GetMaxChans(), mZone->mSample->GetNumChans());
+      for (auto c = 0; c < nOutputs; c++)
+      {
+        const int srcChan = c % nChans;
+        const float y = mFrame0[srcChan] + (float) mFrac * (mFrame1[srcChan] - mFrame0[srcChan]);
+        outputs[c][s] += y * env;
+      }
+
+      mFrac += mRate * pitchRatio;
+    }
+
+    if (underrunFrames)
+      mStream->AddUnderrunFrames(underrunFrames);
+
+    mStream->Acknowledge();
+  }
+
+  void SetSampleRateAndBlockSize(double sampleRate, int) override
+  {
+    mSampleRate = sampleRate;
+    mEnv.SetSampleRate(sampleRate);
+  }
+
+  /** @param timeMS The release time of the amplitude envelope */
+  void SetReleaseTime(double timeMS) { mEnv.SetStageTime(ADSREnvelope<sample>::kRelease, timeMS); }
+
+  /** @return The number of dropouts this voice has had */
+  int GetUnderruns() const { return mStream->GetUnderruns(); }
+
+private:
+  static constexpr int kMaxChans = 8;
+
+  /** Starts playing the pending zone from its first frame, called on Trigger() or once a retriggered voice has faded out */
+  void StartZone()
+  {
+    mZone = mPendingZone;
+    mPendingZone = nullptr;
+
+    if (!mZone)
+    {
+      mStream->Stop();
+      return;
+    }
+
+    const StreamingSample* pSample = mZone->mSample;
+    mPos = 0;
+    mRate = pSample->GetSampleRate() / mSampleRate * std::pow(2., (69. - mZone->mRootKey) / 12.);
+    mFrac = 2.; // fetch two frames before the first output
+    memset(mFrame1, 0, sizeof(mFrame1));
+    mInUnderrun = false;
+
+    // the stream starts after the preloaded attack, short samples are entirely in memory
+    if (pSample->GetPreloadLength() < pSample->GetLength())
+      mStream->Start(pSample, pSample->GetPreloadLength());
+    else
+      mStream->Stop();
+    mAvailable = 0;
+  }
+
+  /** Moves the interpolation frames forward to the current position
+   * @return \c false if the stream ran dry, in which case the position is kept, or if the sample ended, in which case mZone is cleared */
+  bool Advance()
+  {
+    const StreamingSample* pSample = mZone->mSample;
+    const int nChans = std::min(mStream->GetMaxChans(), pSample->GetNumChans());
+
+    while (mFrac >= 1.)
+    {
+      const float* pFrame;
+
+      if (mPos >= pSample->GetLength())
+      {
+        mZone = nullptr;
+        mStream->Stop();
+        return false;
+      }
+      else if (mPos < pSample->GetPreloadLength())
+      {
+        pFrame = pSample->GetPreload() + mPos * pSample->GetNumChans();
+      }
+      else if (mAvailable > 0)
+      {
+        pFrame = mStream->ReadFrame();
+        mAvailable--;
+      }
+      else
+      {
+        return false;
+      }
+
+      memcpy(mFrame0, mFrame1, sizeof(mFrame1));
+      memcpy(mFrame1, pFrame, nChans * sizeof(float));
+      mPos++;
+      mFrac -= 1.;
+    }
+    return true;
+  }
+
+  SampleStream* mStream;
+  const StreamingSampleMap& mSampleMap;
+  ADSREnvelope<sample> mEnv;
+
+  const StreamingSampleMap::Zone* mZone = nullptr;
+  const StreamingSampleMap::Zone* mPendingZone = nullptr;
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  double mRate = 1.; // sample frames per output frame at A4, i.e. pitch 0
+  double mFrac = 0.;
+  int mPos = 0; // the next sample frame to fetch
+  int mAvailable = 0; // stream frames that can be read in this block
+  float mFrame0[kMaxChans] = {};
+  float mFrame1[kMaxChans] = {};
+  bool mInUnderrun = false; // the stream has been dry since the last output frame
+};
+
+END_IPLUG_NAMESPACE
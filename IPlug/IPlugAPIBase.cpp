@@ -191,6 +191,7 @@ void IPlugAPIBase::OnTimer(Timer& t)
 #endif
   }
   
+  mTaskQueue.ProcessCompletions();
   OnIdle();
 }
 
@@ -24,6 +24,7 @@
 #include "IPlugUtilities.h"
 #include "IPlugParameter.h"
 #include "IPlugQueue.h"
+#include "IPlugTaskQueue.h"
 #include "IPlugTimer.h"
 
 /**
@@ -117,6 +118,12 @@ public:
    * @param normalizedValue The new (normalised) value */
   void SetParameterValue(int paramIdx, double normalizedValue);
   
+  /** Background tasks for non-realtime work such as file I/O, analysis or preparing impulse responses. The worker threads are shared by
+   * all plug-in instances, and completion functions are called on the main thread by the idle timer, before OnIdle().
+   * Tasks that use members of your plug-in class must be finished before they are destroyed, so call GetTaskQueue().CancelAll(true) in its destructor
+   * @return The plug-in's task queue */
+  IPlugTaskQueue& GetTaskQueue() { return mTaskQueue; }
+
   /** Get the color of the track that the plug-in is inserted on */
   virtual void GetTrackColor(int& r, int& g, int& b) { r = 0; g = 0; b = 0; }
 
@@ -226,6 +233,7 @@ private:
 private:
   WDL_String mParamDisplayStr;
   std::unique_ptr<Timer> mTimer;
+  IPlugTaskQueue mTaskQueue;
   
   IPlugQueue<ParamTuple> mParamChangeFromProcessor {PARAM_TRANSFER_SIZE};
   IPlugQueue<IMidiMsg> mMidiMsgsFromEditor {MIDI_TRANSFER_SIZE}; // a queue of midi messages generated in the editor by clicking keyboard UI etc
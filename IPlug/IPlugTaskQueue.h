@@ -0,0 +1,353 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @brief Queues of non-realtime background tasks, serviced by a set of worker threads shared by all plug-in instances
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "IPlugPlatform.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+enum class ETaskPriority
+{
+  kLow = 0,
+  kNormal,
+  kHigh,
+  kNumTaskPriorities
+};
+
+class IPlugTaskQueue;
+
+/** A task submitted to an IPlugTaskQueue. The work function receives it, so that it can check whether it has been cancelled */
+class IPlugTask
+{
+public:
+  using WorkFunc = std::function<void(IPlugTask& task)>;
+  using CompletionFunc = std::function<void(bool cancelled)>;
+
+  IPlugTask(const IPlugTask&) = delete;
+  IPlugTask& operator=(const IPlugTask&) = delete;
+
+  int GetID() const { return mID; }
+
+  /** @return \c true if the task has been cancelled. Long running work should check this regularly and return early */
+  bool IsCancelled() const { return mCancelled.load(std::memory_order_relaxed); }
+
+private:
+  friend class IPlugTaskQueue;
+  friend class IPlugTaskPool;
+
+  struct Owner;
+
+  IPlugTask(int id, ETaskPriority priority, WorkFunc work, CompletionFunc onComplete, std::shared_ptr<Owner> pOwner)
+  : mID(id), mPriority(priority), mWork(std::move(work)), mOnComplete(std::move(onComplete)), mOwner(std::move(pOwner))
+  {
+  }
+
+  /** The state of an IPlugTaskQueue that the worker threads need, which lives as long as any of its tasks */
+  struct Owner
+  {
+    std::mutex mMutex;
+    std::condition_variable mIdle;
+    std::unordered_map<int, std::shared_ptr<IPlugTask>> mTasks; // submitted and not yet completed on the main thread
+    std::vector<std::shared_ptr<IPlugTask>> mCompleted;
+    int mNumOutstanding = 0; // queued or running
+  };
+
+  /** Runs the work, unless the task was cancelled first, and hands the task back to its owner for completion */
+  static void Execute(const std::shared_ptr<IPlugTask>& pTask)
+  {
+    if (!pTask->IsCancelled())
+      pTask->mWork(*pTask);
+
+    pTask->mWork = nullptr; // release anything captured, on this thread
+
+    Owner& owner = *pTask->mOwner;
+    std::lock_guard<std::mutex> lock(owner.mMutex);
+    owner.mCompleted.push_back(pTask);
+    if (--owner.mNumOutstanding == 0)
+      owner.mIdle.notify_all();
+  }
+
+  const int mID;
+  const ETaskPriority mPriority;
+  WorkFunc mWork;
+  CompletionFunc mOnComplete;
+  std::shared_ptr<Owner> mOwner;
+  std::atomic<bool> mCancelled {false};
+};
+
+/** The worker threads shared by all IPlugTaskQueues in the process. They start when the first task is added and stop when the
+ * last queue is destroyed. Tasks are taken highest priority first, and in the order they were added within a priority */
+class IPlugTaskPool
+{
+public:
+  ~IPlugTaskPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQuit = true;
+    }
+    mCond.notify_all();
+
+    for (auto& thread : mThreads)
+      thread.join();
+  }
+
+  IPlugTaskPool(const IPlugTaskPool&) = delete;
+  IPlugTaskPool& operator=(const IPlugTaskPool&) = delete;
+
+  /** @return The shared pool, created if no queue holds it */
+  static std::shared_ptr<IPlugTaskPool> Get()
+  {
+    static std::mutex sMutex;
+    static std::weak_ptr<IPlugTaskPool> sPool;
+
+    std::lock_guard<std::mutex> lock(sMutex);
+    std::shared_ptr<IPlugTaskPool> pPool = sPool.lock();
+    if (!pPool)
+    {
+      pPool.reset(new IPlugTaskPool);
+      sPool = pPool;
+    }
+    return pPool;
+  }
+
+  /** @return The number of worker threads, leaving at least one core for the audio and main threads */
+  int GetNumThreads() const { return (int) mThreads.size(); }
+
+  void Submit(const std::shared_ptr<IPlugTask>& pTask)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mQueues[(int) pTask->mPriority].push_back(pTask);
+    }
+    mCond.notify_one();
+  }
+
+  /** Takes the tasks of one owner that haven't started out of the queues
+   * @return The tasks that were removed */
+  std::vector<std::shared_ptr<IPlugTask>> Remove(const IPlugTask::Owner* pOwner)
+  {
+    std::vector<std::shared_ptr<IPlugTask>> removed;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& queue : mQueues)
+    {
+      for (auto it = queue.begin(); it != queue.end();)
+      {
+        if ((*it)->mOwner.get() == pOwner)
+        {
+          removed.push_back(std::move(*it));
+          it = queue.erase(it);
+        }
+        else
+          ++it;
+      }
+    }
+    return removed;
+  }
+
+private:
+  static constexpr int kMaxThreads = 4;
+
+  IPlugTaskPool()
+  {
+    const int nThreads = std::max(1, std::min((int) std::thread::hardware_concurrency() - 1, kMaxThreads));
+    for (auto i = 0; i < nThreads; i++)
+      mThreads.emplace_back([this]() { Run(); });
+  }
+
+  void Run()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+      std::shared_ptr<IPlugTask> pTask;
+      mCond.wait(lock, [&]() { return mQuit || (pTask = Pop()) != nullptr; });
+
+      if (!pTask)
+        return;
+
+      lock.unlock();
+      IPlugTask::Execute(pTask);
+      pTask = nullptr;
+      lock.lock();
+    }
+  }
+
+  std::shared_ptr<IPlugTask> Pop()
+  {
+    for (auto p = (int) ETaskPriority::kNumTaskPriorities - 1; p >= 0; p--)
+    {
+      if (!mQueues[p].empty())
+      {
+        std::shared_ptr<IPlugTask> pTask = std::move(mQueues[p].front());
+        mQueues[p].pop_front();
+        return pTask;
+      }
+    }
+    return nullptr;
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mCond;
+  std::deque<std::shared_ptr<IPlugTask>> mQueues[(int) ETaskPriority::kNumTaskPriorities];
+  std::vector<std::thread> mThreads;
+  bool mQuit = false;
+};
+
+/** Runs non-realtime work, such as file I/O, analysis, IR preparation or preset decoding, on the shared IPlugTaskPool and
+ * calls completion functions back on the main thread. Every IPlugAPIBase has one, see IPlugAPIBase::GetTaskQueue(), which
+ * is processed by the plug-in's idle timer. Other users can own a queue and call ProcessCompletions() themselves.
+ * Without threads (OS_WEB) tasks run immediately when they are added. Don't add tasks on the audio thread */
+class IPlugTaskQueue
+{
+public:
+  IPlugTaskQueue()
+  : mOwner(std::make_shared<IPlugTask::Owner>())
+  {
+  }
+
+  /** Cancels all tasks and waits for the running ones to return */
+  ~IPlugTaskQueue()
+  {
+    CancelAll(true);
+  }
+
+  IPlugTaskQueue(const IPlugTaskQueue&) = delete;
+  IPlugTaskQueue& operator=(const IPlugTaskQueue&) = delete;
+
+  /** Adds a task. Any thread except the audio thread
+   * @param work Called on a worker thread, with the task so that it can check IPlugTask::IsCancelled()
+   * @param onComplete Called on the main thread by ProcessCompletions() after the work has returned, or instead of it if the task was
+   * cancelled before it started. The argument says whether the task was cancelled. May be nullptr
+   * @param priority Tasks with a higher priority are started first
+   * @return The task's ID, for Cancel() */
+  int Add(IPlugTask::WorkFunc work, IPlugTask::CompletionFunc onComplete = nullptr, ETaskPriority priority = ETaskPriority::kNormal)
+  {
+    const int id = ++mLastID;
+    std::shared_ptr<IPlugTask> pTask(new IPlugTask(id, priority, std::move(work), std::move(onComplete), mOwner));
+
+    {
+      std::lock_guard<std::mutex> lock(mOwner->mMutex);
+      mOwner->mTasks[id] = pTask;
+      mOwner->mNumOutstanding++;
+    }
+
+#ifdef OS_WEB
+    IPlugTask::Execute(pTask);
+#else
+    {
+      std::lock_guard<std::mutex> lock(mPoolMutex);
+      if (!mPool)
+        mPool = IPlugTaskPool::Get();
+    }
+    mPool->Submit(pTask);
+#endif
+    return id;
+  }
+
+  /** Cancels a task. If it hasn't started it won't, if it is running IPlugTask::IsCancelled() will return \c true.
+   * Its completion function is still called, with cancelled set to \c true
+   * @return \c false if the task has already completed */
+  bool Cancel(int taskID)
+  {
+    std::lock_guard<std::mutex> lock(mOwner->mMutex);
+    auto it = mOwner->mTasks.find(taskID);
+    if (it == mOwner->mTasks.end())
+      return false;
+
+    it->second->mCancelled = true;
+    return true;
+  }
+
+  /** Cancels all tasks
+   * @param wait If \c true, blocks until the running tasks have returned, e.g. in a plug-in's destructor when they use its members */
+  void CancelAll(bool wait = false)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mOwner->mMutex);
+      for (auto& task : mOwner->mTasks)
+        task.second->mCancelled = true;
+    }
+
+    if (!wait)
+      return;
+
+    std::shared_ptr<IPlugTaskPool> pPool;
+    {
+      std::lock_guard<std::mutex> lock(mPoolMutex);
+      pPool = mPool;
+    }
+
+    // tasks that haven't started are completed here, rather than waiting for a free worker
+    if (pPool)
+    {
+      for (auto& pTask : pPool->Remove(mOwner.get()))
+        IPlugTask::Execute(pTask);
+    }
+
+    std::unique_lock<std::mutex> lock(mOwner->mMutex);
+    mOwner->mIdle.wait(lock, [this]() { return mOwner->mNumOutstanding == 0; });
+  }
+
+  /** Calls the completion functions of finished tasks, in the order they finished. Call on the main thread */
+  void ProcessCompletions()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mOwner->mMutex);
+      if (mOwner->mCompleted.empty())
+        return;
+
+      mCompleted.swap(mOwner->mCompleted);
+      for (auto& pTask : mCompleted)
+        mOwner->mTasks.erase(pTask->mID);
+    }
+
+    for (auto& pTask : mCompleted)
+    {
+      if (pTask->mOnComplete)
+        pTask->mOnComplete(pTask->IsCancelled());
+    }
+    mCompleted.clear();
+  }
+
+  /** @return The number of tasks that have been added and not yet completed on the main thread */
+  int GetNumTasks() const
+  {
+    std::lock_guard<std::mutex> lock(mOwner->mMutex);
+    return (int) mOwner->mTasks.size();
+  }
+
+private:
+  std::shared_ptr<IPlugTask::Owner> mOwner;
+  std::mutex mPoolMutex;
+  std::shared_ptr<IPlugTaskPool> mPool; // acquired on the first Add(), so that instances that don't use tasks start no threads
+  std::atomic<int> mLastID {0};
+  std::vector<std::shared_ptr<IPlugTask>> mCompleted; // main thread
+};
+
+END_IPLUG_NAMESPACE
@@ -20,7 +20,10 @@
 
 #include "IPlugPlatform.h"
 #include "IPlugQueue.h"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <limits>
 
 #if defined OS_IOS || defined OS_MAC
 #include <Accelerate/Accelerate.h>
@@ -491,4 +494,233 @@ private:
   float mThreshold = 0.01f;
 };
 
+/** IEnvelopePyramid holds min/max/RMS envelope points for one channel of an IEnvelopeSender, at MAXPOINTS resolution
+ * and at every power of two decimation of that, down to a single point. The sender only sends the coarsest level that
+ * still has as many points as the display needs, so neither the packet size nor the drawing cost depend on the time window */
+template <int MAXPOINTS = 512>
+struct IEnvelopePyramid
+{
+  static_assert(MAXPOINTS > 0 && !(MAXPOINTS & (MAXPOINTS - 1)), "MAXPOINTS must be a power of two");
+
+  static constexpr int kSize = (2 * MAXPOINTS) - 1;
+
+  /** @return The index of the first point of a level, level 0 being the full resolution */
+  static constexpr int LevelOffset(int level) { return (2 * MAXPOINTS) - ((2 * MAXPOINTS) >> level); }
+  /** @return The number of points of a level */
+  static constexpr int LevelSize(int level) { return MAXPOINTS >> level; }
+
+  /** @return The coarsest level that still has at least nPoints points. Requests for fewer than one point get the single point level */
+  static int LevelForPoints(int nPoints)
+  {
+    nPoints = std::max(nPoints, 1);
+    int level = 0;
+    while (LevelSize(level) > 1 && LevelSize(level + 1) >= nPoints)
+      level++;
+    return level;
+  }
+
+  std::array<float, kSize> min;
+  std::array<float, kSize> max;
+  std::array<float, kSize> rms;
+};
+
+/** IEnvelopePoints is the packet an IEnvelopeSender sends for one channel: one level of its IEnvelopePyramid */
+template <int MAXPOINTS = 512>
+struct IEnvelopePoints
+{
+  int nPoints;
+  int sweepPos; // full resolution points written in the current sweep, the points after it are from the previous sweep
+  bool hasRMS; // false if the sender doesn't calculate RMS, in which case rms isn't written
+  std::array<float, MAXPOINTS> min;
+  std::array<float, MAXPOINTS> max;
+  std::array<float, MAXPOINTS> rms;
+};
+
+/** IEnvelopeSender is a utility class which can be used to send min/max (and optionally RMS) envelopes of long time windows to
+ * the GUI, for display with an IVEnvelopeScopeControl. Rather than sending every sample like IBufferSender, it reduces the input
+ * to MAXPOINTS points per time window as it arrives, with O(1) work per sample, and maintains a decimation pyramid of those points.
+ * The display sweeps from left to right, the whole window is sent at a fixed update rate, at the resolution set with SetNumPoints().
+ * Note that each packet is about 12 * MAXPOINTS bytes per channel, so QUEUE_SIZE defaults to a small value */
+template <int MAXNC = 1, int QUEUE_SIZE = 8, int MAXPOINTS = 512>
+class IEnvelopeSender : public ISender<MAXNC, QUEUE_SIZE, IEnvelopePoints<MAXPOINTS>>
+{
+public:
+  using Pyramid = IEnvelopePyramid<MAXPOINTS>;
+  using Points = IEnvelopePoints<MAXPOINTS>;
+
+  /** @param minThresholdDb Stop sending when the signal stays below this level
+   * @param windowTimeMs The time window that the display covers
+   * @param updateIntervalMs How often the envelope is sent
+   * @param rms Whether to calculate RMS as well as min/max */
+  IEnvelopeSender(double minThresholdDb = -90., double windowTimeMs = 2000., double updateIntervalMs = 33., bool rms = false)
+  : ISender<MAXNC, QUEUE_SIZE, Points>()
+  , mThreshold(static_cast<float>(DBToAmp(minThresholdDb)))
+  , mWindowTimeMs(windowTimeMs)
+  , mUpdateIntervalMs(updateIntervalMs)
+  , mRMS(rms)
+  {
+    Reset(DEFAULT_SAMPLE_RATE);
+  }
+
+  void Reset(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+    mSamplesPerPoint = std::max(static_cast<int>(mWindowTimeMs * 0.001 * sampleRate / MAXPOINTS), 1);
+    mUpdateInterval = std::max(static_cast<int>(mUpdateIntervalMs * 0.001 * sampleRate), 1);
+    mAccCount = 0;
+    mUpdateCount = 0;
+    mSweepPos = 0;
+
+    for (auto c = 0; c < MAXNC; c++)
+    {
+      Pyramid& p = mPyramids[c];
+      p.min.fill(0.f);
+      p.max.fill(0.f);
+      p.rms.fill(0.f);
+      ResetAccumulator(c);
+    }
+  }
+
+  void SetWindowTimeMs(double timeMs, double sampleRate)
+  {
+    mWindowTimeMs = timeMs;
+    Reset(sampleRate);
+  }
+
+  void SetUpdateIntervalMs(double timeMs, double sampleRate)
+  {
+    mUpdateIntervalMs = timeMs;
+    Reset(sampleRate);
+  }
+
+  /** Sets the resolution of the envelopes that are sent, e.g. from the width of the display in pixels. Any thread
+   * @param nPoints The number of points the display needs. The coarsest level of the pyramid with at least that many is sent */
+  void SetNumPoints(int nPoints) { mLevel.store(Pyramid::LevelForPoints(nPoints), std::memory_order_relaxed); }
+
+  /** Reduce sample buffers and queue the envelope at the update rate. This can be called on the realtime audio thread.
+   @param inputs the sample buffers
+   @param nFrames the number of sample frames in the input buffers
+   @param ctrlTag a control tag to indicate which control to send the envelopes to. Note: if you don't supply the control tag here, you must use TransmitDataToControlsWithTags() and specify one or more tags there
+   @param nChans the number of channels of data that should be sent
+   @param chanOffset the starting channel */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    for (auto s = 0; s < nFrames; s++)
+    {
+      for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+      {
+        const float v = static_cast<float>(inputs[c][s]);
+        mAccMin[c] = std::min(mAccMin[c], v);
+        mAccMax[c] = std::max(mAccMax[c], v);
+        mAccSumSq[c] += v * v;
+      }
+
+      if (++mAccCount == mSamplesPerPoint)
+      {
+        for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+        {
+          AddPoint(c);
+          ResetAccumulator(c);
+        }
+
+        mAccCount = 0;
+        if (++mSweepPos == MAXPOINTS)
+          mSweepPos = 0;
+      }
+
+      if (++mUpdateCount == mUpdateInterval)
+      {
+        mUpdateCount = 0;
+
+        mData.ctrlTag = ctrlTag;
+        mData.nChans = nChans;
+        mData.chanOffset = chanOffset;
+
+        float peak = 0.f;
+        for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+        {
+          peak = std::max(peak, mPeakSinceUpdate[c]);
+          mPeakSinceUpdate[c] = 0.f;
+        }
+
+        if (peak > mThreshold || mPreviousPeak > mThreshold)
+        {
+          const int level = mLevel.load(std::memory_order_relaxed);
+          const int offset = Pyramid::LevelOffset(level);
+          const int nPoints = Pyramid::LevelSize(level);
+
+          for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+          {
+            const Pyramid& p = mPyramids[c];
+            Points& d = mData.vals[c];
+            d.nPoints = nPoints;
+            d.sweepPos = mSweepPos;
+            d.hasRMS = mRMS;
+            std::copy_n(p.min.begin() + offset, nPoints, d.min.begin());
+            std::copy_n(p.max.begin() + offset, nPoints, d.max.begin());
+            if (mRMS)
+              std::copy_n(p.rms.begin() + offset, nPoints, d.rms.begin());
+          }
+
+          ISender<MAXNC, QUEUE_SIZE, Points>::PushData(mData);
+        }
+
+        mPreviousPeak = peak;
+      }
+    }
+  }
+
+private:
+  void ResetAccumulator(int c)
+  {
+    mAccMin[c] = std::numeric_limits<float>::max();
+    mAccMax[c] = std::numeric_limits<float>::lowest();
+    mAccSumSq[c] = 0.f;
+  }
+
+  /** Writes the accumulated point at the sweep position and updates the coarser levels that it completes */
+  void AddPoint(int c)
+  {
+    Pyramid& p = mPyramids[c];
+    int idx = mSweepPos;
+    int level = 0;
+
+    p.min[idx] = mAccMin[c];
+    p.max[idx] = mAccMax[c];
+    p.rms[idx] = mRMS ? std::sqrt(mAccSumSq[c] / mSamplesPerPoint) : 0.f;
+    mPeakSinceUpdate[c] = std::max(mPeakSinceUpdate[c], std::max(mAccMax[c], -mAccMin[c]));
+
+    // a pair is complete when its odd point is written
+    while (idx & 1)
+    {
+      const int src = Pyramid::LevelOffset(level) + idx - 1;
+      const int dest = Pyramid::LevelOffset(level + 1) + (idx >> 1);
+      p.min[dest] = std::min(p.min[src], p.min[src + 1]);
+      p.max[dest] = std::max(p.max[src], p.max[src + 1]);
+      p.rms[dest] = std::sqrt((p.rms[src] * p.rms[src] + p.rms[src + 1] * p.rms[src + 1]) * 0.5f);
+      idx >>= 1;
+      level++;
+    }
+  }
+
+  std::array<Pyramid, MAXNC> mPyramids;
+  ISenderData<MAXNC, Points> mData;
+  std::atomic<int> mLevel {0};
+  float mThreshold = 0.01f;
+  double mSampleRate = DEFAULT_SAMPLE_RATE;
+  double mWindowTimeMs = 2000.;
+  double mUpdateIntervalMs = 33.;
+  bool mRMS = false;
+  int mSamplesPerPoint = 1;
+  int mUpdateInterval = 1;
+  int mAccCount = 0;
+  int mUpdateCount = 0;
+  int mSweepPos = 0;
+  float mPreviousPeak = 1.f;
+  std::array<float, MAXNC> mAccMin;
+  std::array<float, MAXNC> mAccMax;
+  std::array<float, MAXNC> mAccSumSq;
+  std::array<float, MAXNC> mPeakSinceUpdate {0.f};
+};
+
 END_IPLUG_NAMESPACE
@@ -0,0 +1,378 @@
+/*
+ ==============================================================================
+
+ This file is part of the iPlug 2 library. Copyright (C) the iPlug 2 developers.
+
+ See LICENSE.txt for  more info.
+
+ ==============================================================================
+*/
+
+#pragma once
+
+/**
+ * @file
+ * @copydoc ISpectrumSender
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "fft.h"
+
+#include "IPlugUtilities.h"
+#include "ISender.h"
+
+BEGIN_IPLUG_NAMESPACE
+
+/** ISpectrumSender is a utility class which can be used to send log-frequency magnitude spectra to the GUI.
+ * The audio thread only copies samples into a lock-free queue. A worker thread computes Hann windowed, overlapping
+ * FFTs with WDL_real_fft(), maps them onto NBINS logarithmically spaced bins, applies attack/decay smoothing and
+ * queues the result. Values are normalized, 0 at the bottom of the dB range and 1 at the top.
+ * The data packets have the same layout as IBufferSender's, so controls that display those, e.g. IVScopeControl<MAXNC, NBINS>,
+ * can display spectra. WDL/fft.c needs to be compiled in the project. Since this class is not included by ISender.h,
+ * WDL_FFT_REALSIZE can be defined as required before including it.
+ * @tparam MAXNC Maximum number of channels
+ * @tparam QUEUE_SIZE Number of spectra that can be queued between TransmitData() calls
+ * @tparam NBINS Number of log-frequency bins per channel */
+template <int MAXNC = 1, int QUEUE_SIZE = 64, int NBINS = 128>
+class ISpectrumSender : public ISender<MAXNC, QUEUE_SIZE, std::array<float, NBINS>>
+{
+public:
+  /** @param fftSize FFT size, a power of two between 64 and 32768
+   * @param overlap Number of FFTs per fftSize samples
+   * @param minDb Level that maps to 0
+   * @param maxDb Level that maps to 1 */
+  ISpectrumSender(int fftSize = 2048, int overlap = 4, double minDb = -90., double maxDb = 0.)
+  : ISender<MAXNC, QUEUE_SIZE, std::array<float, NBINS>>()
+  {
+    WDL_fft_init();
+    SetFFTSize(fftSize, overlap);
+    SetRange(minDb, maxDb);
+    mThread = std::thread([this]() { Run(); });
+  }
+
+  ~ISpectrumSender()
+  {
+    mQuit = true;
+    mThread.join();
+  }
+
+  ISpectrumSender(const ISpectrumSender&) = delete;
+  ISpectrumSender& operator=(const ISpectrumSender&) = delete;
+
+  /** Set the sample rate and clear the analysis state. Call from OnReset() */
+  void Reset(double sampleRate)
+  {
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    mConfig.sampleRate = sampleRate;
+    mConfigChanged = true;
+  }
+
+  void SetFFTSize(int fftSize, int overlap = 4)
+  {
+    assert(fftSize >= 64 && fftSize <= 32768 && !(fftSize & (fftSize - 1)));
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    mConfig.fftSize = fftSize;
+    mConfig.hopSize = std::max(fftSize / std::max(overlap, 1), 1);
+    mConfigChanged = true;
+  }
+
+  /** @param minDb Level that maps to 0
+   * @param maxDb Level that maps to 1 */
+  void SetRange(double minDb, double maxDb)
+  {
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    mConfig.minDb = minDb;
+    mConfig.maxDb = maxDb;
+    mConfigChanged = true;
+  }
+
+  /** @param loHz Frequency at the bottom of the first bin
+   * @param hiHz Frequency at the top of the last bin, clipped to Nyquist */
+  void SetFrequencyRange(double loHz, double hiHz)
+  {
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    mConfig.loHz = loHz;
+    mConfig.hiHz = hiHz;
+    mConfigChanged = true;
+  }
+
+  /** Ballistics of the displayed bins
+   * @param attackTimeMs Time constant for rising values, 0 for instant
+   * @param decayTimeMs Time constant for falling values */
+  void SetSmoothing(double attackTimeMs, double decayTimeMs)
+  {
+    std::lock_guard<std::mutex> lock(mConfigMutex);
+    mConfig.attackTimeMs = attackTimeMs;
+    mConfig.decayTimeMs = decayTimeMs;
+    mConfigChanged = true;
+  }
+
+  /** Queue sample buffers for analysis. This can be called on the realtime audio thread, it doesn't do any analysis.
+   @param inputs the sample buffers to analyze
+   @param nFrames the number of sample frames in the input buffers
+   @param ctrlTag a control tag to indicate which control to send the spectra to. Note: if you don't supply the control tag here, you must use TransmitDataToControlsWithTags() and specify one or more tags there
+   @param nChans the number of channels of data that should be sent
+   @param chanOffset the starting channel */
+  void ProcessBlock(sample** inputs, int nFrames, int ctrlTag = kNoTag, int nChans = MAXNC, int chanOffset = 0)
+  {
+    assert(chanOffset + nChans <= MAXNC);
+
+    int s = 0;
+    while (s < nFrames)
+    {
+      const int n = std::min(nFrames - s, kChunkSize - mChunk.nFrames);
+
+      for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+      {
+        float* pDest = mChunk.data[c].data() + mChunk.nFrames;
+        const sample* pSrc = inputs[c] + s;
+        for (auto i = 0; i < n; i++)
+          pDest[i] = static_cast<float>(pSrc[i]);
+      }
+
+      mChunk.nFrames += n;
+      s += n;
+
+      if (mChunk.nFrames == kChunkSize)
+      {
+        mChunk.ctrlTag = ctrlTag;
+        mChunk.nChans = nChans;
+        mChunk.chanOffset = chanOffset;
+        mChunks.Push(mChunk); // if the worker falls behind, chunks are dropped
+        mChunk.nFrames = 0;
+      }
+    }
+  }
+
+private:
+  static constexpr int kChunkSize = 256;
+
+  struct Chunk
+  {
+    int ctrlTag = kNoTag;
+    int nChans = MAXNC;
+    int chanOffset = 0;
+    int nFrames = 0;
+    std::array<std::array<float, kChunkSize>, MAXNC> data;
+  };
+
+  struct Config
+  {
+    double sampleRate = DEFAULT_SAMPLE_RATE;
+    int fftSize = 2048;
+    int hopSize = 512;
+    double minDb = -90.;
+    double maxDb = 0.;
+    double loHz = 20.;
+    double hiHz = 20000.;
+    double attackTimeMs = 0.;
+    double decayTimeMs = 300.;
+  };
+
+  void Run()
+  {
+    while (!mQuit)
+    {
+      if (mConfigChanged)
+        ApplyConfig();
+
+      Chunk chunk;
+      if (!mChunks.Pop(chunk))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        continue;
+      }
+
+      int s = 0;
+      while (s < chunk.nFrames)
+      {
+        const int n = std::min(chunk.nFrames - s, mWorker.fftSize - mWorker.fill);
+
+        for (auto c = chunk.chanOffset; c < (chunk.chanOffset + chunk.nChans); c++)
+          memcpy(mWorker.input[c].Get() + mWorker.fill, chunk.data[c].data() + s, n * sizeof(float));
+
+        mWorker.fill += n;
+        s += n;
+
+        if (mWorker.fill == mWorker.fftSize)
+        {
+          Analyze(chunk.ctrlTag, chunk.nChans, chunk.chanOffset);
+
+          const int keep = mWorker.fftSize - mWorker.hopSize;
+          for (auto c = chunk.chanOffset; c < (chunk.chanOffset + chunk.nChans); c++)
+            memmove(mWorker.input[c].Get(), mWorker.input[c].Get() + mWorker.hopSize, keep * sizeof(float));
+          mWorker.fill = keep;
+        }
+      }
+    }
+  }
+
+  void ApplyConfig()
+  {
+    Config config;
+    {
+      std::lock_guard<std::mutex> lock(mConfigMutex);
+      config = mConfig;
+      mConfigChanged = false;
+    }
+
+    WorkerState& w = mWorker;
+    const int fftSize = config.fftSize;
+    w.fftSize = fftSize;
+    w.hopSize = std::min(config.hopSize, fftSize);
+    w.fill = 0;
+    w.minDb = static_cast<float>(config.minDb);
+    w.rangeDb = static_cast<float>(std::max(config.maxDb - config.minDb, 1.));
+
+    for (auto c = 0; c < MAXNC; c++)
+      memset(w.input[c].Resize(fftSize), 0, fftSize * sizeof(float));
+    w.fftBuf.Resize(fftSize);
+    w.mags.Resize(fftSize / 2 + 1);
+
+    double windowSum = 0.;
+    w.window.Resize(fftSize);
+    for (auto i = 0; i < fftSize; i++)
+    {
+      const double v = 0.5 - 0.5 * std::cos(2. * PI * i / fftSize);
+      w.window.Get()[i] = static_cast<float>(v);
+      windowSum += v;
+    }
+    // WDL_real_fft() returns 2x the DFT, a full scale sine then has magnitude 1
+    w.magScale = static_cast<float>(1. / windowSum);
+
+    // bin b spans [lo * r^b, lo * r^(b + 1)), in fractional FFT bins
+    const double binHz = config.sampleRate / fftSize;
+    const double nyquist = config.sampleRate * 0.5;
+    const double hi = Clip(config.hiHz, 1., nyquist);
+    const double lo = Clip(config.loHz, 1., hi * 0.5);
+    const double ratio = std::pow(hi / lo, 1. / NBINS);
+    for (auto b = 0; b <= NBINS; b++)
+      w.edges[b] = static_cast<float>(lo * std::pow(ratio, b) / binHz);
+
+    // per-spectrum smoothing coefficients
+    const double framesPerSec = config.sampleRate / w.hopSize;
+    auto coeff = [framesPerSec](double timeMs) {
+      return timeMs > 0. ? static_cast<float>(1. - std::exp(-1. / (timeMs * 0.001 * framesPerSec))) : 1.f;
+    };
+    w.attack = coeff(config.attackTimeMs);
+    w.decay = coeff(config.decayTimeMs);
+
+    for (auto c = 0; c < MAXNC; c++)
+      w.smoothed[c].fill(0.f);
+    w.prevSum = 1.f;
+  }
+
+  void Analyze(int ctrlTag, int nChans, int chanOffset)
+  {
+    WorkerState& w = mWorker;
+    const int fftSize = w.fftSize;
+    const int half = fftSize / 2;
+    const int* permute = WDL_fft_permute_tab(half);
+    WDL_FFT_REAL* pBuf = w.fftBuf.Get();
+    const WDL_FFT_COMPLEX* pCplx = reinterpret_cast<const WDL_FFT_COMPLEX*>(pBuf);
+    float* pMags = w.mags.Get();
+
+    ISenderData<MAXNC, std::array<float, NBINS>> d {ctrlTag, nChans, chanOffset};
+    float sum = 0.f;
+
+    for (auto c = chanOffset; c < (chanOffset + nChans); c++)
+    {
+      const float* pIn = w.input[c].Get();
+      const float* pWin = w.window.Get();
+      for (auto i = 0; i < fftSize; i++)
+        pBuf[i] = static_cast<WDL_FFT_REAL>(pIn[i] * pWin[i]);
+
+      WDL_real_fft(pBuf, fftSize, 0);
+
+      pMags[0] = std::fabs(static_cast<float>(pCplx[0].re)) * w.magScale;
+      pMags[half] = std::fabs(static_cast<float>(pCplx[0].im)) * w.magScale;
+      for (auto k = 1; k < half; k++)
+      {
+        const WDL_FFT_COMPLEX& v = pCplx[permute[k]];
+        pMags[k] = static_cast<float>(std::sqrt(v.re * v.re + v.im * v.im)) * w.magScale;
+      }
+
+      std::array<float, NBINS>& smoothed = w.smoothed[c];
+
+      for (auto b = 0; b < NBINS; b++)
+      {
+        const float lo = w.edges[b], hi = w.edges[b + 1];
+        float mag;
+
+        if (hi - lo < 1.f)
+        {
+          // narrower than an FFT bin, interpolate at the centre
+          const float pos = std::min((lo + hi) * 0.5f, static_cast<float>(half));
+          const int k = std::min(static_cast<int>(pos), half - 1);
+          const float frac = pos - k;
+          mag = pMags[k] + (pMags[k + 1] - pMags[k]) * frac;
+        }
+        else
+        {
+          const int k0 = static_cast<int>(std::ceil(lo));
+          const int k1 = std::min(static_cast<int>(hi), half);
+          mag = 0.f;
+          for (auto k = k0; k <= k1; k++)
+            mag = std::max(mag, pMags[k]);
+        }
+
+        const float db = mag > 1e-9f ? 20.f * std::log10(mag) : -180.f;
+        const float norm = Clip((db - w.minDb) / w.rangeDb, 0.f, 1.f);
+        float& s = smoothed[b];
+        s += (norm - s) * (norm > s ? w.attack : w.decay);
+        denormal_fix(&s);
+
+        d.vals[c][b] = s;
+        sum += s;
+      }
+    }
+
+    // like the other senders, stop sending once the display has decayed to nothing
+    if (sum > 0.f || w.prevSum > 0.f)
+      ISender<MAXNC, QUEUE_SIZE, std::array<float, NBINS>>::PushData(d);
+
+    w.prevSum = sum;
+  }
+
+  struct WorkerState
+  {
+    int fftSize = 0;
+    int hopSize = 0;
+    int fill = 0;
+    float minDb = -90.f;
+    float rangeDb = 90.f;
+    float magScale = 1.f;
+    float attack = 1.f;
+    float decay = 1.f;
+    float prevSum = 1.f;
+    std::array<WDL_TypedBuf<float>, MAXNC> input;
+    WDL_TypedBuf<float> window;
+    WDL_TypedBuf<WDL_FFT_REAL> fftBuf;
+    WDL_TypedBuf<float> mags;
+    std::array<float, NBINS + 1> edges;
+    std::array<std::array<float, NBINS>, MAXNC> smoothed;
+  };
+
+  // audio thread
+  Chunk mChunk;
+
+  // audio thread -> worker
+  IPlugQueue<Chunk> mChunks {QUEUE_SIZE};
+
+  // main thread -> worker
+  std::mutex mConfigMutex;
+  Config mConfig;
+  std::atomic<bool> mConfigChanged {true};
+
+  // worker
+  WorkerState mWorker;
+  std::atomic<bool> mQuit {false};
+  std::thread mThread;
+};
+
+END_IPLUG_NAMESPACE
@@ -32,6 +32,18 @@
 
 #include "denormal.h"
 
+#if !defined(WDL_CONVO_NO_THREADED_TAIL) && defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  #define WDL_CONVO_NO_THREADED_TAIL
+#endif
+
+#ifndef WDL_CONVO_NO_THREADED_TAIL
+  #include <atomic>
+  #include <chrono>
+  #include <condition_variable>
+  #include <mutex>
+  #include <thread>
+#endif
+
 //#define TIMING
 #include "timing.c"
 
@@ -707,17 +719,274 @@ void WDL_ConvolutionEngine::Advance(int len)
 **  low latency version
 */
 
+#ifndef WDL_CONVO_NO_THREADED_TAIL
+
+// Runs the tail engines of a WDL_ConvolutionEngine_Div on a worker thread. Input and output are passed through
+// single-producer/single-consumer rings indexed by free-running sample counters, so the audio thread never locks.
+// If the worker falls so far behind that the input ring would overflow, the tail is restarted (resync) rather than
+// letting the audio thread wait.
+struct WDL_ConvolutionEngine_Div::TailWorker
+{
+  TailWorker(int maxnch, int ringsize) : nch(maxnch), size(ringsize), mask(ringsize-1),
+    in_write(0), in_read(0), out_write(0), out_read(0), cur_nch(maxnch), reset_req(0), reset_done(0), quit(false), fed(false),
+    lead(0), in_pos(0), out_pos(0), base_pos(0), resyncing(false)
+  {
+    memset(inbuf.Resize(nch*size,false),0,nch*size*sizeof(WDL_FFT_REAL));
+    memset(outbuf.Resize(nch*size,false),0,nch*size*sizeof(WDL_FFT_REAL));
+    ptrs.Resize(nch,false);
+  }
+
+  ~TailWorker()
+  {
+    if (thread.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit=true;
+      }
+      cv.notify_one();
+      thread.join();
+    }
+  }
+
+  void Start() { thread = std::thread(&TailWorker::Run,this); }
+
+  // audio thread. clear_positions is set when the owning engine is reset, rather than on an overrun
+  void RequestReset(bool clear_positions)
+  {
+    resyncing=true;
+    reset_req.store(reset_req.load(std::memory_order_relaxed)+1,std::memory_order_release);
+    if (clear_positions) in_pos=out_pos=0;
+    cv.notify_one();
+  }
+
+  // audio thread
+  void Feed(WDL_FFT_REAL **bufs, int len, int use_nch, int *misses)
+  {
+    if (resyncing)
+    {
+      if (reset_done.load(std::memory_order_acquire) != reset_req.load(std::memory_order_relaxed))
+      {
+        in_pos+=len;
+        return;
+      }
+      resyncing=false;
+      base_pos=in_pos; // tail item 0 now lines up with this input sample
+    }
+
+    const unsigned int w = in_write.load(std::memory_order_relaxed);
+    const unsigned int r = in_read.load(std::memory_order_acquire);
+    if ((int)(w-r) + len > size)
+    {
+      *misses += len;
+      RequestReset(false);
+      in_pos+=len;
+      return;
+    }
+
+    if (use_nch>nch) use_nch=nch;
+    cur_nch.store(use_nch,std::memory_order_relaxed);
+
+    for (int ch = 0; ch < use_nch; ch ++)
+    {
+      WDL_FFT_REAL *ring = inbuf.Get() + ch*size;
+      const WDL_FFT_REAL *src = bufs ? bufs[ch] : NULL;
+      int pos = w&mask, left = len;
+      while (left>0)
+      {
+        int seg = wdl_min(left,size-pos);
+        if (src) { memcpy(ring+pos,src,seg*sizeof(WDL_FFT_REAL)); src+=seg; }
+        else memset(ring+pos,0,seg*sizeof(WDL_FFT_REAL));
+        left-=seg;
+        pos=0;
+      }
+    }
+
+    in_write.store(w+len,std::memory_order_release);
+    in_pos+=len;
+    cv.notify_one();
+  }
+
+  // audio thread: mix tail output into the last len samples of each output queue
+  void Mix(WDL_PtrList<WDL_Queue> &sout, int len, int *misses)
+  {
+    const WDL_INT64 start = out_pos;
+    out_pos+=len;
+
+    if (resyncing)
+    {
+      *misses += len;
+      return;
+    }
+
+    // the first lead samples after a (re)start are always silent, since no tail partition reaches them
+    int skip = 0;
+    if (start < base_pos+lead) skip = (int) wdl_min(base_pos+lead-start,(WDL_INT64)len);
+    if (skip>=len) return;
+
+    const unsigned int t0 = (unsigned int) (start+skip-base_pos);
+    const unsigned int w = out_write.load(std::memory_order_acquire);
+    int ready = (int)(w-t0);
+    if (ready<0) ready=0;
+    if (ready>len-skip) ready=len-skip;
+    if (ready < len-skip) *misses += len-skip-ready;
+
+    const int add_sz = len*sizeof(WDL_FFT_REAL);
+    const int use_nch = wdl_min(sout.GetSize(),nch);
+    for (int ch = 0; ch < use_nch && ready>0; ch ++)
+    {
+      WDL_Queue *q = sout.Get(ch);
+      const int qsz = q->Available();
+      if (WDL_NOT_NORMALLY(qsz < add_sz)) continue;
+
+      WDL_FFT_REAL *o = (WDL_FFT_REAL *)((char *)q->Get() + qsz - add_sz) + skip;
+      const WDL_FFT_REAL *ring = outbuf.Get() + ch*size;
+      for (int i = 0; i < ready; i ++) o[i] += ring[(t0+i)&mask];
+    }
+
+    out_read.store(t0+(len-skip),std::memory_order_release);
+  }
+
+  // worker thread
+  bool Process()
+  {
+    const int req = reset_req.load(std::memory_order_acquire);
+    if (req != reset_done.load(std::memory_order_relaxed))
+    {
+      div.Reset();
+      fed=false;
+      in_read.store(in_write.load(std::memory_order_acquire),std::memory_order_relaxed);
+      out_write.store(0,std::memory_order_relaxed);
+      reset_done.store(req,std::memory_order_release);
+      return true;
+    }
+
+    bool did=false;
+    const int use_nch = cur_nch.load(std::memory_order_relaxed);
+
+    unsigned int r = in_read.load(std::memory_order_relaxed);
+    int n = (int)(in_write.load(std::memory_order_acquire)-r);
+    if (n>0)
+    {
+      while (n>0)
+      {
+        const int pos = r&mask;
+        const int seg = wdl_min(n,size-pos);
+        for (int ch = 0; ch < use_nch; ch ++) ptrs.Get()[ch] = inbuf.Get() + ch*size + pos;
+        div.Add(ptrs.Get(),seg,use_nch);
+        r+=seg;
+        n-=seg;
+      }
+      in_read.store(r,std::memory_order_release);
+      fed=true;
+      did=true;
+    }
+
+    // engines that haven't been given any input report everything as available, so wait for the first Add()
+    if (!fed) return did;
+
+    const unsigned int ow = out_write.load(std::memory_order_relaxed);
+    int space = size - (int)(ow - out_read.load(std::memory_order_acquire));
+    if (space>size) space=size; // the reader skipped ahead after a miss
+    if (space>0)
+    {
+      const int a = div.Avail(space);
+      if (a>0)
+      {
+        WDL_FFT_REAL **p = div.Get();
+        const int onch = wdl_min(div.m_sout.GetSize(),nch);
+        for (int ch = 0; p && ch < onch; ch ++)
+        {
+          WDL_FFT_REAL *ring = outbuf.Get() + ch*size;
+          const WDL_FFT_REAL *src = p[ch];
+          for (int i = 0; i < a; i ++) ring[(ow+i)&mask] = src[i];
+        }
+        div.Advance(a);
+        out_write.store(ow+a,std::memory_order_release);
+        did=true;
+      }
+    }
+    return did;
+  }
+
+  void Run()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!quit)
+    {
+      // the audio thread notifies without taking the mutex, so a wakeup can be missed: poll as a fallback
+      if (!Process()) cv.wait_for(lock,std::chrono::milliseconds(2));
+    }
+  }
+
+  WDL_ConvolutionEngine_Div div; // tail engines only
+
+  const int nch, size, mask;
+  WDL_TypedBuf<WDL_FFT_REAL> inbuf, outbuf; // nch rings of size samples
+  WDL_TypedBuf<WDL_FFT_REAL *> ptrs;
+
+  std::atomic<unsigned int> in_write, in_read, out_write, out_read;
+  std::atomic<int> cur_nch, reset_req, reset_done;
+  bool quit, fed;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::thread thread;
+
+  int lead; // offset of the first tail partition
+
+  // audio thread only
+  WDL_INT64 in_pos, out_pos, base_pos;
+  bool resyncing;
+};
+
+#else
+
+struct WDL_ConvolutionEngine_Div::TailWorker
+{
+  WDL_ConvolutionEngine_Div div;
+  int lead;
+  void Start() { }
+  void RequestReset(bool) { }
+  void Feed(WDL_FFT_REAL **, int, int, int *) { }
+  void Mix(WDL_PtrList<WDL_Queue> &, int, int *) { }
+};
+
+#endif
+
 WDL_ConvolutionEngine_Div::WDL_ConvolutionEngine_Div()
 {
   timingInit();
   for (int x = 0; x < 2; x ++) m_sout.Add(new WDL_Queue);
   m_need_feedsilence=true;
+  m_tail=NULL;
+  m_tail_offset=0;
+  m_tail_maxnch=2;
+  m_tail_maxblock=0;
+  m_tail_misses=0;
+}
+
+void WDL_ConvolutionEngine_Div::SetThreadedTail(int tail_offset, int max_nch, int max_blocksize)
+{
+#ifndef WDL_CONVO_NO_THREADED_TAIL
+  m_tail_offset = tail_offset>0 ? tail_offset : 0;
+  m_tail_maxnch = max_nch>0 ? max_nch : 1;
+  m_tail_maxblock = max_blocksize>0 ? max_blocksize : 0;
+#else
+  (void)tail_offset; (void)max_nch; (void)max_blocksize;
+#endif
 }
 
 int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
 {
   m_need_feedsilence=true;
 
+  delete m_tail;
+  m_tail=NULL;
+  m_tail_misses=0;
+  WDL_PtrList<WDL_ConvolutionEngine> tail_engines;
+  int tail_maxfft=0;
+
   m_engines.Empty(true);
   if (maxfft_size<0)maxfft_size=-maxfft_size;
   maxfft_size*=2;
@@ -754,10 +1023,14 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
     if (impulsechunksize*(wantBrute ? 2 : 3) >= samplesleft) impulsechunksize=samplesleft; // early-out, no point going to a larger FFT (since if we did this, we wouldnt have enough samples for a complete next pass)
     if (fftsize>=maxfft_size) { impulsechunksize=samplesleft; fftsize=maxfft_size; } // if FFTs are as large as possible, finish up
 
-    eng->SetImpulse(impulse,fftsize,offs+impulse_offset,impulsechunksize, wantBrute);
+    // tail partitions use half the FFT size, so their output is ready a whole partition before it is needed
+    const bool isTail = m_tail_offset>0 && offs>0 && offs>=m_tail_offset;
+
+    eng->SetImpulse(impulse,isTail ? fftsize/2 : fftsize,offs+impulse_offset,impulsechunksize, wantBrute);
     eng->m_zl_delaypos = offs;
     eng->m_zl_dumpage=0;
-    m_engines.Add(eng);
+    if (isTail) { tail_engines.Add(eng); tail_maxfft=wdl_max(tail_maxfft,fftsize/2); }
+    else m_engines.Add(eng);
 
 #ifdef WDLCONVO_ZL_ACCOUNTING
     wdl_log("ce%d: offs=%d, len=%d, fftsize=%d\n",m_engines.GetSize(),offs,impulsechunksize,fftsize);
@@ -776,7 +1049,24 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
 #endif
   }
   while (samplesleft > 0);
-  
+
+  if (tail_engines.GetSize())
+  {
+#ifndef WDL_CONVO_NO_THREADED_TAIL
+    // the input ring holds the blocks that the worker hasn't taken yet. the output ring holds what it has computed ahead of
+    // the mix, which is at most one output chunk of its largest partition plus a block, as the tail's output is needed no earlier
+    const int maxblock = m_tail_maxblock>0 ? m_tail_maxblock : known_blocksize>0 ? known_blocksize : 4096;
+    int ringsize = 256;
+    while (ringsize < maxblock*4 || ringsize < (maxblock+tail_maxfft)*2) ringsize*=2;
+    m_tail = new TailWorker(m_tail_maxnch,ringsize);
+#else
+    m_tail = new TailWorker;
+#endif
+    m_tail->lead = tail_engines.Get(0)->m_zl_delaypos;
+    for (int x = 0; x < tail_engines.GetSize(); x ++) m_tail->div.m_engines.Add(tail_engines.Get(x));
+    m_tail->Start();
+  }
+
   return GetLatency();
 }
 
@@ -799,12 +1089,15 @@ void WDL_ConvolutionEngine_Div::Reset()
     m_sout.Get(x)->Clear();
   }
 
+  if (m_tail) m_tail->RequestReset(true);
+
   m_need_feedsilence=true;
 }
 
 WDL_ConvolutionEngine_Div::~WDL_ConvolutionEngine_Div()
 {
   timingPrint();
+  delete m_tail;
   m_engines.Empty(true);
   m_sout.Empty(true);
 }
@@ -836,6 +1129,8 @@ void WDL_ConvolutionEngine_Div::Add(WDL_FFT_REAL **bufs, int len, int nch)
     if (ns) eng->AddSilenceToOutput(eng->m_zl_delaypos); // add silence to output (to delay output to its correct time)
 
   }
+
+  if (m_tail) m_tail->Feed(bufs,len,nch,&m_tail_misses);
 }
 WDL_FFT_REAL **WDL_ConvolutionEngine_Div::Get() 
 {
@@ -932,6 +1227,8 @@ int WDL_ConvolutionEngine_Div::Avail(int wantSamples)
       }
       eng->Advance(wantSamples);
     }
+
+    if (m_tail) m_tail->Mix(m_sout,wantSamples,&m_tail_misses);
   }
   timingLeave(1);
 
@@ -165,6 +165,15 @@ public:
   WDL_FFT_REAL **Get(); // returns length valid
   void Advance(int len);
 
+  // threaded tail mode (call before SetImpulse()): partitions starting at least tail_offset samples into the impulse
+  // are processed on a worker thread rather than in Avail(). they use half-size FFTs, so each has a full partition
+  // of slack before its output is needed and the cost per block on the calling thread stays flat.
+  // max_nch is the maximum number of channels that will be passed to Add(). tail_offset=0 disables (default)
+  // max_blocksize is the largest len that will be passed to Add(), which sizes the rings to the worker. 0 uses SetImpulse()'s
+  // known_blocksize, or 4096 if that isn't given. larger blocks than this can't be passed to the worker and are counted as misses
+  void SetThreadedTail(int tail_offset, int max_nch=2, int max_blocksize=0);
+  int GetThreadedTailMisses() const { return m_tail_misses; } // samples of tail output that were not ready in time and were dropped
+
 private:
   WDL_PtrList<WDL_ConvolutionEngine> m_engines;
 
@@ -173,6 +182,10 @@ private:
 
   bool m_need_feedsilence;
 
+  struct TailWorker;
+  TailWorker *m_tail;
+  int m_tail_offset, m_tail_maxnch, m_tail_maxblock, m_tail_misses;
+
 } WDL_FIXALIGN;
 
 
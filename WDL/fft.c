@@ -41,6 +41,24 @@
 #define inline __inline
 #endif
 
+// define WDL_FFT_NO_SIMD to force the scalar code.
+// unlike the AVX2 kernels in resample.cpp there is no runtime dispatch: each path only uses what the target flags
+// already guarantee. SSE2 is part of x86-64 (32-bit x86 builds need -msse2 or /arch:SSE2), AVX is used only when the
+// compiler may emit it anywhere (-mavx, /arch:AVX), and NEON is part of AArch64 (ARMv7 builds need __ARM_NEON).
+// builds for baseline SSE2 therefore use the SSE2 passes on AVX CPUs too.
+#if !defined(WDL_FFT_NO_SIMD)
+  #if defined(__AVX__)
+    #define WDL_FFT_USE_AVX
+    #include <immintrin.h>
+  #elif defined(__SSE2__) || _M_IX86_FP >= 2 || defined(_M_X64)
+    #define WDL_FFT_USE_SSE
+    #include <emmintrin.h>
+  #elif defined(__aarch64__) || defined(_M_ARM64) || ((defined(__ARM_NEON) || defined(__ARM_NEON__)) && WDL_FFT_REALSIZE == 4)
+    #define WDL_FFT_USE_NEON
+    #include <arm_neon.h>
+  #endif
+#endif
+
 #define PI 3.1415926535897932384626433832795
 
 static WDL_FFT_COMPLEX d16[3];
@@ -267,6 +285,207 @@ static WDL_FFT_COMPLEX d32768[4095];
   a1.im = t4; \
   }
 
+#if defined(WDL_FFT_USE_AVX) || defined(WDL_FFT_USE_SSE) || defined(WDL_FFT_USE_NEON)
+
+/*
+  SIMD versions of the radix-4 passes and complex multiplies. A vector holds WDL_FFT_VW
+  consecutive WDL_FFT_COMPLEX in memory order (interleaved re/im), and the butterflies
+  perform the same products and sums as TRANSFORM/UNTRANSFORM, so results match the scalar
+  code (barring FMA contraction) and the output order given by WDL_fft_permute() is unchanged.
+*/
+
+#if defined(WDL_FFT_USE_AVX) && WDL_FFT_REALSIZE == 4
+
+  #define WDL_FFT_VW 4
+  typedef __m256 fftv_t;
+  #define fftv_load(p) _mm256_loadu_ps((const float *)(p))
+  #define fftv_store(p,x) _mm256_storeu_ps((float *)(p),(x))
+  #define fftv_add(x,y) _mm256_add_ps(x,y)
+  #define fftv_sub(x,y) _mm256_sub_ps(x,y)
+  #define fftv_mul(x,y) _mm256_mul_ps(x,y)
+  #define fftv_dupre(x) _mm256_moveldup_ps(x)
+  #define fftv_dupim(x) _mm256_movehdup_ps(x)
+  #define fftv_swap(x) _mm256_permute_ps(x,0xb1)
+  #define fftv_negre(x) _mm256_xor_ps(x,_mm256_setr_ps(-0.0f,0.0f,-0.0f,0.0f,-0.0f,0.0f,-0.0f,0.0f))
+  #define fftv_negim(x) _mm256_xor_ps(x,_mm256_setr_ps(0.0f,-0.0f,0.0f,-0.0f,0.0f,-0.0f,0.0f,-0.0f))
+  static inline fftv_t fftv_rev(fftv_t x) { x = _mm256_permute_ps(x,0x1b); return _mm256_permute2f128_ps(x,x,1); }
+
+#elif defined(WDL_FFT_USE_AVX)
+
+  #define WDL_FFT_VW 2
+  typedef __m256d fftv_t;
+  #define fftv_load(p) _mm256_loadu_pd((const double *)(p))
+  #define fftv_store(p,x) _mm256_storeu_pd((double *)(p),(x))
+  #define fftv_add(x,y) _mm256_add_pd(x,y)
+  #define fftv_sub(x,y) _mm256_sub_pd(x,y)
+  #define fftv_mul(x,y) _mm256_mul_pd(x,y)
+  #define fftv_dupre(x) _mm256_movedup_pd(x)
+  #define fftv_dupim(x) _mm256_permute_pd(x,0xf)
+  #define fftv_swap(x) _mm256_permute_pd(x,0x5)
+  #define fftv_negre(x) _mm256_xor_pd(x,_mm256_setr_pd(-0.0,0.0,-0.0,0.0))
+  #define fftv_negim(x) _mm256_xor_pd(x,_mm256_setr_pd(0.0,-0.0,0.0,-0.0))
+  static inline fftv_t fftv_rev(fftv_t x) { x = _mm256_permute_pd(x,0x5); return _mm256_permute2f128_pd(x,x,1); }
+
+#elif defined(WDL_FFT_USE_SSE) && WDL_FFT_REALSIZE == 4
+
+  #define WDL_FFT_VW 2
+  typedef __m128 fftv_t;
+  #define fftv_load(p) _mm_loadu_ps((const float *)(p))
+  #define fftv_store(p,x) _mm_storeu_ps((float *)(p),(x))
+  #define fftv_add(x,y) _mm_add_ps(x,y)
+  #define fftv_sub(x,y) _mm_sub_ps(x,y)
+  #define fftv_mul(x,y) _mm_mul_ps(x,y)
+  #define fftv_dupre(x) _mm_shuffle_ps(x,x,0xa0)
+  #define fftv_dupim(x) _mm_shuffle_ps(x,x,0xf5)
+  #define fftv_swap(x) _mm_shuffle_ps(x,x,0xb1)
+  #define fftv_negre(x) _mm_xor_ps(x,_mm_setr_ps(-0.0f,0.0f,-0.0f,0.0f))
+  #define fftv_negim(x) _mm_xor_ps(x,_mm_setr_ps(0.0f,-0.0f,0.0f,-0.0f))
+  #define fftv_rev(x) _mm_shuffle_ps(x,x,0x1b)
+
+#elif defined(WDL_FFT_USE_SSE)
+
+  #define WDL_FFT_VW 1
+  typedef __m128d fftv_t;
+  #define fftv_load(p) _mm_loadu_pd((const double *)(p))
+  #define fftv_store(p,x) _mm_storeu_pd((double *)(p),(x))
+  #define fftv_add(x,y) _mm_add_pd(x,y)
+  #define fftv_sub(x,y) _mm_sub_pd(x,y)
+  #define fftv_mul(x,y) _mm_mul_pd(x,y)
+  #define fftv_dupre(x) _mm_unpacklo_pd(x,x)
+  #define fftv_dupim(x) _mm_unpackhi_pd(x,x)
+  #define fftv_swap(x) _mm_shuffle_pd(x,x,1)
+  #define fftv_negre(x) _mm_xor_pd(x,_mm_setr_pd(-0.0,0.0))
+  #define fftv_negim(x) _mm_xor_pd(x,_mm_setr_pd(0.0,-0.0))
+  #define fftv_rev(x) fftv_swap(x)
+
+#elif WDL_FFT_REALSIZE == 4
+
+  #define WDL_FFT_VW 2
+  typedef float32x4_t fftv_t;
+  #define fftv_load(p) vld1q_f32((const float *)(p))
+  #define fftv_store(p,x) vst1q_f32((float *)(p),(x))
+  #define fftv_add(x,y) vaddq_f32(x,y)
+  #define fftv_sub(x,y) vsubq_f32(x,y)
+  #define fftv_mul(x,y) vmulq_f32(x,y)
+  #define fftv_dupre(x) (vtrnq_f32(x,x).val[0])
+  #define fftv_dupim(x) (vtrnq_f32(x,x).val[1])
+  #define fftv_swap(x) vrev64q_f32(x)
+  static inline fftv_t fftv_xor(fftv_t x, unsigned int m0, unsigned int m1)
+  {
+    const uint32x4_t m = vcombine_u32(vcreate_u32(m0 | ((uint64_t)m1 << 32)), vcreate_u32(m0 | ((uint64_t)m1 << 32)));
+    return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(x),m));
+  }
+  #define fftv_negre(x) fftv_xor(x,0x80000000,0)
+  #define fftv_negim(x) fftv_xor(x,0,0x80000000)
+  static inline fftv_t fftv_rev(fftv_t x) { x = vrev64q_f32(x); return vcombine_f32(vget_high_f32(x),vget_low_f32(x)); }
+
+#else
+
+  #define WDL_FFT_VW 1
+  typedef float64x2_t fftv_t;
+  #define fftv_load(p) vld1q_f64((const double *)(p))
+  #define fftv_store(p,x) vst1q_f64((double *)(p),(x))
+  #define fftv_add(x,y) vaddq_f64(x,y)
+  #define fftv_sub(x,y) vsubq_f64(x,y)
+  #define fftv_mul(x,y) vmulq_f64(x,y)
+  #define fftv_dupre(x) vdupq_laneq_f64(x,0)
+  #define fftv_dupim(x) vdupq_laneq_f64(x,1)
+  #define fftv_swap(x) vextq_f64(x,x,1)
+  #define fftv_negre(x) vsetq_lane_f64(-vgetq_lane_f64(x,0),x,0)
+  #define fftv_negim(x) vsetq_lane_f64(-vgetq_lane_f64(x,1),x,1)
+  #define fftv_rev(x) fftv_swap(x)
+
+#endif
+
+// x*w
+static inline fftv_t fftv_cmul(fftv_t x, fftv_t w)
+{
+  return fftv_add(fftv_mul(x,fftv_dupre(w)),fftv_negre(fftv_mul(fftv_swap(x),fftv_dupim(w))));
+}
+
+// x*conj(w)
+static inline fftv_t fftv_cmulconj(fftv_t x, fftv_t w)
+{
+  return fftv_add(fftv_mul(x,fftv_dupre(w)),fftv_negim(fftv_mul(fftv_swap(x),fftv_dupim(w))));
+}
+
+// x*i
+#define fftv_muli(x) fftv_negre(fftv_swap(x))
+
+/* TRANSFORM()s cnt items. If !rev, item k uses w[k], otherwise it uses w[-1-k] with re/im swapped */
+static void vtransform(WDL_FFT_COMPLEX *a0, WDL_FFT_COMPLEX *a1, WDL_FFT_COMPLEX *a2, WDL_FFT_COMPLEX *a3,
+                       const WDL_FFT_COMPLEX *w, unsigned int cnt, int rev)
+{
+  register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
+
+  while (cnt & (WDL_FFT_VW-1))
+  {
+    if (rev) { --w; TRANSFORM(a0[0],a1[0],a2[0],a3[0],w[0].im,w[0].re); }
+    else { TRANSFORM(a0[0],a1[0],a2[0],a3[0],w[0].re,w[0].im); ++w; }
+    ++a0; ++a1; ++a2; ++a3;
+    --cnt;
+  }
+
+  while (cnt)
+  {
+    fftv_t tw, x0, x1, x2, x3, d02, d13;
+    if (rev) { w -= WDL_FFT_VW; tw = fftv_rev(fftv_load(w)); }
+    else { tw = fftv_load(w); w += WDL_FFT_VW; }
+
+    x0 = fftv_load(a0);
+    x1 = fftv_load(a1);
+    x2 = fftv_load(a2);
+    x3 = fftv_load(a3);
+    d02 = fftv_sub(x0,x2);
+    d13 = fftv_muli(fftv_sub(x1,x3));
+    fftv_store(a0,fftv_add(x0,x2));
+    fftv_store(a1,fftv_add(x1,x3));
+    fftv_store(a2,fftv_cmul(fftv_add(d02,d13),tw));
+    fftv_store(a3,fftv_cmulconj(fftv_sub(d02,d13),tw));
+
+    a0 += WDL_FFT_VW; a1 += WDL_FFT_VW; a2 += WDL_FFT_VW; a3 += WDL_FFT_VW;
+    cnt -= WDL_FFT_VW;
+  }
+}
+
+/* UNTRANSFORM()s cnt items, twiddles as in vtransform() */
+static void vuntransform(WDL_FFT_COMPLEX *a0, WDL_FFT_COMPLEX *a1, WDL_FFT_COMPLEX *a2, WDL_FFT_COMPLEX *a3,
+                         const WDL_FFT_COMPLEX *w, unsigned int cnt, int rev)
+{
+  register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
+
+  while (cnt & (WDL_FFT_VW-1))
+  {
+    if (rev) { --w; UNTRANSFORM(a0[0],a1[0],a2[0],a3[0],w[0].im,w[0].re); }
+    else { UNTRANSFORM(a0[0],a1[0],a2[0],a3[0],w[0].re,w[0].im); ++w; }
+    ++a0; ++a1; ++a2; ++a3;
+    --cnt;
+  }
+
+  while (cnt)
+  {
+    fftv_t tw, x0, x1, p, q, s;
+    if (rev) { w -= WDL_FFT_VW; tw = fftv_rev(fftv_load(w)); }
+    else { tw = fftv_load(w); w += WDL_FFT_VW; }
+
+    x0 = fftv_load(a0);
+    x1 = fftv_load(a1);
+    p = fftv_cmulconj(fftv_load(a2),tw);
+    q = fftv_cmul(fftv_load(a3),tw);
+    s = fftv_add(p,q);
+    q = fftv_muli(fftv_sub(q,p));
+    fftv_store(a0,fftv_add(x0,s));
+    fftv_store(a2,fftv_sub(x0,s));
+    fftv_store(a1,fftv_add(x1,q));
+    fftv_store(a3,fftv_sub(x1,q));
+
+    a0 += WDL_FFT_VW; a1 += WDL_FFT_VW; a2 += WDL_FFT_VW; a3 += WDL_FFT_VW;
+    cnt -= WDL_FFT_VW;
+  }
+}
+
+#endif
+
 static void c2(register WDL_FFT_COMPLEX *a)
 {
   register WDL_FFT_REAL t1;
@@ -424,6 +643,9 @@ static void cpass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   TRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
   TRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
 
+#ifdef WDL_FFT_VW
+  vtransform(a + 2,a1 + 2,a2 + 2,a3 + 2,w + 1,2 * n,0);
+#else
   for (;;) {
     TRANSFORM(a[2],a1[2],a2[2],a3[2],w[1].re,w[1].im);
     TRANSFORM(a[3],a1[3],a2[3],a3[3],w[2].re,w[2].im);
@@ -434,6 +656,7 @@ static void cpass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
     a3 += 2;
     w += 2;
   }
+#endif
 }
 
 static void c32(register WDL_FFT_COMPLEX *a)
@@ -497,6 +720,14 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a2 += 2;
   a3 += 2;
 
+#ifdef WDL_FFT_VW
+  vtransform(a,a1,a2,a3,w + 1,k,0);
+  a += k;
+  a1 += k;
+  a2 += k;
+  a3 += k;
+  w += k;
+#else
   do {
     TRANSFORM(a[0],a1[0],a2[0],a3[0],w[1].re,w[1].im);
     TRANSFORM(a[1],a1[1],a2[1],a3[1],w[2].re,w[2].im);
@@ -506,6 +737,7 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
     a3 += 2;
     w += 2;
   } while (k -= 2);
+#endif
 
   TRANSFORMHALF(a[0],a1[0],a2[0],a3[0]);
   TRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].im,w[0].re);
@@ -515,6 +747,9 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 += 2;
 
   k = n - 2;
+#ifdef WDL_FFT_VW
+  vtransform(a,a1,a2,a3,w,k,1);
+#else
   do {
     TRANSFORM(a[0],a1[0],a2[0],a3[0],w[-1].im,w[-1].re);
     TRANSFORM(a[1],a1[1],a2[1],a3[1],w[-2].im,w[-2].re);
@@ -524,6 +759,7 @@ static void cpassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
     a3 += 2;
     w -= 2;
   } while (k -= 2);
+#endif
 }
 
 
@@ -582,6 +818,17 @@ void WDL_fft_complexmul(WDL_FFT_COMPLEX *a,WDL_FFT_COMPLEX *b,int n)
   register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
 
+#ifdef WDL_FFT_VW
+  while (n >= WDL_FFT_VW)
+  {
+    fftv_store(a,fftv_cmul(fftv_load(a),fftv_load(b)));
+    a += WDL_FFT_VW;
+    b += WDL_FFT_VW;
+    n -= WDL_FFT_VW;
+  }
+  if (!n) return;
+#endif
+
   do {
     t1 = a[0].re * b[0].re;
     t2 = a[0].im * b[0].im;
@@ -601,7 +848,7 @@ void WDL_fft_complexmul(WDL_FFT_COMPLEX *a,WDL_FFT_COMPLEX *b,int n)
     a[1].im = t7;
     a += 2;
     b += 2;
-  } while (n -= 2);
+  } while ((n -= 2) > 0);
 }
 
 void WDL_fft_complexmul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX *b, int n)
@@ -609,6 +856,18 @@ void WDL_fft_complexmul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX
   register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
 
+#ifdef WDL_FFT_VW
+  while (n >= WDL_FFT_VW)
+  {
+    fftv_store(c,fftv_cmul(fftv_load(a),fftv_load(b)));
+    a += WDL_FFT_VW;
+    b += WDL_FFT_VW;
+    c += WDL_FFT_VW;
+    n -= WDL_FFT_VW;
+  }
+  if (!n) return;
+#endif
+
   do {
     t1 = a[0].re * b[0].re;
     t2 = a[0].im * b[0].im;
@@ -629,13 +888,25 @@ void WDL_fft_complexmul2(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX
     a += 2;
     b += 2;
     c += 2;
-  } while (n -= 2);
+  } while ((n -= 2) > 0);
 }
 void WDL_fft_complexmul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX *b, int n)
 {
   register WDL_FFT_REAL t1, t2, t3, t4, t5, t6, t7, t8;
   if (n<2 || (n&1)) return;
 
+#ifdef WDL_FFT_VW
+  while (n >= WDL_FFT_VW)
+  {
+    fftv_store(c,fftv_add(fftv_load(c),fftv_cmul(fftv_load(a),fftv_load(b))));
+    a += WDL_FFT_VW;
+    b += WDL_FFT_VW;
+    c += WDL_FFT_VW;
+    n -= WDL_FFT_VW;
+  }
+  if (!n) return;
+#endif
+
   do {
     t1 = a[0].re * b[0].re;
     t2 = a[0].im * b[0].im;
@@ -656,7 +927,7 @@ void WDL_fft_complexmul3(WDL_FFT_COMPLEX *c, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX
     a += 2;
     b += 2;
     c += 2;
-  } while (n -= 2);
+  } while ((n -= 2) > 0);
 }
 
 
@@ -808,6 +1079,9 @@ static void upass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
   UNTRANSFORMZERO(a[0],a1[0],a2[0],a3[0]);
   UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].re,w[0].im);
 
+#ifdef WDL_FFT_VW
+  vuntransform(a + 2,a1 + 2,a2 + 2,a3 + 2,w + 1,2 * n,0);
+#else
   for (;;) {
     UNTRANSFORM(a[2],a1[2],a2[2],a3[2],w[1].re,w[1].im);
     UNTRANSFORM(a[3],a1[3],a2[3],a3[3],w[2].re,w[2].im);
@@ -818,6 +1092,7 @@ static void upass(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX *w,
     a3 += 2;
     w += 2;
   }
+#endif
 }
 
 static void u32(register WDL_FFT_COMPLEX *a)
@@ -882,6 +1157,14 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a2 += 2;
   a3 += 2;
 
+#ifdef WDL_FFT_VW
+  vuntransform(a,a1,a2,a3,w + 1,k,0);
+  a += k;
+  a1 += k;
+  a2 += k;
+  a3 += k;
+  w += k;
+#else
   do {
     UNTRANSFORM(a[0],a1[0],a2[0],a3[0],w[1].re,w[1].im);
     UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[2].re,w[2].im);
@@ -891,6 +1174,7 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
     a3 += 2;
     w += 2;
   } while (k -= 2);
+#endif
 
   UNTRANSFORMHALF(a[0],a1[0],a2[0],a3[0]);
   UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[0].im,w[0].re);
@@ -900,6 +1184,9 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
   a3 += 2;
 
   k = n - 2;
+#ifdef WDL_FFT_VW
+  vuntransform(a,a1,a2,a3,w,k,1);
+#else
   do {
     UNTRANSFORM(a[0],a1[0],a2[0],a3[0],w[-1].im,w[-1].re);
     UNTRANSFORM(a[1],a1[1],a2[1],a3[1],w[-2].im,w[-2].re);
@@ -909,6 +1196,7 @@ static void upassbig(register WDL_FFT_COMPLEX *a,register const WDL_FFT_COMPLEX
     a3 += 2;
     w -= 2;
   } while (k -= 2);
+#endif
 }
 
 
@@ -51,6 +51,9 @@ typedef struct {
   WDL_FFT_REAL im;
 } WDL_FFT_COMPLEX;
 
+/* fft.c uses SSE/AVX/NEON when the target supports them (with identical results and
+output ordering), define WDL_FFT_NO_SIMD when compiling fft.c to use the scalar code. */
+
 extern void WDL_fft_init();
 
 extern void WDL_fft_complexmul(WDL_FFT_COMPLEX *dest, WDL_FFT_COMPLEX *src, int len);
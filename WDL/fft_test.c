@@ -0,0 +1,236 @@
+/*
+  fft_test.c -- checks WDL_fft()/WDL_real_fft()/WDL_fft_complexmul*() against a plain
+  double precision reference and benchmarks them.
+
+  build, for example:
+    cc -O2 -mavx fft_test.c fft.c -lm
+    cc -O2 -DWDL_FFT_REALSIZE=8 fft_test.c fft.c -lm
+    cc -O2 -DWDL_FFT_NO_SIMD fft_test.c fft.c -lm  (scalar reference timings)
+
+  WDL_FFT_REALSIZE and WDL_FFT_NO_SIMD must match for both files.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fft.h"
+#include "time_precise.h"
+
+#define MAXSIZE 32768
+
+static double rand_val() { return rand() / (double) RAND_MAX * 2.0 - 1.0; }
+
+// naive radix-2 reference, natural order, e^(-i) for forward
+static void ref_fft(double *re, double *im, int n, int isInverse)
+{
+  int i, j, len;
+  for (i = 1, j = 0; i < n; i ++)
+  {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j)
+    {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (len = 2; len <= n; len <<= 1)
+  {
+    const double a = (isInverse ? 2.0 : -2.0) * 3.1415926535897932384626433832795 / len;
+    for (i = 0; i < n; i += len)
+    {
+      for (j = 0; j < len / 2; j ++)
+      {
+        const double wr = cos(a * j), wi = sin(a * j);
+        double *ur = re + i + j, *ui = im + i + j;
+        double *vr = ur + len / 2, *vi = ui + len / 2;
+        const double xr = *vr * wr - *vi * wi, xi = *vr * wi + *vi * wr;
+        *vr = *ur - xr; *vi = *ui - xi;
+        *ur += xr; *ui += xi;
+      }
+    }
+  }
+}
+
+static int test_complex(int n, WDL_FFT_COMPLEX *buf, double *re, double *im)
+{
+  const double tol = sizeof(WDL_FFT_REAL) == 4 ? 1e-5 : 1e-12;
+  double err = 0.0, rterr = 0.0;
+  int x;
+
+  for (x = 0; x < n; x ++)
+  {
+    re[x] = rand_val();
+    im[x] = rand_val();
+    buf[x].re = (WDL_FFT_REAL) re[x];
+    buf[x].im = (WDL_FFT_REAL) im[x];
+  }
+
+  WDL_fft(buf, n, 0);
+  ref_fft(re, im, n, 0);
+
+  for (x = 0; x < n; x ++)
+  {
+    const WDL_FFT_COMPLEX *c = buf + WDL_fft_permute(n, x);
+    const double e = fabs(c->re - re[x]) + fabs(c->im - im[x]);
+    if (e > err) err = e;
+  }
+
+  // inverse of the reference spectrum in permuted order should get back n * input
+  ref_fft(re, im, n, 1);
+  WDL_fft(buf, n, 1);
+  for (x = 0; x < n; x ++)
+  {
+    const double e = fabs(buf[x].re - re[x]) + fabs(buf[x].im - im[x]);
+    if (e > rterr) rterr = e;
+  }
+
+  err /= sqrt((double) n);
+  rterr /= n;
+  if (err > tol || rterr > tol)
+  {
+    printf("WDL_fft(%d): FAILED, error %g (inverse %g)\n", n, err, rterr);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_real(int n, WDL_FFT_REAL *buf, double *re, double *im)
+{
+  const double tol = sizeof(WDL_FFT_REAL) == 4 ? 1e-5 : 1e-12;
+  const WDL_FFT_COMPLEX *c = (const WDL_FFT_COMPLEX *) buf;
+  double err;
+  int x;
+
+  for (x = 0; x < n; x ++)
+  {
+    re[x] = rand_val();
+    im[x] = 0.0;
+    buf[x] = (WDL_FFT_REAL) re[x];
+  }
+
+  WDL_real_fft(buf, n, 0);
+  ref_fft(re, im, n, 0);
+
+  // the real transform is scaled by 2
+  err = fabs(c[0].re - 2.0 * re[0]) + fabs(c[0].im - 2.0 * re[n / 2]);
+  for (x = 1; x < n / 2; x ++)
+  {
+    const WDL_FFT_COMPLEX *v = c + WDL_fft_permute(n / 2, x);
+    const double e = fabs(v->re - 2.0 * re[x]) + fabs(v->im - 2.0 * im[x]);
+    if (e > err) err = e;
+  }
+
+  err /= sqrt((double) n);
+  if (err > tol)
+  {
+    printf("WDL_real_fft(%d): FAILED, error %g\n", n, err);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_complexmul(int n, WDL_FFT_COMPLEX *a, WDL_FFT_COMPLEX *b, WDL_FFT_COMPLEX *c)
+{
+  WDL_FFT_COMPLEX *ref = (WDL_FFT_COMPLEX *) malloc(n * sizeof(WDL_FFT_COMPLEX));
+  int x, fails = 0;
+
+  for (x = 0; x < n; x ++)
+  {
+    a[x].re = (WDL_FFT_REAL) rand_val();
+    a[x].im = (WDL_FFT_REAL) rand_val();
+    b[x].re = (WDL_FFT_REAL) rand_val();
+    b[x].im = (WDL_FFT_REAL) rand_val();
+    c[x].re = (WDL_FFT_REAL) rand_val();
+    c[x].im = (WDL_FFT_REAL) rand_val();
+  }
+
+  for (x = 0; x < n; x ++)
+  {
+    ref[x].re = a[x].re * b[x].re - a[x].im * b[x].im;
+    ref[x].im = a[x].im * b[x].re + a[x].re * b[x].im;
+  }
+
+  // complexmul3: c += a*b
+  memcpy(c + n, c, n * sizeof(WDL_FFT_COMPLEX));
+  WDL_fft_complexmul3(c, a, b, n);
+  for (x = 0; x < n && !fails; x ++)
+    if (fabs(c[x].re - (c[n + x].re + ref[x].re)) + fabs(c[x].im - (c[n + x].im + ref[x].im)) > 1e-6) fails ++;
+
+  // complexmul2: c = a*b, complexmul: a *= b
+  WDL_fft_complexmul2(c, a, b, n);
+  WDL_fft_complexmul(a, b, n);
+  for (x = 0; x < n && !fails; x ++)
+    if (fabs(c[x].re - ref[x].re) + fabs(c[x].im - ref[x].im) > 1e-6 || memcmp(a + x, c + x, sizeof(WDL_FFT_COMPLEX))) fails ++;
+
+  free(ref);
+  if (fails) printf("WDL_fft_complexmul(%d): FAILED\n", n);
+  return fails;
+}
+
+static void bench(int n, WDL_FFT_COMPLEX *buf, WDL_FFT_COMPLEX *b)
+{
+  const int iter = (1 << 24) / n;
+  double t, tf, tr, tm;
+  int x;
+
+  for (x = 0; x < n; x ++)
+  {
+    buf[x].re = b[x].re = (WDL_FFT_REAL) (rand_val() / n);
+    buf[x].im = b[x].im = (WDL_FFT_REAL) (rand_val() / n);
+  }
+
+  t = time_precise();
+  for (x = 0; x < iter; x ++) { WDL_fft(buf, n, 0); WDL_fft(buf, n, 1); }
+  tf = time_precise() - t;
+
+  t = time_precise();
+  for (x = 0; x < iter; x ++) { WDL_real_fft((WDL_FFT_REAL *) buf, n, 0); WDL_real_fft((WDL_FFT_REAL *) buf, n, 1); }
+  tr = time_precise() - t;
+
+  t = time_precise();
+  for (x = 0; x < iter; x ++) WDL_fft_complexmul3(buf, b, b, n);
+  tm = time_precise() - t;
+
+  printf("%6d  %10.1f  %10.1f  %14.1f\n", n,
+    tf * 1e9 / (iter * 2.0), tr * 1e9 / (iter * 2.0), tm * 1e9 / iter);
+}
+
+int main(int argc, char **argv)
+{
+  WDL_FFT_COMPLEX *a = (WDL_FFT_COMPLEX *) malloc(MAXSIZE * sizeof(WDL_FFT_COMPLEX));
+  WDL_FFT_COMPLEX *b = (WDL_FFT_COMPLEX *) malloc(MAXSIZE * sizeof(WDL_FFT_COMPLEX));
+  WDL_FFT_COMPLEX *c = (WDL_FFT_COMPLEX *) malloc(MAXSIZE * sizeof(WDL_FFT_COMPLEX));
+  double *re = (double *) malloc(MAXSIZE * sizeof(double));
+  double *im = (double *) malloc(MAXSIZE * sizeof(double));
+  int n, fails = 0;
+
+  WDL_fft_init();
+
+  for (n = 2; n <= MAXSIZE; n *= 2)
+  {
+    fails += test_complex(n, a, re, im);
+    if (n >= 4) fails += test_real(n, (WDL_FFT_REAL *) a, re, im);
+  }
+  for (n = 2; n <= 1026; n += 2)
+    fails += test_complexmul(n, a, b, c);
+
+  printf("%s, WDL_FFT_REALSIZE=%d\n\n", fails ? "FAILED" : "all tests passed", (int) sizeof(WDL_FFT_REAL));
+
+  if (!fails && (argc < 2 || strcmp(argv[1], "-nobench")))
+  {
+    printf("  size  fft ns/call  real ns/call  complexmul3 ns/call\n");
+    for (n = 64; n <= MAXSIZE; n *= 2)
+      bench(n, a, b);
+  }
+
+  free(a);
+  free(b);
+  free(c);
+  free(re);
+  free(im);
+  return fails ? 1 : 0;
+}
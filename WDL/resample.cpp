@@ -37,6 +37,28 @@
   #include <emmintrin.h>
 #endif
 
+// AVX2/FMA kernels are compiled alongside SSE and used if the CPU supports them, define WDL_RESAMPLE_NO_AVX2 to disable.
+// they are only used with the default (double) WDL_ResampleSample
+#if defined(WDL_RESAMPLE_USE_SSE) && !defined(WDL_RESAMPLE_NO_AVX2) && !defined(WDL_RESAMPLE_TYPE) && \
+    (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__) || _MSC_VER >= 1800)
+  #define WDL_RESAMPLE_USE_AVX2
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+  #if defined(__GNUC__) || defined(__clang__)
+    #define WDL_RESAMPLE_AVX2_TARGET __attribute__((target("avx2,fma")))
+  #else
+    #define WDL_RESAMPLE_AVX2_TARGET
+  #endif
+#endif
+
+// NEON is part of AArch64, define WDL_RESAMPLE_NO_NEON to use the scalar code
+#if !defined(WDL_RESAMPLE_USE_SSE) && !defined(WDL_RESAMPLE_NO_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+  #define WDL_RESAMPLE_USE_NEON
+  #include <arm_neon.h>
+#endif
+
 #ifndef PI
 #define PI 3.1415926535897932384626433832795
 #endif
@@ -315,120 +337,6 @@ template <class T1, class T2> static void inline SincSample2N(T1 *outptr, const
 
 #ifdef WDL_RESAMPLE_USE_SSE
 
-static void inline SincSample(double *outptr, const double *inptr, double fracpos, int nch, const float *filter, int filtsz, int oversize)
-{
-  fracpos *= oversize;
-  const int ifpos=(int)fracpos;
-  filter += (oversize-ifpos) * filtsz;
-  fracpos -= ifpos;
-
-  int x;
-  for (x = 0; x < nch; x ++)
-  {
-    double sum, sum2;
-    const float *fptr2=filter;
-    const float *fptr=fptr2 - filtsz;
-    const double *iptr=inptr+x;
-    int i=filtsz/2;
-
-    __m128d xmm0 = _mm_setzero_pd();
-    __m128d xmm1 = _mm_setzero_pd();
-    __m128d xmm2, xmm3;
-
-    while (i--)
-    {
-      xmm2 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm3 = _mm_load_sd((double *)fptr);
-      xmm3 = _mm_cvtps_pd(_mm_castpd_ps(xmm3));
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm0 = _mm_add_pd(xmm0, xmm3);
-
-      xmm3 = _mm_load_sd((double *)fptr2);
-      xmm3 = _mm_cvtps_pd(_mm_castpd_ps(xmm3));
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm1 = _mm_add_pd(xmm1, xmm3);
-
-      iptr+=nch*2;
-      fptr+=2;
-      fptr2+=2;
-    }
-
-    xmm2 = xmm0;
-    xmm0 = _mm_unpackhi_pd(xmm0, xmm2);
-    xmm0 = _mm_add_pd(xmm0, xmm2);
-    _mm_store_sd(&sum, xmm0);
-
-    xmm3 = xmm1;
-    xmm1 = _mm_unpackhi_pd(xmm1, xmm3);
-    xmm1 = _mm_add_pd(xmm1, xmm3);
-    _mm_store_sd(&sum2, xmm1);
-
-    outptr[x]=sum*fracpos + sum2*(1.0-fracpos);
-  }
-
-}
-
-static void inline SincSampleN(double *outptr, const double *inptr, double fracpos, int nch, const float *filter, int filtsz, int oversize)
-{
-  const int ifpos=(int)(fracpos*oversize+0.5);
-  filter += (oversize-ifpos) * filtsz;
-
-  int x;
-  for (x = 0; x < nch; x ++)
-  {
-    double sum2;
-    const float *fptr2=filter;
-    const double *iptr=inptr+x;
-    int i=filtsz/2;
-
-    __m128d xmm0 = _mm_setzero_pd();
-    __m128d xmm1 = _mm_setzero_pd();
-    __m128d xmm2, xmm3;
-
-    while (i >= 2)
-    {
-      xmm2 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm3 = _mm_load_sd((double *)fptr2);
-      xmm3 = _mm_cvtps_pd(_mm_castpd_ps(xmm3));
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm0 = _mm_add_pd(xmm0, xmm3);
-
-      xmm2 = _mm_set_pd(iptr[nch*3], iptr[nch*2]);
-
-      xmm3 = _mm_load_sd((double *)fptr2 + 1);
-      xmm3 = _mm_cvtps_pd(_mm_castpd_ps(xmm3));
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm1 = _mm_add_pd(xmm1, xmm3);
-
-      iptr+=nch*4;
-      fptr2+=4;
-      i-=2;
-    }
-
-    if (i)
-    {
-      xmm2 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm3 = _mm_load_sd((double *)fptr2);
-      xmm3 = _mm_cvtps_pd(_mm_castpd_ps(xmm3));
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm0 = _mm_add_pd(xmm0, xmm3);
-    }
-
-    xmm1 = _mm_add_pd(xmm1, xmm0);
-
-    xmm3 = xmm1;
-    xmm1 = _mm_unpackhi_pd(xmm1, xmm3);
-    xmm1 = _mm_add_pd(xmm1, xmm3);
-    _mm_store_sd(&sum2, xmm1);
-
-    outptr[x]=sum2;
-  }
-
-}
-
 static void inline SincSample1(double *outptr, const double *inptr, double fracpos, const float *filter, int filtsz, int oversize)
 {
   fracpos *= oversize;
@@ -666,144 +574,6 @@ static void inline SincSample2N(double *outptr, const double *inptr, double frac
 }
 
 
-static void inline SincSample(double *outptr, const double *inptr, double fracpos, int nch, const double *filter, int filtsz, int oversize)
-{
-  fracpos *= oversize;
-  const int ifpos=(int)fracpos;
-  filter += (oversize-ifpos) * filtsz;
-  fracpos -= ifpos;
-
-  int x;
-  for (x = 0; x < nch; x ++)
-  {
-    double sum, sum2;
-    const double *fptr2=filter;
-    const double *fptr=fptr2 - filtsz;
-    const double *iptr=inptr+x;
-    int i=filtsz/2;
-
-    __m128d xmm0 = _mm_setzero_pd();
-    __m128d xmm1 = _mm_setzero_pd();
-    __m128d xmm2 = _mm_setzero_pd();
-    __m128d xmm3 = _mm_setzero_pd();
-    __m128d xmm4, xmm5;
-
-    while (i >= 2)
-    {
-      xmm4 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm5 = _mm_load_pd(fptr);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm0 = _mm_add_pd(xmm0, xmm5);
-
-      xmm5 = _mm_load_pd(fptr2);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm1 = _mm_add_pd(xmm1, xmm5);
-
-      xmm4 = _mm_set_pd(iptr[nch*3], iptr[nch*2]);
-
-      xmm5 = _mm_load_pd(fptr+2);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm2 = _mm_add_pd(xmm2, xmm5);
-
-      xmm5 = _mm_load_pd(fptr2+2);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm3 = _mm_add_pd(xmm3, xmm5);
-
-      iptr+=nch*4;
-      fptr+=4;
-      fptr2+=4;
-      i-=2;
-    }
-
-    if (i)
-    {
-      xmm4 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm5 = _mm_load_pd(fptr);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm0 = _mm_add_pd(xmm0, xmm5);
-
-      xmm5 = _mm_load_pd(fptr2);
-      xmm5 = _mm_mul_pd(xmm5, xmm4);
-      xmm1 = _mm_add_pd(xmm1, xmm5);
-    }
-
-    xmm0 = _mm_add_pd(xmm0, xmm2);
-    xmm1 = _mm_add_pd(xmm1, xmm3);
-
-    xmm2 = xmm0;
-    xmm0 = _mm_unpackhi_pd(xmm0, xmm2);
-    xmm0 = _mm_add_pd(xmm0, xmm2);
-    _mm_store_sd(&sum, xmm0);
-
-    xmm3 = xmm1;
-    xmm1 = _mm_unpackhi_pd(xmm1, xmm3);
-    xmm1 = _mm_add_pd(xmm1, xmm3);
-    _mm_store_sd(&sum2, xmm1);
-
-    outptr[x]=sum*fracpos + sum2*(1.0-fracpos);
-  }
-
-}
-
-static void inline SincSampleN(double *outptr, const double *inptr, double fracpos, int nch, const double *filter, int filtsz, int oversize)
-{
-  const int ifpos=(int)(fracpos*oversize+0.5);
-  filter += (oversize-ifpos) * filtsz;
-
-  int x;
-  for (x = 0; x < nch; x ++)
-  {
-    double sum2;
-    const double *fptr2=filter;
-    const double *iptr=inptr+x;
-    int i=filtsz/2;
-
-    __m128d xmm0 = _mm_setzero_pd();
-    __m128d xmm1 = _mm_setzero_pd();
-    __m128d xmm2, xmm3;
-
-    while (i >= 2)
-    {
-      xmm2 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm3 = _mm_load_pd(fptr2);
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm0 = _mm_add_pd(xmm0, xmm3);
-
-      xmm2 = _mm_set_pd(iptr[nch*3], iptr[nch*2]);
-
-      xmm3 = _mm_load_pd(fptr2+2);
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm1 = _mm_add_pd(xmm1, xmm3);
-
-      iptr+=nch*4;
-      fptr2+=4;
-      i-=2;
-    }
-
-    if (i)
-    {
-      xmm2 = _mm_set_pd(iptr[nch], iptr[0]);
-
-      xmm3 = _mm_load_pd(fptr2);
-      xmm3 = _mm_mul_pd(xmm3, xmm2);
-      xmm0 = _mm_add_pd(xmm0, xmm3);
-    }
-
-    xmm1 = _mm_add_pd(xmm1, xmm0);
-
-    xmm3 = xmm1;
-    xmm1 = _mm_unpackhi_pd(xmm1, xmm3);
-    xmm1 = _mm_add_pd(xmm1, xmm3);
-    _mm_store_sd(&sum2, xmm1);
-
-    outptr[x]=sum2;
-  }
-
-}
-
 static void inline SincSample1(double *outptr, const double *inptr, double fracpos, const double *filter, int filtsz, int oversize)
 {
   fracpos *= oversize;
@@ -1071,8 +841,511 @@ static void inline SincSample2N(double *outptr, const double *inptr, double frac
   outptr[1]=sum2b;
 }
 
+
+/*
+  interleaved multichannel (nch > 2): rather than gathering one channel at a time, SincSampleBlock() accumulates
+  2*NV adjacent channels at once, so each tap is a contiguous load per channel pair times a broadcast coefficient.
+  even and odd taps go to separate accumulators to keep more additions in flight.
+*/
+template <bool interp, int NV, class T2> static void inline SincSampleBlock(double *outptr, const double *iptr, double fracpos, int nch, const T2 *fptr2, int filtsz)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  __m128d sum[NV], sumb[NV], sum2[NV], sum2b[NV];
+  int v;
+  for (v = 0; v < NV; v ++) sum[v] = sumb[v] = sum2[v] = sum2b[v] = _mm_setzero_pd();
+
+  int i=filtsz/2;
+  while (i--)
+  {
+    const __m128d f2a = _mm_set1_pd(fptr2[0]), f2b = _mm_set1_pd(fptr2[1]);
+    const __m128d fa = _mm_set1_pd(interp ? fptr[0] : 0.0), fb = _mm_set1_pd(interp ? fptr[1] : 0.0);
+    for (v = 0; v < NV; v ++)
+    {
+      const __m128d ina = _mm_loadu_pd(iptr + v*2), inb = _mm_loadu_pd(iptr + nch + v*2);
+      sum2[v] = _mm_add_pd(sum2[v], _mm_mul_pd(ina, f2a));
+      sum2b[v] = _mm_add_pd(sum2b[v], _mm_mul_pd(inb, f2b));
+      if (interp)
+      {
+        sum[v] = _mm_add_pd(sum[v], _mm_mul_pd(ina, fa));
+        sumb[v] = _mm_add_pd(sumb[v], _mm_mul_pd(inb, fb));
+      }
+    }
+    iptr+=nch*2;
+    if (interp) fptr+=2;
+    fptr2+=2;
+  }
+
+  if (interp)
+  {
+    const __m128d a = _mm_set1_pd(fracpos), b = _mm_set1_pd(1.0-fracpos);
+    for (v = 0; v < NV; v ++)
+      _mm_storeu_pd(outptr + v*2, _mm_add_pd(_mm_mul_pd(_mm_add_pd(sum[v], sumb[v]), a), _mm_mul_pd(_mm_add_pd(sum2[v], sum2b[v]), b)));
+  }
+  else
+  {
+    for (v = 0; v < NV; v ++)
+      _mm_storeu_pd(outptr + v*2, _mm_add_pd(sum2[v], sum2b[v]));
+  }
+}
+
 #endif // WDL_RESAMPLE_USE_SSE
 
+#ifdef WDL_RESAMPLE_USE_NEON
+
+static inline float64x2_t wdl_rs_neon_load2(const float *p) { return vcvt_f64_f32(vld1_f32(p)); }
+static inline float64x2_t wdl_rs_neon_load2(const double *p) { return vld1q_f64(p); }
+
+template <bool interp, class T2> static void inline SincSample1NEON(double *outptr, const double *iptr, double fracpos, const T2 *filter, int filtsz, int oversize)
+{
+  int ifpos;
+  if (interp)
+  {
+    fracpos *= oversize;
+    ifpos=(int)fracpos;
+    fracpos -= ifpos;
+  }
+  else ifpos=(int)(fracpos*oversize+0.5);
+
+  const T2 *fptr2=filter + (oversize-ifpos) * filtsz;
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+
+  float64x2_t sum = vdupq_n_f64(0.0), sumb = sum, sum2 = sum, sum2b = sum;
+  int i=filtsz;
+  while (i >= 4)
+  {
+    const float64x2_t ina = vld1q_f64(iptr), inb = vld1q_f64(iptr+2);
+    sum2 = vfmaq_f64(sum2, ina, wdl_rs_neon_load2(fptr2));
+    sum2b = vfmaq_f64(sum2b, inb, wdl_rs_neon_load2(fptr2+2));
+    if (interp)
+    {
+      sum = vfmaq_f64(sum, ina, wdl_rs_neon_load2(fptr));
+      sumb = vfmaq_f64(sumb, inb, wdl_rs_neon_load2(fptr+2));
+      fptr+=4;
+    }
+    iptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+  if (i) // filtsz is even
+  {
+    const float64x2_t ina = vld1q_f64(iptr);
+    sum2 = vfmaq_f64(sum2, ina, wdl_rs_neon_load2(fptr2));
+    if (interp) sum = vfmaq_f64(sum, ina, wdl_rs_neon_load2(fptr));
+  }
+
+  const double s2 = vaddvq_f64(vaddq_f64(sum2, sum2b));
+  outptr[0]=interp ? vaddvq_f64(vaddq_f64(sum, sumb))*fracpos + s2*(1.0-fracpos) : s2;
+}
+
+template <bool interp, class T2> static void inline SincSample2NEON(double *outptr, const double *iptr, double fracpos, const T2 *filter, int filtsz, int oversize)
+{
+  int ifpos;
+  if (interp)
+  {
+    fracpos *= oversize;
+    ifpos=(int)fracpos;
+    fracpos -= ifpos;
+  }
+  else ifpos=(int)(fracpos*oversize+0.5);
+
+  const T2 *fptr2=filter + (oversize-ifpos) * filtsz;
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+
+  float64x2_t sum = vdupq_n_f64(0.0), sumb = sum, sum2 = sum, sum2b = sum;
+  int i=filtsz/2;
+  while (i--)
+  {
+    const float64x2_t ina = vld1q_f64(iptr), inb = vld1q_f64(iptr+2);
+    sum2 = vfmaq_f64(sum2, ina, vdupq_n_f64(fptr2[0]));
+    sum2b = vfmaq_f64(sum2b, inb, vdupq_n_f64(fptr2[1]));
+    if (interp)
+    {
+      sum = vfmaq_f64(sum, ina, vdupq_n_f64(fptr[0]));
+      sumb = vfmaq_f64(sumb, inb, vdupq_n_f64(fptr[1]));
+      fptr+=2;
+    }
+    iptr+=4;
+    fptr2+=2;
+  }
+
+  sum2 = vaddq_f64(sum2, sum2b);
+  if (interp)
+    sum2 = vaddq_f64(vmulq_n_f64(vaddq_f64(sum, sumb), fracpos), vmulq_n_f64(sum2, 1.0-fracpos));
+  vst1q_f64(outptr, sum2);
+}
+
+static void inline SincSample1(double *outptr, const double *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSample1NEON<true>(outptr, inptr, fracpos, filter, filtsz, oversize);
+}
+
+static void inline SincSample1N(double *outptr, const double *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSample1NEON<false>(outptr, inptr, fracpos, filter, filtsz, oversize);
+}
+
+static void inline SincSample2(double *outptr, const double *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSample2NEON<true>(outptr, inptr, fracpos, filter, filtsz, oversize);
+}
+
+static void inline SincSample2N(double *outptr, const double *inptr, double fracpos, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSample2NEON<false>(outptr, inptr, fracpos, filter, filtsz, oversize);
+}
+
+// see the SSE version
+template <bool interp, int NV, class T2> static void inline SincSampleBlock(double *outptr, const double *iptr, double fracpos, int nch, const T2 *fptr2, int filtsz)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  float64x2_t sum[NV], sumb[NV], sum2[NV], sum2b[NV];
+  int v;
+  for (v = 0; v < NV; v ++) sum[v] = sumb[v] = sum2[v] = sum2b[v] = vdupq_n_f64(0.0);
+
+  int i=filtsz/2;
+  while (i--)
+  {
+    const float64x2_t f2a = vdupq_n_f64(fptr2[0]), f2b = vdupq_n_f64(fptr2[1]);
+    const float64x2_t fa = vdupq_n_f64(interp ? fptr[0] : 0.0), fb = vdupq_n_f64(interp ? fptr[1] : 0.0);
+    for (v = 0; v < NV; v ++)
+    {
+      const float64x2_t ina = vld1q_f64(iptr + v*2), inb = vld1q_f64(iptr + nch + v*2);
+      sum2[v] = vfmaq_f64(sum2[v], ina, f2a);
+      sum2b[v] = vfmaq_f64(sum2b[v], inb, f2b);
+      if (interp)
+      {
+        sum[v] = vfmaq_f64(sum[v], ina, fa);
+        sumb[v] = vfmaq_f64(sumb[v], inb, fb);
+      }
+    }
+    iptr+=nch*2;
+    if (interp) fptr+=2;
+    fptr2+=2;
+  }
+
+  for (v = 0; v < NV; v ++)
+  {
+    float64x2_t r = vaddq_f64(sum2[v], sum2b[v]);
+    if (interp) r = vaddq_f64(vmulq_n_f64(vaddq_f64(sum[v], sumb[v]), fracpos), vmulq_n_f64(r, 1.0-fracpos));
+    vst1q_f64(outptr + v*2, r);
+  }
+}
+
+#endif // WDL_RESAMPLE_USE_NEON
+
+#if defined(WDL_RESAMPLE_USE_SSE) || defined(WDL_RESAMPLE_USE_NEON)
+
+// interleaved multichannel, one channel at a time. used for the channel left over by the SIMD blocks
+template <bool interp, class T2> static void inline SincSampleChannel(double *outptr, const double *iptr, double fracpos, int nch, const T2 *fptr2, int filtsz)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  double sum=0.0, sumb=0.0, sum2=0.0, sum2b=0.0;
+  int i=filtsz/2;
+  while (i--)
+  {
+    if (interp)
+    {
+      sum += fptr[0] * iptr[0];
+      sumb += fptr[1] * iptr[nch];
+      fptr+=2;
+    }
+    sum2 += fptr2[0] * iptr[0];
+    sum2b += fptr2[1] * iptr[nch];
+    fptr2+=2;
+    iptr+=nch*2;
+  }
+  outptr[0]=interp ? (sum+sumb)*fracpos + (sum2+sum2b)*(1.0-fracpos) : sum2+sum2b;
+}
+
+// blocks of 4 channels, then 2, then a single channel
+template <bool interp, class T2> static void inline SincSampleBatch(double *outptr, const double *inptr, double fracpos, int nch, const T2 *filter, int filtsz, int oversize)
+{
+  int ifpos;
+  if (interp)
+  {
+    fracpos *= oversize;
+    ifpos=(int)fracpos;
+    fracpos -= ifpos;
+  }
+  else ifpos=(int)(fracpos*oversize+0.5);
+  filter += (oversize-ifpos) * filtsz;
+
+  int x=0;
+  for (; x+4 <= nch; x += 4) SincSampleBlock<interp, 2>(outptr+x, inptr+x, fracpos, nch, filter, filtsz);
+  if (x+2 <= nch) { SincSampleBlock<interp, 1>(outptr+x, inptr+x, fracpos, nch, filter, filtsz); x += 2; }
+  if (x < nch) SincSampleChannel<interp>(outptr+x, inptr+x, fracpos, nch, filter, filtsz);
+}
+
+static void inline SincSample(double *outptr, const double *inptr, double fracpos, int nch, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSampleBatch<true>(outptr, inptr, fracpos, nch, filter, filtsz, oversize);
+}
+
+static void inline SincSampleN(double *outptr, const double *inptr, double fracpos, int nch, const WDL_SincFilterSample *filter, int filtsz, int oversize)
+{
+  SincSampleBatch<false>(outptr, inptr, fracpos, nch, filter, filtsz, oversize);
+}
+
+#endif
+
+#ifdef WDL_RESAMPLE_USE_AVX2
+
+/*
+  AVX2/FMA kernels, compiled with a target attribute and selected at runtime by wdl_resample_has_avx2(), so that
+  builds for baseline SSE2 still use them where available. SincResampleAVX2() runs the whole output loop, so the
+  dispatch happens once per ResampleOut() rather than once per sample.
+*/
+
+static bool wdl_resample_has_avx2()
+{
+  static int s_has_avx2 = -1; // every thread computes the same value, so racing on the first call is harmless
+  if (s_has_avx2 < 0)
+  {
+#ifdef _MSC_VER
+    int info[4];
+    bool ok = false;
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+      __cpuid(info, 1);
+      const int fma_osxsave_avx = (1<<12) | (1<<27) | (1<<28);
+      if ((info[2] & fma_osxsave_avx) == fma_osxsave_avx && (_xgetbv(0) & 6) == 6)
+      {
+        __cpuidex(info, 7, 0);
+        ok = (info[1] & (1<<5)) != 0;
+      }
+    }
+    s_has_avx2 = ok ? 1 : 0;
+#else
+    __builtin_cpu_init();
+    s_has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 1 : 0;
+#endif
+  }
+  return s_has_avx2 > 0;
+}
+
+WDL_RESAMPLE_AVX2_TARGET static inline __m256d wdl_rs_avx_load4(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+WDL_RESAMPLE_AVX2_TARGET static inline __m256d wdl_rs_avx_load4(const double *p) { return _mm256_loadu_pd(p); }
+WDL_RESAMPLE_AVX2_TARGET static inline __m128d wdl_rs_avx_load2(const float *p) { return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double *)p))); }
+WDL_RESAMPLE_AVX2_TARGET static inline __m128d wdl_rs_avx_load2(const double *p) { return _mm_loadu_pd(p); }
+WDL_RESAMPLE_AVX2_TARGET static inline __m128d wdl_rs_avx_fold(__m256d v) { return _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)); }
+WDL_RESAMPLE_AVX2_TARGET static inline double wdl_rs_avx_hsum(__m128d v) { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+
+template <bool interp, class T2> WDL_RESAMPLE_AVX2_TARGET static inline void SincSample1AVX2(double *outptr, const double *iptr, double fracpos, const T2 *fptr2, int filtsz)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  __m256d sum = _mm256_setzero_pd(), sumb = sum, sum2 = sum, sum2b = sum;
+  int i=filtsz;
+  while (i >= 8)
+  {
+    const __m256d ina = _mm256_loadu_pd(iptr), inb = _mm256_loadu_pd(iptr+4);
+    sum2 = _mm256_fmadd_pd(ina, wdl_rs_avx_load4(fptr2), sum2);
+    sum2b = _mm256_fmadd_pd(inb, wdl_rs_avx_load4(fptr2+4), sum2b);
+    if (interp)
+    {
+      sum = _mm256_fmadd_pd(ina, wdl_rs_avx_load4(fptr), sum);
+      sumb = _mm256_fmadd_pd(inb, wdl_rs_avx_load4(fptr+4), sumb);
+      fptr+=8;
+    }
+    iptr+=8;
+    fptr2+=8;
+    i-=8;
+  }
+  if (i >= 4)
+  {
+    const __m256d ina = _mm256_loadu_pd(iptr);
+    sum2 = _mm256_fmadd_pd(ina, wdl_rs_avx_load4(fptr2), sum2);
+    if (interp) { sum = _mm256_fmadd_pd(ina, wdl_rs_avx_load4(fptr), sum); fptr+=4; }
+    iptr+=4;
+    fptr2+=4;
+    i-=4;
+  }
+
+  __m128d s = wdl_rs_avx_fold(_mm256_add_pd(sum, sumb)), s2 = wdl_rs_avx_fold(_mm256_add_pd(sum2, sum2b));
+  if (i) // filtsz is even
+  {
+    const __m128d in = _mm_loadu_pd(iptr);
+    s2 = _mm_fmadd_pd(in, wdl_rs_avx_load2(fptr2), s2);
+    if (interp) s = _mm_fmadd_pd(in, wdl_rs_avx_load2(fptr), s);
+  }
+
+  outptr[0]=interp ? wdl_rs_avx_hsum(s)*fracpos + wdl_rs_avx_hsum(s2)*(1.0-fracpos) : wdl_rs_avx_hsum(s2);
+}
+
+template <bool interp, class T2> WDL_RESAMPLE_AVX2_TARGET static inline void SincSample2AVX2(double *outptr, const double *iptr, double fracpos, const T2 *fptr2, int filtsz)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  // the input is deinterleaved to L0 L2 L1 L3 and R0 R2 R1 R3, so the coefficients are permuted to match
+  __m256d suml = _mm256_setzero_pd(), sumr = suml, sumlb = suml, sumrb = suml;
+  __m256d sum2l = suml, sum2r = suml, sum2lb = suml, sum2rb = suml;
+  int i=filtsz;
+  while (i >= 8)
+  {
+    const __m256d a = _mm256_loadu_pd(iptr), b = _mm256_loadu_pd(iptr+4), c = _mm256_loadu_pd(iptr+8), d = _mm256_loadu_pd(iptr+12);
+    const __m256d l = _mm256_unpacklo_pd(a, b), r = _mm256_unpackhi_pd(a, b), lb = _mm256_unpacklo_pd(c, d), rb = _mm256_unpackhi_pd(c, d);
+    __m256d f = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr2), 0xd8), fb = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr2+4), 0xd8);
+    sum2l = _mm256_fmadd_pd(l, f, sum2l);
+    sum2r = _mm256_fmadd_pd(r, f, sum2r);
+    sum2lb = _mm256_fmadd_pd(lb, fb, sum2lb);
+    sum2rb = _mm256_fmadd_pd(rb, fb, sum2rb);
+    if (interp)
+    {
+      f = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr), 0xd8);
+      fb = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr+4), 0xd8);
+      suml = _mm256_fmadd_pd(l, f, suml);
+      sumr = _mm256_fmadd_pd(r, f, sumr);
+      sumlb = _mm256_fmadd_pd(lb, fb, sumlb);
+      sumrb = _mm256_fmadd_pd(rb, fb, sumrb);
+      fptr+=8;
+    }
+    iptr+=16;
+    fptr2+=8;
+    i-=8;
+  }
+  if (i >= 4)
+  {
+    const __m256d a = _mm256_loadu_pd(iptr), b = _mm256_loadu_pd(iptr+4);
+    const __m256d l = _mm256_unpacklo_pd(a, b), r = _mm256_unpackhi_pd(a, b);
+    const __m256d f = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr2), 0xd8);
+    sum2l = _mm256_fmadd_pd(l, f, sum2l);
+    sum2r = _mm256_fmadd_pd(r, f, sum2r);
+    if (interp)
+    {
+      const __m256d g = _mm256_permute4x64_pd(wdl_rs_avx_load4(fptr), 0xd8);
+      suml = _mm256_fmadd_pd(l, g, suml);
+      sumr = _mm256_fmadd_pd(r, g, sumr);
+      fptr+=4;
+    }
+    iptr+=8;
+    fptr2+=4;
+    i-=4;
+  }
+
+  // L, R
+  __m128d r = _mm_hadd_pd(wdl_rs_avx_fold(_mm256_add_pd(sum2l, sum2lb)), wdl_rs_avx_fold(_mm256_add_pd(sum2r, sum2rb)));
+  __m128d rb = _mm_setzero_pd();
+  if (i) // filtsz is even
+  {
+    const __m128d a = _mm_loadu_pd(iptr), b = _mm_loadu_pd(iptr+2);
+    r = _mm_fmadd_pd(a, _mm_set1_pd(fptr2[0]), r);
+    r = _mm_fmadd_pd(b, _mm_set1_pd(fptr2[1]), r);
+    if (interp)
+    {
+      rb = _mm_fmadd_pd(a, _mm_set1_pd(fptr[0]), rb);
+      rb = _mm_fmadd_pd(b, _mm_set1_pd(fptr[1]), rb);
+    }
+  }
+  if (interp)
+  {
+    rb = _mm_add_pd(rb, _mm_hadd_pd(wdl_rs_avx_fold(_mm256_add_pd(suml, sumlb)), wdl_rs_avx_fold(_mm256_add_pd(sumr, sumrb))));
+    r = _mm_add_pd(_mm_mul_pd(rb, _mm_set1_pd(fracpos)), _mm_mul_pd(r, _mm_set1_pd(1.0-fracpos)));
+  }
+  _mm_storeu_pd(outptr, r);
+}
+
+// 4*NV interleaved channels at once, see SincSampleBlock(). if masked, only the channels enabled in mask are read and written
+template <bool interp, int NV, bool masked, class T2> WDL_RESAMPLE_AVX2_TARGET static inline void SincSampleBlockAVX2(double *outptr, const double *iptr, double fracpos, int nch, const T2 *fptr2, int filtsz, __m256i mask)
+{
+  const T2 *fptr=interp ? fptr2 - filtsz : fptr2;
+  __m256d sum[NV], sumb[NV], sum2[NV], sum2b[NV];
+  int v;
+  for (v = 0; v < NV; v ++) sum[v] = sumb[v] = sum2[v] = sum2b[v] = _mm256_setzero_pd();
+
+  int i=filtsz/2;
+  while (i--)
+  {
+    const __m256d f2a = _mm256_set1_pd(fptr2[0]), f2b = _mm256_set1_pd(fptr2[1]);
+    const __m256d fa = _mm256_set1_pd(interp ? fptr[0] : 0.0), fb = _mm256_set1_pd(interp ? fptr[1] : 0.0);
+    for (v = 0; v < NV; v ++)
+    {
+      const __m256d ina = masked ? _mm256_maskload_pd(iptr + v*4, mask) : _mm256_loadu_pd(iptr + v*4);
+      const __m256d inb = masked ? _mm256_maskload_pd(iptr + nch + v*4, mask) : _mm256_loadu_pd(iptr + nch + v*4);
+      sum2[v] = _mm256_fmadd_pd(ina, f2a, sum2[v]);
+      sum2b[v] = _mm256_fmadd_pd(inb, f2b, sum2b[v]);
+      if (interp)
+      {
+        sum[v] = _mm256_fmadd_pd(ina, fa, sum[v]);
+        sumb[v] = _mm256_fmadd_pd(inb, fb, sumb[v]);
+      }
+    }
+    iptr+=nch*2;
+    if (interp) fptr+=2;
+    fptr2+=2;
+  }
+
+  for (v = 0; v < NV; v ++)
+  {
+    __m256d r = _mm256_add_pd(sum2[v], sum2b[v]);
+    if (interp) r = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(sum[v], sumb[v]), _mm256_set1_pd(fracpos)), _mm256_mul_pd(r, _mm256_set1_pd(1.0-fracpos)));
+    if (masked) _mm256_maskstore_pd(outptr + v*4, mask, r);
+    else _mm256_storeu_pd(outptr + v*4, r);
+  }
+}
+
+// blocks of 8 channels, then 4, then the remaining 1-3 channels as a masked block
+template <bool interp, class T2> WDL_RESAMPLE_AVX2_TARGET static inline void SincSampleBatchAVX2(double *outptr, const double *inptr, double fracpos, int nch, const T2 *fptr2, int filtsz)
+{
+  const __m256i nomask = _mm256_setzero_si256();
+  int x=0;
+  for (; x+8 <= nch; x += 8) SincSampleBlockAVX2<interp, 2, false>(outptr+x, inptr+x, fracpos, nch, fptr2, filtsz, nomask);
+  if (x+4 <= nch) { SincSampleBlockAVX2<interp, 1, false>(outptr+x, inptr+x, fracpos, nch, fptr2, filtsz, nomask); x += 4; }
+  if (x < nch)
+  {
+    const __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(nch-x), _mm256_setr_epi64x(0, 1, 2, 3));
+    SincSampleBlockAVX2<interp, 1, true>(outptr+x, inptr+x, fracpos, nch, fptr2, filtsz, mask);
+  }
+}
+
+template <int nchk, bool interp, class T2> WDL_RESAMPLE_AVX2_TARGET static int SincLoopAVX2(double *outptr, const double *localin, double *srcpos, double drspos, int ns,
+                                                                                     int filtlen, int nch, const T2 *filter, int filtsz, int oversize)
+{
+  double pos = *srcpos;
+  int ret = 0;
+  while (ns--)
+  {
+    const int ipos = (int)pos;
+
+    if (ipos >= filtlen-1) break; // quit decoding, not enough input samples
+
+    double fracpos = (pos-ipos)*oversize;
+    int ifpos;
+    if (interp)
+    {
+      ifpos=(int)fracpos;
+      fracpos -= ifpos;
+    }
+    else ifpos=(int)(fracpos+0.5);
+
+    const double *iptr = localin + ipos*nch;
+    const T2 *fptr2 = filter + (oversize-ifpos) * filtsz;
+    if (nchk == 1) SincSample1AVX2<interp>(outptr, iptr, fracpos, fptr2, filtsz);
+    else if (nchk == 2) SincSample2AVX2<interp>(outptr, iptr, fracpos, fptr2, filtsz);
+    else SincSampleBatchAVX2<interp>(outptr, iptr, fracpos, nch, fptr2, filtsz);
+
+    outptr += nch;
+    pos += drspos;
+    ret++;
+  }
+  *srcpos = pos;
+  return ret;
+}
+
+// returns the number of samples output, and advances *srcpos
+template <class T2> static int SincResampleAVX2(double *outptr, const double *localin, double *srcpos, double drspos, int ns,
+                                                int filtlen, int nch, const T2 *filter, int filtsz, int oversize, bool isideal)
+{
+  if (nch == 1)
+    return isideal ? SincLoopAVX2<1, false>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize) :
+                     SincLoopAVX2<1, true>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize);
+  if (nch == 2)
+    return isideal ? SincLoopAVX2<2, false>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize) :
+                     SincLoopAVX2<2, true>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize);
+  return isideal ? SincLoopAVX2<0, false>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize) :
+                   SincLoopAVX2<0, true>(outptr, localin, srcpos, drspos, ns, filtlen, nch, filter, filtsz, oversize);
+}
+
+#endif // WDL_RESAMPLE_USE_AVX2
+
 
 WDL_Resampler::WDL_Resampler()
 {
@@ -1444,6 +1717,12 @@ int WDL_Resampler::ResampleOut(WDL_ResampleSample *out, int nsamples_in, int nsa
     outlatadj=filtsz/2-1;
 
     if (WDL_NOT_NORMALLY(!filter)) {} 
+#ifdef WDL_RESAMPLE_USE_AVX2
+    else if (wdl_resample_has_avx2())
+    {
+      ret = SincResampleAVX2(outptr,localin,&srcpos,drspos,ns,filtlen,nch,filter,filtsz,oversize,isideal);
+    }
+#endif
     else if (nch == 1)
     {
       if (isideal)
@@ -0,0 +1,137 @@
+/*
+  resample_test.cpp -- checks WDL_Resampler's sinc modes against analytic sines, one frequency per channel
+  (which catches channels being mixed up), and benchmarks them across sinc sizes and channel counts.
+
+  build, for example:
+    c++ -O2 resample_test.cpp resample.cpp
+    c++ -O2 -DWDL_RESAMPLE_NO_AVX2 resample_test.cpp resample.cpp  (SSE2 timings)
+    c++ -O2 -DWDL_RESAMPLE_NO_SSE resample_test.cpp resample.cpp   (scalar timings)
+
+  the defines must match for both files.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+#include "time_precise.h"
+
+#define MAXCH 8
+#define BLOCKSIZE 512
+#define PI 3.1415926535897932384626433832795
+
+static double tone_freq(int ch, double srate) { return srate * (0.02 + 0.011 * ch); } // well inside either passband
+
+// interleaved multichannel sines, one frequency per channel
+static WDL_ResampleSample *make_input(int nch, double srate, int nframes)
+{
+  WDL_ResampleSample *buf = (WDL_ResampleSample *) malloc(nframes * nch * sizeof(WDL_ResampleSample));
+  for (int x = 0; x < nframes; x ++)
+    for (int ch = 0; ch < nch; ch ++)
+      buf[x * nch + ch] = (WDL_ResampleSample) sin(2.0 * PI * tone_freq(ch, srate) * x / srate);
+  return buf;
+}
+
+// resamples the input in blocks, returns the number of output frames
+static int run(WDL_Resampler *rs, int nch, double rate_in, double rate_out, const WDL_ResampleSample *in, int nframes, WDL_ResampleSample *out, int outsize)
+{
+  int inpos = 0, outpos = 0;
+  rs->Reset();
+  rs->SetRates(rate_in, rate_out);
+  while (outpos < outsize)
+  {
+    WDL_ResampleSample *inbuf;
+    const int want = outsize - outpos < BLOCKSIZE ? outsize - outpos : BLOCKSIZE;
+    int n = rs->ResamplePrepare(want, nch, &inbuf);
+    if (n > nframes - inpos) n = nframes - inpos;
+    memcpy(inbuf, in + inpos * nch, n * nch * sizeof(WDL_ResampleSample));
+    inpos += n;
+    const int got = rs->ResampleOut(out + outpos * nch, n, want, nch);
+    outpos += got;
+    if (!got && inpos >= nframes) break;
+  }
+  return outpos;
+}
+
+static int test(int sincsize, int nch, double rate_in, double rate_out, WDL_ResampleSample *out)
+{
+  const int nframes = 16384, outsize = (int) (nframes * rate_out / rate_in) - sincsize * 4;
+  WDL_ResampleSample *in = make_input(nch, rate_in, nframes);
+  WDL_Resampler rs;
+  rs.SetMode(false, 0, true, sincsize, 32);
+  const int nout = run(&rs, nch, rate_in, rate_out, in, nframes, out, outsize);
+  free(in);
+
+  // compare the steady state with the input sines, the resampler compensates for its own latency
+  const double tol = sincsize >= 64 ? 1e-4 : 2e-2; // short filters roll off below the highest tones
+  double err = 0.0;
+  int x;
+  for (x = sincsize * 4; x < nout; x ++)
+    for (int ch = 0; ch < nch; ch ++)
+    {
+      const double e = fabs(out[x * nch + ch] - sin(2.0 * PI * tone_freq(ch, rate_in) * x / rate_out));
+      if (e > err) err = e;
+    }
+
+  if (nout < outsize / 2 || err > tol)
+  {
+    printf("sinc %d, %d ch, %g -> %g: FAILED, error %g (%d frames)\n", sincsize, nch, rate_in, rate_out, err, nout);
+    return 1;
+  }
+  return 0;
+}
+
+// microseconds per second of output audio, best of 3
+static double bench(int sincsize, int nch, double rate_in, double rate_out, WDL_ResampleSample *out, int outsize)
+{
+  const int nframes = (int) (outsize * rate_in / rate_out) + sincsize * 2;
+  WDL_ResampleSample *in = make_input(nch, rate_in, nframes);
+  WDL_Resampler rs;
+  rs.SetMode(false, 0, true, sincsize, 32);
+  double best = 0.0;
+  for (int i = 0; i < 3; i ++)
+  {
+    const double t = time_precise();
+    const int nout = run(&rs, nch, rate_in, rate_out, in, nframes, out, outsize);
+    const double us = (time_precise() - t) * 1e6 / (nout / rate_out);
+    if (!i || us < best) best = us;
+  }
+  free(in);
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  static const int sincsizes[] = { 16, 64, 256 };
+  static const int chans[] = { 1, 2, 3, 4, 6, 8 };
+  static const double rates[][2] = { { 44100.0, 48000.0 }, { 48000.0, 96000.0 }, { 96000.0, 48000.0 } };
+  const int outsize = 96000;
+  WDL_ResampleSample *out = (WDL_ResampleSample *) malloc(outsize * MAXCH * sizeof(WDL_ResampleSample));
+  int fails = 0;
+
+  for (int s = 0; s < 3; s ++)
+    for (int c = 0; c < 6; c ++)
+      for (int r = 0; r < 3; r ++)
+        fails += test(sincsizes[s], chans[c], rates[r][0], rates[r][1], out);
+
+  printf("%s, sizeof(WDL_ResampleSample)=%d\n\n", fails ? "FAILED" : "all tests passed", (int) sizeof(WDL_ResampleSample));
+
+  if (!fails && (argc < 2 || strcmp(argv[1], "-nobench")))
+  {
+    // 44.1k -> 48k interpolates between filter phases, 48k -> 96k uses the exact ("ideal") phases
+    printf("us per second of output     44.1k -> 48k          48k -> 96k\n");
+    printf("  sinc  ch                total  per ch       total  per ch\n");
+    for (int s = 0; s < 3; s ++)
+      for (int c = 0; c < 6; c ++)
+      {
+        const double t1 = bench(sincsizes[s], chans[c], 44100.0, 48000.0, out, outsize);
+        const double t2 = bench(sincsizes[s], chans[c], 48000.0, 96000.0, out, outsize);
+        printf("%6d  %2d  %14.1f  %6.1f  %10.1f  %6.1f\n", sincsizes[s], chans[c], t1, t1 / chans[c], t2, t2 / chans[c]);
+      }
+  }
+
+  free(out);
+  return fails ? 1 : 0;
+}